@@ -55,6 +55,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -92,7 +95,8 @@ extern "C"
 	//
 	// IMPORTANT:
 	//
-	// This will be called from the server's thread. Be careful to ensure your implementation is thread safe.
+	// This will be called from the server's thread (and, with dispatch shards, from theirs, though never two calls at once; see
+	// `ggkSetDispatchShards()`.) Be careful to ensure your implementation is thread safe.
 	//
 	// Similarly, the pointer to data returned to the server should point to non-volatile memory so that the server can use it
 	// safely for an indefinite period of time.
@@ -102,7 +106,8 @@ extern "C"
 	//
 	// IMPORTANT:
 	//
-	// This will be called from the server's thread. Be careful to ensure your implementation is thread safe.
+	// This will be called from the server's thread (and, with dispatch shards, from theirs, though never two calls at once; see
+	// `ggkSetDispatchShards()`.) Be careful to ensure your implementation is thread safe.
 	//
 	// The data setter uses void* types to allow receipt of unknown data types from the server. Ensure that you do not store these
 	// pointers. Copy the data before returning from your getter delegate.
@@ -117,6 +122,29 @@ extern "C"
 	//   * Any other failure, as deemed by the delegate handler
 	typedef int (*GGKServerDataSetter)(const char *pName, const void *pData);
 
+	// Type definition for an optional delegate that the server will use when it needs to receive several data values at once
+	//
+	// IMPORTANT:
+	//
+	// This will be called from the server's thread (and, with dispatch shards, from theirs, though never two calls at once; see
+	// `ggkSetDispatchShards()`.) Be careful to ensure your implementation is thread safe.
+	//
+	// `ppNames` is an array of `count` names (the same names that would be passed to `GGKServerDataGetter`.) The delegate must
+	// fill `ppValues[i]` with the pointer that `GGKServerDataGetter` would have returned for `ppNames[i]` (or nullptr if the name
+	// is not supported.) The same rules apply to these pointers as to those returned from `GGKServerDataGetter`.
+	//
+	// The server uses this delegate whenever it is about to process more than one value in a single cycle (for example, several
+	// queued updates or several tick events firing at once) so the application can take its own locks once for the whole set.
+	//
+	// This method returns a non-zero value on success or 0 on failure. On failure, the server falls back to calling the
+	// `GGKServerDataGetter` for each name.
+	typedef int (*GGKServerDataBatchGetter)(const char * const *ppNames, size_t count, const void **ppValues);
+
+	// Registers an optional batch data getter (see `GGKServerDataBatchGetter`.) To unregister, simply register with `nullptr`.
+	//
+	// This may be called before or after `ggkStart()`.
+	void ggkRegisterDataBatchGetter(GGKServerDataBatchGetter getter);
+
 	// -----------------------------------------------------------------------------------------------------------------------------
 	// SERVER DATA UPDATE MANAGEMENT
 	// -----------------------------------------------------------------------------------------------------------------------------
@@ -131,6 +159,33 @@ extern "C"
 	// Returns non-zero value on success or 0 on failure.
 	int ggkNofifyUpdatedDescriptor(const char *pObjectPath);
 
+	// Announces a change to the data value `pName`, queueing one update for each composite characteristic that binds it
+	//
+	// Composite characteristics pack several data values into one and notify the combined value once for any number of changes
+	// made before the server gets to it. Values that also have a characteristic of their own don't need this: notifying that
+	// characteristic with `ggkNofifyUpdatedCharacteristic()` schedules its composites as well.
+	//
+	// This may be called from any thread. Returns the number of composite characteristics that bind `pName` (0 if none do, or if
+	// the server isn't running.)
+	int ggkNotifyUpdatedData(const char *pName);
+
+	// Adds updates to the front of the queue for the `count` characteristics with the handles `pHandles` (see
+	// `ggkGetCharacteristicHandle()`), all at once
+	//
+	// This is the cheapest way to announce many changes: the whole set is queued under one lock, without building a path string
+	// for each, and the server picks it up in one pass. Invalid handles are skipped.
+	//
+	// This may be called from any thread. Returns the number of updates queued.
+	int ggkNotifyMany(const int *pHandles, size_t count);
+
+	// Adds updates to the front of the queue for the `count` characteristics at the object paths `ppObjectPaths`, all at once
+	//
+	// Like calling `ggkNofifyUpdatedCharacteristic()` for each path, but the whole set is queued under one lock. Prefer
+	// `ggkNotifyMany()` where the handles are known. Null paths are skipped.
+	//
+	// This may be called from any thread. Returns the number of updates queued.
+	int ggkNotifyManyPaths(const char * const *ppObjectPaths, size_t count);
+
 	// Adds a named update to the front of the queue. Generally, this routine should not be used directly. Instead, use the
 	// `ggkNofifyUpdatedCharacteristic()` instead.
 	//
@@ -152,6 +207,15 @@ extern "C"
 	// Returns 1 on success, 0 if the queue is empty, -1 on error (such as the length too small to store the element)
 	int ggkPopUpdateQueue(char *pElement, int elementLen, int keep);
 
+	// Gets up to `maxElements` updates from the back of the queue (oldest first) and removes them, under one lock
+	//
+	// The updates are written to `pBuffer` one after another, each as a null-terminated string in the format used by
+	// `ggkPopUpdateQueue()`. Copying stops at the first update that won't fit in the rest of the `bufferLen` bytes; it stays in
+	// the queue for the next call.
+	//
+	// Returns the number of updates written, 0 if the queue is empty, or -1 if the first update doesn't fit in the buffer.
+	int ggkPopUpdateQueueMany(char *pBuffer, int bufferLen, int maxElements);
+
 	// Returns 1 if the queue is empty, otherwise 0
 	int ggkUpdateQueueIsEmpty();
 
@@ -304,6 +368,369 @@ extern "C"
 	// Convert a `GGKServerHealth` into a human-readable string
 	const char *ggkGetServerHealthString(enum GGKServerHealth state);
 	bool ggkIsConnected();
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// ADVERTISING
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Adds an LE advertising set and returns its zero-based index (or -1 on failure)
+	//
+	// By default, the server uses the adapter's advertising setting, which provides no control over the advertising data or
+	// intervals. Once one or more sets are added, the server manages its own advertising instance instead. When more than one set
+	// is added, the server moves on to the next set each time its connections free up.
+	//
+	// ppServiceUuids: An array of `uuidCount` service UUIDs (16-bit or 128-bit, e.g., "180A") to advertise
+	//
+	// manufacturerId / pManufacturerData / manufacturerDataLen: Manufacturer specific data to advertise. Set `pManufacturerData`
+	//     to nullptr to omit it.
+	//
+	// includeName: Non-zero to include the local name in the scan response
+	//
+	// Legacy advertising data is limited to 31 bytes. Fields that do not fit are dropped (with a warning.)
+	//
+	// This may be called before or after `ggkStart()`.
+	int ggkAdvertisingAddSet(const char * const *ppServiceUuids, int uuidCount, uint16_t manufacturerId, const uint8_t *pManufacturerData, int manufacturerDataLen, int includeName);
+
+	// Removes all advertising sets, returning control of advertising to the adapter's advertising setting
+	void ggkAdvertisingClearSets();
+
+	// Sets the advertising interval ranges (in milliseconds) used for the advertising sets
+	//
+	// The server advertises with the fast interval range for `fastPeriodSeconds` seconds each time it starts advertising (at
+	// startup and each time its connections free up), then switches to the slow interval range to save power.
+	//
+	// Interval control requires kernel support for the "Add Extended Advertising Parameters" management command. On older kernels
+	// the intervals are left to the controller.
+	void ggkAdvertisingSetIntervals(int fastMinMS, int fastMaxMS, int slowMinMS, int slowMaxMS, int fastPeriodSeconds);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// CONNECTION PROFILES
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Connection profiles, in increasing order of throughput (and power use)
+	//
+	// Each profile selects a set of LE connection parameters (connection interval, latency and supervision timeout) and the
+	// preferred PHY:
+	//
+	//     EConnectionProfileIdle:        100ms - 200ms interval, latency 4, LE 1M PHY
+	//     EConnectionProfileInteractive: 15ms - 30ms interval, no latency, LE 2M PHY (if supported)
+	//     EConnectionProfileBulk:        7.5ms - 15ms interval, no latency, LE 2M PHY (if supported)
+	//
+	// Characteristics can request a profile for as long as a client is subscribed to their notifications (see
+	// `GattCharacteristic::connectionProfile()`.) The highest profile requested at any time is applied.
+	enum GGKConnectionProfile
+	{
+		EConnectionProfileIdle,
+		EConnectionProfileInteractive,
+		EConnectionProfileBulk
+	};
+
+	// Sets the baseline connection profile, used whenever no subscribed characteristic requests a higher one
+	//
+	// The default is `EConnectionProfileIdle`. This may be called before or after `ggkStart()`.
+	void ggkSetConnectionProfile(enum GGKConnectionProfile profile);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// CLOCK
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Runs the server on a virtual clock (non-zero) or on real time (zero, the default)
+	//
+	// On the virtual clock, time only moves forward when the server runs out of work, at which point it jumps straight to the next
+	// timer deadline (tick events, retries, advertising interval changes, etc.) rather than waiting for it. This allows hours of
+	// timer-driven behavior to be exercised in seconds, which is useful for testing and benchmarking.
+	//
+	// This must be called before `ggkStart()` and is ignored otherwise.
+	void ggkSetSimulatedClock(int simulated);
+
+	// Returns the server's current (monotonic) clock time in milliseconds
+	//
+	// On the virtual clock, this is the virtual time. Applications that rate-limit or timestamp their data should use this rather
+	// than the system clock, so that their behavior follows the server's clock.
+	int64_t ggkGetClockMS();
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// CAPTURE
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Starts capturing the server's D-Bus and HCI traffic to the file `pFilename`, replacing any capture in progress
+	//
+	// The capture records incoming method calls and property accesses (with the time spent handling them), emitted signals and
+	// Bluetooth Management API packets, each with a timestamp. Use the `replay` tool to replay a capture against a running server.
+	//
+	// This may be called before or after `ggkStart()`. Returns non-zero on success, otherwise zero.
+	int ggkCaptureStart(const char *pFilename);
+
+	// Stops the capture in progress (if any) and closes the capture file
+	//
+	// The capture is also stopped when the server stops.
+	void ggkCaptureStop();
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// MEMORY
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// The subsystems that the library's memory is accounted to
+	enum GGKMemorySubsystem
+	{
+		// The object tree (objects, interfaces, methods, events and properties)
+		EMemorySchema,
+
+		// The update queue (see `ggkPushUpdateQueue()`)
+		EMemoryUpdateQueue,
+
+		// Values cached on behalf of the application (such as the results of the batch data getter)
+		EMemoryCache,
+
+		// Logging and traffic capture buffers
+		EMemoryLogging,
+
+		// HCI buffers and connection tracking
+		EMemoryHci,
+
+		// Registrations with GLib (estimated from the introspection data handed to GLib)
+		EMemoryGLib,
+
+		// The number of subsystems (not a subsystem)
+		EMemorySubsystemCount
+	};
+
+	// Memory statistics for a single subsystem
+	struct GGKMemoryStats
+	{
+		// Bytes currently allocated
+		size_t bytes;
+
+		// The most bytes ever allocated at once
+		size_t peakBytes;
+
+		// Allocations currently live
+		size_t allocations;
+
+		// Allocations made since the process started
+		size_t totalAllocations;
+
+		// The budget set with `ggkSetMemoryBudget()` (zero if none)
+		size_t budget;
+	};
+
+	// Fills `pStats` with the statistics for each subsystem, indexed by `GGKMemorySubsystem`
+	//
+	// Up to `count` entries are filled. Returns the number of entries filled.
+	//
+	// This may be called at any time, from any thread.
+	int ggkGetMemoryStats(struct GGKMemoryStats *pStats, int count);
+
+	// Returns a human-readable name for a `GGKMemorySubsystem`
+	const char *ggkGetMemorySubsystemString(enum GGKMemorySubsystem subsystem);
+
+	// Sets a budget (in bytes) for a subsystem, or removes it if `bytes` is zero
+	//
+	// The server logs a warning (on its periodic timer) whenever a subsystem has exceeded its budget, which helps to catch growth
+	// in long-running devices.
+	void ggkSetMemoryBudget(enum GGKMemorySubsystem subsystem, size_t bytes);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// WAKEUP PROFILING
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// The sources of the server's wakeups
+	enum GGKWakeupSource
+	{
+		// The main loop's idle function, which polls the update queue
+		EWakeupIdle,
+
+		// The periodic (one second) timer
+		EWakeupPeriodicTimer,
+
+		// The HCI event thread (each event, as well as each poll timeout)
+		EWakeupHciPoll,
+
+		// D-Bus method calls and property accesses
+		EWakeupDBus,
+
+		// The number of sources (not a source)
+		EWakeupSourceCount
+	};
+
+	// Wakeup statistics for a single source, since profiling started
+	struct GGKWakeupStats
+	{
+		// The number of wakeups
+		uint64_t wakeups;
+
+		// The total time spent awake, in microseconds
+		uint64_t awakeUS;
+
+		// The average wakeups per second
+		double wakeupsPerSecond;
+
+		// The percentage of time spent awake
+		double awakePercent;
+
+		// The handler that ran on the most recent wakeup
+		char lastHandler[64];
+
+		// The handler that has run most often
+		char topHandler[64];
+	};
+
+	// Starts (or restarts) wakeup profiling from zero
+	//
+	// If `summaryIntervalSeconds` is non-zero, a summary of each interval (wakeups per second and time spent awake for each
+	// source, along with the busiest handlers) is logged at the info level every `summaryIntervalSeconds` seconds.
+	//
+	// This may be called before or after `ggkStart()`.
+	void ggkWakeupProfilerStart(int summaryIntervalSeconds);
+
+	// Stops wakeup profiling (the statistics gathered so far remain available)
+	void ggkWakeupProfilerStop();
+
+	// Fills `pStats` with the statistics for each source, indexed by `GGKWakeupSource`
+	//
+	// Up to `count` entries are filled. Returns the number of entries filled.
+	int ggkGetWakeupStats(struct GGKWakeupStats *pStats, int count);
+
+	// Returns a human-readable name for a `GGKWakeupSource`
+	const char *ggkGetWakeupSourceString(enum GGKWakeupSource source);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// TRANSIENT POOL
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Statistics for a single size class of the pool that serves the library's small transient allocations
+	struct GGKPoolStats
+	{
+		// The size of the blocks in this class (zero for the entry that covers allocations too large for any class)
+		size_t blockSize;
+
+		// Allocations made from this class since the process started
+		uint64_t allocations;
+
+		// Allocations that were served by recycling a released block
+		uint64_t recycled;
+
+		// Releases that found the thread's free list full, and so returned their block to the heap
+		uint64_t overflows;
+
+		// Blocks currently held in free lists, across all threads
+		size_t cachedBlocks;
+	};
+
+	// Fills `pStats` with the statistics for each size class, from smallest to largest, followed by an entry for allocations that
+	// were too large for any class
+	//
+	// Up to `count` entries are filled. Returns the number of entries filled.
+	//
+	// This may be called at any time, from any thread.
+	int ggkGetPoolStats(struct GGKPoolStats *pStats, int count);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// IDLE MODE
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Enables or disables idle mode (enabled by default)
+	//
+	// While no central is connected, the server enters idle mode: it stops its one-second timer (pausing tick events and the
+	// value refreshes they drive) and stops polling the update queue, waking only every 30 seconds for housekeeping. It resumes
+	// as soon as a device connects or an update is queued (queued updates are always processed, never dropped.)
+	//
+	// Each change of mode logs the server thread's CPU usage over the period that ended.
+	//
+	// This may be called at any time, from any thread.
+	void ggkSetIdleModeEnabled(int enable);
+
+	// Returns 1 if the server is in idle mode, otherwise 0
+	int ggkIsIdleMode();
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// HOT RESTART
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Sets handoff mode, for upgrading a running server without taking it down
+	//
+	// Call this before `ggkStart()` in the new process, while the old process is still running. The new server registers its
+	// objects and configures the adapter first, then takes over the owned name from the running server and registers its
+	// application with BlueZ. The old server then sends any notifications still queued, unregisters its application and shuts
+	// down on its own (its `ggkWait()` returns), so the GATT server is never missing.
+	//
+	// The old process must allow this, with `ggkSetAllowTakeover()` or by having been started in handoff mode itself. Otherwise
+	// the new server waits for the name until the old one exits.
+	void ggkSetHandoffMode(int enable);
+
+	// Allows a new server in handoff mode (see `ggkSetHandoffMode()`) to take over from this one
+	//
+	// This is off by default, so another process on the bus can't replace a server that didn't ask for it. A server started in
+	// handoff mode always allows the next one to take over. Call this before `ggkStart()`.
+	void ggkSetAllowTakeover(int enable);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// DISPATCH SHARDS
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Sets the number of threads that dispatch D-Bus calls to our services (1 by default, up to 16)
+	//
+	// The services are dealt to the threads round-robin, in the order they are declared in the server description. The server's
+	// own thread is the first; each of the others has its own connection to the system bus and registers its services with BlueZ
+	// as a separate GATT application, so calls to services on different threads are handled in parallel. Updates and
+	// notifications for a service are sent from the thread (and connection) that owns it.
+	//
+	// IMPORTANT: With more than one thread, the handlers in the server description are called from several threads at once and
+	// must be thread-safe. The data getter and setter are called from those threads too, though never two calls at once (the
+	// server serializes them.) Values from the batch data getter are only used on the server's own thread.
+	//
+	// This must be called before `ggkStart()`.
+	void ggkSetDispatchShards(int count);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// FIRMWARE
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Sets the directory that firmware images are received into ("/var/lib/gattsrv" by default)
+	//
+	// Characteristics flagged with `receiveFirmware()` stage images in this directory as they arrive (along with a checkpoint for
+	// resuming an interrupted transfer.) Once an image is verified, it is renamed to "<name>.bin" and its path is handed to the
+	// data setter under the characteristic's data name. The directory is created if needed, but not its parents.
+	//
+	// This must be called before `ggkStart()`.
+	void ggkSetFirmwareDirectory(const char *pDirectory);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// STATS INTERFACE
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Enables or disables the stats interface (disabled by default)
+	//
+	// When enabled, the server serves its metrics over D-Bus to tools that can't link against the application: the object
+	// "/com/<service name>/stats" carries the interface "com.<service name>.Stats1", whose properties report the update queue's
+	// depth, a histogram of D-Bus dispatch latency, the number of notifications sent, connection counts and startup timings. Its
+	// `Snapshot()` method returns all of them at once, as an "a{sv}". The object is not reported to BlueZ.
+	//
+	// The metrics are gathered with lock-free counters, so reading them never makes the server wait.
+	//
+	// This must be called before `ggkStart()`.
+	void ggkSetStatsInterfaceEnabled(int enable);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// SAMPLE RINGS
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Returns the handle of the characteristic at the object path `pObjectPath` (for example, "/com/gobbledegook/service/1/samples"),
+	// or -1 if there is no characteristic there
+	//
+	// Handles remain valid for as long as the server runs. This must be called after `ggkStart()`.
+	int ggkGetCharacteristicHandle(const char *pObjectPath);
+
+	// Appends a sample of `length` bytes at `pData`, taken at `timestampMS` (see `ggkGetClockMS()`), to the ring of the
+	// characteristic with the handle `handle`
+	//
+	// The characteristic must be flagged with `sampleRing()` and `length` must be its sample size. The oldest sample is replaced
+	// when the ring is full. Centrals read samples in batches from a cursor they set, and samples are notified in batches as they
+	// arrive; once a batch is waiting, this queues the update for it (see `ggkNofifyUpdatedCharacteristic()`.)
+	//
+	// This may be called from any thread. Returns 1 on success or 0 if the handle, characteristic or length is invalid.
+	int ggkAppendSample(int handle, int64_t timestampMS, const void *pData, int length);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -0,0 +1,412 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Management of our LE advertising instance (advertising data, intervals and rotation between advertising sets)
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// By default, advertising is controlled by the adapter's advertising setting (see `Mgmt::setAdvertising()`), which gives us no
+// control over the advertising interval or the advertising data. Once the application configures one or more advertising sets
+// (see `ggkAdvertisingAddSet()`), we take over by disabling that setting and managing a single advertising instance through the
+// management API's "Add Extended Advertising Parameters" / "Add Extended Advertising Data" commands. On kernels that do not
+// support those commands, we fall back to "Add Advertising", which provides the advertising data but leaves the intervals to the
+// controller.
+//
+// Advertising starts with a fast interval so that phones discover us quickly, then falls back to a slow interval after the fast
+// period to save power. Each time our connections free up, we move on to the next advertising set (if there is more than one)
+// and start over with the fast interval.
+//
+// We log the time between starting to advertise and the next connection, which is a reasonable stand-in for the time it takes a
+// client to discover us.
+//
+// All of the adapter work is performed from the periodic timer on the server thread (see `tick()`), since the management
+// commands cannot be sent from the HciAdapter's event thread. The one exception is `stop()`, which removes our instance as the
+// server shuts down (from whichever thread asked it to) so that the controller doesn't keep advertising an instance that nobody
+// owns. The runtime state is kept under a mutex for that reason.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+
+#include "Advertising.h"
+#include "Clock.h"
+#include "DosellGatt.h"
+#include "GattUuid.h"
+#include "HciAdapter.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// AD types (see the Bluetooth "Assigned Numbers" document)
+static const uint8_t kADTypeIncomplete16BitUuids = 0x02;
+static const uint8_t kADTypeComplete16BitUuids = 0x03;
+static const uint8_t kADTypeIncomplete128BitUuids = 0x06;
+static const uint8_t kADTypeComplete128BitUuids = 0x07;
+static const uint8_t kADTypeManufacturerData = 0xff;
+
+// The kernel adds a flags field (3 bytes) to our advertising data since we advertise as discoverable
+static const size_t kMaxAdvertisingPayload = Mgmt::kMaxAdvertisingDataLength - 3;
+
+// The status returned by the kernel for commands it does not know
+static const uint8_t kStatusUnknownCommand = 0x01;
+
+// Private constructor for our Singleton
+Advertising::Advertising()
+: fastMinIntervalMS(kDefaultFastMinIntervalMS),
+  fastMaxIntervalMS(kDefaultFastMaxIntervalMS),
+  slowMinIntervalMS(kDefaultSlowMinIntervalMS),
+  slowMaxIntervalMS(kDefaultSlowMaxIntervalMS),
+  fastPeriodSeconds(kDefaultFastPeriodSeconds),
+  configChanged(false),
+  mode(EIdle),
+  currentSet(0),
+  extendedSupported(true),
+  modeStartTimeMS(0),
+  advertisingStartTimeMS(0),
+  connectCount(0),
+  totalConnectTimeMS(0)
+{
+}
+
+// Returns true if the application has configured any advertising sets
+//
+// If no sets are configured, advertising is left to the adapter's advertising setting (see `Mgmt::setAdvertising()`)
+bool Advertising::isManaged() const
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	return !sets.empty();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Configuration
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Adds an advertising set and returns its zero-based index
+//
+// When more than one set is configured, we move on to the next set each time our connections free up.
+int Advertising::addSet(const Set &set)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	sets.push_back(set);
+	configChanged = true;
+	return static_cast<int>(sets.size()) - 1;
+}
+
+// Removes all advertising sets
+void Advertising::clearSets()
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	sets.clear();
+	configChanged = true;
+}
+
+// Sets the fast and slow advertising interval ranges (in milliseconds) and the length of the fast period (in seconds)
+void Advertising::setIntervals(int fastMinMS, int fastMaxMS, int slowMinMS, int slowMaxMS, int fastPeriodSeconds)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	fastMinIntervalMS = fastMinMS;
+	fastMaxIntervalMS = std::max(fastMinMS, fastMaxMS);
+	slowMinIntervalMS = slowMinMS;
+	slowMaxIntervalMS = std::max(slowMinMS, slowMaxMS);
+	this->fastPeriodSeconds = fastPeriodSeconds;
+	configChanged = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Advertising management
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Updates our advertising instance based on the configuration and the current connection state
+//
+// This is called from the periodic timer once our application has been registered with BlueZ.
+void Advertising::tick()
+{
+	std::lock_guard<std::mutex> runtimeLock(runtimeMutex);
+
+	bool changed;
+	size_t setCount;
+	int fastPeriod;
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+		changed = configChanged;
+		setCount = sets.size();
+		fastPeriod = fastPeriodSeconds;
+		configChanged = false;
+	}
+
+	// If the application removed all sets, hand advertising back to the adapter's advertising setting
+	if (0 == setCount)
+	{
+		if (EIdle != mode)
+		{
+			removeInstance();
+			if (THESERVER->getEnableAdvertising())
+			{
+				pMgmt->setAdvertising(1);
+			}
+		}
+		return;
+	}
+
+	int64_t nowMS = Clock::getInstance().nowMS();
+
+	// While connected, the controller stops advertising our (connectable) instance on its own
+	if (HciAdapter::getInstance().getActiveConnectionCount() > 0)
+	{
+		if (EConnected != mode && EIdle != mode)
+		{
+			int64_t elapsedMS = nowMS - advertisingStartTimeMS;
+			connectCount += 1;
+			totalConnectTimeMS += elapsedMS;
+
+			Logger::info(SSTR << "Connected " << elapsedMS << "ms after advertising set " << currentSet << " started ("
+				<< (EFast == mode ? "fast" : "slow") << " interval); average over " << connectCount << " connection(s): "
+				<< totalConnectTimeMS / connectCount << "ms");
+		}
+
+		mode = EConnected;
+		return;
+	}
+
+	// Our connections have freed up - rotate to the next set and start over
+	if (EConnected == mode)
+	{
+		currentSet = (currentSet + 1) % setCount;
+		start(EFast);
+	}
+	else if (EIdle == mode || changed)
+	{
+		currentSet = currentSet % setCount;
+		start(EFast);
+	}
+	else if (EFast == mode && nowMS - modeStartTimeMS >= int64_t(fastPeriod) * 1000)
+	{
+		start(ESlow);
+	}
+}
+
+// Returns true if `tick()` has nothing left to do until the configuration or the connection state changes
+bool Advertising::isSettled()
+{
+	std::lock_guard<std::mutex> runtimeLock(runtimeMutex);
+	std::lock_guard<std::mutex> lock(configMutex);
+	if (configChanged)
+	{
+		return false;
+	}
+
+	return sets.empty() ? EIdle == mode : ESlow == mode;
+}
+
+// Removes our advertising instance
+//
+// This may be called from any thread, but must be called before the HciAdapter stops (it's called as the server shuts down.)
+void Advertising::stop()
+{
+	std::lock_guard<std::mutex> runtimeLock(runtimeMutex);
+	removeInstance();
+}
+
+// Removes our advertising instance (the caller must hold `runtimeMutex`)
+void Advertising::removeInstance()
+{
+	if (EIdle == mode || nullptr == pMgmt)
+	{
+		return;
+	}
+
+	Logger::debug("Removing our advertising instance");
+	pMgmt->removeAdvertising(kInstance);
+	mode = EIdle;
+}
+
+// Adds (or replaces) our advertising instance using the current set and the intervals for `newMode`
+bool Advertising::start(Mode newMode)
+{
+	Set set;
+	int minIntervalMS;
+	int maxIntervalMS;
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+		if (sets.empty())
+		{
+			return false;
+		}
+
+		set = sets[currentSet % sets.size()];
+		minIntervalMS = EFast == newMode ? fastMinIntervalMS : slowMinIntervalMS;
+		maxIntervalMS = EFast == newMode ? fastMaxIntervalMS : slowMaxIntervalMS;
+	}
+
+	if (nullptr == pMgmt)
+	{
+		pMgmt.reset(new Mgmt());
+	}
+
+	// Our instance is only advertised while the adapter's advertising setting is disabled
+	if (HciAdapter::getInstance().getAdapterSettings().isSet(HciAdapter::EHciAdvertising))
+	{
+		Logger::debug("Disabling the adapter's advertising setting in favor of our advertising instance");
+		if (!pMgmt->setAdvertising(0)) { return false; }
+	}
+
+	uint32_t flags = Mgmt::EAdvertisingDiscoverable;
+	if (THESERVER->getEnableConnectable()) { flags |= Mgmt::EAdvertisingConnectable; }
+	if (set.includeName) { flags |= Mgmt::EAdvertisingLocalName; }
+
+	std::vector<uint8_t> advertisingData = buildAdvertisingData(set);
+	std::vector<uint8_t> scanResponseData;
+
+	bool success = false;
+	if (extendedSupported)
+	{
+		success = pMgmt->addExtendedAdvertisingParameters(kInstance, flags | Mgmt::EAdvertisingParamIntervals, 0, 0,
+			toIntervalUnits(minIntervalMS), toIntervalUnits(maxIntervalMS), 0)
+			&& pMgmt->addExtendedAdvertisingData(kInstance, advertisingData, scanResponseData);
+
+		if (!success && HciAdapter::getInstance().getLastCommandStatus() == kStatusUnknownCommand)
+		{
+			Logger::warn("Extended advertising parameters are not supported by this kernel; advertising intervals will be left to the controller");
+			extendedSupported = false;
+		}
+	}
+
+	if (!extendedSupported)
+	{
+		success = pMgmt->addAdvertising(kInstance, flags, 0, 0, advertisingData, scanResponseData);
+	}
+
+	if (!success)
+	{
+		return false;
+	}
+
+	Logger::debug(SSTR << "Advertising set " << currentSet << " with " << (EFast == newMode ? "fast" : "slow") << " interval ("
+		<< minIntervalMS << "ms - " << maxIntervalMS << "ms)");
+
+	// The time-to-connect is measured from the time we start advertising, not from the switch between fast and slow
+	modeStartTimeMS = Clock::getInstance().nowMS();
+	if (EFast == newMode)
+	{
+		advertisingStartTimeMS = modeStartTimeMS;
+	}
+
+	mode = newMode;
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Utilitarian
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the advertising data (AD structures) for `set`
+//
+// Fields that do not fit are dropped (UUID lists are then marked as incomplete, as the spec requires.)
+std::vector<uint8_t> Advertising::buildAdvertisingData(const Set &set)
+{
+	std::vector<uint8_t> data;
+
+	// Appends a single AD structure if it fits
+	auto appendField = [&data](uint8_t type, const std::vector<uint8_t> &payload) -> bool
+	{
+		if (payload.empty() || data.size() + payload.size() + 2 > kMaxAdvertisingPayload)
+		{
+			return false;
+		}
+
+		data.push_back(static_cast<uint8_t>(payload.size() + 1));
+		data.push_back(type);
+		data.insert(data.end(), payload.begin(), payload.end());
+		return true;
+	};
+
+	// Manufacturer data goes first, since it is usually what scanning applications filter on
+	if (set.hasManufacturerData)
+	{
+		std::vector<uint8_t> payload;
+		payload.push_back(set.manufacturerId & 0xff);
+		payload.push_back(set.manufacturerId >> 8);
+		payload.insert(payload.end(), set.manufacturerData.begin(), set.manufacturerData.end());
+		if (!appendField(kADTypeManufacturerData, payload))
+		{
+			Logger::warn(SSTR << "Manufacturer data (" << payload.size() << " bytes) does not fit in the advertising data");
+		}
+	}
+
+	// Split the UUIDs by size (AD fields store them little-endian)
+	std::vector<std::vector<uint8_t>> uuids16;
+	std::vector<std::vector<uint8_t>> uuids128;
+	for (const std::string &strUuid : set.serviceUuids)
+	{
+		GattUuid uuid(strUuid);
+		if (uuid.getBitCount() == 0)
+		{
+			Logger::warn(SSTR << "Ignoring invalid advertising UUID '" << strUuid << "'");
+			continue;
+		}
+
+		std::string hex = uuid.getBitCount() == 16 ? uuid.toString16() : GattUuid::clean(uuid.toString128());
+		std::vector<uint8_t> bytes;
+		for (size_t i = hex.length(); i >= 2; i -= 2)
+		{
+			bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i - 2, 2), nullptr, 16)));
+		}
+
+		(uuid.getBitCount() == 16 ? uuids16 : uuids128).push_back(bytes);
+	}
+
+	// Appends as many UUIDs of a single size as will fit
+	auto appendUuids = [&](const std::vector<std::vector<uint8_t>> &uuids, uint8_t completeType, uint8_t incompleteType)
+	{
+		std::vector<uint8_t> payload;
+		size_t count = 0;
+		for (const std::vector<uint8_t> &uuid : uuids)
+		{
+			if (data.size() + payload.size() + uuid.size() + 2 > kMaxAdvertisingPayload)
+			{
+				break;
+			}
+
+			payload.insert(payload.end(), uuid.begin(), uuid.end());
+			count += 1;
+		}
+
+		if (count < uuids.size())
+		{
+			Logger::warn(SSTR << "Only " << count << " of " << uuids.size() << " service UUIDs fit in the advertising data");
+		}
+
+		appendField(count == uuids.size() ? completeType : incompleteType, payload);
+	};
+
+	appendUuids(uuids16, kADTypeComplete16BitUuids, kADTypeIncomplete16BitUuids);
+	appendUuids(uuids128, kADTypeComplete128BitUuids, kADTypeIncomplete128BitUuids);
+
+	return data;
+}
+
+// Converts milliseconds into the advertising interval units of 0.625ms
+//
+// The result is clamped to the range allowed by the spec (20ms to 10.24s for legacy advertising.)
+uint32_t Advertising::toIntervalUnits(int ms)
+{
+	uint32_t units = static_cast<uint32_t>(std::max(ms, 0)) * 8 / 5;
+	return std::min(std::max(units, static_cast<uint32_t>(0x0020)), static_cast<uint32_t>(0x4000));
+}
+
+}; // namespace ggk
@@ -0,0 +1,188 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Management of our LE advertising instance (advertising data, intervals and rotation between advertising sets)
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Advertising.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "Mgmt.h"
+
+namespace ggk {
+
+class Advertising
+{
+public:
+
+	//
+	// Constants
+	//
+
+	// The advertising instance we manage
+	static const uint8_t kInstance = 1;
+
+	// Default fast advertising interval range (in milliseconds), used right after advertising starts
+	static const int kDefaultFastMinIntervalMS = 20;
+	static const int kDefaultFastMaxIntervalMS = 30;
+
+	// Default slow advertising interval range (in milliseconds), used once the fast period has elapsed
+	static const int kDefaultSlowMinIntervalMS = 1000;
+	static const int kDefaultSlowMaxIntervalMS = 1285;
+
+	// Default length of the fast advertising period (in seconds)
+	static const int kDefaultFastPeriodSeconds = 30;
+
+	//
+	// Types
+	//
+
+	// The contents of a single advertising set
+	struct Set
+	{
+		// Service UUIDs (16-bit or 128-bit, in string form) to include in the advertising data
+		std::vector<std::string> serviceUuids;
+
+		// Manufacturer specific data (only included if `hasManufacturerData` is set)
+		bool hasManufacturerData;
+		uint16_t manufacturerId;
+		std::vector<uint8_t> manufacturerData;
+
+		// Include the local name in the scan response
+		bool includeName;
+	};
+
+	// Our advertising modes
+	enum Mode
+	{
+		EIdle,
+		EFast,
+		ESlow,
+		EConnected
+	};
+
+	//
+	// Accessors
+	//
+
+	// Returns the instance to this singleton class
+	static Advertising &getInstance()
+	{
+		static Advertising instance;
+		return instance;
+	}
+
+	// Returns true if the application has configured any advertising sets
+	//
+	// If no sets are configured, advertising is left to the adapter's advertising setting (see `Mgmt::setAdvertising()`)
+	bool isManaged() const;
+
+	//
+	// Disallow copies of our singleton (c++11)
+	//
+	Advertising(Advertising const&) = delete;
+	void operator=(Advertising const&) = delete;
+
+	//
+	// Configuration (may be called from any thread)
+	//
+
+	// Adds an advertising set and returns its zero-based index
+	//
+	// When more than one set is configured, we move on to the next set each time our connections free up.
+	int addSet(const Set &set);
+
+	// Removes all advertising sets
+	void clearSets();
+
+	// Sets the fast and slow advertising interval ranges (in milliseconds) and the length of the fast period (in seconds)
+	void setIntervals(int fastMinMS, int fastMaxMS, int slowMinMS, int slowMaxMS, int fastPeriodSeconds);
+
+	//
+	// Advertising management
+	//
+
+	// Updates our advertising instance based on the configuration and the current connection state
+	//
+	// This is called from the periodic timer (on the server thread) once our application has been registered with BlueZ.
+	void tick();
+
+	// Returns true if `tick()` has nothing left to do until the configuration or the connection state changes
+	//
+	// This is the case once we've settled on the slow interval (or handed advertising back to the adapter.)
+	bool isSettled();
+
+	// Removes our advertising instance
+	//
+	// This may be called from any thread, but must be called before the HciAdapter stops (it's called as the server shuts down.)
+	void stop();
+
+private:
+	// Private constructor for our Singleton
+	Advertising();
+
+	// Adds (or replaces) our advertising instance using the current set and the intervals for `newMode`
+	bool start(Mode newMode);
+
+	// Removes our advertising instance (the caller must hold `runtimeMutex`)
+	void removeInstance();
+
+	// Builds the advertising data (AD structures) for `set`
+	static std::vector<uint8_t> buildAdvertisingData(const Set &set);
+
+	// Converts milliseconds into the advertising interval units of 0.625ms
+	static uint32_t toIntervalUnits(int ms);
+
+	//
+	// Configuration (guarded by `configMutex`)
+	//
+
+	mutable std::mutex configMutex;
+	std::vector<Set> sets;
+	int fastMinIntervalMS;
+	int fastMaxIntervalMS;
+	int slowMinIntervalMS;
+	int slowMaxIntervalMS;
+	int fastPeriodSeconds;
+	bool configChanged;
+
+	//
+	// Runtime state (guarded by `runtimeMutex`, which is held for the whole of `tick()`)
+	//
+
+	std::mutex runtimeMutex;
+	std::unique_ptr<Mgmt> pMgmt;
+	Mode mode;
+	size_t currentSet;
+	bool extendedSupported;
+	int64_t modeStartTimeMS;
+	int64_t advertisingStartTimeMS;
+
+	// Time-to-connect statistics
+	int connectCount;
+	int64_t totalConnectTimeMS;
+};
+
+}; // namespace ggk
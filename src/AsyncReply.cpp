@@ -0,0 +1,333 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A pending reply to a D-Bus method call, used by asynchronous characteristic handlers
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Our method handlers run on the server's thread, which also runs the GLib main loop (or on a dispatch shard's thread, see
+// DispatchShards.cpp.) A handler that blocks (on a file, a device, a lock, etc.) stalls every other client, every notification and
+// every timer for as long as it blocks.
+//
+// Asynchronous handlers (see `GattCharacteristic::onReadValueAsync()` and `onWriteValueAsync()`) receive an `AsyncReply` in place
+// of the raw `GDBusMethodInvocation`. The handler returns right away and completes the reply whenever its result is ready, from
+// any thread. To help with that, a reply can:
+//
+//     * run a continuation later on the server's clock (`after()`)
+//     * run work on one of our worker threads and complete with its result (`runInWorker()`)
+//     * run work on a worker thread and then continue on the server's thread (`runInWorker()` with a continuation)
+//
+// For example:
+//
+//     .onReadValueAsync(CHARACTERISTIC_ASYNC_READ_CALLBACK_LAMBDA
+//     {
+//         reply->runInWorker([]() { return readSensor(); });
+//     })
+//
+// Continuations are chained by capturing the reply they are given. Continuations always run on the server's thread, wherever
+// the handler ran. A reply that is dropped without being completed fails the method call, so the client never waits for a D-Bus
+// timeout; likewise, an exception thrown from work or from a continuation fails the method call with the exception's message.
+//
+// The worker threads are joined as the server shuts down (see `stopWorkers()`), so none of them is left running into static
+// destruction.
+//
+// Note: this fills the role of a coroutine-based handler API. The library is built as C++17, which has no coroutines, so the
+// continuations are explicit.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <thread>
+#include <memory>
+#include <vector>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "AsyncReply.h"
+#include "Clock.h"
+#include "DosellGatt.h"
+#include "Globals.h"
+#include "Logger.h"
+#include "Pool.h"
+#include "Utils.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// The number of worker threads used by `runInWorker()`
+static const int kWorkerThreadCount = 2;
+
+//
+// Worker threads
+//
+
+// Our worker threads and the queue of work they pull from
+//
+// The threads are started the first time work is queued and run until the server shuts down (see `AsyncReply::stopWorkers()`.)
+static std::mutex workerMutex;
+static std::condition_variable workerCondition;
+static std::deque<std::function<void()>> workerQueue;
+static std::vector<std::thread> workers;
+static bool workersStopping = false;
+
+// Runs `function`, failing `reply`'s method call if it throws
+//
+// Work and continuations are called from our worker threads and from GLib's callbacks, where an exception would terminate the
+// process.
+static void runGuarded(const AsyncReply::Ptr &reply, const std::function<void()> &function)
+{
+	try
+	{
+		function();
+	}
+	catch (const std::exception &ex)
+	{
+		Logger::error(SSTR << "Asynchronous method handler failed: " << ex.what());
+		reply->returnError(kErrorFailed, ex.what());
+	}
+	catch (...)
+	{
+		Logger::error("Asynchronous method handler failed with an unknown exception");
+		reply->returnError(kErrorFailed, "The request failed");
+	}
+}
+
+// The body of each worker thread
+static void runWorker()
+{
+	while (true)
+	{
+		std::function<void()> function;
+		{
+			std::unique_lock<std::mutex> workerLock(workerMutex);
+			workerCondition.wait(workerLock, []() { return workersStopping || !workerQueue.empty(); });
+			if (workersStopping)
+			{
+				return;
+			}
+
+			function = std::move(workerQueue.front());
+			workerQueue.pop_front();
+		}
+
+		function();
+	}
+}
+
+// Queues `function` to run on a worker thread
+//
+// Work queued while the workers are stopping is dropped (failing its method call once `function` is released.)
+static void queueWork(std::function<void()> function)
+{
+	std::unique_lock<std::mutex> lock(workerMutex);
+	if (workersStopping)
+	{
+		lock.unlock();
+		return;
+	}
+
+	workerQueue.push_back(std::move(function));
+
+	if (workers.empty())
+	{
+		for (int i = 0; i < kWorkerThreadCount; ++i)
+		{
+			workers.emplace_back(runWorker);
+		}
+	}
+
+	workerCondition.notify_one();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Construction
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Creates a pending reply for `pInvocation` (we hold our own reference to the invocation)
+//
+// Replies live for the length of a single request, so both the reply and its shared state come from the transient pool.
+AsyncReply::Ptr AsyncReply::create(GDBusMethodInvocation *pInvocation)
+{
+	AsyncReply *pReply = new (Pool::allocate(sizeof(AsyncReply))) AsyncReply(pInvocation);
+	return Ptr(pReply, [](AsyncReply *p)
+	{
+		p->~AsyncReply();
+		Pool::deallocate(p, sizeof(AsyncReply));
+	}, PoolAllocator<AsyncReply>());
+}
+
+// Use `create()`
+AsyncReply::AsyncReply(GDBusMethodInvocation *pInvocation)
+: pInvocation(static_cast<GDBusMethodInvocation *>(g_object_ref(pInvocation))), completed(false)
+{
+}
+
+// If the reply was never completed, the method call fails rather than leaving the client to wait for a timeout
+AsyncReply::~AsyncReply()
+{
+	if (claim())
+	{
+		Logger::warn("Asynchronous method reply was dropped without being completed");
+		g_dbus_method_invocation_return_dbus_error(pInvocation, kErrorFailed.c_str(), "The request was not completed");
+	}
+
+	g_object_unref(pInvocation);
+}
+
+// Returns true for the first caller only, marking the reply as completed
+bool AsyncReply::claim()
+{
+	return !completed.exchange(true);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Completion
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Completes a ReadValue call with the given value (sent as "(ay)")
+void AsyncReply::returnBytes(const std::vector<uint8_t> &bytes)
+{
+	if (!claim()) { return; }
+
+	GVariant *pValue = Utils::gvariantFromByteArray(bytes);
+	g_dbus_method_invocation_return_value(pInvocation, g_variant_new_tuple(&pValue, 1));
+}
+
+// Completes a call that has no return value (such as WriteValue)
+void AsyncReply::returnVoid()
+{
+	if (!claim()) { return; }
+
+	g_dbus_method_invocation_return_value(pInvocation, nullptr);
+}
+
+// Fails the call with the given D-Bus error name and message
+void AsyncReply::returnError(const std::string &errorName, const std::string &message)
+{
+	if (!claim()) { return; }
+
+	g_dbus_method_invocation_return_dbus_error(pInvocation, errorName.c_str(), message.c_str());
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Continuations
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Runs `continuation` on the server's thread once `delayMS` milliseconds have passed on the server's clock (see `Clock`)
+//
+// This may be called from any thread. Handlers are called on the server's thread or on their dispatch shard's thread (see
+// DispatchShards.cpp), so the timer is always added from the server's thread.
+void AsyncReply::after(int delayMS, Continuation continuation)
+{
+	struct Pending
+	{
+		Ptr reply;
+		Continuation continuation;
+	};
+
+	// Timers belong to the server's thread, so we add ours from there (right away if that's where we are)
+	//
+	// The posted function owns the pending continuation until the timer takes it, so if the function is destroyed without running
+	// (the main context is torn down first), the reply is released and the method call fails rather than being left unanswered.
+	std::shared_ptr<Pending> pending = std::make_shared<Pending>(Pending { shared_from_this(), std::move(continuation) });
+	int timeoutMS = delayMS > 0 ? delayMS : 1;
+	postToServerThread([pending, timeoutMS]()
+	{
+		Clock::getInstance().addTimer(timeoutMS, [](gpointer pUserData) -> gboolean
+		{
+			std::shared_ptr<Pending> *pPending = static_cast<std::shared_ptr<Pending> *>(pUserData);
+			Pending &timed = **pPending;
+			runGuarded(timed.reply, [&timed]() { timed.continuation(timed.reply); });
+			delete pPending;
+			return FALSE;
+		}, new std::shared_ptr<Pending>(pending));
+	});
+}
+
+// Runs `work` on a worker thread and completes this (ReadValue) reply with its result
+void AsyncReply::runInWorker(ReadWork work)
+{
+	Ptr reply = shared_from_this();
+	queueWork([reply, work]()
+	{
+		runGuarded(reply, [&reply, &work]() { reply->returnBytes(work()); });
+	});
+}
+
+// Runs `work` on a worker thread, then `continuation` on the server's thread
+void AsyncReply::runInWorker(Work work, Continuation continuation)
+{
+	Ptr reply = shared_from_this();
+	queueWork([reply, work, continuation]()
+	{
+		bool succeeded = false;
+		runGuarded(reply, [&work, &succeeded]() { work(); succeeded = true; });
+		if (succeeded)
+		{
+			postToServerThread([reply, continuation]()
+			{
+				runGuarded(reply, [&reply, &continuation]() { continuation(reply); });
+			});
+		}
+	});
+}
+
+// Queues `function` to run on the server's thread the next time its main loop is idle (may be called from any thread)
+//
+// If we're already on the server's thread (the owner of the default main context), `function` runs right away.
+void AsyncReply::postToServerThread(std::function<void()> function)
+{
+	g_main_context_invoke_full(g_main_context_default(), G_PRIORITY_DEFAULT_IDLE, [](gpointer pUserData) -> gboolean
+	{
+		std::function<void()> *pFunction = static_cast<std::function<void()> *>(pUserData);
+		(*pFunction)();
+		return FALSE;
+	}, new std::function<void()>(std::move(function)), [](gpointer pUserData)
+	{
+		delete static_cast<std::function<void()> *>(pUserData);
+	});
+}
+
+// Stops our worker threads, waiting for the work they are running to finish
+//
+// Work that hasn't started is dropped, which fails its method calls. This is called as the server shuts down (see `uninit()`),
+// so that no worker outlives the server. Workers are started again by the next `runInWorker()`.
+void AsyncReply::stopWorkers()
+{
+	std::vector<std::thread> stopping;
+	std::deque<std::function<void()>> dropped;
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		workersStopping = true;
+		stopping.swap(workers);
+		dropped.swap(workerQueue);
+	}
+
+	workerCondition.notify_all();
+	for (std::thread &worker : stopping)
+	{
+		worker.join();
+	}
+
+	std::lock_guard<std::mutex> lock(workerMutex);
+	workersStopping = false;
+
+	// The dropped work (and the replies it holds) is released as we leave
+}
+
+}; // namespace ggk
@@ -0,0 +1,121 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A pending reply to a D-Bus method call, used by asynchronous characteristic handlers
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of AsyncReply.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+
+namespace ggk {
+
+class AsyncReply : public std::enable_shared_from_this<AsyncReply>
+{
+public:
+
+	//
+	// Types
+	//
+
+	// Handlers hold on to their reply through this shared pointer; the method call is completed by the time the last copy is gone
+	typedef std::shared_ptr<AsyncReply> Ptr;
+
+	// A continuation, run on the server's thread (an exception thrown from it fails the method call)
+	typedef std::function<void(Ptr reply)> Continuation;
+
+	// Work that produces the value for a ReadValue reply, run on a worker thread (an exception thrown from it fails the method call)
+	typedef std::function<std::vector<uint8_t>()> ReadWork;
+
+	// Work with no result, run on a worker thread (an exception thrown from it fails the method call)
+	typedef std::function<void()> Work;
+
+	//
+	// Construction
+	//
+
+	// Creates a pending reply for `pInvocation` (we hold our own reference to the invocation)
+	static Ptr create(GDBusMethodInvocation *pInvocation);
+
+	// If the reply was never completed, the method call fails rather than leaving the client to wait for a timeout
+	~AsyncReply();
+
+	AsyncReply(AsyncReply const&) = delete;
+	void operator=(AsyncReply const&) = delete;
+
+	//
+	// Completion (may be called from any thread; only the first completion counts)
+	//
+
+	// Returns true once the reply has been completed
+	bool isCompleted() const { return completed; }
+
+	// Completes a ReadValue call with the given value (sent as "(ay)")
+	void returnBytes(const std::vector<uint8_t> &bytes);
+
+	// Completes a call that has no return value (such as WriteValue)
+	void returnVoid();
+
+	// Fails the call with the given D-Bus error name and message
+	void returnError(const std::string &errorName, const std::string &message);
+
+	//
+	// Continuations
+	//
+
+	// Runs `continuation` on the server's thread once `delayMS` milliseconds have passed on the server's clock (see `Clock`)
+	//
+	// This may be called from any thread. Handlers are called on the server's thread or on their dispatch shard's thread (see
+	// DispatchShards.cpp), so the timer is always added from the server's thread.
+	void after(int delayMS, Continuation continuation);
+
+	// Runs `work` on a worker thread and completes this (ReadValue) reply with its result
+	void runInWorker(ReadWork work);
+
+	// Runs `work` on a worker thread, then `continuation` on the server's thread
+	void runInWorker(Work work, Continuation continuation);
+
+	// Queues `function` to run on the server's thread the next time its main loop is idle (may be called from any thread)
+	static void postToServerThread(std::function<void()> function);
+
+	// Stops our worker threads, waiting for the work they are running to finish
+	//
+	// Work that hasn't started is dropped, which fails its method calls. This is called as the server shuts down (see `uninit()`),
+	// so that no worker outlives the server. Workers are started again by the next `runInWorker()`.
+	static void stopWorkers();
+
+private:
+	// Use `create()`
+	explicit AsyncReply(GDBusMethodInvocation *pInvocation);
+
+	// Returns true for the first caller only, marking the reply as completed
+	bool claim();
+
+	GDBusMethodInvocation *pInvocation;
+	std::atomic<bool> completed;
+};
+
+}; // namespace ggk
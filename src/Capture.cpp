@@ -0,0 +1,407 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Recording (and reading back) captures of our D-Bus and HCI traffic
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Performance problems in the field often depend on the exact pattern of calls from BlueZ and the timing of HCI events. A capture
+// records that traffic so it can be studied (and replayed, see replay.cpp) later. Recording is started with `ggkCaptureStart()`.
+//
+// We record incoming method calls, property gets and sets (along with the time spent handling them), the signals we emit and the
+// Bluetooth Management API packets we read and write. Each hook checks `isRecording()` before it takes a timestamp or touches its
+// arguments, so when not recording, a hook costs a single atomic load.
+//
+// The file format is compact and simple. The file starts with the 8 bytes of `Capture::kMagic`, followed by records:
+//
+//     type       1 byte (CaptureRecordType)
+//     timestamp  zig-zag varint: microseconds since the previous record's timestamp (records from different threads may be
+//                written slightly out of order, so this may be negative)
+//     duration   varint: microseconds spent handling the record
+//
+//     For D-Bus records:
+//         sender, path, interface, member, type string    5 string references
+//         data                                             varint length + serialized GVariant (in normal form)
+//
+//     For HCI records:
+//         data                                             varint length + raw packet
+//
+// A string reference is a varint index into a table of strings seen so far in the file. An index equal to the size of the table
+// introduces a new string (varint length + bytes) which is then added to the table. Since the same few object paths, interfaces
+// and members appear over and over, most D-Bus records only need a handful of bytes beyond their data.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+#include <algorithm>
+
+#include "Capture.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// Every capture file starts with these bytes (the last byte is the format version)
+const char Capture::kMagic[8] = { 'G', 'G', 'K', 'C', 'A', 'P', 0, 1 };
+
+//
+// Encoding helpers
+//
+
+// Appends `value` to `out` as a varint (7 bits per byte, least significant first)
+static void encodeVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+// Appends `count` bytes from `pData` to `out`, prefixed with their length
+static void encodeBytes(std::vector<uint8_t> &out, const uint8_t *pData, size_t count)
+{
+	encodeVarint(out, count);
+	if (count > 0)
+	{
+		out.insert(out.end(), pData, pData + count);
+	}
+}
+
+// Zig-zag encoding maps signed values to unsigned ones so that small magnitudes stay small
+static uint64_t zigZag(int64_t value) { return (uint64_t(value) << 1) ^ uint64_t(value >> 63); }
+static int64_t unZigZag(uint64_t value) { return int64_t(value >> 1) ^ -int64_t(value & 1); }
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Private constructor for our Singleton
+Capture::Capture()
+: recording(false), captureStartUS(0), lastTimestampUS(0)
+{
+}
+
+// Starts recording to the file at `filename`, replacing any current recording
+//
+// Returns true on success, otherwise false
+bool Capture::start(const std::string &filename)
+{
+	stop();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	stream.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!stream.is_open())
+	{
+		Logger::error(SSTR << "Unable to open capture file '" << filename << "'");
+		return false;
+	}
+
+	stream.write(kMagic, sizeof(kMagic));
+	strings.clear();
+	captureStartUS = nowUS();
+	lastTimestampUS = 0;
+
+	recording = true;
+	Logger::info(SSTR << "Capturing D-Bus and HCI traffic to '" << filename << "'");
+	return true;
+}
+
+// Stops recording and closes the capture file
+void Capture::stop()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!stream.is_open())
+	{
+		return;
+	}
+
+	recording = false;
+	stream.close();
+	Logger::info(SSTR << "Capture stopped (" << strings.size() << " unique strings)");
+}
+
+// Records a D-Bus method call, property access or emitted signal that started at `startUS` (see `nowUS()`)
+//
+// `pParameters` may be nullptr.
+void Capture::recordDBus(CaptureRecordType type, int64_t startUS, const char *pSender, const char *pPath, const char *pInterface,
+	const char *pMember, GVariant *pParameters)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	// Signals are not handled by us, so they have no duration
+	int64_t durationUS = ECaptureSignal == type ? 0 : nowUS() - startUS;
+
+	// New strings are defined where they are first used, so the string references must be encoded in the same order that the
+	// records are written
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<uint8_t> body;
+	encodeString(body, pSender);
+	encodeString(body, pPath);
+	encodeString(body, pInterface);
+	encodeString(body, pMember);
+	encodeString(body, nullptr == pParameters ? "" : g_variant_get_type_string(pParameters));
+
+	if (nullptr == pParameters)
+	{
+		encodeBytes(body, nullptr, 0);
+	}
+	else
+	{
+		// Serialize the normal form, so that the reader can trust the data's offsets and padding
+		GVariant *pNormal = g_variant_get_normal_form(pParameters);
+		encodeBytes(body, static_cast<const uint8_t *>(g_variant_get_data(pNormal)), g_variant_get_size(pNormal));
+		g_variant_unref(pNormal);
+	}
+
+	write(type, startUS, durationUS, body);
+}
+
+// Records an HCI packet read from (or written to) the kernel
+void Capture::recordHci(CaptureRecordType type, const uint8_t *pData, size_t count)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	std::vector<uint8_t> body;
+	encodeBytes(body, pData, count);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	write(type, nowUS(), 0, body);
+}
+
+// Encodes the record header and writes `body` to the capture file
+//
+// The caller must hold `mutex`.
+void Capture::write(CaptureRecordType type, int64_t startUS, int64_t durationUS, const std::vector<uint8_t> &body)
+{
+	// We may have stopped since checking `recording`
+	if (!stream.is_open())
+	{
+		return;
+	}
+
+	int64_t timestampUS = startUS - captureStartUS;
+
+	std::vector<uint8_t> header;
+	header.push_back(uint8_t(type));
+	encodeVarint(header, zigZag(timestampUS - lastTimestampUS));
+	encodeVarint(header, uint64_t(std::max(durationUS, int64_t(0))));
+	lastTimestampUS = timestampUS;
+
+	stream.write(reinterpret_cast<const char *>(header.data()), header.size());
+	stream.write(reinterpret_cast<const char *>(body.data()), body.size());
+}
+
+// Appends a reference to `str` in our string table to `out`, adding the string to the table if needed
+//
+// The caller must hold `mutex`.
+void Capture::encodeString(std::vector<uint8_t> &out, const char *pStr)
+{
+	if (nullptr == pStr)
+	{
+		pStr = "";
+	}
+
+	auto it = std::find(strings.begin(), strings.end(), pStr);
+	encodeVarint(out, it - strings.begin());
+
+	if (it == strings.end())
+	{
+		encodeBytes(out, reinterpret_cast<const uint8_t *>(pStr), strlen(pStr));
+		strings.push_back(pStr);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reading
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+CaptureReader::CaptureReader()
+: fileSize(0), lastTimestampUS(0), damaged(false)
+{
+}
+
+// Opens the capture file at `filename`
+//
+// Returns true on success, otherwise false
+bool CaptureReader::open(const std::string &filename)
+{
+	stream.open(filename, std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+	{
+		Logger::error(SSTR << "Unable to open capture file '" << filename << "'");
+		return false;
+	}
+
+	char magic[sizeof(Capture::kMagic)];
+	if (!stream.read(magic, sizeof(magic)) || memcmp(magic, Capture::kMagic, sizeof(magic)) != 0)
+	{
+		Logger::error(SSTR << "'" << filename << "' is not a capture file (or has an unsupported version)");
+		return false;
+	}
+
+	// Lengths in the file are checked against what's left of it before anything is allocated for them
+	stream.seekg(0, std::ios::end);
+	fileSize = uint64_t(stream.tellg());
+	stream.seekg(sizeof(Capture::kMagic), std::ios::beg);
+
+	strings.clear();
+	lastTimestampUS = 0;
+	damaged = false;
+	return true;
+}
+
+// Reads the next record
+//
+// Returns true on success or false at the end of the file (or if the file is damaged, see `isDamaged()`)
+bool CaptureReader::next(CaptureRecord &record)
+{
+	int type = stream.get();
+	if (type == std::char_traits<char>::eof())
+	{
+		return false;
+	}
+
+	uint64_t timestampDelta;
+	uint64_t duration;
+	if (!readVarint(timestampDelta) || !readVarint(duration))
+	{
+		return false;
+	}
+
+	record.type = static_cast<CaptureRecordType>(type);
+	record.timestampUS = lastTimestampUS + unZigZag(timestampDelta);
+	record.durationUS = int64_t(duration);
+	lastTimestampUS = record.timestampUS;
+
+	record.sender.clear();
+	record.path.clear();
+	record.interface.clear();
+	record.member.clear();
+	record.typeString.clear();
+
+	switch(record.type)
+	{
+		case ECaptureMethodCall:
+		case ECaptureGetProperty:
+		case ECaptureSetProperty:
+		case ECaptureSignal:
+			if (!readString(record.sender) || !readString(record.path) || !readString(record.interface)
+				|| !readString(record.member) || !readString(record.typeString))
+			{
+				return false;
+			}
+			return readBytes(record.data);
+		case ECaptureHciRead:
+		case ECaptureHciWrite:
+			return readBytes(record.data);
+		default:
+			Logger::error(SSTR << "Unknown capture record type: " << type);
+			damaged = true;
+			return false;
+	}
+}
+
+// Reads a varint; returns false if the file is damaged
+bool CaptureReader::readVarint(uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int byte = stream.get();
+		if (byte == std::char_traits<char>::eof())
+		{
+			break;
+		}
+
+		value |= uint64_t(byte & 0x7f) << shift;
+		if (0 == (byte & 0x80))
+		{
+			return true;
+		}
+	}
+
+	damaged = true;
+	return false;
+}
+
+// Reads a length-prefixed run of bytes; returns false if the file is damaged
+//
+// A length longer than the rest of the file (a truncated or corrupt capture) is rejected before we allocate for it.
+bool CaptureReader::readBytes(std::vector<uint8_t> &bytes)
+{
+	uint64_t count;
+	if (!readVarint(count))
+	{
+		return false;
+	}
+
+	std::streamoff position = stream.tellg();
+	if (position < 0 || count > fileSize - uint64_t(position))
+	{
+		damaged = true;
+		return false;
+	}
+
+	bytes.resize(count);
+	if (count > 0 && !stream.read(reinterpret_cast<char *>(bytes.data()), count))
+	{
+		damaged = true;
+		return false;
+	}
+
+	return true;
+}
+
+// Reads a string reference (adding new strings to our table); returns false if the file is damaged
+bool CaptureReader::readString(std::string &str)
+{
+	uint64_t index;
+	if (!readVarint(index))
+	{
+		return false;
+	}
+
+	if (index < strings.size())
+	{
+		str = strings[index];
+		return true;
+	}
+
+	std::vector<uint8_t> bytes;
+	if (index != strings.size() || !readBytes(bytes))
+	{
+		damaged = true;
+		return false;
+	}
+
+	str.assign(bytes.begin(), bytes.end());
+	strings.push_back(str);
+	return true;
+}
+
+}; // namespace ggk
@@ -0,0 +1,199 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Recording (and reading back) captures of our D-Bus and HCI traffic
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Capture.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+
+#include "MemoryStats.h"
+
+namespace ggk {
+
+//
+// Types
+//
+
+// The kinds of traffic we capture
+enum CaptureRecordType
+{
+	ECaptureMethodCall = 1,
+	ECaptureGetProperty = 2,
+	ECaptureSetProperty = 3,
+	ECaptureSignal = 4,
+	ECaptureHciRead = 5,
+	ECaptureHciWrite = 6
+};
+
+// A single decoded capture record
+struct CaptureRecord
+{
+	CaptureRecordType type;
+
+	// Microseconds since the start of the capture
+	int64_t timestampUS;
+
+	// Microseconds spent handling the record (zero for signals and HCI traffic)
+	int64_t durationUS;
+
+	// D-Bus records only
+	std::string sender;
+	std::string path;
+	std::string interface;
+	std::string member;
+
+	// For D-Bus records, the GVariant type string of `data` (empty if there were no parameters)
+	std::string typeString;
+
+	// For D-Bus records, the serialized GVariant parameters (or value); for HCI records, the raw packet
+	std::vector<uint8_t> data;
+};
+
+//
+// Recording
+//
+
+class Capture
+{
+public:
+
+	//
+	// Constants
+	//
+
+	// Every capture file starts with these bytes (the last byte is the format version)
+	static const char kMagic[8];
+
+	//
+	// Accessors
+	//
+
+	// Returns the instance to this singleton class
+	static Capture &getInstance()
+	{
+		static Capture instance;
+		return instance;
+	}
+
+	//
+	// Disallow copies of our singleton (c++11)
+	//
+	Capture(Capture const&) = delete;
+	void operator=(Capture const&) = delete;
+
+	// Returns true if we are currently recording (this is cheap and may be called from any thread)
+	bool isRecording() const { return recording; }
+
+	// Returns the current time in microseconds, as used for capture timestamps
+	//
+	// Captures measure real latencies, so this uses the real monotonic clock even when the server runs on virtual time.
+	static int64_t nowUS() { return g_get_monotonic_time(); }
+
+	//
+	// Control (may be called from any thread)
+	//
+
+	// Starts recording to the file at `filename`, replacing any current recording
+	//
+	// Returns true on success, otherwise false
+	bool start(const std::string &filename);
+
+	// Stops recording and closes the capture file
+	void stop();
+
+	//
+	// Recording (may be called from any thread)
+	//
+	// Hooks should check `isRecording()` first, so that nothing is timed or formatted while we aren't recording.
+	//
+
+	// Records a D-Bus method call, property access or emitted signal that started at `startUS` (see `nowUS()`)
+	//
+	// `pParameters` may be nullptr.
+	void recordDBus(CaptureRecordType type, int64_t startUS, const char *pSender, const char *pPath, const char *pInterface,
+		const char *pMember, GVariant *pParameters);
+
+	// Records an HCI packet read from (or written to) the kernel
+	void recordHci(CaptureRecordType type, const uint8_t *pData, size_t count);
+
+private:
+	// Private constructor for our Singleton
+	Capture();
+
+	// Encodes the record header and writes `body` to the capture file
+	void write(CaptureRecordType type, int64_t startUS, int64_t durationUS, const std::vector<uint8_t> &body);
+
+	// Appends a reference to `str` in our string table to `out`, adding the string to the table if needed
+	void encodeString(std::vector<uint8_t> &out, const char *pStr);
+
+	std::atomic<bool> recording;
+
+	// Recording state (guarded by `mutex`)
+	std::mutex mutex;
+	std::ofstream stream;
+	std::vector<std::string, TaggedAllocator<std::string, EMemoryLogging>> strings;
+	int64_t captureStartUS;
+	int64_t lastTimestampUS;
+};
+
+//
+// Reading
+//
+
+class CaptureReader
+{
+public:
+	CaptureReader();
+
+	// Opens the capture file at `filename`
+	//
+	// Returns true on success, otherwise false
+	bool open(const std::string &filename);
+
+	// Reads the next record
+	//
+	// Returns true on success or false at the end of the file (or if the file is damaged, see `isDamaged()`)
+	bool next(CaptureRecord &record);
+
+	// Returns true if reading stopped because the file is damaged or truncated
+	bool isDamaged() const { return damaged; }
+
+private:
+	// Decoding helpers; these return false if the file is damaged
+	bool readVarint(uint64_t &value);
+	bool readBytes(std::vector<uint8_t> &bytes);
+	bool readString(std::string &str);
+
+	std::ifstream stream;
+	uint64_t fileSize;
+	std::vector<std::string> strings;
+	int64_t lastTimestampUS;
+	bool damaged;
+};
+
+}; // namespace ggk
@@ -0,0 +1,196 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The server's clock and timers, with an optional virtual (simulated) time base
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Everything in the server that is scheduled in time (the periodic timer that drives tick events and retries, advertising interval
+// changes, the Current Time characteristics, etc.) asks this class for the time rather than going to GLib or the C library.
+//
+// On real time, this is a thin wrapper: timers are GLib timeouts and the time comes from the monotonic clock.
+//
+// On virtual time (see `ggkSetSimulatedClock()`), the clock does not move on its own. Instead, whenever the server's idle function
+// runs out of work, it jumps the clock straight to the next timer deadline and fires that timer rather than sleeping. Hours of
+// tick-driven behavior (notifications, retries, advertising rotation) therefore run in as little time as the CPU allows.
+//
+// Note that waits on the kernel (such as the HCI command response timeout in `HciAdapter`) remain on real time, since the kernel
+// does not share our virtual clock.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+
+#include "Clock.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// Private constructor for our Singleton
+Clock::Clock()
+: simulated(false), virtualNowMS(0), simulationStartMS(0), simulationStartWallTime(0), nextTimerId(1)
+{
+}
+
+// Returns the real monotonic time in milliseconds
+int64_t Clock::realNowMS()
+{
+	return g_get_monotonic_time() / 1000;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Simulation
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Enables or disables the virtual time base
+//
+// When enabled, the virtual clock starts at the current (real) time and only moves forward when the server's thread advances
+// it (see `runUntilNextTimer()`.) This must be called before the server is started.
+void Clock::setSimulated(bool enable)
+{
+	if (enable)
+	{
+		simulationStartMS = realNowMS();
+		simulationStartWallTime = time(nullptr);
+		virtualNowMS = simulationStartMS;
+	}
+
+	simulated = enable;
+	Logger::info(SSTR << "Clock running on " << (enable ? "virtual" : "real") << " time");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Time
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the current monotonic time in milliseconds
+int64_t Clock::nowMS() const
+{
+	return simulated ? virtualNowMS.load() : realNowMS();
+}
+
+// Returns the current wall-clock time
+//
+// On virtual time, this is the wall-clock time at which simulation was enabled plus the virtual time elapsed since then.
+time_t Clock::wallTime() const
+{
+	if (!simulated)
+	{
+		return time(nullptr);
+	}
+
+	return simulationStartWallTime + time_t((virtualNowMS - simulationStartMS) / 1000);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Timers
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Adds a timer that calls `callback` every `intervalMS` milliseconds until the callback returns FALSE
+//
+// On real time, this is a GLib timeout on the default main context. Returns the timer's ID, or 0 on failure.
+guint Clock::addTimer(guint intervalMS, GSourceFunc callback, gpointer pUserData)
+{
+	if (!simulated)
+	{
+		// Whole seconds let GLib group our wakeups with others on the system
+		if (0 == intervalMS % 1000)
+		{
+			return g_timeout_add_seconds(intervalMS / 1000, callback, pUserData);
+		}
+
+		return g_timeout_add(intervalMS, callback, pUserData);
+	}
+
+	Timer timer;
+	timer.id = nextTimerId++;
+	timer.intervalMS = std::max(intervalMS, 1U);
+	timer.deadlineMS = nowMS() + timer.intervalMS;
+	timer.callback = callback;
+	timer.pUserData = pUserData;
+	timers.push_back(timer);
+
+	return timer.id;
+}
+
+// Removes the timer with the given ID
+void Clock::removeTimer(guint id)
+{
+	if (!simulated)
+	{
+		g_source_remove(id);
+		return;
+	}
+
+	timers.erase(std::remove_if(timers.begin(), timers.end(), [id](const Timer &entry) { return entry.id == id; }), timers.end());
+}
+
+// Advances the virtual clock to the earliest timer deadline (but no more than `maxAdvanceMS`) and fires all timers that are due
+//
+// This does nothing on real time. Returns true if any timer fired.
+bool Clock::runUntilNextTimer(int64_t maxAdvanceMS)
+{
+	if (!simulated)
+	{
+		return false;
+	}
+
+	int64_t now = nowMS();
+	int64_t target = now + maxAdvanceMS;
+	for (const Timer &timer : timers)
+	{
+		target = std::min(target, timer.deadlineMS);
+	}
+
+	virtualNowMS = std::max(now, target);
+
+	// Collect the due timers first, since their callbacks may add or remove timers
+	std::vector<guint> dueIds;
+	for (const Timer &timer : timers)
+	{
+		if (timer.deadlineMS <= virtualNowMS) { dueIds.push_back(timer.id); }
+	}
+
+	for (guint id : dueIds)
+	{
+		auto it = std::find_if(timers.begin(), timers.end(), [id](const Timer &entry) { return entry.id == id; });
+		if (it == timers.end())
+		{
+			continue;
+		}
+
+		Timer timer = *it;
+		gboolean keep = timer.callback(timer.pUserData);
+
+		// The callback may have removed (or reallocated) our timers, so look it up again
+		it = std::find_if(timers.begin(), timers.end(), [id](const Timer &entry) { return entry.id == id; });
+		if (it == timers.end())
+		{
+			continue;
+		}
+
+		if (keep)
+		{
+			it->deadlineMS += it->intervalMS;
+		}
+		else
+		{
+			timers.erase(it);
+		}
+	}
+
+	return !dueIds.empty();
+}
+
+}; // namespace ggk
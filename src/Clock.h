@@ -0,0 +1,124 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The server's clock and timers, with an optional virtual (simulated) time base
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Clock.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include <atomic>
+
+namespace ggk {
+
+class Clock
+{
+public:
+
+	//
+	// Accessors
+	//
+
+	// Returns the instance to this singleton class
+	static Clock &getInstance()
+	{
+		static Clock instance;
+		return instance;
+	}
+
+	//
+	// Disallow copies of our singleton (c++11)
+	//
+	Clock(Clock const&) = delete;
+	void operator=(Clock const&) = delete;
+
+	//
+	// Simulation
+	//
+
+	// Enables or disables the virtual time base
+	//
+	// When enabled, the virtual clock starts at the current (real) time and only moves forward when the server's thread advances
+	// it (see `runUntilNextTimer()`.) This must be called before the server is started.
+	void setSimulated(bool enable);
+
+	// Returns true if we are running on virtual time
+	bool isSimulated() const { return simulated; }
+
+	//
+	// Time (may be called from any thread)
+	//
+
+	// Returns the current monotonic time in milliseconds
+	int64_t nowMS() const;
+
+	// Returns the current wall-clock time
+	//
+	// On virtual time, this is the wall-clock time at which simulation was enabled plus the virtual time elapsed since then.
+	time_t wallTime() const;
+
+	//
+	// Timers (server thread only)
+	//
+
+	// Adds a timer that calls `callback` every `intervalMS` milliseconds until the callback returns FALSE
+	//
+	// On real time, this is a GLib timeout on the default main context. Returns the timer's ID, or 0 on failure.
+	guint addTimer(guint intervalMS, GSourceFunc callback, gpointer pUserData);
+
+	// Removes the timer with the given ID
+	void removeTimer(guint id);
+
+	// Advances the virtual clock to the earliest timer deadline (but no more than `maxAdvanceMS`) and fires all timers that are due
+	//
+	// This does nothing on real time. Returns true if any timer fired.
+	bool runUntilNextTimer(int64_t maxAdvanceMS);
+
+private:
+	// Private constructor for our Singleton
+	Clock();
+
+	// A timer on the virtual time base
+	struct Timer
+	{
+		guint id;
+		int64_t intervalMS;
+		int64_t deadlineMS;
+		GSourceFunc callback;
+		gpointer pUserData;
+	};
+
+	// Returns the real monotonic time in milliseconds
+	static int64_t realNowMS();
+
+	std::atomic<bool> simulated;
+	std::atomic<int64_t> virtualNowMS;
+	int64_t simulationStartMS;
+	time_t simulationStartWallTime;
+
+	// Virtual timers (server thread only)
+	std::vector<Timer> timers;
+	guint nextTimerId;
+};
+
+}; // namespace ggk
@@ -0,0 +1,177 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The packed layout of a characteristic flagged with `composite()`, which binds several data values into one
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Related values (a device's status, its control word and the time of its next dispense, say) often change together. Served as
+// separate characteristics, one state change costs a getter call, a PropertiesChanged signal and an ATT notification for each of
+// them. A characteristic flagged with `composite()` binds several data values into one fixed, packed layout instead:
+//
+//     EUnsigned   a little-endian integer of 1, 2, 4 or 8 bytes, from a value of the same width
+//     EString     a string, truncated or padded with zeros to a fixed size
+//     EFixed      a fixed number of bytes, copied as they are
+//
+// The fields are packed one after another, with no padding, in the order they are declared. The library reads and packs the
+// values itself (so the application only serves them by name, as usual) and the characteristic answers ReadValue with the whole
+// layout.
+//
+// A change to any bound value schedules one notification of the combined value. Changes are announced either with
+// `ggkNotifyUpdatedData()` or, for values that also have a characteristic of their own, by notifying that characteristic as
+// before. The first change marks the composite as pending and queues its update; changes that arrive while it's pending are
+// coalesced into it. The pending mark is cleared just before the values are read, so a change made while we pack is never lost:
+// it schedules another notification. When the server handles several updates at once, the bound values are prefetched along
+// with the others, in one call to the batch data getter.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+
+#include "CompositeValue.h"
+#include "DosellGatt.h"
+
+namespace ggk {
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Fields
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// An unsigned 8-bit integer
+CompositeValue::Field CompositeValue::Field::uint8(const std::string &name)
+{
+	return { name, EUnsigned, sizeof(uint8_t) };
+}
+
+// An unsigned 16-bit integer
+CompositeValue::Field CompositeValue::Field::uint16(const std::string &name)
+{
+	return { name, EUnsigned, sizeof(uint16_t) };
+}
+
+// An unsigned 32-bit integer
+CompositeValue::Field CompositeValue::Field::uint32(const std::string &name)
+{
+	return { name, EUnsigned, sizeof(uint32_t) };
+}
+
+// An unsigned 64-bit integer
+CompositeValue::Field CompositeValue::Field::uint64(const std::string &name)
+{
+	return { name, EUnsigned, sizeof(uint64_t) };
+}
+
+// A string of `size` bytes
+CompositeValue::Field CompositeValue::Field::string(const std::string &name, size_t size)
+{
+	return { name, EString, size };
+}
+
+// A fixed layout of `size` bytes
+CompositeValue::Field CompositeValue::Field::fixed(const std::string &name, size_t size)
+{
+	return { name, EFixed, size };
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Layout
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Constructs the layout `fields`, packed one after another in the order given
+CompositeValue::CompositeValue(const std::vector<Field> &fields)
+: fields(fields), size(0), pending(false)
+{
+	for (const Field &field : fields)
+	{
+		size += field.size;
+	}
+}
+
+// Returns true if the data value `name` is one of our fields
+bool CompositeValue::binds(const std::string &name) const
+{
+	for (const Field &field : fields)
+	{
+		if (field.name == name)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Packs the current data values into `pValue` (which must hold `getSize()` bytes)
+//
+// Values are requested through the server's data getter (see `DosellGatt::getData()`.) Values the getter doesn't have are
+// packed as zeros.
+void CompositeValue::pack(uint8_t *pValue) const
+{
+	memset(pValue, 0, size);
+
+	for (const Field &field : fields)
+	{
+		const void *pData = THESERVER->getData(field.name.c_str());
+		if (nullptr != pData)
+		{
+			if (Field::EUnsigned == field.kind)
+			{
+				uint64_t value = 0;
+				switch(field.size)
+				{
+					case sizeof(uint8_t): value = *static_cast<const uint8_t *>(pData); break;
+					case sizeof(uint16_t): value = *static_cast<const uint16_t *>(pData); break;
+					case sizeof(uint32_t): value = *static_cast<const uint32_t *>(pData); break;
+					default: value = *static_cast<const uint64_t *>(pData); break;
+				}
+
+				for (size_t i = 0; i < field.size; ++i)
+				{
+					pValue[i] = uint8_t(value >> (8 * i));
+				}
+			}
+			else if (Field::EString == field.kind)
+			{
+				const char *pString = static_cast<const char *>(pData);
+				memcpy(pValue, pString, strnlen(pString, field.size));
+			}
+			else
+			{
+				memcpy(pValue, pData, field.size);
+			}
+		}
+
+		pValue += field.size;
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Coalescing
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Marks a notification of the combined value as pending, returning true if one wasn't already
+//
+// Only the call that returns true should queue the update; others are coalesced into it. May be called from any thread.
+bool CompositeValue::schedule()
+{
+	return !pending.exchange(true);
+}
+
+// Clears the pending notification, before the value is packed for it
+void CompositeValue::clearPending()
+{
+	pending = false;
+}
+
+}; // namespace ggk
@@ -0,0 +1,114 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The packed layout of a characteristic flagged with `composite()`, which binds several data values into one
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of CompositeValue.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+namespace ggk {
+
+class CompositeValue
+{
+public:
+
+	// One data value within the layout
+	struct Field
+	{
+		// The kinds of fields we understand
+		enum Kind
+		{
+			// A little-endian unsigned integer of `size` bytes (1, 2, 4 or 8), from a value of that width
+			EUnsigned,
+
+			// A string, truncated or padded with zeros to exactly `size` bytes
+			EString,
+
+			// Exactly `size` bytes, copied as they are
+			EFixed
+		};
+
+		// An unsigned 8-bit integer
+		static Field uint8(const std::string &name);
+
+		// An unsigned 16-bit integer
+		static Field uint16(const std::string &name);
+
+		// An unsigned 32-bit integer
+		static Field uint32(const std::string &name);
+
+		// An unsigned 64-bit integer
+		static Field uint64(const std::string &name);
+
+		// A string of `size` bytes
+		static Field string(const std::string &name, size_t size);
+
+		// A fixed layout of `size` bytes
+		static Field fixed(const std::string &name, size_t size);
+
+		// The data name that the value is requested with
+		std::string name;
+		Kind kind;
+		size_t size;
+	};
+
+	// Constructs the layout `fields`, packed one after another in the order given
+	CompositeValue(const std::vector<Field> &fields);
+
+	CompositeValue(const CompositeValue &) = delete;
+	CompositeValue &operator =(const CompositeValue &) = delete;
+
+	// Returns our fields
+	const std::vector<Field> &getFields() const { return fields; }
+
+	// Returns the size of the packed value
+	size_t getSize() const { return size; }
+
+	// Returns true if the data value `name` is one of our fields
+	bool binds(const std::string &name) const;
+
+	// Packs the current data values into `pValue` (which must hold `getSize()` bytes)
+	//
+	// Values are requested through the server's data getter (see `DosellGatt::getData()`.) Values the getter doesn't have are
+	// packed as zeros.
+	void pack(uint8_t *pValue) const;
+
+	// Marks a notification of the combined value as pending, returning true if one wasn't already
+	//
+	// Only the call that returns true should queue the update; others are coalesced into it. May be called from any thread.
+	bool schedule();
+
+	// Clears the pending notification, before the value is packed for it
+	void clearPending();
+
+private:
+
+	std::vector<Field> fields;
+	size_t size;
+	std::atomic<bool> pending;
+};
+
+}; // namespace ggk
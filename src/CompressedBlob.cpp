@@ -0,0 +1,364 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The compressed form of a large value served by a characteristic flagged with `compressedRead()`, and its LZ4 codec
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Large read-only values (logs, configuration dumps, histories) are fetched with long reads: a central reads the value in pieces
+// of MTU - 1 bytes, one ATT round trip each, so the transfer time is set by the size of the value. Text like this compresses
+// well, so a characteristic flagged with `compressedRead()` serves its value compressed. Each value is:
+//
+//     [u8 method][u32 original size, little-endian][encoded value]
+//
+// where the method is 0x01 for an LZ4 block, or 0x00 if compression didn't make the value any smaller (the value is then stored
+// as it is.) The characteristic carries a descriptor that reads "lz4-block", so a central can tell a compressed characteristic
+// from a plain one.
+//
+// The codec writes the standard LZ4 block format (see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so any LZ4
+// library can decode it (with LZ4_decompress_safe() and the original size from the header); `decompress()` here is a reference
+// decoder. It's a single greedy pass with a small hash table of recent positions, which is fast and good enough for text. We
+// implement it here rather than pull in liblz4 because we only need the block format, and only this much of it.
+//
+// Compressing is far more work than serving a read, so each version of the value is compressed once. A read at offset zero fetches
+// the value from the data getter as usual and compares its CRC32C (see `Utils::crc32c()`, which uses the CPU's instructions where
+// it can) and size with those of the value we last compressed; only a changed value is compressed again. Reads
+// at later offsets never look at the value: they are served from the encoding that the same central's read at offset zero
+// returned, so a long read always sees one version, even if the value changes part way through it and another central's read
+// encodes the new one. Each central (keyed by the device object path that BlueZ passes with the read) holds on to its encoding
+// until its next read at offset zero, and an encoding no central holds is freed.
+//
+// The value is requested from the data getter as a null-terminated string, as text characteristics are.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+#include <algorithm>
+
+#include "CompressedBlob.h"
+#include "Utils.h"
+
+namespace ggk {
+
+//
+// LZ4 block format
+//
+
+// The shortest match that can be encoded
+static const size_t kMinMatch = 4;
+
+// The last match must start at least this many bytes before the end of the input
+static const size_t kMatchFindLimit = 12;
+
+// The last bytes of the input are always literals
+static const size_t kLastLiterals = 5;
+
+// The farthest back a match can reach
+static const size_t kMaxDistance = 65535;
+
+// The size of our hash table of recent positions (as a power of two)
+static const int kHashLog = 12;
+
+// Returns the four bytes at `p`
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// Returns the hash table slot for the four bytes at `p`
+static uint32_t hash(const uint8_t *p)
+{
+	return (read32(p) * 2654435761u) >> (32 - kHashLog);
+}
+
+// Appends a length of `length` (less the part already in the token) as a run of 255s and a final byte
+static void appendLength(CompressedBlob::Buffer &output, size_t length)
+{
+	while (length >= 255)
+	{
+		output.push_back(255);
+		length -= 255;
+	}
+	output.push_back(uint8_t(length));
+}
+
+// Appends a sequence: the literals [pLiterals, pLiterals + literalLength), then (unless it's the last) a match of `matchLength`
+// bytes from `distance` back
+static void appendSequence(CompressedBlob::Buffer &output, const uint8_t *pLiterals, size_t literalLength, size_t distance,
+	size_t matchLength)
+{
+	size_t tokenPosition = output.size();
+	output.push_back(uint8_t((literalLength < 15 ? literalLength : 15) << 4));
+	if (literalLength >= 15)
+	{
+		appendLength(output, literalLength - 15);
+	}
+	output.insert(output.end(), pLiterals, pLiterals + literalLength);
+
+	if (0 == matchLength)
+	{
+		return;
+	}
+
+	output.push_back(uint8_t(distance));
+	output.push_back(uint8_t(distance >> 8));
+
+	size_t code = matchLength - kMinMatch;
+	output[tokenPosition] |= uint8_t(code < 15 ? code : 15);
+	if (code >= 15)
+	{
+		appendLength(output, code - 15);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Codec
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Compresses `length` bytes at `pData` into `output` as an LZ4 block (see the discussion in CompressedBlob.cpp)
+void CompressedBlob::compress(const uint8_t *pData, size_t length, Buffer &output)
+{
+	output.clear();
+
+	const uint8_t *pEnd = pData + length;
+	const uint8_t *pLiterals = pData;
+
+	// Inputs too short to hold a match are all literals
+	if (length > kMatchFindLimit)
+	{
+		// Each slot holds a position (plus one, so zero is empty) of the four bytes that last hashed there
+		std::vector<uint32_t> table(size_t(1) << kHashLog, 0);
+		const uint8_t *pMatchLimit = pEnd - kMatchFindLimit;
+		const uint8_t *p = pData;
+
+		while (p < pMatchLimit)
+		{
+			uint32_t slot = hash(p);
+			uint32_t candidate = table[slot];
+			table[slot] = uint32_t(p - pData) + 1;
+
+			const uint8_t *pCandidate = pData + candidate - 1;
+			if (0 == candidate || size_t(p - pCandidate) > kMaxDistance || read32(pCandidate) != read32(p))
+			{
+				++p;
+				continue;
+			}
+
+			// Extend the match backwards over literals, then forwards up to the last literals
+			while (p > pLiterals && pCandidate > pData && p[-1] == pCandidate[-1])
+			{
+				--p;
+				--pCandidate;
+			}
+
+			size_t matchLength = kMinMatch;
+			while (p + matchLength < pEnd - kLastLiterals && p[matchLength] == pCandidate[matchLength])
+			{
+				++matchLength;
+			}
+
+			appendSequence(output, pLiterals, size_t(p - pLiterals), size_t(p - pCandidate), matchLength);
+			p += matchLength;
+			pLiterals = p;
+		}
+	}
+
+	appendSequence(output, pLiterals, size_t(pEnd - pLiterals), 0, 0);
+}
+
+// Decompresses the LZ4 block of `length` bytes at `pData` into `output`, which must be sized to the original size
+//
+// Returns false if the block is malformed or doesn't fill `output` exactly.
+bool CompressedBlob::decompress(const uint8_t *pData, size_t length, Buffer &output)
+{
+	const uint8_t *pEnd = pData + length;
+	size_t written = 0;
+
+	while (pData < pEnd)
+	{
+		uint8_t token = *pData++;
+
+		// Literals
+		size_t literalLength = token >> 4;
+		if (15 == literalLength)
+		{
+			uint8_t byte;
+			do
+			{
+				if (pData == pEnd)
+				{
+					return false;
+				}
+				byte = *pData++;
+				literalLength += byte;
+			} while (255 == byte);
+		}
+
+		if (literalLength > size_t(pEnd - pData) || literalLength > output.size() - written)
+		{
+			return false;
+		}
+		memcpy(output.data() + written, pData, literalLength);
+		pData += literalLength;
+		written += literalLength;
+
+		// The last sequence has no match
+		if (pData == pEnd)
+		{
+			break;
+		}
+
+		// Match
+		if (size_t(pEnd - pData) < 2)
+		{
+			return false;
+		}
+		size_t distance = size_t(pData[0]) | size_t(pData[1]) << 8;
+		pData += 2;
+
+		size_t matchLength = token & 0x0f;
+		if (15 == matchLength)
+		{
+			uint8_t byte;
+			do
+			{
+				if (pData == pEnd)
+				{
+					return false;
+				}
+				byte = *pData++;
+				matchLength += byte;
+			} while (255 == byte);
+		}
+		matchLength += kMinMatch;
+
+		if (0 == distance || distance > written || matchLength > output.size() - written)
+		{
+			return false;
+		}
+
+		// Matches may overlap what they write, so copy forwards a byte at a time
+		for (size_t i = 0; i < matchLength; ++i, ++written)
+		{
+			output[written] = output[written - distance];
+		}
+	}
+
+	return written == output.size();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Cache
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+CompressedBlob::CompressedBlob()
+: readerUses(0), originalSize(0), originalCrc(0), encodeCount(0)
+{
+}
+
+// Copies into `output` the encoded value from `offset`, for a read by the central `device` (its object path) of the value
+// `pData` (`length` bytes)
+//
+// A read at offset zero compares the value with the one we last encoded, and encodes it again only if it has changed. Reads at
+// later offsets (long reads) are served from the encoding that the central's read at offset zero returned, without looking at
+// the value, even if another central's read has encoded a newer one since. Returns false if `offset` is beyond the end of the
+// encoded value.
+bool CompressedBlob::read(const std::string &device, uint16_t offset, const uint8_t *pData, size_t length, Buffer &output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Reader &reader = getReader(device);
+	if (0 == offset)
+	{
+		uint32_t crc = Utils::crc32c(0, pData, length);
+		if (nullptr == pEncoded || length != originalSize || crc != originalCrc)
+		{
+			Buffer block;
+			compress(pData, length, block);
+
+			// A new buffer, so that centrals part way through a long read of the previous one keep it
+			Method method = block.size() < length ? EMethodLz4 : EMethodStored;
+			std::shared_ptr<Buffer> pBuffer = std::allocate_shared<Buffer>(TaggedAllocator<Buffer, EMemoryCache>());
+			pBuffer->push_back(uint8_t(method));
+			for (size_t i = 0; i < sizeof(uint32_t); ++i)
+			{
+				pBuffer->push_back(uint8_t(length >> (8 * i)));
+			}
+			if (EMethodLz4 == method)
+			{
+				pBuffer->insert(pBuffer->end(), block.begin(), block.end());
+			}
+			else
+			{
+				pBuffer->insert(pBuffer->end(), pData, pData + length);
+			}
+
+			pEncoded = pBuffer;
+			originalSize = length;
+			originalCrc = crc;
+			encodeCount += 1;
+		}
+
+		reader.pEncoded = pEncoded;
+	}
+
+	// A long read without a read at offset zero (from a central we've forgotten) is served from the latest encoding
+	std::shared_ptr<const Buffer> pServed = nullptr != reader.pEncoded ? reader.pEncoded : pEncoded;
+	if (nullptr == pServed || offset > pServed->size())
+	{
+		return false;
+	}
+
+	output.assign(pServed->begin() + offset, pServed->end());
+	return true;
+}
+
+// Returns the reader for the central `device`, creating it if needed (the caller must hold `mutex`)
+//
+// When we already have `kMaxReaders` readers, the least recently used is replaced.
+CompressedBlob::Reader &CompressedBlob::getReader(const std::string &device)
+{
+	readerUses += 1;
+
+	auto found = std::find_if(readers.begin(), readers.end(), [&device](const Reader &reader) { return reader.device == device; });
+	if (found == readers.end())
+	{
+		if (readers.size() < kMaxReaders)
+		{
+			readers.push_back(Reader());
+			found = readers.end() - 1;
+		}
+		else
+		{
+			found = std::min_element(readers.begin(), readers.end(),
+				[](const Reader &a, const Reader &b) { return a.lastUsed < b.lastUsed; });
+		}
+
+		*found = Reader{device, nullptr, 0};
+	}
+
+	found->lastUsed = readerUses;
+	return *found;
+}
+
+// Returns the number of times the value has been encoded
+uint64_t CompressedBlob::getEncodeCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return encodeCount;
+}
+
+}; // namespace ggk
@@ -0,0 +1,116 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The compressed form of a large value served by a characteristic flagged with `compressedRead()`, and its LZ4 codec
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of CompressedBlob.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+
+#include "MemoryStats.h"
+
+namespace ggk {
+
+class CompressedBlob
+{
+public:
+
+	// How the value that follows the header is encoded
+	enum Method
+	{
+		EMethodStored = 0x00,
+		EMethodLz4 = 0x01
+	};
+
+	// The size of the header of each served value: [u8 method][u32 original size]
+	static constexpr size_t kHeaderSize = 5;
+
+	// The UUID of the descriptor that advertises the encoding, and the encoding it reads
+	static constexpr const char *kEncodingDescriptorUuid = "6151F1A4-ECFA-4EE0-BBF7-50C1B04F4322";
+	static constexpr const char *kEncodingName = "lz4-block";
+
+	// An encoded value
+	typedef std::vector<uint8_t, TaggedAllocator<uint8_t, EMemoryCache>> Buffer;
+
+	// The most centrals we track long reads for (the least recently used is forgotten first)
+	static constexpr size_t kMaxReaders = 8;
+
+	//
+	// Codec
+	//
+
+	// Compresses `length` bytes at `pData` into `output` as an LZ4 block (see the discussion in CompressedBlob.cpp)
+	static void compress(const uint8_t *pData, size_t length, Buffer &output);
+
+	// Decompresses the LZ4 block of `length` bytes at `pData` into `output`, which must be sized to the original size
+	//
+	// Returns false if the block is malformed or doesn't fill `output` exactly.
+	static bool decompress(const uint8_t *pData, size_t length, Buffer &output);
+
+	//
+	// Cache
+	//
+
+	CompressedBlob();
+
+	CompressedBlob(const CompressedBlob &) = delete;
+	CompressedBlob &operator =(const CompressedBlob &) = delete;
+
+	// Copies into `output` the encoded value from `offset`, for a read by the central `device` (its object path) of the value
+	// `pData` (`length` bytes)
+	//
+	// A read at offset zero compares the value with the one we last encoded, and encodes it again only if it has changed. Reads at
+	// later offsets (long reads) are served from the encoding that the central's read at offset zero returned, without looking at
+	// the value, even if another central's read has encoded a newer one since. Returns false if `offset` is beyond the end of the
+	// encoded value.
+	bool read(const std::string &device, uint16_t offset, const uint8_t *pData, size_t length, Buffer &output);
+
+	// Returns the number of times the value has been encoded
+	uint64_t getEncodeCount() const;
+
+private:
+
+	// The encoding a central's long read is served from
+	struct Reader
+	{
+		std::string device;
+		std::shared_ptr<const Buffer> pEncoded;
+		uint64_t lastUsed;
+	};
+
+	// Returns the reader for the central `device`, creating it if needed (the caller must hold `mutex`)
+	Reader &getReader(const std::string &device);
+
+	std::shared_ptr<const Buffer> pEncoded;
+	std::vector<Reader> readers;
+	uint64_t readerUses;
+	size_t originalSize;
+	uint32_t originalCrc;
+	uint64_t encodeCount;
+	mutable std::mutex mutex;
+};
+
+}; // namespace ggk
@@ -0,0 +1,336 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Selection and application of connection profiles (LE connection parameters and PHY)
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Our notification throughput is limited by the connection interval and the PHY. A short interval and the LE 2M PHY move data
+// quickly but cost power on both ends of the link, so we only want them while we are actually streaming.
+//
+// A profile (see `GGKConnectionProfile`) bundles a set of connection parameters with a PHY preference. The application sets a
+// baseline profile and characteristics may request a higher profile while a client is subscribed to their notifications (see
+// `GattCharacteristic::connectionProfile()`.) Subscriptions only record the request; the highest requested profile is applied
+// from the periodic timer (see `tick()`), so a StartNotify call is answered without waiting on the management commands:
+//
+//     "Set Default System Configuration" sets the default LE connection parameters (newer kernels only)
+//     "Load Connection Parameters" sets the parameters for each connected device
+//     "Set PHY Configuration" selects (or deselects) the LE 2M PHY
+//
+// The kernel applies the stored parameters when it next negotiates them, which on an established link may be never. Since the
+// point of a profile is to speed up a link that's already streaming, each connected device's link is also updated with the HCI
+// "LE Connection Update" command (which a peripheral may send from Bluetooth 4.1 on), written to a raw HCI socket. We don't
+// wait for the controller to answer: the kernel follows the LE Connection Update Complete event and a refused update simply
+// leaves the link as it was. Note that the LE data length is negotiated by the controller and is not exposed by the management
+// API.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <sys/ioctl.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "ConnectionProfiles.h"
+#include "Logger.h"
+#include "Utils.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// The status returned by the kernel for commands it does not know
+static const uint8_t kStatusUnknownCommand = 0x01;
+
+// Our profiles, indexed by GGKConnectionProfile
+const ConnectionProfiles::Parameters ConnectionProfiles::kProfiles[] =
+{
+	// name           min   max   latency  timeout  2M PHY
+	{ "idle",          80,  160,        4,     600,  false },  // EConnectionProfileIdle
+	{ "interactive",   12,   24,        0,     400,  true  },  // EConnectionProfileInteractive
+	{ "bulk",           6,   12,        0,     400,  true  },  // EConnectionProfileBulk
+};
+
+// Private constructor for our Singleton
+ConnectionProfiles::ConnectionProfiles()
+: baseProfile(EConnectionProfileIdle),
+  profilesRequested(false),
+  profileApplied(false),
+  appliedProfile(EConnectionProfileIdle),
+  appliedConnectionCount(0),
+  defaultParametersSupported(true),
+  phySupported(true)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Profile requests
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the baseline profile, used whenever no streaming characteristic requests a higher one (may be called from any thread)
+void ConnectionProfiles::setBaseProfile(GGKConnectionProfile profile)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	baseProfile = profile;
+	profilesRequested = true;
+}
+
+// Records that the characteristic at `path` started streaming with `profile` (may be called from any thread)
+//
+// This only records the request; the resulting profile is applied by the next `tick()`, so that the method call that started
+// the stream isn't held up by the management commands.
+void ConnectionProfiles::beginStreaming(const std::string &path, GGKConnectionProfile profile)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		streams[path] = profile;
+		profilesRequested = true;
+	}
+
+	Logger::debug(SSTR << "Streaming started for '" << path << "' (" << kProfiles[profile].pName << " profile)");
+}
+
+// Records that the characteristic at `path` stopped streaming (may be called from any thread)
+//
+// As with `beginStreaming()`, the resulting profile is applied by the next `tick()`.
+void ConnectionProfiles::endStreaming(const std::string &path)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		streams.erase(path);
+	}
+
+	Logger::debug(SSTR << "Streaming stopped for '" << path << "'");
+}
+
+// Applies the requested profile if it (or the set of connected devices) changed since it was last applied
+//
+// This is called from the periodic timer (on the server thread) once our application has been registered with BlueZ.
+void ConnectionProfiles::tick()
+{
+	// Leave the kernel's defaults alone until somebody asks for a profile
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!profilesRequested)
+		{
+			return;
+		}
+	}
+
+	int connectionCount = HciAdapter::getInstance().getActiveConnectionCount();
+
+	// Without connections, nobody is subscribed any longer
+	if (0 == connectionCount)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		streams.clear();
+	}
+
+	GGKConnectionProfile profile = getRequestedProfile();
+	if (profileApplied && profile == appliedProfile && connectionCount == appliedConnectionCount)
+	{
+		return;
+	}
+
+	// Whatever the result, don't retry until something changes
+	profileApplied = true;
+	appliedProfile = profile;
+	appliedConnectionCount = connectionCount;
+
+	apply(profile);
+}
+
+// Returns the highest of the baseline profile and all streaming profiles
+GGKConnectionProfile ConnectionProfiles::getRequestedProfile()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GGKConnectionProfile profile = baseProfile;
+	for (const auto &stream : streams)
+	{
+		profile = std::max(profile, stream.second);
+	}
+
+	return profile;
+}
+
+// Applies `profile` to the controller and to every connected device
+bool ConnectionProfiles::apply(GGKConnectionProfile profile)
+{
+	const Parameters &parameters = kProfiles[profile];
+
+	if (nullptr == pMgmt)
+	{
+		pMgmt.reset(new Mgmt());
+	}
+
+	bool success = true;
+
+	// Default parameters (for devices that connect later)
+	if (defaultParametersSupported)
+	{
+		if (!pMgmt->setDefaultConnectionParameters(parameters.minInterval, parameters.maxInterval, parameters.latency, parameters.supervisionTimeout))
+		{
+			if (HciAdapter::getInstance().getLastCommandStatus() == kStatusUnknownCommand)
+			{
+				Logger::info("Default connection parameters are not supported by this kernel");
+				defaultParametersSupported = false;
+			}
+			else
+			{
+				success = false;
+			}
+		}
+	}
+
+	// Parameters for our connected devices
+	std::vector<HciAdapter::ConnectedDevice> devices = HciAdapter::getInstance().getConnectedDevices();
+	std::vector<Mgmt::ConnectionParameters> deviceParameters;
+	for (const HciAdapter::ConnectedDevice &device : devices)
+	{
+		Mgmt::ConnectionParameters entry;
+		std::copy(device.address, device.address + sizeof(entry.address), entry.address);
+		entry.addressType = device.addressType;
+		entry.minInterval = parameters.minInterval;
+		entry.maxInterval = parameters.maxInterval;
+		entry.latency = parameters.latency;
+		entry.supervisionTimeout = parameters.supervisionTimeout;
+		deviceParameters.push_back(entry);
+	}
+
+	if (!deviceParameters.empty() && !pMgmt->loadConnectionParameters(deviceParameters))
+	{
+		success = false;
+	}
+
+	// The stored parameters only take effect when they're next negotiated, so update the established links as well
+	int updatedCount = 0;
+	for (const HciAdapter::ConnectedDevice &device : devices)
+	{
+		updatedCount += updateConnection(device, parameters) ? 1 : 0;
+	}
+
+	// PHY selection
+	if (phySupported)
+	{
+		if (!pMgmt->getPhyConfiguration())
+		{
+			if (HciAdapter::getInstance().getLastCommandStatus() == kStatusUnknownCommand)
+			{
+				Logger::info("PHY configuration is not supported by this kernel");
+				phySupported = false;
+			}
+			else
+			{
+				success = false;
+			}
+		}
+		else
+		{
+			HciAdapter::PhyConfiguration phy = HciAdapter::getInstance().getPhyConfiguration();
+			uint32_t le2M = Mgmt::EPhyLE2MTx | Mgmt::EPhyLE2MRx;
+			uint32_t selected = phy.selectedPhys & ~le2M;
+			if (parameters.use2MPhy)
+			{
+				selected |= phy.supportedPhys & phy.configurablePhys & le2M;
+			}
+
+			if (selected != phy.selectedPhys && !pMgmt->setPhyConfiguration(selected))
+			{
+				success = false;
+			}
+		}
+	}
+
+	Logger::info(SSTR << "Applied the '" << parameters.pName << "' connection profile to " << deviceParameters.size() << " connected device(s), "
+		<< updatedCount << " link update(s) requested" << (success ? "" : " (with errors)"));
+
+	return success;
+}
+
+// Asks the controller to update the established link to `device` to `parameters` (see the discussion at the top of this file)
+//
+// This writes the HCI "LE Connection Update" command to a raw HCI socket and returns without waiting for the controller's answer.
+//
+// Returns true if the command was sent, otherwise false
+bool ConnectionProfiles::updateConnection(const HciAdapter::ConnectedDevice &device, const Parameters &parameters)
+{
+	struct SCommand
+	{
+		uint8_t packetType;
+		hci_command_hdr header;
+		le_connection_update_cp update;
+	} __attribute__((packed));
+
+	int fdSocket = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+	if (fdSocket < 0)
+	{
+		Logger::warn(SSTR << "Unable to open a raw HCI socket to update a connection: " << strerror(errno));
+		return false;
+	}
+
+	struct sockaddr_hci addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.hci_family = AF_BLUETOOTH;
+	addr.hci_dev = pMgmt->getControllerIndex();
+	addr.hci_channel = HCI_CHANNEL_RAW;
+
+	// Find the handle of the device's LE link
+	uint8_t connectionInfo[sizeof(struct hci_conn_info_req) + sizeof(struct hci_conn_info)];
+	memset(connectionInfo, 0, sizeof(connectionInfo));
+	struct hci_conn_info_req *pRequest = reinterpret_cast<struct hci_conn_info_req *>(connectionInfo);
+	memcpy(&pRequest->bdaddr, device.address, sizeof(pRequest->bdaddr));
+	pRequest->type = LE_LINK;
+
+	bool sent = false;
+	if (bind(fdSocket, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+	{
+		Logger::warn(SSTR << "Unable to bind a raw HCI socket to update a connection: " << strerror(errno));
+	}
+	else if (ioctl(fdSocket, HCIGETCONNINFO, pRequest) < 0)
+	{
+		Logger::debug(SSTR << "No LE link to update for " << Utils::hex(device.address, sizeof(device.address)) << ": " << strerror(errno));
+	}
+	else
+	{
+		SCommand command;
+		command.packetType = HCI_COMMAND_PKT;
+		command.header.opcode = Utils::endianToHci(static_cast<uint16_t>(cmd_opcode_pack(OGF_LE_CTL, OCF_LE_CONN_UPDATE)));
+		command.header.plen = sizeof(command.update);
+		command.update.handle = Utils::endianToHci(pRequest->conn_info[0].handle);
+		command.update.min_interval = Utils::endianToHci(parameters.minInterval);
+		command.update.max_interval = Utils::endianToHci(parameters.maxInterval);
+		command.update.latency = Utils::endianToHci(parameters.latency);
+		command.update.supervision_timeout = Utils::endianToHci(parameters.supervisionTimeout);
+		command.update.min_ce_length = 0;
+		command.update.max_ce_length = 0;
+
+		sent = write(fdSocket, &command, sizeof(command)) == static_cast<ssize_t>(sizeof(command));
+		if (!sent)
+		{
+			Logger::warn(SSTR << "Unable to send the LE Connection Update command: " << strerror(errno));
+		}
+	}
+
+	close(fdSocket);
+	return sent;
+}
+
+}; // namespace ggk
@@ -0,0 +1,134 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Selection and application of connection profiles (LE connection parameters and PHY)
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of ConnectionProfiles.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "../include/Gobbledegook.h"
+#include "Mgmt.h"
+#include "HciAdapter.h"
+
+namespace ggk {
+
+class ConnectionProfiles
+{
+public:
+
+	//
+	// Types
+	//
+
+	// The settings for a single profile
+	//
+	// Intervals are in units of 1.25ms and the supervision timeout is in units of 10ms.
+	struct Parameters
+	{
+		const char *pName;
+		uint16_t minInterval;
+		uint16_t maxInterval;
+		uint16_t latency;
+		uint16_t supervisionTimeout;
+		bool use2MPhy;
+	};
+
+	//
+	// Constants
+	//
+
+	// Our profiles, indexed by GGKConnectionProfile
+	static const Parameters kProfiles[];
+
+	//
+	// Accessors
+	//
+
+	// Returns the instance to this singleton class
+	static ConnectionProfiles &getInstance()
+	{
+		static ConnectionProfiles instance;
+		return instance;
+	}
+
+	//
+	// Disallow copies of our singleton (c++11)
+	//
+	ConnectionProfiles(ConnectionProfiles const&) = delete;
+	void operator=(ConnectionProfiles const&) = delete;
+
+	//
+	// Profile requests
+	//
+
+	// Sets the baseline profile, used whenever no streaming characteristic requests a higher one (may be called from any thread)
+	void setBaseProfile(GGKConnectionProfile profile);
+
+	// Records that the characteristic at `path` started streaming with `profile` (may be called from any thread)
+	//
+	// This only records the request; the resulting profile is applied by the next `tick()`, so that the method call that started
+	// the stream isn't held up by the management commands.
+	void beginStreaming(const std::string &path, GGKConnectionProfile profile);
+
+	// Records that the characteristic at `path` stopped streaming (may be called from any thread)
+	//
+	// As with `beginStreaming()`, the resulting profile is applied by the next `tick()`.
+	void endStreaming(const std::string &path);
+
+	// Applies the requested profile if it (or the set of connected devices) changed since it was last applied
+	//
+	// This is called from the periodic timer (on the server thread) once our application has been registered with BlueZ.
+	void tick();
+
+private:
+	// Private constructor for our Singleton
+	ConnectionProfiles();
+
+	// Returns the highest of the baseline profile and all streaming profiles
+	GGKConnectionProfile getRequestedProfile();
+
+	// Applies `profile` to the controller and to every connected device
+	bool apply(GGKConnectionProfile profile);
+
+	// Asks the controller to update the established link to `device` to `parameters` (see the discussion in ConnectionProfiles.cpp)
+	bool updateConnection(const HciAdapter::ConnectedDevice &device, const Parameters &parameters);
+
+	// Requests (guarded by `mutex`)
+	std::mutex mutex;
+	GGKConnectionProfile baseProfile;
+	bool profilesRequested;
+	std::map<std::string, GGKConnectionProfile> streams;
+
+	// Runtime state (server thread only)
+	std::unique_ptr<Mgmt> pMgmt;
+	bool profileApplied;
+	GGKConnectionProfile appliedProfile;
+	int appliedConnectionCount;
+	bool defaultParametersSupported;
+	bool phySupported;
+};
+
+}; // namespace ggk
@@ -165,6 +165,20 @@ void DBusInterface::tickEvents(GDBusConnection *pConnection, void *pUserData) co
 	}
 }
 
+// Returns true if any of this interface's events will fire on the next tick
+bool DBusInterface::hasDueEvents() const
+{
+	for (const TickEvent &event : events)
+	{
+		if (event.isDue())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 // Internal method used to generate introspection XML used to describe our services on D-Bus
 std::string DBusInterface::generateIntrospectionXML(int depth) const
 {
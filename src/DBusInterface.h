@@ -28,6 +28,7 @@
 
 #include "TickEvent.h"
 #include "DBusMethod.h"
+#include "MemoryStats.h"
 
 namespace ggk {
 
@@ -121,14 +122,17 @@ struct DBusInterface
 	// their subclass type.
 	virtual void tickEvents(GDBusConnection *pConnection, void *pUserData) const;
 
+	// Returns true if any of this interface's events will fire on the next tick
+	bool hasDueEvents() const;
+
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
 	virtual std::string generateIntrospectionXML(int depth) const;
 
 protected:
 	DBusObject &owner;
 	std::string name;
-	std::list<DBusMethod> methods;
-	std::list<TickEvent> events;
+	TaggedList<DBusMethod, EMemorySchema> methods;
+	TaggedList<TickEvent, EMemorySchema> events;
 };
 
 }; // namespace ggk
\ No newline at end of file
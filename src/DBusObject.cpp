@@ -45,6 +45,7 @@
 #include "Utils.h"
 #include "GattUuid.h"
 #include "Logger.h"
+#include "Capture.h"
 
 namespace ggk {
 
@@ -107,7 +108,7 @@ DBusObject &DBusObject::getParent()
 }
 
 // Returns the list of children objects
-const std::list<DBusObject> &DBusObject::getChildren() const
+const DBusObject::ChildList &DBusObject::getChildren() const
 {
 	return children;
 }
@@ -131,7 +132,7 @@ const DBusObject::InterfaceList &DBusObject::getInterfaces() const
 GattService &DBusObject::gattServiceBegin(const std::string &pathElement, const GattUuid &uuid)
 {
 	DBusObject &child = addChild(DBusObjectPath(pathElement));
-	GattService &service = *child.addInterface(std::make_shared<GattService>(child, "org.bluez.GattService1"));
+	GattService &service = *child.addInterface(std::allocate_shared<GattService>(TaggedAllocator<GattService, EMemorySchema>(), child, "org.bluez.GattService1"));
 	service.addProperty<GattService>("UUID", uuid);
 	service.addProperty<GattService>("Primary", true);
 	return service;
@@ -258,6 +259,13 @@ std::string DBusObject::generateIntrospectionXML(int depth) const
 // Emits a signal on the bus from the given path, interface name and signal name, containing a GVariant set of parameters
 void DBusObject::emitSignal(GDBusConnection *pBusConnection, const std::string &interfaceName, const std::string &signalName, GVariant *pParameters)
 {
+	// Record the signal before emitting it, since emitting consumes a floating `pParameters`
+	if (Capture::getInstance().isRecording())
+	{
+		Capture::getInstance().recordDBus(ECaptureSignal, Capture::nowUS(), nullptr, getPath().c_str(), interfaceName.c_str(),
+			signalName.c_str(), pParameters);
+	}
+
 	GError *pError = nullptr;
 	gboolean result = g_dbus_connection_emit_signal
 	(
@@ -28,6 +28,7 @@
 #include <memory>
 
 #include "DBusObjectPath.h"
+#include "MemoryStats.h"
 
 namespace ggk {
 
@@ -39,7 +40,10 @@ struct DBusInterface;
 struct DBusObject
 {
 	// A convenience typedef for describing our list of interface
-	typedef std::list<std::shared_ptr<DBusInterface> > InterfaceList;
+	typedef TaggedList<std::shared_ptr<DBusInterface>, EMemorySchema> InterfaceList;
+
+	// A convenience typedef for describing our list of children
+	typedef TaggedList<DBusObject, EMemorySchema> ChildList;
 
 	// Construct a root object with no parent
 	//
@@ -72,7 +76,7 @@ struct DBusObject
 	DBusObject &getParent();
 
 	// Returns the list of children objects
-	const std::list<DBusObject> &getChildren() const;
+	const ChildList &getChildren() const;
 
 	// Add a child to this object
 	DBusObject &addChild(const DBusObjectPath &pathElement);
@@ -122,7 +126,7 @@ private:
 	bool publish;
 	DBusObjectPath path;
 	InterfaceList interfaces;
-	std::list<DBusObject> children;
+	ChildList children;
 	DBusObject *pParent;
 };
 
@@ -22,6 +22,9 @@
 //
 // In addition to this functionality, our DBusObjectPath is its own distinct type requiring explicit conversion, providing a level
 // of protection against accidentally using an arbitrary string as an object path.
+//
+// Paths are built and compared on every D-Bus request (each step of a search through the object tree concatenates a path), so
+// their storage comes from the transient pool rather than the heap.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #pragma once
@@ -29,6 +32,8 @@
 #include <string>
 #include <ostream>
 
+#include "Pool.h"
+
 namespace ggk {
 
 struct DBusObjectPath
@@ -47,10 +52,10 @@ struct DBusObjectPath
 	// Constructor that accepts a std::string
 	//
 	// Note: explicit because we don't want accidental conversion. Creating a DBusObjectPath must be intentional.
-	inline explicit DBusObjectPath(const std::string &path) : path(path) {}
+	inline explicit DBusObjectPath(const std::string &path) : path(path.c_str(), path.length()) {}
 
 	// Explicit conversion to std::string
-	inline const std::string &toString() const { return path; }
+	inline std::string toString() const { return std::string(path.c_str(), path.length()); }
 
 	// Explicit conversion to a C string
 	inline const char *c_str() const { return path.c_str(); }
@@ -140,7 +145,7 @@ struct DBusObjectPath
 
 private:
 
-	std::string path;
+	PooledString path;
 };
 
 // Mixed-mode override for adding a DBusObjectPath to a C string, returning a new DBusObjectPath result
@@ -152,14 +157,14 @@ inline DBusObjectPath operator +(const std::string &lhs, const DBusObjectPath &r
 // Streaming support for our DBusObjectPath (useful for our logging mechanism)
 inline std::ostream& operator<<(std::ostream &os, const DBusObjectPath &path)
 {
-    os << path.toString();
+    os << path.c_str();
     return os;
 }
 
 // Streaming support for our DBusObjectPath (useful for our logging mechanism)
 inline std::ostream& operator +(std::ostream &os, const DBusObjectPath &path)
 {
-    os << path.toString();
+    os << path.c_str();
     return os;
 }
 
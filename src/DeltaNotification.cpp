@@ -0,0 +1,221 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Delta-encoded notifications for characteristics flagged with `deltaNotify()`, and a reference decoder
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Structured values (the 10-byte time struct from `ServerUtils::gvariantCurrentTime()`, our packed composites, configuration
+// structs) usually change in a field or two between notifications, yet each notification carries the whole value. A
+// characteristic flagged with `deltaNotify()` declares its value as a list of fixed-size fields, and its notifications (sent by
+// its `onUpdatedValue` as usual) are encoded against the last value sent:
+//
+//     Keyframe    [u8 0x80 | sequence][the whole value]
+//     Delta       [u8 sequence][change mask][the changed fields, in order]
+//
+// The sequence number counts notifications (modulo 128.) The change mask has a bit per field, least significant bit first,
+// padded to whole bytes: bit `i % 8` of mask byte `i / 8` is set if field `i` is in the delta. A delta is only sent when it's
+// smaller than a keyframe; otherwise, and for the first notification, every `keyframeInterval` notifications and whenever the
+// value (or the last value sent) doesn't match the layout, a keyframe is sent.
+//
+// BlueZ sends each notification to every subscriber, so the last value sent is kept once per characteristic: its subscribers are
+// one group that has all seen the same notifications. When the first central subscribes (BlueZ calls StartNotify), the next
+// notification is a keyframe. A subscriber that joins part way through (or misses a notification, which the sequence number
+// shows) can't apply deltas until the next keyframe, so the keyframe interval bounds how long that takes. It can read the
+// characteristic in the meantime; reads always return the whole value.
+//
+// `DeltaDecoder` is a reference decoder for centrals (and for the bench.) The encoder keeps its state under a mutex, since with
+// dispatch shards a characteristic may be notified from the server's thread and from its shard's thread. Characteristics send
+// each notification under the same mutex (see `encodeAndSend()`), so that notifications go out in the order they were encoded.
+// Otherwise a delta could overtake the notification it was encoded against.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+
+#include "DeltaNotification.h"
+
+namespace ggk {
+
+// Returns the size of the layout `fieldSizes`
+static size_t getLayoutSize(const std::vector<size_t> &fieldSizes)
+{
+	size_t size = 0;
+	for (size_t fieldSize : fieldSizes)
+	{
+		size += fieldSize;
+	}
+	return size;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Encoder
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Constructs an encoder for values laid out as fields of `fieldSizes` bytes, with a keyframe at least every
+// `keyframeInterval` notifications
+DeltaEncoder::DeltaEncoder(const std::vector<size_t> &fieldSizes, int keyframeInterval)
+: fieldSizes(fieldSizes), layoutSize(getLayoutSize(fieldSizes)), keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1),
+  sequence(0), sinceKeyframe(0), keyframeRequested(true)
+{
+}
+
+// Encodes the notification of `length` bytes at `pValue` into `output`, as a keyframe or as a delta from the last value sent
+void DeltaEncoder::encode(const uint8_t *pValue, size_t length, DeltaBuffer &output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	encodeLocked(pValue, length, output);
+}
+
+// Encodes the notification of `length` bytes at `pValue` and passes it to `send` before any other notification is encoded
+//
+// Each delta applies to the notification encoded before it, so when notifications may be sent from more than one thread, they
+// must be sent in the order they were encoded. `send` is called under our lock to keep that order.
+void DeltaEncoder::encodeAndSend(const uint8_t *pValue, size_t length, const SendFunction &send)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	DeltaBuffer encoded;
+	encodeLocked(pValue, length, encoded);
+	send(encoded);
+}
+
+// Encodes as `encode()` does (the caller must hold `mutex`)
+void DeltaEncoder::encodeLocked(const uint8_t *pValue, size_t length, DeltaBuffer &output)
+{
+	output.clear();
+	output.push_back(sequence & kSequenceMask);
+
+	// A delta compares `layoutSize` bytes of both values, so both must match the layout
+	bool keyframe = keyframeRequested || length != layoutSize || lastValue.size() != layoutSize
+		|| sinceKeyframe + 1 >= keyframeInterval;
+	if (!keyframe)
+	{
+		// The mask, then each changed field
+		size_t maskSize = (fieldSizes.size() + 7) / 8;
+		output.resize(1 + maskSize, 0);
+
+		size_t offset = 0;
+		for (size_t field = 0; field < fieldSizes.size(); ++field)
+		{
+			if (0 != memcmp(pValue + offset, lastValue.data() + offset, fieldSizes[field]))
+			{
+				output[1 + field / 8] |= uint8_t(1 << (field % 8));
+				output.insert(output.end(), pValue + offset, pValue + offset + fieldSizes[field]);
+			}
+			offset += fieldSizes[field];
+		}
+
+		// Only send a delta when it saves something
+		keyframe = output.size() >= 1 + length;
+	}
+
+	if (keyframe)
+	{
+		output.resize(1);
+		output[0] |= kKeyframeFlag;
+		output.insert(output.end(), pValue, pValue + length);
+		sinceKeyframe = 0;
+		keyframeRequested = false;
+	}
+	else
+	{
+		sinceKeyframe += 1;
+	}
+
+	lastValue.assign(pValue, pValue + length);
+	sequence = (sequence + 1) & kSequenceMask;
+}
+
+// Makes the next notification a keyframe
+void DeltaEncoder::requestKeyframe()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	keyframeRequested = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reference decoder
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Constructs a decoder for values laid out as fields of `fieldSizes` bytes
+DeltaDecoder::DeltaDecoder(const std::vector<size_t> &fieldSizes)
+: fieldSizes(fieldSizes), layoutSize(getLayoutSize(fieldSizes)), nextSequence(0), valid(false)
+{
+}
+
+// Applies the notification of `length` bytes at `pData` to our value
+DeltaDecoder::Result DeltaDecoder::apply(const uint8_t *pData, size_t length)
+{
+	if (0 == length)
+	{
+		return EMalformed;
+	}
+
+	uint8_t header = pData[0];
+	uint8_t sequence = header & DeltaEncoder::kSequenceMask;
+	bool inSequence = sequence == nextSequence;
+	nextSequence = (sequence + 1) & DeltaEncoder::kSequenceMask;
+
+	if (0 != (header & DeltaEncoder::kKeyframeFlag))
+	{
+		value.assign(pData + 1, pData + length);
+		valid = true;
+		return EKeyframe;
+	}
+
+	if (!valid || !inSequence || value.size() != layoutSize)
+	{
+		valid = false;
+		return EMissed;
+	}
+
+	size_t maskSize = (fieldSizes.size() + 7) / 8;
+	if (length < 1 + maskSize)
+	{
+		valid = false;
+		return EMalformed;
+	}
+
+	const uint8_t *pMask = pData + 1;
+	const uint8_t *pField = pMask + maskSize;
+	const uint8_t *pEnd = pData + length;
+
+	size_t offset = 0;
+	for (size_t field = 0; field < fieldSizes.size(); ++field)
+	{
+		if (0 != (pMask[field / 8] & (1 << (field % 8))))
+		{
+			if (size_t(pEnd - pField) < fieldSizes[field])
+			{
+				valid = false;
+				return EMalformed;
+			}
+
+			memcpy(value.data() + offset, pField, fieldSizes[field]);
+			pField += fieldSizes[field];
+		}
+		offset += fieldSizes[field];
+	}
+
+	if (pField != pEnd)
+	{
+		valid = false;
+		return EMalformed;
+	}
+
+	return EDelta;
+}
+
+}; // namespace ggk
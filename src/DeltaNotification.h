@@ -0,0 +1,125 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Delta-encoded notifications for characteristics flagged with `deltaNotify()`, and a reference decoder
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of DeltaNotification.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+#include "MemoryStats.h"
+
+namespace ggk {
+
+// An encoded notification, or a decoded value
+typedef std::vector<uint8_t, TaggedAllocator<uint8_t, EMemoryCache>> DeltaBuffer;
+
+class DeltaEncoder
+{
+public:
+
+	// The header's keyframe flag; the rest of the header is the sequence number
+	static constexpr uint8_t kKeyframeFlag = 0x80;
+	static constexpr uint8_t kSequenceMask = 0x7f;
+
+	// Constructs an encoder for values laid out as fields of `fieldSizes` bytes, with a keyframe at least every
+	// `keyframeInterval` notifications
+	DeltaEncoder(const std::vector<size_t> &fieldSizes, int keyframeInterval);
+
+	DeltaEncoder(const DeltaEncoder &) = delete;
+	DeltaEncoder &operator =(const DeltaEncoder &) = delete;
+
+	// Sends an encoded notification
+	typedef std::function<void(const DeltaBuffer &encoded)> SendFunction;
+
+	// Encodes the notification of `length` bytes at `pValue` into `output`, as a keyframe or as a delta from the last value sent
+	void encode(const uint8_t *pValue, size_t length, DeltaBuffer &output);
+
+	// Encodes the notification of `length` bytes at `pValue` and passes it to `send` before any other notification is encoded
+	//
+	// Each delta applies to the notification encoded before it, so when notifications may be sent from more than one thread, they
+	// must be sent in the order they were encoded. `send` is called under our lock to keep that order.
+	void encodeAndSend(const uint8_t *pValue, size_t length, const SendFunction &send);
+
+	// Makes the next notification a keyframe
+	void requestKeyframe();
+
+private:
+
+	// Encodes as `encode()` does (the caller must hold `mutex`)
+	void encodeLocked(const uint8_t *pValue, size_t length, DeltaBuffer &output);
+
+	std::vector<size_t> fieldSizes;
+	size_t layoutSize;
+	int keyframeInterval;
+	DeltaBuffer lastValue;
+	uint8_t sequence;
+	int sinceKeyframe;
+	bool keyframeRequested;
+	std::mutex mutex;
+};
+
+class DeltaDecoder
+{
+public:
+
+	// The outcome of applying a notification
+	enum Result
+	{
+		// The value was replaced by a keyframe
+		EKeyframe,
+
+		// The changed fields were applied to the value
+		EDelta,
+
+		// A delta can't be applied (we have no value yet, or missed a notification); wait for the next keyframe
+		EMissed,
+
+		// The notification doesn't match the layout
+		EMalformed
+	};
+
+	// Constructs a decoder for values laid out as fields of `fieldSizes` bytes
+	DeltaDecoder(const std::vector<size_t> &fieldSizes);
+
+	// Applies the notification of `length` bytes at `pData` to our value
+	Result apply(const uint8_t *pData, size_t length);
+
+	// Returns the current value (valid after a keyframe, until a notification is missed)
+	const DeltaBuffer &getValue() const { return value; }
+
+	// Returns true if we hold a current value
+	bool isValid() const { return valid; }
+
+private:
+
+	std::vector<size_t> fieldSizes;
+	size_t layoutSize;
+	DeltaBuffer value;
+	uint8_t nextSequence;
+	bool valid;
+};
+
+}; // namespace ggk
@@ -0,0 +1,612 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Dispatch of our object tree across several threads and bus connections, partitioned by service
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Every D-Bus call to our objects is normally dispatched on the server's thread, one at a time. With a busy central (or several
+// centrals) reading and writing different services, that one thread is the limit on our throughput, however many cores the
+// device has.
+//
+// With `ggkSetDispatchShards()`, our services are dealt out to that many shards, round-robin in the order they are declared in
+// the server description. Shard 0 is the server's own thread and connection. Every other shard has a thread running its own
+// GMainContext and its own connection to the system bus, on which it registers its services' objects (along with an
+// ObjectManager at "/") and then registers itself with BlueZ's GATT manager as a separate application. BlueZ calls each service
+// through the connection that registered it, so calls to services on different shards are dispatched in parallel, each by the
+// same entry points as always (`onMethodCall()` and friends in Init.cpp.)
+//
+// Each connection's `GetManagedObjects` reports only the services of its own shard (see `ServerUtils::getManagedObjects()`.) The
+// server's own connection still registers the whole tree, so introspecting it shows everything, but it only tells BlueZ about the
+// services of shard 0.
+//
+// Updates from the update queue are popped by the server's idle loop as always. Those for characteristics owned by another shard
+// are handed to that shard in a batch, and the shard calls their `onUpdatedValue` handlers on its thread with its connection.
+// Tick events still run on the server's thread; the notifications they send go out on the owning shard's connection (see
+// `getConnection()`.) Fast reads (see FastRead.cpp) are only installed on the server's own connection.
+//
+// The shards are set up from the server's thread: the partitioning is done once the object tree is registered, and the
+// connections and registrations are made before the shards' threads start. The routing tables (the shards and the services and
+// characteristics dealt to them) are read from every thread that dispatches a call or sends a notification, so they are guarded
+// by a reader-writer lock: lookups share it, and only `assign()`, `start()` and `stop()` take it exclusively, for as long as it
+// takes to swap the tables in or out. Connecting the shards and joining their threads happen outside of the lock, so a shard's
+// thread can never be waiting for it while `stop()` waits for the thread.
+//
+// Sharding moves the handlers in the server description onto several threads, so they must be thread-safe. The application's data
+// getter and setter are called from those threads too, but never two at once (see `DosellGatt::getData()`), so an application
+// written for a single dispatch thread keeps working. Values prefetched by the batch data getter are only served on the server's
+// thread. Timers and connection profile changes requested from a shard's handlers are passed to the server's thread (see
+// `AsyncReply::after()` and `GattCharacteristic::connectionProfile()`.) Note that GDBus
+// reads and writes the messages of every connection in the process on a single worker thread, so sharding parallelizes the work of
+// dispatch (handlers, value conversion and replies) but not the transport itself.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "DispatchShards.h"
+#include "DosellGatt.h"
+#include "DBusObject.h"
+#include "DBusInterface.h"
+#include "GattService.h"
+#include "GattCharacteristic.h"
+#include "Init.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Shards
+//
+
+// A shard's thread, loop and connection (shard 0 is the server's own and has none of these)
+struct Shard
+{
+	GMainContext *pContext = nullptr;
+	GMainLoop *pLoop = nullptr;
+	GDBusConnection *pConnection = nullptr;
+	RegisteredObjectIds objectIds;
+	std::thread thread;
+};
+
+// A batch of updates handed to a shard's thread (see `post()`)
+struct UpdateBatch
+{
+	std::vector<std::shared_ptr<const GattCharacteristic>> characteristics;
+	GDBusConnection *pConnection;
+	void *pUserData;
+};
+
+static std::atomic<int> shardCount(1);
+static std::atomic<bool> bRunning(false);
+static std::vector<std::unique_ptr<Shard>> shards;
+
+//
+// Partitioning
+//
+
+static std::vector<std::pair<const DBusObject *, int>> services;
+static std::unordered_map<std::string, int> serviceShards;
+static std::unordered_map<const GattCharacteristic *, int> characteristicShards;
+
+// Guards `shards`, `bRunning` changes and the partitioning tables (see the discussion above)
+static std::shared_mutex tablesMutex;
+
+//
+// Application registration
+//
+
+static DispatchShards::StartedCallback startedCallback = nullptr;
+static int pendingApplications = 0;
+static bool applicationsFailed = false;
+static int generation = 0;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Partitioning
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the number of shards (1, the default, dispatches everything on the server's thread)
+//
+// This must be called before the server is started.
+void DispatchShards::setShardCount(int count)
+{
+	shardCount = std::max(1, std::min(count, kMaxShards));
+}
+
+// Returns the number of shards
+int DispatchShards::getShardCount()
+{
+	return shardCount;
+}
+
+// Records `shard` as the owner of every characteristic within `object` (and its children) in `characteristicMap`
+static void assignCharacteristics(const DBusObject &object, int shard, std::unordered_map<const GattCharacteristic *, int> &characteristicMap)
+{
+	for (std::shared_ptr<const DBusInterface> pInterface : object.getInterfaces())
+	{
+		if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
+		{
+			characteristicMap[pCharacteristic.get()] = shard;
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		assignCharacteristics(child, shard, characteristicMap);
+	}
+}
+
+// Deals each service within `object` (and its children) to the next shard, recording them in `serviceList` and `serviceMap`
+static void assignServices(const DBusObject &object, int &serviceIndex, std::vector<std::pair<const DBusObject *, int>> &serviceList,
+	std::unordered_map<std::string, int> &serviceMap, std::unordered_map<const GattCharacteristic *, int> &characteristicMap)
+{
+	for (std::shared_ptr<const DBusInterface> pInterface : object.getInterfaces())
+	{
+		if (TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattService))
+		{
+			int shard = serviceIndex++ % shardCount;
+			serviceList.push_back(std::make_pair(&object, shard));
+			serviceMap[object.getPath().toString()] = shard;
+			assignCharacteristics(object, shard, characteristicMap);
+			return;
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		assignServices(child, serviceIndex, serviceList, serviceMap, characteristicMap);
+	}
+}
+
+// Deals our services to the shards (from the server's thread, before any objects are registered with BlueZ)
+//
+// The tables are built aside and swapped in, so lookups from other threads only wait for the swap.
+void DispatchShards::assign()
+{
+	std::vector<std::pair<const DBusObject *, int>> serviceList;
+	std::unordered_map<std::string, int> serviceMap;
+	std::unordered_map<const GattCharacteristic *, int> characteristicMap;
+
+	int serviceIndex = 0;
+	if (shardCount > 1)
+	{
+		for (const DBusObject &object : THESERVER->getObjects())
+		{
+			if (object.isPublished())
+			{
+				assignServices(object, serviceIndex, serviceList, serviceMap, characteristicMap);
+			}
+		}
+	}
+
+	{
+		std::unique_lock<std::shared_mutex> lock(tablesMutex);
+		services.swap(serviceList);
+		serviceShards.swap(serviceMap);
+		characteristicShards.swap(characteristicMap);
+	}
+
+	if (serviceIndex > 0)
+	{
+		Logger::info(SSTR << "Dispatching " << serviceIndex << " service(s) across " << shardCount << " shard(s)");
+	}
+}
+
+// Returns the shard that owns the service at `servicePath`, or -1 if it isn't a service (or the services haven't been dealt)
+int DispatchShards::getShard(const DBusObjectPath &servicePath)
+{
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	auto it = serviceShards.find(servicePath.toString());
+	return it == serviceShards.end() ? -1 : it->second;
+}
+
+// Returns the shard that owns `characteristic` (the caller must hold `tablesMutex`)
+static int findShard(const GattCharacteristic &characteristic)
+{
+	auto it = characteristicShards.find(&characteristic);
+	return it == characteristicShards.end() ? 0 : it->second;
+}
+
+// Returns the shard that owns `characteristic`
+int DispatchShards::getShard(const GattCharacteristic &characteristic)
+{
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	return findShard(characteristic);
+}
+
+// Returns the shard that dispatches calls from `pConnection` (0 for the server's own connection)
+int DispatchShards::getShard(GDBusConnection *pConnection)
+{
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	for (size_t index = 1; index < shards.size(); ++index)
+	{
+		if (nullptr != shards[index] && shards[index]->pConnection == pConnection)
+		{
+			return static_cast<int>(index);
+		}
+	}
+
+	return 0;
+}
+
+// Returns the connection to send `characteristic`'s notifications on: its shard's connection if the shards are running,
+// otherwise `pDefault`
+GDBusConnection *DispatchShards::getConnection(const GattCharacteristic &characteristic, GDBusConnection *pDefault)
+{
+	// Without shards, notifications don't need to wait for the lock
+	if (!bRunning)
+	{
+		return pDefault;
+	}
+
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	int shard = findShard(characteristic);
+	if (!bRunning || 0 == shard || shard >= static_cast<int>(shards.size()) || nullptr == shards[shard])
+	{
+		return pDefault;
+	}
+
+	return shards[shard]->pConnection;
+}
+
+// Returns the unique bus name of a running shard's connection (or an empty string)
+std::string DispatchShards::getUniqueName(int shard)
+{
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	if (!bRunning || shard <= 0 || shard >= static_cast<int>(shards.size()))
+	{
+		return "";
+	}
+
+	return g_dbus_connection_get_unique_name(shards[shard]->pConnection);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Startup and shutdown
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Registers `object` and its children with D-Bus on `shard`'s connection, returning false on failure
+static bool registerObject(Shard &shard, const DBusObject &object)
+{
+	GError *pError = nullptr;
+	GDBusNodeInfo *pNode = g_dbus_node_info_new_for_xml(object.generateIntrospectionXML().c_str(), &pError);
+	if (nullptr == pNode)
+	{
+		Logger::error(SSTR << "Failed to introspect XML: " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+		return false;
+	}
+
+	bool registered = registerNodeHierarchy(shard.pConnection, pNode, object.getPath(), shard.objectIds);
+	g_dbus_node_info_unref(pNode);
+	return registered;
+}
+
+// Connects `shard` to the bus at `address` and registers its objects, returning false on failure
+static bool connectShard(Shard &shard, int index, const std::string &address)
+{
+	GError *pError = nullptr;
+	shard.pConnection = g_dbus_connection_new_for_address_sync(address.c_str(),
+		GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+		nullptr, nullptr, &pError);
+
+	if (nullptr == shard.pConnection)
+	{
+		Logger::error(SSTR << "Shard " << index << " failed to connect to the bus: " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+		return false;
+	}
+
+	shard.pContext = g_main_context_new();
+	shard.pLoop = g_main_loop_new(shard.pContext, FALSE);
+
+	// GDBus dispatches calls to an object in the thread-default context at the time it was registered
+	g_main_context_push_thread_default(shard.pContext);
+
+	// Our ObjectManager (and any other unpublished objects), then the services dealt to this shard
+	bool registered = true;
+	for (const DBusObject &object : THESERVER->getObjects())
+	{
+		if (registered && !object.isPublished())
+		{
+			registered = registerObject(shard, object);
+		}
+	}
+
+	for (const std::pair<const DBusObject *, int> &service : services)
+	{
+		if (registered && service.second == index)
+		{
+			registered = registerObject(shard, *service.first);
+		}
+	}
+
+	g_main_context_pop_thread_default(shard.pContext);
+
+	if (!registered)
+	{
+		Logger::error(SSTR << "Shard " << index << " failed to register its objects");
+		return false;
+	}
+
+	Logger::debug(SSTR << "Shard " << index << " registered " << shard.objectIds.size() << " object interface(s) as "
+		<< g_dbus_connection_get_unique_name(shard.pConnection));
+	return true;
+}
+
+// Runs a shard's main loop until it is stopped
+static void runShard(Shard *pShard)
+{
+	g_main_context_push_thread_default(pShard->pContext);
+	g_main_loop_run(pShard->pLoop);
+	g_main_context_pop_thread_default(pShard->pContext);
+}
+
+// Reports the outcome of `start()`, stopping the shards if it failed
+static void finishStart(bool success)
+{
+	if (!success)
+	{
+		DispatchShards::stop();
+	}
+
+	if (nullptr != startedCallback)
+	{
+		startedCallback(success);
+	}
+}
+
+// Registers `index`'s application with BlueZ's GATT manager on the adapter at `adapterPath`
+static void registerApplication(int index, const std::string &adapterPath)
+{
+	g_auto(GVariantBuilder) builder;
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+	g_dbus_connection_call
+	(
+		shards[index]->pConnection,                  // GDBusConnection *connection
+		"org.bluez",                                 // const gchar *bus_name
+		adapterPath.c_str(),                         // const gchar *object_path
+		"org.bluez.GattManager1",                    // const gchar *interface_name
+		"RegisterApplication",                       // const gchar *method_name
+		g_variant_new("(oa{sv})", "/", &builder),    // GVariant *parameters
+		nullptr,                                     // const GVariantType *reply_type
+		G_DBUS_CALL_FLAGS_NONE,                      // GDBusCallFlags flags
+		-1,                                          // gint timeout_msec
+		nullptr,                                     // GCancellable *cancellable
+
+		// GAsyncReadyCallback callback
+		[] (GObject *pSourceObject, GAsyncResult *pAsyncResult, gpointer pUserData)
+		{
+			int callGeneration = GPOINTER_TO_INT(pUserData) / DispatchShards::kMaxShards;
+			int callIndex = GPOINTER_TO_INT(pUserData) % DispatchShards::kMaxShards;
+
+			GError *pError = nullptr;
+			GVariant *pResult = g_dbus_connection_call_finish(reinterpret_cast<GDBusConnection *>(pSourceObject), pAsyncResult, &pError);
+
+			// Ignore replies for shards that have since been stopped
+			if (callGeneration != generation)
+			{
+				g_clear_error(&pError);
+				if (nullptr != pResult) { g_variant_unref(pResult); }
+				return;
+			}
+
+			if (nullptr == pResult)
+			{
+				Logger::error(SSTR << "Shard " << callIndex << " failed to register its application: " << (nullptr == pError ? "Unknown" : pError->message));
+				g_clear_error(&pError);
+				applicationsFailed = true;
+			}
+			else
+			{
+				g_variant_unref(pResult);
+				Logger::debug(SSTR << "Shard " << callIndex << " registered its GATT application with BlueZ");
+			}
+
+			if (--pendingApplications == 0)
+			{
+				finishStart(!applicationsFailed);
+			}
+		},
+
+		GINT_TO_POINTER(generation * DispatchShards::kMaxShards + index) // gpointer user_data
+	);
+}
+
+// Connects each shard to the bus at `busAddress` (the system bus if empty), registers its objects and starts its thread
+//
+// If `adapterPath` isn't empty, each shard also registers its application with BlueZ's GATT manager on that adapter.
+// `onStarted` (if not nullptr) is called once every shard is running or one of them has failed. Must be called from the
+// server's thread, which must be running its main loop for `onStarted` to be called.
+void DispatchShards::start(const std::string &busAddress, const std::string &adapterPath, StartedCallback onStarted)
+{
+	stop();
+	startedCallback = onStarted;
+
+	if (shardCount <= 1)
+	{
+		finishStart(true);
+		return;
+	}
+
+	std::string address = busAddress;
+	if (address.empty())
+	{
+		GError *pError = nullptr;
+		gchar *pAddress = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SYSTEM, nullptr, &pError);
+		if (nullptr == pAddress)
+		{
+			Logger::error(SSTR << "Unable to find the system bus for our shards: " << (nullptr == pError ? "Unknown" : pError->message));
+			g_clear_error(&pError);
+			finishStart(false);
+			return;
+		}
+
+		address = pAddress;
+		g_free(pAddress);
+	}
+
+	// Connect the shards aside (this takes a round trip to the bus for each), then swap them in
+	std::vector<std::unique_ptr<Shard>> newShards(shardCount);
+	bool connected = true;
+	for (int index = 1; connected && index < shardCount; ++index)
+	{
+		newShards[index].reset(new Shard());
+		connected = connectShard(*newShards[index], index, address);
+	}
+
+	{
+		std::unique_lock<std::shared_mutex> lock(tablesMutex);
+		shards.swap(newShards);
+	}
+
+	if (!connected)
+	{
+		finishStart(false);
+		return;
+	}
+
+	for (int index = 1; index < shardCount; ++index)
+	{
+		shards[index]->thread = std::thread(runShard, shards[index].get());
+	}
+
+	{
+		std::unique_lock<std::shared_mutex> lock(tablesMutex);
+		bRunning = true;
+	}
+
+	if (adapterPath.empty())
+	{
+		finishStart(true);
+		return;
+	}
+
+	pendingApplications = shardCount - 1;
+	applicationsFailed = false;
+	for (int index = 1; index < shardCount; ++index)
+	{
+		registerApplication(index, adapterPath);
+	}
+}
+
+// Returns true if the shards were started successfully and haven't been stopped
+bool DispatchShards::isRunning()
+{
+	return bRunning;
+}
+
+// Stops the shards' threads, unregisters their objects and closes their connections (from the server's thread)
+void DispatchShards::stop()
+{
+	// Take the shards out of the tables first; their threads may still be dispatching, and find no shards from here on
+	std::vector<std::unique_ptr<Shard>> stopping;
+	{
+		std::unique_lock<std::shared_mutex> lock(tablesMutex);
+		bRunning = false;
+		stopping.swap(shards);
+	}
+
+	generation += 1;
+
+	for (std::unique_ptr<Shard> &pShard : stopping)
+	{
+		if (nullptr == pShard)
+		{
+			continue;
+		}
+
+		if (pShard->thread.joinable())
+		{
+			// Quit the shard's loop from within the loop, in case it hasn't started running yet
+			GSource *pQuit = g_idle_source_new();
+			g_source_set_callback(pQuit, [](gpointer pLoop) -> gboolean
+			{
+				g_main_loop_quit(static_cast<GMainLoop *>(pLoop));
+				return FALSE;
+			}, pShard->pLoop, nullptr);
+			g_source_attach(pQuit, pShard->pContext);
+			g_source_unref(pQuit);
+
+			pShard->thread.join();
+		}
+
+		if (nullptr != pShard->pConnection)
+		{
+			for (guint id : pShard->objectIds)
+			{
+				g_dbus_connection_unregister_object(pShard->pConnection, id);
+			}
+
+			// Closing the connection also ends its application's registration with BlueZ
+			g_dbus_connection_close_sync(pShard->pConnection, nullptr, nullptr);
+			g_object_unref(pShard->pConnection);
+		}
+
+		if (nullptr != pShard->pLoop)
+		{
+			g_main_loop_unref(pShard->pLoop);
+		}
+
+		if (nullptr != pShard->pContext)
+		{
+			g_main_context_unref(pShard->pContext);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Updates
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Hands a batch of updated characteristics (all owned by `shard`) to the shard's thread, which calls their `onUpdatedValue`
+// handlers with the shard's connection
+void DispatchShards::post(int shard, const std::vector<std::shared_ptr<const GattCharacteristic>> &characteristics, void *pUserData)
+{
+	std::shared_lock<std::shared_mutex> lock(tablesMutex);
+	if (!bRunning || shard <= 0 || shard >= static_cast<int>(shards.size()))
+	{
+		return;
+	}
+
+	UpdateBatch *pBatch = new UpdateBatch{ characteristics, shards[shard]->pConnection, pUserData };
+
+	g_main_context_invoke_full(shards[shard]->pContext, G_PRIORITY_DEFAULT, [](gpointer pData) -> gboolean
+	{
+		UpdateBatch *pUpdates = static_cast<UpdateBatch *>(pData);
+		for (const std::shared_ptr<const GattCharacteristic> &pCharacteristic : pUpdates->characteristics)
+		{
+			// The value has changed, so fast reads wait for the notification (or the next read) to take a new snapshot
+			if (nullptr != pCharacteristic->getValueSnapshot())
+			{
+				pCharacteristic->getValueSnapshot()->invalidate();
+			}
+
+			pCharacteristic->callOnUpdatedValue(pUpdates->pConnection, pUpdates->pUserData);
+		}
+		return FALSE;
+	},
+	pBatch, [](gpointer pData)
+	{
+		delete static_cast<UpdateBatch *>(pData);
+	});
+}
+
+}; // namespace ggk
@@ -0,0 +1,92 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Dispatch of our object tree across several threads and bus connections, partitioned by service
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of DispatchShards.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "DBusObjectPath.h"
+
+namespace ggk {
+
+struct GattCharacteristic;
+
+class DispatchShards
+{
+public:
+
+	// The most shards we run (including the server's own)
+	static const int kMaxShards = 16;
+
+	// Receives the outcome of `start()` on the server's thread
+	typedef void (*StartedCallback)(bool success);
+
+	// Sets the number of shards (1, the default, dispatches everything on the server's thread)
+	//
+	// This must be called before the server is started.
+	static void setShardCount(int count);
+
+	// Returns the number of shards
+	static int getShardCount();
+
+	// Deals our services to the shards (from the server's thread, before any objects are registered with BlueZ)
+	static void assign();
+
+	// Returns the shard that owns the service at `servicePath`, or -1 if it isn't a service (or the services haven't been dealt)
+	static int getShard(const DBusObjectPath &servicePath);
+
+	// Returns the shard that owns `characteristic`
+	static int getShard(const GattCharacteristic &characteristic);
+
+	// Returns the shard that dispatches calls from `pConnection` (0 for the server's own connection)
+	static int getShard(GDBusConnection *pConnection);
+
+	// Returns the connection to send `characteristic`'s notifications on: its shard's connection if the shards are running,
+	// otherwise `pDefault`
+	static GDBusConnection *getConnection(const GattCharacteristic &characteristic, GDBusConnection *pDefault);
+
+	// Returns the unique bus name of a running shard's connection (or an empty string)
+	static std::string getUniqueName(int shard);
+
+	// Connects each shard to the bus at `busAddress` (the system bus if empty), registers its objects and starts its thread
+	//
+	// If `adapterPath` isn't empty, each shard also registers its application with BlueZ's GATT manager on that adapter.
+	// `onStarted` (if not nullptr) is called once every shard is running or one of them has failed. Must be called from the
+	// server's thread, which must be running its main loop for `onStarted` to be called.
+	static void start(const std::string &busAddress, const std::string &adapterPath, StartedCallback onStarted);
+
+	// Returns true if the shards were started successfully and haven't been stopped
+	static bool isRunning();
+
+	// Hands a batch of updated characteristics (all owned by `shard`) to the shard's thread, which calls their
+	// `onUpdatedValue` handlers with the shard's connection
+	static void post(int shard, const std::vector<std::shared_ptr<const GattCharacteristic>> &characteristics, void *pUserData);
+
+	// Stops the shards' threads, unregisters their objects and closes their connections (from the server's thread)
+	static void stop();
+};
+
+}; // namespace ggk
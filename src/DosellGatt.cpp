@@ -6,6 +6,7 @@
 // in the LICENSE file in the root of the source tree.
 
 #include <algorithm>
+#include <stdexcept>
 
 #include "DosellGatt.h"
 #include "ServerUtils.h"
@@ -18,6 +19,8 @@
 #include "GattUuid.h"
 #include "GattCharacteristic.h"
 #include "GattDescriptor.h"
+#include "StatsInterface.h"
+#include "ServerStats.h"
 #include "Logger.h"
 
 namespace ggk {
@@ -39,6 +42,24 @@ namespace ggk {
 // Our one and only server. It's global.
 std::shared_ptr<DosellGatt> THESERVER = nullptr;
 
+// Appends the characteristics in the tree at `object` to `characteristics`, in the order they appear in the tree
+static void collectCharacteristics(const DBusObject &object, std::vector<std::shared_ptr<const GattCharacteristic>> &characteristics)
+{
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		std::shared_ptr<const DBusInterface> pConstInterface = pInterface;
+		if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pConstInterface, GattCharacteristic))
+		{
+			characteristics.push_back(pCharacteristic);
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		collectCharacteristics(child, characteristics);
+	}
+}
+
 DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advertisingName, const std::string &advertisingShortName, 
 	GGKServerDataGetter getter, GGKServerDataSetter setter)
 	:mEnableBREDR(false),
@@ -57,6 +78,8 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 	// Register getter & setter for server data
 	dataGetter = getter;
 	dataSetter = setter;
+	dataBatchGetter = nullptr;
+	mDataBatchThread = std::thread::id();
 
 
 	//
@@ -79,6 +102,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 			{
 				self.methodReturnValue(pInvocation, "Dosell AB", true);
 			})
+			.fastRead()
 
 		.gattCharacteristicEnd()
 		.gattCharacteristicBegin("hardware/revision", "2A27", {"read"})
@@ -86,6 +110,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 			{
 				self.methodReturnValue(pInvocation, "V3", true);
 			})
+			.fastRead()
 		.gattDescriptorBegin("description", "2901", {"read"})
 			.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
 			{
@@ -94,6 +119,23 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 			})
 		.gattDescriptorEnd()
 		.gattCharacteristicEnd()
+		// The software revision is the VERSION_ID from the system's os-release file, which is read on a worker thread so that a
+		// slow filesystem doesn't hold up the server (see AsyncReply.cpp)
+		.gattCharacteristicBegin("software/revision", "2A28", {"read"})
+			.onReadValueAsync(CHARACTERISTIC_ASYNC_READ_CALLBACK_LAMBDA
+			{
+				reply->runInWorker([]()
+				{
+					std::string version = ServerUtils::getOsReleaseField("/etc/os-release", "VERSION_ID");
+					if (version.empty())
+					{
+						throw std::runtime_error("The software revision is not available");
+					}
+
+					return std::vector<uint8_t>(version.begin(), version.end());
+				});
+			})
+		.gattCharacteristicEnd()
 	.gattServiceEnd()
 	//     GATT Dosell Service-1 (6151EC38-ECFA-4EE0-BBF7-50C1B04F4322)
 	.gattServiceBegin("service/1", "6151EC38-ECFA-4EE0-BBF7-50C1B04F4322")
@@ -181,14 +223,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 				auto pValue = self.getDataValue<const uint16_t>(pName.c_str(), 0);
 				self.methodReturnValue(pInvocation, pValue, true);
 			})
-			.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
-			{
-				// Update the text string value
-				GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
-				self.setDataPointer("control", Utils::stringFromGVariantByteArray(pAyBuffer).c_str());
-				self.callOnUpdatedValue(pConnection, pUserData);
-				self.methodReturnVariant(pInvocation, NULL);
-			})
+			.writeValueSchema(ValueSchema::uint16())
 			.onUpdatedValue(CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
 			{
 				std::string pName = "control"; //pName is the lookup name in dataGetter(const char *pName)
@@ -317,6 +352,72 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 
 			.gattDescriptorEnd()
 		.gattCharacteristicEnd()
+		// Firmware 6151F1A0-ECFA-4EE0-BBF7-50C1B04F4322
+		//
+		// Only a bonded, authenticated central may write an image (BlueZ refuses the writes on any other link)
+		.gattCharacteristicBegin("firmware", "6151F1A0-ECFA-4EE0-BBF7-50C1B04F4322",
+			{"write", "write-without-response", "encrypt-authenticated-write", "notify"})
+			.receiveFirmware()
+			.gattDescriptorBegin("description", "2901", {"read"})
+				.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
+				{
+					const char *pDescription = "Firmware";
+					self.methodReturnValue(pInvocation, pDescription, true);
+				})
+			.gattDescriptorEnd()
+		.gattCharacteristicEnd()
+		// State 6151F1A2-ECFA-4EE0-BBF7-50C1B04F4322
+		//
+		// The status, control and next dispense time in one notification (see CompositeValue.cpp):
+		//
+		//     [u64 status][u16 control][u32 dispense/nexttime]
+		//
+		// Usually only one of them changes, so notifications carry just the changed fields (see DeltaNotification.cpp.) Reads
+		// return the whole value.
+		.gattCharacteristicBegin("state", "6151F1A2-ECFA-4EE0-BBF7-50C1B04F4322", {"read", "notify"})
+			.composite({
+				CompositeValue::Field::uint64("status"),
+				CompositeValue::Field::uint16("control"),
+				CompositeValue::Field::uint32("dispense/nexttime")
+			})
+			.deltaNotify({8, 2, 4})
+			.gattDescriptorBegin("description", "2901", {"read"})
+				.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
+				{
+					const char *pDescription = "State";
+					self.methodReturnValue(pInvocation, pDescription, true);
+				})
+			.gattDescriptorEnd()
+		.gattCharacteristicEnd()
+		// Configuration 6151F1A3-ECFA-4EE0-BBF7-50C1B04F4322
+		//
+		// A text dump of the device's configuration, served compressed (see CompressedBlob.cpp)
+		.gattCharacteristicBegin("configuration", "6151F1A3-ECFA-4EE0-BBF7-50C1B04F4322", {"read"})
+			.compressedRead()
+			.gattDescriptorBegin("description", "2901", {"read"})
+				.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
+				{
+					const char *pDescription = "Configuration";
+					self.methodReturnValue(pInvocation, pDescription, true);
+				})
+			.gattDescriptorEnd()
+		.gattCharacteristicEnd()
+		// Samples 6151F1A1-ECFA-4EE0-BBF7-50C1B04F4322
+		//
+		// The last 1024 four-byte samples appended with `ggkAppendSample()`, read in batches from each central's cursor and
+		// notified in batches of up to 8 (see SampleRing.cpp.) The link is moved to the bulk connection profile while a central
+		// is subscribed, so that it can catch up quickly (see ConnectionProfiles.cpp)
+		.gattCharacteristicBegin("samples", "6151F1A1-ECFA-4EE0-BBF7-50C1B04F4322", {"read", "write", "notify"})
+			.sampleRing(1024, 4, 8)
+			.connectionProfile(EConnectionProfileBulk)
+			.gattDescriptorBegin("description", "2901", {"read"})
+				.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
+				{
+					const char *pDescription = "Samples";
+					self.methodReturnValue(pInvocation, pDescription, true);
+				})
+			.gattDescriptorEnd()
+		.gattCharacteristicEnd()
 	.gattServiceEnd()
 	//     GATT Dosell Service-2 (61515260-ECFA-4EE0-BBF7-50C1B04F4322)
 	.gattServiceBegin("service/2", "61515260-ECFA-4EE0-BBF7-50C1B04F4322")
@@ -387,14 +488,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 				auto pValue = self.getDataValue<const uint32_t>(pName.c_str(), 0);
 				self.methodReturnValue(pInvocation, pValue, true);
 			})
-			.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
-			{
-				// Update the text string value
-				GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
-				self.setDataPointer("birthday", Utils::stringFromGVariantByteArray(pAyBuffer).c_str());
-				self.callOnUpdatedValue(pConnection, pUserData);
-				self.methodReturnVariant(pInvocation, NULL);
-			})
+			.writeValueSchema(ValueSchema::uint32())
 			.onUpdatedValue(CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
 			{
 				std::string pName = "birthday"; //pName is the lookup name in dataGetter(const char *pName)
@@ -447,14 +541,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 				auto pValue = self.getDataValue<const uint8_t>(pName.c_str(), 0);
 				self.methodReturnValue(pInvocation, pValue, true);
 			})
-			.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
-			{
-				// Update the text string value
-				GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
-				self.setDataPointer("dispense/daysbeforelastdispensealert", Utils::stringFromGVariantByteArray(pAyBuffer).c_str());
-				self.callOnUpdatedValue(pConnection, pUserData);
-				self.methodReturnVariant(pInvocation, NULL);
-			})
+			.writeValueSchema(ValueSchema::uint8())
 			.onUpdatedValue(CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
 			{
 				std::string pName = "dispense/daysbeforelastdispensealert"; //pName is the lookup name in dataGetter(const char *pName)
@@ -634,7 +721,7 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 	// Create an interface of the standard type 'org.freedesktop.DBus.ObjectManager'
 	//
 	// See: https://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-objectmanager
-	auto omInterface = std::make_shared<DBusInterface>(objectManager, "org.freedesktop.DBus.ObjectManager");
+	auto omInterface = std::allocate_shared<DBusInterface>(TaggedAllocator<DBusInterface, EMemorySchema>(), objectManager, "org.freedesktop.DBus.ObjectManager");
 
 	// Add the interface to the object manager
 	objectManager.addInterface(omInterface);
@@ -647,6 +734,34 @@ DosellGatt::DosellGatt(const std::string &serviceName, const std::string &advert
 	{
 		ServerUtils::getManagedObjects(pInvocation);
 	});
+
+	//  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+	// Stats interface
+	//  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+	//
+	// If enabled, the server's metrics are served to tools on the device by an interface of our own (see StatsInterface.cpp.) Like
+	// the object manager, it lives on a non-published object so that BlueZ never sees it.
+	if (ServerStats::isInterfaceEnabled())
+	{
+		mObjects.push_back(DBusObject(DBusObjectPath() + "com" + getServiceName() + "stats", false));
+		DBusObject &statsObject = mObjects.back();
+		statsObject.addInterface(std::allocate_shared<StatsInterface>(TaggedAllocator<StatsInterface, EMemorySchema>(), statsObject,
+			"com." + getServiceName() + ".Stats1"));
+	}
+
+	// Number our characteristics so the application can refer to them by handle
+	for (const DBusObject &object : mObjects)
+	{
+		collectCharacteristics(object, mCharacteristics);
+	}
+
+	for (const std::shared_ptr<const GattCharacteristic> &pCharacteristic : mCharacteristics)
+	{
+		if (nullptr != pCharacteristic->getCompositeValue())
+		{
+			mComposites.push_back(pCharacteristic);
+		}
+	}
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -706,8 +821,149 @@ const GattProperty *DosellGatt::findProperty(const DBusObjectPath &objectPath, c
 	{
 		return pGattInterface->findProperty(propertyName);
 	}
+	else if (std::shared_ptr<const StatsInterface> pStatsInterface = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, StatsInterface))
+	{
+		return pStatsInterface->findProperty(propertyName);
+	}
 
 	return nullptr;
 }
 
+// Returns the handle of the characteristic at `objectPath`, or -1 if there is no characteristic there
+//
+// Handles are small integers assigned to our characteristics as the server is built. They let the application refer to a
+// characteristic from hot paths (such as `ggkAppendSample()`) without a path lookup each time.
+int DosellGatt::getCharacteristicHandle(const DBusObjectPath &objectPath) const
+{
+	for (size_t handle = 0; handle < mCharacteristics.size(); ++handle)
+	{
+		if (mCharacteristics[handle]->getPath() == objectPath)
+		{
+			return int(handle);
+		}
+	}
+
+	return -1;
+}
+
+// Returns the characteristic with the handle `handle`, or nullptr if the handle is invalid
+std::shared_ptr<const GattCharacteristic> DosellGatt::getCharacteristic(int handle) const
+{
+	if (handle < 0 || size_t(handle) >= mCharacteristics.size())
+	{
+		return nullptr;
+	}
+
+	return mCharacteristics[handle];
+}
+
+// Schedules a notification for each composite characteristic that binds the data value `name` (see CompositeValue.cpp)
+//
+// Composites that already have a notification pending aren't queued again. Returns the number of composites that bind `name`.
+// May be called from any thread.
+int DosellGatt::notifyDataChanged(const std::string &name) const
+{
+	int count = 0;
+	for (const std::shared_ptr<const GattCharacteristic> &pComposite : mComposites)
+	{
+		if (pComposite->getCompositeValue()->binds(name))
+		{
+			if (pComposite->getCompositeValue()->schedule())
+			{
+				ggkNofifyUpdatedCharacteristic(pComposite->getPath().c_str());
+			}
+			count += 1;
+		}
+	}
+
+	return count;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Server data
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the data value for the given name
+//
+// If a data batch is active on the calling thread (see `beginDataBatch`) and contains the name, the prefetched value is
+// returned. Otherwise, this falls through to the registered data getter.
+//
+// This is called from the server's thread and, with dispatch shards, from the shards' threads (see DispatchShards.cpp.) The
+// calls to the application's data getter and setter are serialized, so the application never sees two at once.
+const void *DosellGatt::getData(const char *pName) const
+{
+	if (mDataBatchThread.load(std::memory_order_acquire) == std::this_thread::get_id() && !mDataBatch.empty())
+	{
+		auto it = mDataBatch.find(pName);
+		if (it != mDataBatch.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(mDataMutex);
+	return dataGetter(pName);
+}
+
+// Hands the data value for the given name to the registered data setter, returning true on success
+//
+// As with `getData`, this may be called from any thread that dispatches our objects.
+bool DosellGatt::setData(const char *pName, const void *pData) const
+{
+	std::lock_guard<std::recursive_mutex> lock(mDataMutex);
+	return dataSetter(pName, pData) != 0;
+}
+
+// Prefetches the data values for all `names` with a single call to the batch data getter
+//
+// Values are served from this batch by `getData` until `endDataBatch` is called. If there is no batch data getter registered,
+// or if fewer than two names are requested, this does nothing and `getData` continues to use the single-value getter.
+//
+// This must only be called from the server's thread.
+void DosellGatt::beginDataBatch(const std::vector<std::string> &names)
+{
+	mDataBatchThread.store(std::thread::id(), std::memory_order_release);
+	mDataBatch.clear();
+
+	GGKServerDataBatchGetter batchGetter = dataBatchGetter;
+	if (nullptr == batchGetter || names.size() < 2)
+	{
+		return;
+	}
+
+	std::vector<const char *> pNames;
+	pNames.reserve(names.size());
+	for (const std::string &name : names)
+	{
+		pNames.push_back(name.c_str());
+	}
+
+	std::vector<const void *> pValues(names.size(), nullptr);
+	int fetched;
+	{
+		std::lock_guard<std::recursive_mutex> lock(mDataMutex);
+		fetched = batchGetter(pNames.data(), pNames.size(), pValues.data());
+	}
+
+	if (0 == fetched)
+	{
+		Logger::warn(SSTR << "Batch data getter failed for " << names.size() << " values; falling back to the data getter");
+		return;
+	}
+
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		mDataBatch[names[i]] = pValues[i];
+	}
+
+	mDataBatchThread.store(std::this_thread::get_id(), std::memory_order_release);
+}
+
+// Releases the data batch started with `beginDataBatch`
+void DosellGatt::endDataBatch()
+{
+	mDataBatchThread.store(std::thread::id(), std::memory_order_release);
+	mDataBatch.clear();
+}
+
 }; // namespace ggk
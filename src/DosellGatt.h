@@ -30,6 +30,10 @@
 #include <vector>
 #include <list>
 #include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 #include "../include/Gobbledegook.h"
 #include "DBusObject.h"
@@ -56,7 +60,7 @@ struct DosellGatt
 	//
 
 	// Our server is a collection of D-Bus objects
-	typedef std::list<DBusObject> Objects;
+	typedef DBusObject::ChildList Objects;
 
 	//
 	// Accessors
@@ -89,6 +93,12 @@ struct DosellGatt
 	// Returns our registered data setter
 	GGKServerDataSetter getDataSetter() const { return dataSetter; }
 
+	// Returns our registered batch data getter (may be nullptr)
+	GGKServerDataBatchGetter getDataBatchGetter() const { return dataBatchGetter; }
+
+	// Registers (or unregisters, with nullptr) the batch data getter
+	void setDataBatchGetter(GGKServerDataBatchGetter getter) { dataBatchGetter = getter; }
+
 	// advertisingName: The name for this controller, as advertised over LE
 	//
 	// This is set from the constructor.
@@ -180,11 +190,61 @@ struct DosellGatt
 	// If the property was found, it is returned, otherwise nullptr is returned
 	const GattProperty *findProperty(const DBusObjectPath &objectPath, const std::string &interfaceName, const std::string &propertyName) const;
 
+	// Returns the handle of the characteristic at `objectPath`, or -1 if there is no characteristic there
+	//
+	// Handles are small integers assigned to our characteristics as the server is built. They let the application refer to a
+	// characteristic from hot paths (such as `ggkAppendSample()`) without a path lookup each time.
+	int getCharacteristicHandle(const DBusObjectPath &objectPath) const;
+
+	// Returns the characteristic with the handle `handle`, or nullptr if the handle is invalid
+	std::shared_ptr<const GattCharacteristic> getCharacteristic(int handle) const;
+
+	// Schedules a notification for each composite characteristic that binds the data value `name` (see CompositeValue.cpp)
+	//
+	// Composites that already have a notification pending aren't queued again. Returns the number of composites that bind `name`.
+	// May be called from any thread.
+	int notifyDataChanged(const std::string &name) const;
+
+	//
+	// Server data
+	//
+
+	// Returns the data value for the given name
+	//
+	// If a data batch is active on the calling thread (see `beginDataBatch`) and contains the name, the prefetched value is
+	// returned. Otherwise, this falls through to the registered data getter.
+	//
+	// This is called from the server's thread and, with dispatch shards, from the shards' threads (see DispatchShards.cpp.) The
+	// calls to the application's data getter and setter are serialized, so the application never sees two at once.
+	const void *getData(const char *pName) const;
+
+	// Hands the data value for the given name to the registered data setter, returning true on success
+	//
+	// As with `getData`, this may be called from any thread that dispatches our objects.
+	bool setData(const char *pName, const void *pData) const;
+
+	// Prefetches the data values for all `names` with a single call to the batch data getter
+	//
+	// Values are served from this batch by `getData` until `endDataBatch` is called. If there is no batch data getter registered,
+	// or if fewer than two names are requested, this does nothing and `getData` continues to use the single-value getter.
+	//
+	// This must only be called from the server's thread.
+	void beginDataBatch(const std::vector<std::string> &names);
+
+	// Releases the data batch started with `beginDataBatch`
+	void endDataBatch();
+
 private:
 
 	// Our server's objects
 	Objects mObjects;
 
+	// Our characteristics, indexed by handle (see `getCharacteristicHandle`)
+	std::vector<std::shared_ptr<const GattCharacteristic>> mCharacteristics;
+
+	// Our characteristics flagged with `composite()`
+	std::vector<std::shared_ptr<const GattCharacteristic>> mComposites;
+
 	// BR/EDR requested state
 	bool mEnableBREDR;
 
@@ -209,6 +269,19 @@ private:
 	// The setter callback that is responsible for storing current server data that is shared over Bluetooth
 	GGKServerDataSetter dataSetter;
 
+	// The optional getter callback that returns several server data values in one call
+	std::atomic<GGKServerDataBatchGetter> dataBatchGetter;
+
+	// Values prefetched by the batch data getter for the current cycle, keyed by name (server thread only)
+	std::unordered_map<std::string, const void *, std::hash<std::string>, std::equal_to<std::string>,
+		TaggedAllocator<std::pair<const std::string, const void *>, EMemoryCache>> mDataBatch;
+
+	// The thread that began the current data batch (only that thread is served from it)
+	std::atomic<std::thread::id> mDataBatchThread;
+
+	// Serializes the calls to the application's data getters and setter (recursive, in case one of them calls back into us)
+	mutable std::recursive_mutex mDataMutex;
+
 	// advertisingName: The name for this controller, as advertised over LE
 	//
 	// This is set from the constructor.
@@ -0,0 +1,413 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A fast path that answers ReadValue calls for selected characteristics on GDBus's worker thread
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// A ReadValue call normally crosses two threads: GDBus's worker thread receives it and hands it to our main loop, which runs
+// `onMethodCall()` and replies. When the main loop is busy (ticking events, sending notifications or processing writes), reads
+// queue up behind that work, even for values that rarely change.
+//
+// A characteristic flagged with `fastRead()` keeps a snapshot of its value. The snapshot is published from the server thread each
+// time the characteristic answers a ReadValue or sends a change notification, and it is invalidated when the value may have
+// changed without either: when the application queues an update for it (`ggkPushUpdateQueue()`, `ggkNotifyMany()` and the
+// functions built on them) and when a write arrives. With the fast path installed, a message filter on the worker thread
+// recognizes ReadValue calls for these characteristics and answers them straight from the snapshot. Anything else (other
+// methods, other objects, reads at an offset, or a read while the snapshot is invalid) goes through normal dispatch, which also
+// refreshes the snapshot.
+//
+// Writes are seen by the same filter, as they arrive and before they are dispatched, so a client that writes and then reads back
+// gets what it wrote. Each write invalidates the snapshot and counts as in flight until the server has dispatched it; while any
+// write is in flight, reads pass through to normal dispatch (queued behind the write) and nothing is published, not even the
+// reply to a read that was dispatched ahead of the write.
+//
+// The snapshot is a sequence lock: the server thread bumps the sequence before and after writing the value, and readers retry if
+// the sequence changed while they copied it. Readers never block the server thread, and copying the value takes no lock (finding
+// the snapshot takes a mutex for a moment, see below.) The value lives in
+// atomic words, so a reader that races with a write reads stale words rather than invoking undefined behavior.
+//
+// A fast read returns the value as of the last read or notification, so this is only suitable for characteristics whose changes
+// are announced with `ggkNofifyUpdatedCharacteristic()` (or written by clients.) Fast reads skip the wakeup profiler (they don't
+// wake the server thread) but are captured.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+
+#include "FastRead.h"
+#include "DosellGatt.h"
+#include "DBusObject.h"
+#include "DBusInterface.h"
+#include "GattCharacteristic.h"
+#include "Capture.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// How many times a reader retries a snapshot that is being published before falling back to the normal path
+static const int kMaxReadAttempts = 4;
+
+//
+// Fast path state
+//
+// The snapshots are collected before the filter is installed and are left in place when it is removed. GDBus may still be
+// running the filter on its worker thread for a moment after its removal, and so into the next `install()` (after a reconnect),
+// which collects them again; the application's threads (see `invalidate()`) may look them up at any time. So collecting them and
+// every lookup, including the filter's, takes `snapshotsMutex`. Lookups hold it only to copy the snapshot's pointer.
+//
+
+static std::unordered_map<std::string, std::shared_ptr<ValueSnapshot>> snapshots;
+static std::mutex snapshotsMutex;
+static guint filterId = 0;
+static std::atomic<uint64_t> servedCount(0);
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// ValueSnapshot
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+ValueSnapshot::ValueSnapshot()
+: sequence(0), valueLength(kInvalidLength), writesInFlight(0)
+{
+	for (std::atomic<uint64_t> &word : words)
+	{
+		word.store(0, std::memory_order_relaxed);
+	}
+}
+
+// Publishes a new value (from a thread that dispatches the characteristic)
+//
+// A value longer than `kMaxLength`, or one published while a write is in flight, invalidates the snapshot instead.
+void ValueSnapshot::publish(const void *pData, size_t length)
+{
+	if (length > kMaxLength || writesInFlight.load(std::memory_order_acquire) > 0)
+	{
+		invalidate();
+		return;
+	}
+
+	write(pData, static_cast<uint32_t>(length));
+}
+
+// Invalidates the snapshot, so that reads fall through to the normal path until the next publish
+//
+// This may be called from any thread.
+void ValueSnapshot::invalidate()
+{
+	if (valueLength.load(std::memory_order_relaxed) != kInvalidLength)
+	{
+		write(nullptr, kInvalidLength);
+	}
+}
+
+// Notes that a write to the characteristic has arrived (invalidating the snapshot) and is waiting to be dispatched
+//
+// This is called from the fast path's filter, on GDBus's worker thread.
+void ValueSnapshot::beginWrite()
+{
+	// Invalidate even if the snapshot looks invalid already, since a publish may be claiming the lock as we look (see `write()`)
+	writesInFlight.fetch_add(1, std::memory_order_acq_rel);
+	write(nullptr, kInvalidLength);
+}
+
+// Notes that a write counted by `beginWrite()` has been dispatched
+//
+// Does nothing if no write is in flight (as when the fast path isn't installed.)
+void ValueSnapshot::endWrite()
+{
+	uint32_t count = writesInFlight.load(std::memory_order_relaxed);
+	while (count > 0 && !writesInFlight.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+	{
+	}
+}
+
+// Writes the value under the sequence lock (an odd sequence means a write is in progress)
+//
+// Writers claim the lock by moving the sequence from even to odd, so a write from a dispatch shard's thread and one from the server's
+// thread (see DispatchShards.cpp) take turns.
+//
+// A publish checks for writes in flight again once it holds the lock: a `beginWrite()` that arrived after `publish()` checked
+// either claimed the lock before us (and we see its count here) or claims it after us (and its invalidation replaces our value.)
+void ValueSnapshot::write(const void *pData, uint32_t length)
+{
+	uint32_t start = sequence.load(std::memory_order_relaxed);
+	while ((start & 1) || !sequence.compare_exchange_weak(start, start + 1, std::memory_order_acquire))
+	{
+		start = sequence.load(std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (nullptr != pData && writesInFlight.load(std::memory_order_acquire) > 0)
+	{
+		pData = nullptr;
+		length = kInvalidLength;
+	}
+
+	valueLength.store(length, std::memory_order_relaxed);
+	if (nullptr != pData)
+	{
+		const uint8_t *pBytes = static_cast<const uint8_t *>(pData);
+		for (size_t offset = 0; offset < length; offset += sizeof(uint64_t))
+		{
+			uint64_t word = 0;
+			memcpy(&word, pBytes + offset, std::min(sizeof(uint64_t), length - offset));
+			words[offset / sizeof(uint64_t)].store(word, std::memory_order_relaxed);
+		}
+	}
+
+	sequence.store(start + 2, std::memory_order_release);
+}
+
+// Copies the value into `pBuffer` (which must hold `kMaxLength` bytes) and sets `length`
+//
+// Returns false if the snapshot is invalid or is being published too often to get a consistent copy.
+bool ValueSnapshot::read(uint8_t *pBuffer, size_t &length) const
+{
+	for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt)
+	{
+		uint32_t start = sequence.load(std::memory_order_acquire);
+		if (start & 1)
+		{
+			continue;
+		}
+
+		uint32_t currentLength = valueLength.load(std::memory_order_relaxed);
+		if (currentLength != kInvalidLength)
+		{
+			for (size_t offset = 0; offset < currentLength; offset += sizeof(uint64_t))
+			{
+				uint64_t word = words[offset / sizeof(uint64_t)].load(std::memory_order_relaxed);
+				memcpy(pBuffer + offset, &word, std::min(sizeof(uint64_t), currentLength - offset));
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) == start)
+		{
+			length = currentLength;
+			return currentLength != kInvalidLength;
+		}
+	}
+
+	return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Message filter
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the "offset" read option from the body of a ReadValue call, or 0 if there isn't one
+static guint16 getReadOffset(GDBusMessage *pMessage)
+{
+	GVariant *pBody = g_dbus_message_get_body(pMessage);
+	if (nullptr == pBody || !g_variant_is_of_type(pBody, G_VARIANT_TYPE("(a{sv})")))
+	{
+		return 0;
+	}
+
+	guint16 offset = 0;
+	GVariant *pOptions = g_variant_get_child_value(pBody, 0);
+	g_variant_lookup(pOptions, "offset", "q", &offset);
+	g_variant_unref(pOptions);
+	return offset;
+}
+
+// Answers ReadValue calls for our fast-read characteristics and notes the writes to them (runs on GDBus's worker thread)
+//
+// Returning the message passes it on to normal dispatch. Returning nullptr (after releasing it) drops it, as we've answered it.
+static GDBusMessage *fastReadFilter(GDBusConnection *pConnection, GDBusMessage *pMessage, gboolean incoming, gpointer)
+{
+	if (!incoming || g_dbus_message_get_message_type(pMessage) != G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+	{
+		return pMessage;
+	}
+
+	const gchar *pMember = g_dbus_message_get_member(pMessage);
+	const gchar *pInterface = g_dbus_message_get_interface(pMessage);
+	const gchar *pPath = g_dbus_message_get_path(pMessage);
+	if (nullptr == pMember || nullptr == pInterface || nullptr == pPath || 0 != strcmp(pInterface, "org.bluez.GattCharacteristic1"))
+	{
+		return pMessage;
+	}
+
+	std::shared_ptr<ValueSnapshot> pSnapshot;
+	{
+		std::lock_guard<std::mutex> lock(snapshotsMutex);
+		auto entry = snapshots.find(pPath);
+		if (entry == snapshots.end())
+		{
+			return pMessage;
+		}
+		pSnapshot = entry->second;
+	}
+
+	// The write is dispatched as usual; until it has been, reads go the same way (see `GattCharacteristic::callMethod()`)
+	if (0 == strcmp(pMember, "WriteValue"))
+	{
+		pSnapshot->beginWrite();
+		return pMessage;
+	}
+
+	// The snapshot holds the whole value, so reads at an offset (the rest of a long read) go through normal dispatch
+	if (0 != strcmp(pMember, "ReadValue") || 0 != getReadOffset(pMessage))
+	{
+		return pMessage;
+	}
+
+	bool recording = Capture::getInstance().isRecording();
+	int64_t startUS = recording ? Capture::nowUS() : 0;
+	uint8_t value[ValueSnapshot::kMaxLength];
+	size_t length = 0;
+	if (!pSnapshot->read(value, length))
+	{
+		return pMessage;
+	}
+
+	GVariant *pValue = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, value, length, sizeof(uint8_t));
+	GDBusMessage *pReply = g_dbus_message_new_method_reply(pMessage);
+	g_dbus_message_set_body(pReply, g_variant_new_tuple(&pValue, 1));
+
+	GError *pError = nullptr;
+	if (!g_dbus_connection_send_message(pConnection, pReply, G_DBUS_SEND_MESSAGE_FLAGS_NONE, nullptr, &pError))
+	{
+		// We can't pass the call on once we've tried to answer it, and the caller will time out either way
+		Logger::warn(SSTR << "Failed to send a fast read reply for '" << pPath << "': " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+	}
+	g_object_unref(pReply);
+
+	if (recording)
+	{
+		Capture::getInstance().recordDBus(ECaptureMethodCall, startUS, g_dbus_message_get_sender(pMessage), pPath, pInterface, pMember,
+			g_dbus_message_get_body(pMessage));
+	}
+
+	servedCount += 1;
+	g_object_unref(pMessage);
+	return nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Installation
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Collects the snapshots of the fast-read characteristics within `object` and its children
+static void collectSnapshots(const DBusObject &object)
+{
+	for (std::shared_ptr<const DBusInterface> pInterface : object.getInterfaces())
+	{
+		std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+		if (nullptr != pCharacteristic && nullptr != pCharacteristic->getValueSnapshot())
+		{
+			snapshots[pCharacteristic->getPath().toString()] = pCharacteristic->getValueSnapshot();
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		collectSnapshots(child);
+	}
+}
+
+// Installs the fast path on `pConnection` for every published characteristic flagged with `fastRead()`
+//
+// Does nothing if there are no such characteristics.
+void FastRead::install(GDBusConnection *pConnection)
+{
+	if (0 != filterId)
+	{
+		return;
+	}
+
+	size_t snapshotCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(snapshotsMutex);
+		snapshots.clear();
+		for (const DBusObject &object : THESERVER->getObjects())
+		{
+			if (object.isPublished())
+			{
+				collectSnapshots(object);
+			}
+		}
+		snapshotCount = snapshots.size();
+	}
+
+	if (0 == snapshotCount)
+	{
+		return;
+	}
+
+	filterId = g_dbus_connection_add_filter(pConnection, fastReadFilter, nullptr, nullptr);
+	Logger::debug(SSTR << "Installed the fast read path for " << snapshotCount << " characteristic(s)");
+}
+
+// Removes the fast path from `pConnection`
+void FastRead::uninstall(GDBusConnection *pConnection)
+{
+	if (0 == filterId)
+	{
+		return;
+	}
+
+	g_dbus_connection_remove_filter(pConnection, filterId);
+	filterId = 0;
+
+	Logger::debug(SSTR << "Removed the fast read path (" << servedCount << " read(s) answered)");
+}
+
+// Invalidates the snapshot of the characteristic at `objectPath`, if it has one (for example, when an update is queued for it)
+//
+// This may be called from any thread.
+void FastRead::invalidate(const char *pObjectPath)
+{
+	if (nullptr == pObjectPath)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(snapshotsMutex);
+	auto entry = snapshots.find(pObjectPath);
+	if (entry != snapshots.end())
+	{
+		entry->second->invalidate();
+	}
+}
+
+// Invalidates every snapshot (for example, when queued updates are discarded without being sent)
+void FastRead::invalidateAll()
+{
+	std::lock_guard<std::mutex> lock(snapshotsMutex);
+	for (auto &entry : snapshots)
+	{
+		entry.second->invalidate();
+	}
+}
+
+// Returns the number of ReadValue calls answered on the fast path
+uint64_t FastRead::getServedCount()
+{
+	return servedCount;
+}
+
+}; // namespace ggk
@@ -0,0 +1,105 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A fast path that answers ReadValue calls for selected characteristics on GDBus's worker thread
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of FastRead.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace ggk {
+
+// A characteristic's last known value, published by the server thread and read from any thread without locking
+class ValueSnapshot
+{
+public:
+
+	// The longest value we keep (the longest attribute value allowed by ATT)
+	static const size_t kMaxLength = 512;
+
+	ValueSnapshot();
+
+	// Publishes a new value (from a thread that dispatches the characteristic)
+	//
+	// A value longer than `kMaxLength`, or one published while a write is in flight, invalidates the snapshot instead.
+	void publish(const void *pData, size_t length);
+
+	// Invalidates the snapshot, so that reads fall through to the normal path until the next publish
+	//
+	// This may be called from any thread.
+	void invalidate();
+
+	// Notes that a write to the characteristic has arrived (invalidating the snapshot) and is waiting to be dispatched
+	//
+	// This is called from the fast path's filter, on GDBus's worker thread.
+	void beginWrite();
+
+	// Notes that a write counted by `beginWrite()` has been dispatched
+	//
+	// Does nothing if no write is in flight (as when the fast path isn't installed.)
+	void endWrite();
+
+	// Copies the value into `pBuffer` (which must hold `kMaxLength` bytes) and sets `length`
+	//
+	// Returns false if the snapshot is invalid or is being published too often to get a consistent copy.
+	bool read(uint8_t *pBuffer, size_t &length) const;
+
+private:
+
+	static const size_t kWordCount = kMaxLength / sizeof(uint64_t);
+	static const uint32_t kInvalidLength = 0xffffffff;
+
+	void write(const void *pData, uint32_t length);
+
+	std::atomic<uint32_t> sequence;
+	std::atomic<uint32_t> valueLength;
+	std::atomic<uint32_t> writesInFlight;
+	std::atomic<uint64_t> words[kWordCount];
+};
+
+class FastRead
+{
+public:
+
+	// Installs the fast path on `pConnection` for every published characteristic flagged with `fastRead()`
+	//
+	// Does nothing if there are no such characteristics.
+	static void install(GDBusConnection *pConnection);
+
+	// Removes the fast path from `pConnection`
+	static void uninstall(GDBusConnection *pConnection);
+
+	// Invalidates the snapshot of the characteristic at `objectPath`, if it has one (for example, when an update is queued for it)
+	//
+	// This may be called from any thread.
+	static void invalidate(const char *pObjectPath);
+
+	// Invalidates every snapshot (for example, when queued updates are discarded without being sent)
+	static void invalidateAll();
+
+	// Returns the number of ReadValue calls answered on the fast path
+	static uint64_t getServedCount();
+};
+
+}; // namespace ggk
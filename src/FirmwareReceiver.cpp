@@ -0,0 +1,568 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The receive path for firmware images written to a characteristic flagged with `receiveFirmware()`
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Firmware images are far larger than anything else written to our characteristics, and they arrive as thousands of small writes.
+// Collecting them through the data setter would copy every packet at least twice and keep the whole image in memory, so a
+// characteristic flagged with `receiveFirmware()` hands its writes to a FirmwareReceiver instead.
+//
+// The first byte of each write is an opcode:
+//
+//     0x01 Start  - [u32 size][u32 crc32c]  Begins (or resumes) the transfer of an image
+//     0x02 Data   - [u32 offset][payload]   Carries part of the image
+//     0x03 Finish -                         Verifies the image and makes it available
+//     0x04 Abort  -                         Discards the transfer
+//
+// All integers are little-endian. We answer with notifications of [u8 status][u32 offset]: Ready (with the offset to continue
+// from) after Start, Ack every `kAckBytes` as the image arrives, Resend when a packet arrives beyond the received offset (the
+// central should go back to the offset given), and Complete or CrcMismatch after Finish.
+//
+// The image is staged in "<name>.part" in the firmware directory. The file is allocated to its full size when the transfer starts
+// and mapped into memory, so each packet is copied exactly once, from the D-Bus message straight into the page cache. Packets are
+// taken in order: a packet that overlaps what we have already received contributes only its new bytes, and a packet past a gap
+// asks for a resend (once, until the gap is filled) rather than being buffered. This keeps the running CRC32C incremental, which
+// is computed with the CPU's CRC instructions where available (see `Utils::crc32c()`.)
+//
+// Every `kCheckpointBytes` the bytes received since the last checkpoint are flushed to disk and a checkpoint ("<name>.checkpoint")
+// records how far we got along with the running CRC. Flushing waits on the disk, so it is done by a flusher thread that lives for
+// the duration of the transfer; the dispatch thread only hands it the offset and CRC to record. If the transfer is interrupted
+// (the central disconnects or the server restarts), a Start with the same size and CRC resumes from the checkpoint. Once the image
+// is complete and verified it is renamed to "<name>.bin" and its path is handed to the data setter under the characteristic's data
+// name.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "FirmwareReceiver.h"
+#include "Logger.h"
+#include "Utils.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// The largest image we accept
+static const uint32_t kMaxImageSize = 64 * 1024 * 1024;
+
+// How often (in received bytes) we acknowledge progress
+static const uint32_t kAckBytes = 16 * 1024;
+
+// How often (in received bytes) we flush the image and write a checkpoint
+static const uint32_t kCheckpointBytes = 256 * 1024;
+
+// Identifies our checkpoint files ("GGKF")
+static const uint32_t kCheckpointMagic = 0x464b4747;
+
+//
+// Checkpoint
+//
+
+struct Checkpoint
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t crc;
+	uint32_t received;
+	uint32_t receivedCrc;
+};
+
+//
+// Firmware directory
+//
+
+static std::string firmwareDirectory = "/var/lib/gattsrv";
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Configuration
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the directory that images are received into (see the discussion at the top of this file)
+//
+// This must be called before the server is started.
+void FirmwareReceiver::setDirectory(const std::string &directory)
+{
+	firmwareDirectory = directory;
+}
+
+// Returns the directory that images are received into
+std::string FirmwareReceiver::getDirectory()
+{
+	return firmwareDirectory;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Receiving
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Reads a little-endian u32 from `pData`
+static uint32_t readU32(const uint8_t *pData)
+{
+	return uint32_t(pData[0]) | uint32_t(pData[1]) << 8 | uint32_t(pData[2]) << 16 | uint32_t(pData[3]) << 24;
+}
+
+// Returns an outcome that notifies the central with `status` and `offset`
+static FirmwareReceiver::Outcome notification(FirmwareReceiver::Status status, uint32_t offset)
+{
+	FirmwareReceiver::Outcome outcome;
+	outcome.notify = true;
+	outcome.status = status;
+	outcome.offset = offset;
+	return outcome;
+}
+
+// Returns an outcome that rejects the write with `result`
+static FirmwareReceiver::Outcome rejection(FirmwareReceiver::Result result)
+{
+	FirmwareReceiver::Outcome outcome;
+	outcome.result = result;
+	return outcome;
+}
+
+// Constructs a receiver for the characteristic with the data name `name`
+FirmwareReceiver::FirmwareReceiver(const std::string &name)
+: name(name), fd(-1), pImage(nullptr), imageSize(0), imageCrc(0), received(0), receivedCrc(0), lastAck(0), lastCheckpoint(0),
+  resendRequested(false), startUS(0), flushPending(false), flusherStopping(false), pendingReceived(0), pendingReceivedCrc(0),
+  flushed(0)
+{
+	std::replace(this->name.begin(), this->name.end(), '/', '-');
+}
+
+// Checkpoints any transfer in progress so that it can be resumed
+FirmwareReceiver::~FirmwareReceiver()
+{
+	if (nullptr != pImage)
+	{
+		checkpoint();
+	}
+	close();
+}
+
+// Handles a write of `length` bytes at `pData`
+FirmwareReceiver::Outcome FirmwareReceiver::write(const uint8_t *pData, size_t length)
+{
+	if (0 == length)
+	{
+		return rejection(EInvalidLength);
+	}
+
+	switch(pData[0])
+	{
+		case EOpStart:
+			if (9 != length) { return rejection(EInvalidLength); }
+			return start(readU32(pData + 1), readU32(pData + 5));
+		case EOpData:
+			if (length < 5) { return rejection(EInvalidLength); }
+			return receive(readU32(pData + 1), pData + 5, length - 5);
+		case EOpFinish:
+			if (1 != length) { return rejection(EInvalidLength); }
+			return finish();
+		case EOpAbort:
+			if (1 != length) { return rejection(EInvalidLength); }
+			return abort();
+		default:
+			return rejection(EFailed);
+	}
+}
+
+// Encodes `outcome`'s notification into `pBuffer` (which must hold `kNotificationSize` bytes)
+void FirmwareReceiver::encodeNotification(const Outcome &outcome, uint8_t *pBuffer)
+{
+	pBuffer[0] = uint8_t(outcome.status);
+	pBuffer[1] = uint8_t(outcome.offset);
+	pBuffer[2] = uint8_t(outcome.offset >> 8);
+	pBuffer[3] = uint8_t(outcome.offset >> 16);
+	pBuffer[4] = uint8_t(outcome.offset >> 24);
+}
+
+// Begins the transfer of an image of `size` bytes with the CRC32C `crc`, resuming from a checkpoint of the same image if we have one
+FirmwareReceiver::Outcome FirmwareReceiver::start(uint32_t size, uint32_t crc)
+{
+	if (0 == size || size > kMaxImageSize)
+	{
+		Logger::warn(SSTR << "Rejected firmware image of " << size << " bytes for '" << name << "'");
+		return notification(EStatusError, 0);
+	}
+
+	// A repeated Start for the image we're receiving continues where we are
+	if (nullptr != pImage && size == imageSize && crc == imageCrc)
+	{
+		resendRequested = false;
+		return notification(EStatusReady, received);
+	}
+
+	if (nullptr != pImage)
+	{
+		checkpoint();
+		close();
+	}
+
+	if (0 != mkdir(firmwareDirectory.c_str(), 0700) && EEXIST != errno)
+	{
+		Logger::error(SSTR << "Unable to create firmware directory '" << firmwareDirectory << "': " << strerror(errno));
+		return notification(EStatusError, 0);
+	}
+
+	std::string partPath = getPath(".part");
+	fd = open(partPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		Logger::error(SSTR << "Unable to open firmware staging file '" << partPath << "': " << strerror(errno));
+		return notification(EStatusError, 0);
+	}
+
+	imageSize = size;
+	imageCrc = crc;
+	bool resumed = loadCheckpoint(size, crc);
+	if (!resumed)
+	{
+		received = 0;
+		receivedCrc = 0;
+		if (0 != ftruncate(fd, 0))
+		{
+			Logger::error(SSTR << "Unable to truncate firmware staging file '" << partPath << "': " << strerror(errno));
+			close();
+			return notification(EStatusError, 0);
+		}
+	}
+
+	// Reserve the whole image up front so that a full disk fails here rather than with SIGBUS while receiving (not every file
+	// system supports preallocation, in which case the file is simply extended)
+	if (0 != posix_fallocate(fd, 0, size) && 0 != ftruncate(fd, size))
+	{
+		Logger::error(SSTR << "Unable to size firmware staging file '" << partPath << "': " << strerror(errno));
+		close();
+		return notification(EStatusError, 0);
+	}
+
+	void *pMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == pMapping)
+	{
+		Logger::error(SSTR << "Unable to map firmware staging file '" << partPath << "': " << strerror(errno));
+		close();
+		return notification(EStatusError, 0);
+	}
+
+	pImage = static_cast<uint8_t *>(pMapping);
+	madvise(pImage, size, MADV_SEQUENTIAL);
+
+	lastAck = received;
+	lastCheckpoint = received;
+	flushed = received;
+	resendRequested = false;
+	startUS = g_get_monotonic_time();
+
+	if (resumed)
+	{
+		Logger::info(SSTR << "Resuming firmware transfer of " << size << " bytes for '" << name << "' at offset " << received);
+	}
+	else
+	{
+		Logger::info(SSTR << "Starting firmware transfer of " << size << " bytes for '" << name << "'");
+	}
+
+	return notification(EStatusReady, received);
+}
+
+// Takes `length` bytes of the image at `offset`
+FirmwareReceiver::Outcome FirmwareReceiver::receive(uint32_t offset, const uint8_t *pPayload, size_t length)
+{
+	if (nullptr == pImage)
+	{
+		return rejection(ENoTransfer);
+	}
+
+	if (offset > imageSize || length > imageSize - offset)
+	{
+		return rejection(EInvalidOffset);
+	}
+
+	// Something we already have (a retransmission after a Resend)
+	uint32_t end = offset + uint32_t(length);
+	if (end <= received)
+	{
+		return Outcome();
+	}
+
+	// A gap: ask for everything from the received offset, once until it is filled
+	if (offset > received)
+	{
+		if (resendRequested)
+		{
+			return Outcome();
+		}
+
+		resendRequested = true;
+		return notification(EStatusResend, received);
+	}
+
+	// Take only the new bytes
+	uint32_t skip = received - offset;
+	uint32_t count = end - received;
+	memcpy(pImage + received, pPayload + skip, count);
+	receivedCrc = Utils::crc32c(receivedCrc, pImage + received, count);
+	received = end;
+	resendRequested = false;
+
+	if (received - lastCheckpoint >= kCheckpointBytes)
+	{
+		checkpoint();
+	}
+
+	if (received - lastAck >= kAckBytes || received == imageSize)
+	{
+		lastAck = received;
+		return notification(EStatusAck, received);
+	}
+
+	return Outcome();
+}
+
+// Verifies the received image and, if it's complete and intact, makes it available as "<name>.bin"
+FirmwareReceiver::Outcome FirmwareReceiver::finish()
+{
+	if (nullptr == pImage)
+	{
+		return rejection(ENoTransfer);
+	}
+
+	if (received != imageSize)
+	{
+		resendRequested = false;
+		return notification(EStatusResend, received);
+	}
+
+	if (receivedCrc != imageCrc)
+	{
+		Logger::warn(SSTR << "Firmware image for '" << name << "' failed verification (CRC32C " << Utils::hex(receivedCrc)
+			<< ", expected " << Utils::hex(imageCrc) << ")");
+		close();
+		unlink(getPath(".part").c_str());
+		unlink(getPath(".checkpoint").c_str());
+		return notification(EStatusCrcMismatch, 0);
+	}
+
+	// Anything the flusher hasn't reached yet is flushed here (there's nothing left to checkpoint once the image is renamed)
+	stopFlusher();
+	long pageSize = sysconf(_SC_PAGESIZE);
+	uint32_t flushStart = flushed - flushed % uint32_t(pageSize);
+	if (0 != msync(pImage + flushStart, imageSize - flushStart, MS_SYNC) || 0 != fsync(fd))
+	{
+		Logger::error(SSTR << "Unable to flush firmware image for '" << name << "': " << strerror(errno));
+		return notification(EStatusError, received);
+	}
+
+	int64_t elapsedUS = std::max(g_get_monotonic_time() - startUS, int64_t(1));
+	uint32_t size = imageSize;
+	close();
+
+	std::string imagePath = getPath(".bin");
+	if (0 != rename(getPath(".part").c_str(), imagePath.c_str()))
+	{
+		Logger::error(SSTR << "Unable to move firmware image to '" << imagePath << "': " << strerror(errno));
+		return notification(EStatusError, 0);
+	}
+	unlink(getPath(".checkpoint").c_str());
+
+	Logger::info(SSTR << "Received firmware image '" << imagePath << "' (" << size << " bytes, "
+		<< (uint64_t(size) * 1000000 / uint64_t(elapsedUS) / 1024) << " KiB/s)");
+
+	Outcome outcome = notification(EStatusComplete, size);
+	outcome.imagePath = imagePath;
+	return outcome;
+}
+
+// Discards the transfer in progress (and any checkpoint of it)
+FirmwareReceiver::Outcome FirmwareReceiver::abort()
+{
+	if (nullptr != pImage)
+	{
+		Logger::info(SSTR << "Firmware transfer for '" << name << "' aborted at offset " << received);
+		close();
+	}
+
+	unlink(getPath(".part").c_str());
+	unlink(getPath(".checkpoint").c_str());
+	return notification(EStatusReady, 0);
+}
+
+// Loads the checkpoint for an image of `size` bytes with the CRC32C `crc`
+//
+// Returns true if the checkpoint matched (and `received` and `receivedCrc` were restored), otherwise false
+bool FirmwareReceiver::loadCheckpoint(uint32_t size, uint32_t crc)
+{
+	int checkpointFd = open(getPath(".checkpoint").c_str(), O_RDONLY | O_CLOEXEC);
+	if (checkpointFd < 0)
+	{
+		return false;
+	}
+
+	Checkpoint saved;
+	bool valid = sizeof(saved) == read(checkpointFd, &saved, sizeof(saved));
+	::close(checkpointFd);
+
+	struct stat info;
+	if (!valid || kCheckpointMagic != saved.magic || size != saved.size || crc != saved.crc || saved.received > size
+		|| 0 != fstat(fd, &info) || info.st_size != off_t(size))
+	{
+		return false;
+	}
+
+	received = saved.received;
+	receivedCrc = saved.receivedCrc;
+	return true;
+}
+
+// Hands the received offset and CRC to the flusher thread (starting it if needed), which flushes the image and records them
+//
+// Only the bytes received since the last checkpoint are flushed. They are never written again (packets are taken in order), so
+// the flusher can read them while we keep receiving past them. If the flusher is still busy with the previous checkpoint, it picks
+// up the latest one when it's done.
+void FirmwareReceiver::checkpoint()
+{
+	lastCheckpoint = received;
+
+	{
+		std::lock_guard<std::mutex> lock(flushMutex);
+		pendingReceived = received;
+		pendingReceivedCrc = receivedCrc;
+		flushPending = true;
+	}
+
+	if (!flusher.joinable())
+	{
+		flusherStopping = false;
+		flusher = std::thread(&FirmwareReceiver::runFlusher, this);
+	}
+
+	flushCondition.notify_one();
+}
+
+// The flusher thread: writes each checkpoint handed to it by `checkpoint()` until `stopFlusher()` is called
+void FirmwareReceiver::runFlusher()
+{
+	std::unique_lock<std::mutex> lock(flushMutex);
+	while (true)
+	{
+		flushCondition.wait(lock, [this] { return flushPending || flusherStopping; });
+
+		// A pending checkpoint is written even when stopping, so that an interrupted transfer can resume from it
+		if (!flushPending)
+		{
+			return;
+		}
+
+		uint32_t flushReceived = pendingReceived;
+		uint32_t flushReceivedCrc = pendingReceivedCrc;
+		flushPending = false;
+
+		lock.unlock();
+		flush(flushReceived, flushReceivedCrc);
+		lock.lock();
+	}
+}
+
+// Flushes the image up to `flushReceived` and records it, with `flushReceivedCrc`, in the checkpoint (on the flusher thread)
+//
+// The checkpoint is written to a temporary file and renamed over the previous one, so that a crash leaves either checkpoint intact.
+void FirmwareReceiver::flush(uint32_t flushReceived, uint32_t flushReceivedCrc)
+{
+	long pageSize = sysconf(_SC_PAGESIZE);
+	uint32_t flushStart = flushed - flushed % uint32_t(pageSize);
+	if (0 != msync(pImage + flushStart, flushReceived - flushStart, MS_SYNC))
+	{
+		Logger::warn(SSTR << "Unable to flush firmware image for '" << name << "': " << strerror(errno));
+		return;
+	}
+	flushed = flushReceived;
+
+	Checkpoint saved = { kCheckpointMagic, imageSize, imageCrc, flushReceived, flushReceivedCrc };
+	std::string tempPath = getPath(".checkpoint.tmp");
+	int checkpointFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (checkpointFd < 0)
+	{
+		Logger::warn(SSTR << "Unable to write firmware checkpoint '" << tempPath << "': " << strerror(errno));
+		return;
+	}
+
+	bool written = sizeof(saved) == ::write(checkpointFd, &saved, sizeof(saved)) && 0 == fsync(checkpointFd);
+	::close(checkpointFd);
+
+	if (!written || 0 != rename(tempPath.c_str(), getPath(".checkpoint").c_str()))
+	{
+		Logger::warn(SSTR << "Unable to write firmware checkpoint for '" << name << "': " << strerror(errno));
+		unlink(tempPath.c_str());
+	}
+}
+
+// Waits for the flusher thread to write any pending checkpoint, then stops it
+void FirmwareReceiver::stopFlusher()
+{
+	if (!flusher.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(flushMutex);
+		flusherStopping = true;
+	}
+
+	flushCondition.notify_one();
+	flusher.join();
+}
+
+// Unmaps and closes the staging file (leaving it and its checkpoint in place)
+//
+// The flusher is stopped first, as it reads the mapping and must not rename a checkpoint into place after we've removed it.
+void FirmwareReceiver::close()
+{
+	stopFlusher();
+
+	if (nullptr != pImage)
+	{
+		munmap(pImage, imageSize);
+		pImage = nullptr;
+	}
+
+	if (fd >= 0)
+	{
+		::close(fd);
+		fd = -1;
+	}
+}
+
+// Returns the path of our file with the extension `pExtension` in the firmware directory
+std::string FirmwareReceiver::getPath(const char *pExtension) const
+{
+	return firmwareDirectory + "/" + name + pExtension;
+}
+
+}; // namespace ggk
@@ -0,0 +1,141 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The receive path for firmware images written to a characteristic flagged with `receiveFirmware()`
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of FirmwareReceiver.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ggk {
+
+class FirmwareReceiver
+{
+public:
+
+	// The operation of each write (its first byte)
+	enum Opcode
+	{
+		EOpStart = 0x01,
+		EOpData = 0x02,
+		EOpFinish = 0x03,
+		EOpAbort = 0x04
+	};
+
+	// The status in each notification we send back to the central
+	enum Status
+	{
+		EStatusReady = 0x00,
+		EStatusAck = 0x01,
+		EStatusResend = 0x02,
+		EStatusComplete = 0x03,
+		EStatusCrcMismatch = 0x04,
+		EStatusError = 0x05
+	};
+
+	// How a write is answered
+	enum Result
+	{
+		EAccepted,
+		EInvalidLength,
+		EInvalidOffset,
+		ENoTransfer,
+		EFailed
+	};
+
+	// The outcome of a write: the reply, an optional notification and, once an image is complete, its path
+	struct Outcome
+	{
+		Result result = EAccepted;
+		bool notify = false;
+		Status status = EStatusReady;
+		uint32_t offset = 0;
+		std::string imagePath;
+	};
+
+	// The size of each notification: the status followed by an offset (little-endian)
+	static const size_t kNotificationSize = 5;
+
+	// Sets the directory that images are received into (see the discussion in FirmwareReceiver.cpp)
+	//
+	// This must be called before the server is started.
+	static void setDirectory(const std::string &directory);
+
+	// Returns the directory that images are received into
+	static std::string getDirectory();
+
+	// Constructs a receiver for the characteristic with the data name `name`
+	FirmwareReceiver(const std::string &name);
+	~FirmwareReceiver();
+
+	FirmwareReceiver(const FirmwareReceiver &) = delete;
+	FirmwareReceiver &operator =(const FirmwareReceiver &) = delete;
+
+	// Handles a write of `length` bytes at `pData`
+	Outcome write(const uint8_t *pData, size_t length);
+
+	// Encodes `outcome`'s notification into `pBuffer` (which must hold `kNotificationSize` bytes)
+	static void encodeNotification(const Outcome &outcome, uint8_t *pBuffer);
+
+private:
+
+	Outcome start(uint32_t size, uint32_t crc);
+	Outcome receive(uint32_t offset, const uint8_t *pPayload, size_t length);
+	Outcome finish();
+	Outcome abort();
+
+	bool loadCheckpoint(uint32_t size, uint32_t crc);
+	void checkpoint();
+	void runFlusher();
+	void flush(uint32_t flushReceived, uint32_t flushReceivedCrc);
+	void stopFlusher();
+	void close();
+	std::string getPath(const char *pExtension) const;
+
+	std::string name;
+	int fd;
+	uint8_t *pImage;
+	uint32_t imageSize;
+	uint32_t imageCrc;
+	uint32_t received;
+	uint32_t receivedCrc;
+	uint32_t lastAck;
+	uint32_t lastCheckpoint;
+	bool resendRequested;
+	int64_t startUS;
+
+	// The flusher thread writes checkpoints off the dispatch thread (see `checkpoint()`)
+	std::thread flusher;
+	std::mutex flushMutex;
+	std::condition_variable flushCondition;
+	bool flushPending;
+	bool flusherStopping;
+	uint32_t pendingReceived;
+	uint32_t pendingReceivedCrc;
+	uint32_t flushed;
+};
+
+}; // namespace ggk
@@ -22,17 +22,71 @@
 // in Server.cpp.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+#include <string.h>
+#include <stdexcept>
+
 #include "GattCharacteristic.h"
 #include "GattDescriptor.h"
 #include "GattProperty.h"
 #include "GattUuid.h"
 #include "DBusObject.h"
 #include "GattService.h"
+#include "ConnectionProfiles.h"
 #include "Utils.h"
 #include "Logger.h"
+#include "Pool.h"
+#include "DispatchShards.h"
+#include "ServerStats.h"
 
 namespace ggk {
 
+//
+// Constants
+//
+
+// BlueZ translates these D-Bus errors into ATT errors (for "Failed", the message carries an application error code)
+static const char *kBluezErrorInvalidValueLength = "org.bluez.Error.InvalidValueLength";
+static const char *kBluezErrorFailed = "org.bluez.Error.Failed";
+static const char *kBluezErrorInvalidOffset = "org.bluez.Error.InvalidOffset";
+static const char *kAttErrorValueNotAllowed = "0x80";
+
+//
+// Streaming
+//
+
+// Passes the start (`streaming`) or end of a stream from `characteristic` to ConnectionProfiles on the server's thread
+//
+// StartNotify and StopNotify may be dispatched on a shard's thread (see DispatchShards.cpp); on the server's thread, this runs
+// right away.
+static void postStreamingChange(const GattCharacteristic &characteristic, bool streaming)
+{
+	struct StreamingChange
+	{
+		std::string path;
+		GGKConnectionProfile profile;
+		bool streaming;
+	};
+
+	StreamingChange *pChange = new StreamingChange { characteristic.getPath().toString(), characteristic.getConnectionProfile(), streaming };
+	g_main_context_invoke_full(g_main_context_default(), G_PRIORITY_DEFAULT, [](gpointer pData) -> gboolean
+	{
+		const StreamingChange *pChange = static_cast<const StreamingChange *>(pData);
+		if (pChange->streaming)
+		{
+			ConnectionProfiles::getInstance().beginStreaming(pChange->path, pChange->profile);
+		}
+		else
+		{
+			ConnectionProfiles::getInstance().endStreaming(pChange->path);
+		}
+		return FALSE;
+	},
+	pChange, [](gpointer pData)
+	{
+		delete static_cast<StreamingChange *>(pData);
+	});
+}
+
 //
 // Standard constructor
 //
@@ -42,7 +96,11 @@ namespace ggk {
 // Genreally speaking, these objects should not be constructed directly. Rather, use the `gattCharacteristicBegin()` method
 // in `GattService`.
 GattCharacteristic::GattCharacteristic(DBusObject &owner, GattService &service, const std::string &name)
-: GattInterface(owner, name), service(service), pOnUpdatedValueFunc(nullptr)
+: GattInterface(owner, name), service(service), pOnUpdatedValueFunc(nullptr), pOnReadValueAsyncFunc(nullptr),
+  pOnWriteValueAsyncFunc(nullptr), writeSchema(ValueSchema::fixed(0)), streamingProfile(EConnectionProfileIdle),
+  streamingProfileRequested(false), notifyMethodsAdded(false),
+  pNotificationTemplate(std::allocate_shared<NotificationTemplate>(TaggedAllocator<NotificationTemplate, EMemorySchema>(),
+	getPath().toString(), getName()))
 {
 }
 
@@ -57,16 +115,31 @@ GattService &GattCharacteristic::gattCharacteristicEnd()
 // Locates a D-Bus method within this D-Bus interface and invokes the method
 bool GattCharacteristic::callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
 {
+	// A write may change our value, so fast reads wait for the next snapshot; once the write has been dispatched, it is no longer
+	// in flight (see FastRead.cpp)
+	bool write = nullptr != pValueSnapshot && methodName == "WriteValue";
+	if (write)
+	{
+		pValueSnapshot->invalidate();
+	}
+
+	bool found = false;
 	for (const DBusMethod &method : methods)
 	{
 		if (methodName == method.getName())
 		{
 			method.call<GattCharacteristic>(pConnection, getPath(), getName(), methodName, pParameters, pInvocation, pUserData);
-			return true;
+			found = true;
+			break;
 		}
 	}
 
-	return false;
+	if (write)
+	{
+		pValueSnapshot->endWrite();
+	}
+
+	return found;
 }
 
 #pragma GCC diagnostic push
@@ -169,6 +242,430 @@ bool GattCharacteristic::callOnUpdatedValue(GDBusConnection *pConnection, void *
 	return pOnUpdatedValueFunc(*this, pConnection, pUserData);
 }
 
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-function-type"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+// Asynchronous form of `onReadValue()`
+//
+// The callback receives an `AsyncReply` rather than the method invocation. It should return without blocking and complete
+// the reply (with `returnBytes()` or `returnError()`) once the value is available, from any thread. See AsyncReply.cpp for
+// the helpers available to do that without blocking the server's thread.
+GattCharacteristic &GattCharacteristic::onReadValueAsync(AsyncReadCallback callback)
+{
+	pOnReadValueAsyncFunc = callback;
+
+	// array{byte} ReadValue(dict options)
+	static const char *inArgs[] = {"a{sv}", nullptr};
+	addMethod("ReadValue", inArgs, "ay", reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		self.pOnReadValueAsyncFunc(self, AsyncReply::create(pInvocation), pUserData);
+	})));
+
+	return *this;
+}
+
+// Asynchronous form of `onWriteValue()`
+//
+// The callback receives the written value and an `AsyncReply`, which it should complete (with `returnVoid()` or
+// `returnError()`) once the write has been handled. See `onReadValueAsync()`.
+GattCharacteristic &GattCharacteristic::onWriteValueAsync(AsyncWriteCallback callback)
+{
+	pOnWriteValueAsyncFunc = callback;
+
+	// void WriteValue(array{byte} value, dict options)
+	static const char *inArgs[] = {"ay", "a{sv}", nullptr};
+	addMethod("WriteValue", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		// Copy the value out, since the parameters don't outlive this call
+		GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
+		gsize size = 0;
+		const guint8 *pBytes = static_cast<const guint8 *>(g_variant_get_fixed_array(pAyBuffer, &size, sizeof(guint8)));
+		std::vector<uint8_t> value(pBytes, pBytes + size);
+		g_variant_unref(pAyBuffer);
+
+		self.pOnWriteValueAsyncFunc(self, value, AsyncReply::create(pInvocation), pUserData);
+	})));
+
+	return *this;
+}
+
+// Declares the layout of values written to this characteristic and handles WriteValue accordingly
+//
+// Writes are validated against `schema` before any application code runs. Writes with the wrong length are rejected with the
+// ATT error "Invalid Attribute Value Length" and out-of-range values with the application error 0x80. Valid writes are decoded
+// and handed to the server's data setter (under this characteristic's data name) as a typed value (see ValueSchema.cpp),
+// after which `onUpdatedValue` is called.
+//
+// Use this in place of `onWriteValue()`.
+GattCharacteristic &GattCharacteristic::writeValueSchema(const ValueSchema &schema)
+{
+	writeSchema = schema;
+
+	// void WriteValue(array{byte} value, dict options)
+	static const char *inArgs[] = {"ay", "a{sv}", nullptr};
+	addMethod("WriteValue", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		const ValueSchema &schema = self.getWriteSchema();
+		const std::string name = self.getPathNode().toString();
+		const char *pName = name.c_str();
+
+		// Validate the value in place
+		GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
+		gsize length = 0;
+		const uint8_t *pData = static_cast<const uint8_t *>(g_variant_get_fixed_array(pAyBuffer, &length, sizeof(guint8)));
+
+		ValueSchema::Result result = schema.validate(pData, length);
+		if (ValueSchema::EValid != result)
+		{
+			Logger::warn(SSTR << "Rejected write of " << length << " byte(s) to '" << pName << "', expected " << schema.toString());
+			g_variant_unref(pAyBuffer);
+
+			if (ValueSchema::EInvalidLength == result)
+			{
+				g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidValueLength, "Invalid value length");
+			}
+			else
+			{
+				g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorFailed, kAttErrorValueNotAllowed);
+			}
+			return;
+		}
+
+		// Hand the decoded value to the setter
+		bool stored = false;
+		if (ValueSchema::EUnsigned == schema.kind)
+		{
+			uint32_t value = schema.decodeUnsigned(pData);
+			switch(schema.size)
+			{
+				case sizeof(uint8_t): stored = self.setDataValue(pName, uint8_t(value)); break;
+				case sizeof(uint16_t): stored = self.setDataValue(pName, uint16_t(value)); break;
+				default: stored = self.setDataValue(pName, value); break;
+			}
+		}
+		else if (ValueSchema::EString == schema.kind)
+		{
+			PooledString value(reinterpret_cast<const char *>(pData), length);
+			stored = self.setDataPointer(pName, value.c_str());
+		}
+		else
+		{
+			stored = self.setDataPointer(pName, pData);
+		}
+
+		g_variant_unref(pAyBuffer);
+
+		if (!stored)
+		{
+			g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorFailed, "The value was not accepted");
+			return;
+		}
+
+		self.callOnUpdatedValue(pConnection, pUserData);
+		self.methodReturnVariant(pInvocation, NULL);
+	})));
+
+	return *this;
+}
+
+// Requests the connection profile `profile` for as long as a client is subscribed to this characteristic's notifications
+//
+// This adds handlers for BlueZ's StartNotify/StopNotify methods, which are called when the first client subscribes and when
+// the last client unsubscribes. The handlers only record the request, which the periodic timer applies (to the links that are
+// already up as well as to new ones.) See ConnectionProfiles.cpp for details on how profiles are applied.
+//
+// With dispatch shards, the handlers run on our shard's thread, so the request is passed to the server's thread, where the
+// rest of the connection profiles' state lives.
+GattCharacteristic &GattCharacteristic::connectionProfile(GGKConnectionProfile profile)
+{
+	streamingProfile = profile;
+	streamingProfileRequested = true;
+	addNotifyMethods();
+	return *this;
+}
+
+// Adds (once) the handlers for BlueZ's StartNotify/StopNotify methods, shared by `connectionProfile()` and `deltaNotify()`
+//
+// StartNotify requests our streaming connection profile (if we have one) and makes the next delta notification a keyframe, so
+// that the first subscriber starts from a whole value. StopNotify ends the streaming request.
+void GattCharacteristic::addNotifyMethods()
+{
+	if (notifyMethodsAdded)
+	{
+		return;
+	}
+	notifyMethodsAdded = true;
+
+	static const char *inArgs[] = {nullptr};
+	addMethod("StartNotify", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		if (self.streamingProfileRequested)
+		{
+			postStreamingChange(self, true);
+		}
+		if (nullptr != self.getDeltaEncoder())
+		{
+			self.getDeltaEncoder()->requestKeyframe();
+		}
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+	})));
+	addMethod("StopNotify", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		if (self.streamingProfileRequested)
+		{
+			postStreamingChange(self, false);
+		}
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+	})));
+}
+
+// Receives firmware images written to this characteristic (see FirmwareReceiver.cpp for the protocol)
+//
+// Writes are staged straight into a memory-mapped file in the firmware directory, with progress notified back to the central.
+// Once an image is complete and its CRC32C verified, its path is handed to the server's data setter (under this
+// characteristic's data name) as a string, after which `onUpdatedValue` is called.
+//
+// Use this in place of `onWriteValue()`. The characteristic should have the "write-without-response" and "notify" flags, and
+// "encrypt-authenticated-write" so that only an authenticated central can replace the firmware.
+GattCharacteristic &GattCharacteristic::receiveFirmware()
+{
+	pFirmwareReceiver = std::allocate_shared<FirmwareReceiver>(TaggedAllocator<FirmwareReceiver, EMemorySchema>(), getPathNode().toString());
+
+	// void WriteValue(array{byte} value, dict options)
+	static const char *inArgs[] = {"ay", "a{sv}", nullptr};
+	addMethod("WriteValue", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		// Hand the packet to the receiver in place
+		GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
+		gsize length = 0;
+		const uint8_t *pData = static_cast<const uint8_t *>(g_variant_get_fixed_array(pAyBuffer, &length, sizeof(guint8)));
+		FirmwareReceiver::Outcome outcome = self.getFirmwareReceiver()->write(pData, length);
+		g_variant_unref(pAyBuffer);
+
+		switch(outcome.result)
+		{
+			case FirmwareReceiver::EAccepted:
+				break;
+			case FirmwareReceiver::EInvalidLength:
+				g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidValueLength, "Invalid value length");
+				return;
+			case FirmwareReceiver::EInvalidOffset:
+				g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidOffset, "Invalid offset");
+				return;
+			default:
+				g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorFailed, kAttErrorValueNotAllowed);
+				return;
+		}
+
+		if (outcome.notify)
+		{
+			uint8_t notification[FirmwareReceiver::kNotificationSize];
+			FirmwareReceiver::encodeNotification(outcome, notification);
+			self.sendChangeNotificationVariant(pConnection, Utils::gvariantFromByteArray(notification, sizeof(notification)));
+		}
+
+		if (!outcome.imagePath.empty() && self.setDataPointer(self.getPathNode().c_str(), outcome.imagePath.c_str()))
+		{
+			self.callOnUpdatedValue(pConnection, pUserData);
+		}
+
+		self.methodReturnVariant(pInvocation, NULL);
+	})));
+
+	return *this;
+}
+
+// Keeps the last `capacity` samples of `sampleSize` bytes appended to this characteristic (see SampleRing.cpp)
+//
+// Samples are appended with `ggkAppendSample()`. Reads return batches of samples from a cursor that centrals set by writing a
+// sequence number, and samples are notified in batches of `notifyBatch` as they arrive.
+//
+// Use this in place of `onReadValue()`, `onWriteValue()` and `onUpdatedValue()`. The characteristic should have the "read",
+// "write" and "notify" flags. A batch must hold at least one sample, so `sampleSize` is at most `SampleRing::kMaxSampleSize`.
+//
+// Notifications are sized to the smallest ATT_MTU a central has reported (with a read or write), or to the minimum ATT_MTU of 23
+// until one has. A notification holds `SampleRing::kHeaderSize` + `SampleRing::kDeltaSize` bytes plus each sample, so samples
+// over 5 bytes are only notified once a central has reported an MTU of at least `sampleSize` + 18; until then, they can only be
+// read.
+GattCharacteristic &GattCharacteristic::sampleRing(size_t capacity, size_t sampleSize, size_t notifyBatch)
+{
+	if (0 == sampleSize || sampleSize > SampleRing::kMaxSampleSize)
+	{
+		Logger::error(SSTR << "Samples of " << sampleSize << " bytes don't fit a batch for '" << getPath().toString()
+			<< "' (at most " << SampleRing::kMaxSampleSize << " bytes)");
+		throw std::invalid_argument("Invalid sample size");
+	}
+
+	pSampleRing = std::allocate_shared<SampleRing>(TaggedAllocator<SampleRing, EMemorySchema>(), capacity, sampleSize, notifyBatch);
+
+	// array{byte} ReadValue(dict options)
+	static const char *readArgs[] = {"a{sv}", nullptr};
+	addMethod("ReadValue", readArgs, "ay", reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		// BlueZ tells us the offset of long reads, the central reading and, when it knows it, the MTU
+		guint16 offset = 0;
+		guint16 mtu = 0;
+		const gchar *pDevice = "";
+		GVariant *pOptions = g_variant_get_child_value(pParameters, 0);
+		g_variant_lookup(pOptions, "offset", "q", &offset);
+		g_variant_lookup(pOptions, "mtu", "q", &mtu);
+		g_variant_lookup(pOptions, "device", "&o", &pDevice);
+		std::string device = pDevice;
+		g_variant_unref(pOptions);
+
+		SampleRing::Batch batch;
+		if (!self.getSampleRing()->read(device, mtu, offset, batch))
+		{
+			g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidOffset, "Invalid offset");
+			return;
+		}
+
+		self.methodReturnVariant(pInvocation, Utils::gvariantFromByteArray(batch.data(), int(batch.size())), true);
+	})));
+
+	// void WriteValue(array{byte} value, dict options)
+	static const char *writeArgs[] = {"ay", "a{sv}", nullptr};
+	addMethod("WriteValue", writeArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		// The value is the sequence number to read from next: [u32]
+		GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
+		gsize length = 0;
+		const uint8_t *pData = static_cast<const uint8_t *>(g_variant_get_fixed_array(pAyBuffer, &length, sizeof(guint8)));
+		if (sizeof(uint32_t) != length)
+		{
+			g_variant_unref(pAyBuffer);
+			g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidValueLength, "Invalid value length");
+			return;
+		}
+
+		uint32_t sequence = uint32_t(pData[0]) | uint32_t(pData[1]) << 8 | uint32_t(pData[2]) << 16 | uint32_t(pData[3]) << 24;
+		g_variant_unref(pAyBuffer);
+
+		// The cursor belongs to the central writing (and we note its MTU for sizing notifications)
+		guint16 mtu = 0;
+		const gchar *pDevice = "";
+		GVariant *pOptions = g_variant_get_child_value(pParameters, 1);
+		g_variant_lookup(pOptions, "mtu", "q", &mtu);
+		g_variant_lookup(pOptions, "device", "&o", &pDevice);
+		std::string device = pDevice;
+		g_variant_unref(pOptions);
+
+		self.getSampleRing()->setCursor(device, mtu, sequence);
+		self.methodReturnVariant(pInvocation, NULL);
+	})));
+
+	// Appends queue an update once a batch is waiting, which we notify here (along with any others that have filled since.)
+	// `takeNotification()` stops once nothing is waiting or the samples don't fit a notification (see SampleRing.cpp.)
+	pOnUpdatedValueFunc = CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
+	{
+		SampleRing::Batch batch;
+		while (self.getSampleRing()->takeNotification(batch))
+		{
+			self.sendChangeNotificationVariant(pConnection, Utils::gvariantFromByteArray(batch.data(), int(batch.size())));
+		}
+		return true;
+	};
+
+	return *this;
+}
+
+// Binds the data values `fields` into one packed value, notified once for any number of changes to them (see
+// CompositeValue.cpp)
+//
+// Changes are announced with `ggkNotifyUpdatedData()`, or by notifying a bound value's own characteristic. The library packs
+// the value for ReadValue and for notifications.
+//
+// Use this in place of `onReadValue()` and `onUpdatedValue()`. The characteristic should have the "read" and "notify" flags.
+GattCharacteristic &GattCharacteristic::composite(const std::vector<CompositeValue::Field> &fields)
+{
+	pCompositeValue = std::allocate_shared<CompositeValue>(TaggedAllocator<CompositeValue, EMemorySchema>(), fields);
+
+	// array{byte} ReadValue(dict options)
+	static const char *inArgs[] = {"a{sv}", nullptr};
+	addMethod("ReadValue", inArgs, "ay", reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		std::shared_ptr<CompositeValue> pComposite = self.getCompositeValue();
+		std::vector<guint8> value(pComposite->getSize());
+		pComposite->pack(value.data());
+		self.methodReturnVariant(pInvocation, Utils::gvariantFromByteArray(value.data(), int(value.size())), true);
+	})));
+
+	// Changes to any bound value are coalesced into one update (see `CompositeValue::schedule()`), which we notify here
+	pOnUpdatedValueFunc = CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
+	{
+		std::shared_ptr<CompositeValue> pComposite = self.getCompositeValue();
+		pComposite->clearPending();
+
+		std::vector<guint8> value(pComposite->getSize());
+		pComposite->pack(value.data());
+		self.sendChangeNotificationVariant(pConnection, Utils::gvariantFromByteArray(value.data(), int(value.size())));
+		return true;
+	};
+
+	return *this;
+}
+
+// Serves this characteristic's value compressed, for large values fetched with long reads (see CompressedBlob.cpp)
+//
+// The value is requested from the data getter (under this characteristic's data name) as a null-terminated string. Each
+// version of it is compressed once, and reads at an offset are served from the cached encoding. This adds a descriptor that
+// advertises the encoding.
+//
+// Use this in place of `onReadValue()`. The characteristic should have the "read" flag.
+GattCharacteristic &GattCharacteristic::compressedRead()
+{
+	pCompressedBlob = std::allocate_shared<CompressedBlob>(TaggedAllocator<CompressedBlob, EMemorySchema>());
+
+	// array{byte} ReadValue(dict options)
+	static const char *inArgs[] = {"a{sv}", nullptr};
+	addMethod("ReadValue", inArgs, "ay", reinterpret_cast<DBusMethod::Callback>(static_cast<MethodCallback>(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+	{
+		guint16 offset = 0;
+		const gchar *pDevice = "";
+		GVariant *pOptions = g_variant_get_child_value(pParameters, 0);
+		g_variant_lookup(pOptions, "offset", "q", &offset);
+		g_variant_lookup(pOptions, "device", "&o", &pDevice);
+		std::string device = pDevice;
+		g_variant_unref(pOptions);
+
+		// Only a read from the start looks at the value; the rest of a long read comes from the central's same encoding
+		const char *pValue = 0 == offset ? self.getDataPointer<const char *>(self.getPathNode().c_str(), "") : "";
+
+		CompressedBlob::Buffer encoded;
+		if (!self.getCompressedBlob()->read(device, offset, reinterpret_cast<const uint8_t *>(pValue), strlen(pValue), encoded))
+		{
+			g_dbus_method_invocation_return_dbus_error(pInvocation, kBluezErrorInvalidOffset, "Invalid offset");
+			return;
+		}
+
+		self.methodReturnVariant(pInvocation, Utils::gvariantFromByteArray(encoded.data(), int(encoded.size())), true);
+	})));
+
+	gattDescriptorBegin("encoding", CompressedBlob::kEncodingDescriptorUuid, {"read"})
+		.onReadValue(DESCRIPTOR_METHOD_CALLBACK_LAMBDA
+		{
+			self.methodReturnValue(pInvocation, CompressedBlob::kEncodingName, true);
+		})
+	.gattDescriptorEnd();
+
+	return *this;
+}
+
+// Sends this characteristic's notifications as deltas against the last value sent (see DeltaNotification.cpp)
+//
+// The value is laid out as fields of `fieldSizes` bytes. Each notification carries only the fields that changed since the
+// previous one, with a keyframe of the whole value at least every `keyframeInterval` notifications. Reads are unaffected.
+//
+// Use this alongside `onUpdatedValue()` (or a builder that notifies, such as `composite()`.) The characteristic should have
+// the "notify" flag, and its notifications must be byte arrays. A keyframe is sent first when a central subscribes.
+GattCharacteristic &GattCharacteristic::deltaNotify(const std::vector<size_t> &fieldSizes, int keyframeInterval)
+{
+	pDeltaEncoder = std::allocate_shared<DeltaEncoder>(TaggedAllocator<DeltaEncoder, EMemorySchema>(), fieldSizes, keyframeInterval);
+	addNotifyMethods();
+	return *this;
+}
+#pragma GCC diagnostic pop
+
 // Convenience functions to add a GATT descriptor to the hierarchy
 //
 // We simply add a new child at the given path and add an interface configured as a GATT descriptor to it. The
@@ -191,7 +688,7 @@ bool GattCharacteristic::callOnUpdatedValue(GDBusConnection *pConnection, void *
 GattDescriptor &GattCharacteristic::gattDescriptorBegin(const std::string &pathElement, const GattUuid &uuid, const std::vector<const char *> &flags)
 {
 	DBusObject &child = owner.addChild(DBusObjectPath(pathElement));
-	GattDescriptor &descriptor = *child.addInterface(std::make_shared<GattDescriptor>(child, *this, "org.bluez.GattDescriptor1"));
+	GattDescriptor &descriptor = *child.addInterface(std::allocate_shared<GattDescriptor>(TaggedAllocator<GattDescriptor, EMemorySchema>(), child, *this, "org.bluez.GattDescriptor1"));
 	descriptor.addProperty<GattDescriptor>("UUID", uuid);
 	descriptor.addProperty<GattDescriptor>("Characteristic", getPath());
 	descriptor.addProperty<GattDescriptor>("Flags", flags);
@@ -203,15 +700,94 @@ GattDescriptor &GattCharacteristic::gattDescriptorBegin(const std::string &pathE
 // This is a generalized method that accepts a `GVariant *`. A templated version is available that supports common types called
 // `sendChangeNotificationValue()`.
 //
+// The signal is sent from a template that is built along with the characteristic (see NotificationTemplate.cpp), so it can be
+// shared by the server's thread and our shard's thread without a lock. If this characteristic is flagged with `deltaNotify()`,
+// the value is delta-encoded first.
+//
 // The caller may choose to consult HciAdapter::getInstance().getActiveConnectionCount() in order to determine if there are any
 // active connections before sending a change notification.
 void GattCharacteristic::sendChangeNotificationVariant(GDBusConnection *pBusConnection, GVariant *pNewValue) const
 {
-	g_auto(GVariantBuilder) builder;
-	g_variant_builder_init(&builder, G_VARIANT_TYPE_ARRAY);
-	g_variant_builder_add(&builder, "{sv}", "Value", pNewValue);
-	GVariant *pSasv = g_variant_new("(sa{sv})", "org.bluez.GattCharacteristic1", &builder);
-	owner.emitSignal(pBusConnection, "org.freedesktop.DBus.Properties", "PropertiesChanged", pSasv);
+	// Publish the new value for fast reads before sending consumes it
+	if (nullptr != pValueSnapshot)
+	{
+		publishSnapshot(pNewValue);
+	}
+
+	// Send from the connection that registered us with BlueZ (see DispatchShards.cpp)
+	GDBusConnection *pConnection = DispatchShards::getConnection(*this, pBusConnection);
+
+	// Replace the value with its delta from the last one sent (see DeltaNotification.cpp), sending it under the encoder's lock so
+	// that notifications from the server's thread and our shard's thread leave in the order they were encoded
+	if (nullptr != pDeltaEncoder && g_variant_is_of_type(pNewValue, G_VARIANT_TYPE_BYTESTRING))
+	{
+		g_variant_ref_sink(pNewValue);
+
+		gsize size = 0;
+		const guint8 *pData = static_cast<const guint8 *>(g_variant_get_fixed_array(pNewValue, &size, sizeof(guint8)));
+
+		pDeltaEncoder->encodeAndSend(pData, size, [this, pConnection](const DeltaBuffer &encoded)
+		{
+			pNotificationTemplate->send(pConnection, Utils::gvariantFromByteArray(encoded.data(), int(encoded.size())));
+		});
+		g_variant_unref(pNewValue);
+	}
+	else
+	{
+		pNotificationTemplate->send(pConnection, pNewValue);
+	}
+
+	ServerStats::recordNotification();
+}
+
+// Answers ReadValue calls for this characteristic from a snapshot of its value, on GDBus's worker thread
+//
+// The snapshot is taken from the replies to ReadValue (from `onReadValue()`) and from change notifications, so this is only
+// suitable for values whose changes are announced with `ggkNofifyUpdatedCharacteristic()`. See FastRead.cpp.
+GattCharacteristic &GattCharacteristic::fastRead()
+{
+	pValueSnapshot = std::allocate_shared<ValueSnapshot>(TaggedAllocator<ValueSnapshot, EMemorySchema>());
+	return *this;
+}
+
+// Sends the reply to a method call, publishing the value to our snapshot if it's the reply to ReadValue (see `fastRead()`)
+//
+// The reply to a read at an offset may hold only part of the value, so it isn't published.
+void GattCharacteristic::methodReturnVariant(GDBusMethodInvocation *pInvocation, GVariant *pVariant, bool wrapInTuple) const
+{
+	if (nullptr != pValueSnapshot && nullptr != pVariant && wrapInTuple
+		&& 0 == strcmp(g_dbus_method_invocation_get_method_name(pInvocation), "ReadValue"))
+	{
+		guint16 offset = 0;
+		GVariant *pParameters = g_dbus_method_invocation_get_parameters(pInvocation);
+		if (nullptr != pParameters && g_variant_is_of_type(pParameters, G_VARIANT_TYPE("(a{sv})")))
+		{
+			GVariant *pOptions = g_variant_get_child_value(pParameters, 0);
+			g_variant_lookup(pOptions, "offset", "q", &offset);
+			g_variant_unref(pOptions);
+		}
+
+		if (0 == offset)
+		{
+			publishSnapshot(pVariant);
+		}
+	}
+
+	GattInterface::methodReturnVariant(pInvocation, pVariant, wrapInTuple);
+}
+
+// Publishes `pValue` to our snapshot if it's a byte array, or invalidates the snapshot if it isn't
+void GattCharacteristic::publishSnapshot(GVariant *pValue) const
+{
+	if (!g_variant_is_of_type(pValue, G_VARIANT_TYPE_BYTESTRING))
+	{
+		pValueSnapshot->invalidate();
+		return;
+	}
+
+	gsize size = 0;
+	const void *pData = g_variant_get_fixed_array(pValue, &size, sizeof(guint8));
+	pValueSnapshot->publish(pData, size);
 }
 
 }; // namespace ggk
\ No newline at end of file
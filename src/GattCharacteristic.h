@@ -26,11 +26,22 @@
 #include <gio/gio.h>
 #include <string>
 #include <list>
+#include <memory>
 
 #include "Utils.h"
 #include "TickEvent.h"
+#include "../include/Gobbledegook.h"
 #include "GattInterface.h"
 #include "HciAdapter.h"
+#include "AsyncReply.h"
+#include "ValueSchema.h"
+#include "NotificationTemplate.h"
+#include "FastRead.h"
+#include "FirmwareReceiver.h"
+#include "SampleRing.h"
+#include "CompositeValue.h"
+#include "CompressedBlob.h"
+#include "DeltaNotification.h"
 
 namespace ggk {
 
@@ -74,6 +85,21 @@ struct DBusObject;
        void *pUserData \
 )
 
+#define CHARACTERISTIC_ASYNC_READ_CALLBACK_LAMBDA [] \
+( \
+	const GattCharacteristic &self, \
+	AsyncReply::Ptr reply, \
+	void *pUserData \
+)
+
+#define CHARACTERISTIC_ASYNC_WRITE_CALLBACK_LAMBDA [] \
+( \
+	const GattCharacteristic &self, \
+	const std::vector<uint8_t> &value, \
+	AsyncReply::Ptr reply, \
+	void *pUserData \
+)
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Representation of a Bluetooth GATT Characteristic
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -86,6 +112,8 @@ struct GattCharacteristic : GattInterface
 	typedef void (*MethodCallback)(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData);
 	typedef void (*EventCallback)(const GattCharacteristic &self, const TickEvent &event, GDBusConnection *pConnection, void *pUserData);
 	typedef bool (*UpdatedValueCallback)(const GattCharacteristic &self, GDBusConnection *pConnection, void *pUserData);
+	typedef void (*AsyncReadCallback)(const GattCharacteristic &self, AsyncReply::Ptr reply, void *pUserData);
+	typedef void (*AsyncWriteCallback)(const GattCharacteristic &self, const std::vector<uint8_t> &value, AsyncReply::Ptr reply, void *pUserData);
 
 	// Construct a GattCharacteristic
 	//
@@ -137,6 +165,110 @@ struct GattCharacteristic : GattInterface
 	//     Output args: void
 	GattCharacteristic &onWriteValue(MethodCallback callback);
 
+	// Asynchronous form of `onReadValue()`
+	//
+	// The callback receives an `AsyncReply` rather than the method invocation. It should return without blocking and complete
+	// the reply (with `returnBytes()` or `returnError()`) once the value is available, from any thread. See AsyncReply.cpp for
+	// the helpers available to do that without blocking the server's thread.
+	GattCharacteristic &onReadValueAsync(AsyncReadCallback callback);
+
+	// Asynchronous form of `onWriteValue()`
+	//
+	// The callback receives the written value and an `AsyncReply`, which it should complete (with `returnVoid()` or
+	// `returnError()`) once the write has been handled. See `onReadValueAsync()`.
+	GattCharacteristic &onWriteValueAsync(AsyncWriteCallback callback);
+
+	// Declares the layout of values written to this characteristic and handles WriteValue accordingly
+	//
+	// Writes are validated against `schema` before any application code runs. Writes with the wrong length are rejected with the
+	// ATT error "Invalid Attribute Value Length" and out-of-range values with the application error 0x80. Valid writes are decoded
+	// and handed to the server's data setter (under this characteristic's data name) as a typed value (see ValueSchema.cpp),
+	// after which `onUpdatedValue` is called.
+	//
+	// Use this in place of `onWriteValue()`.
+	GattCharacteristic &writeValueSchema(const ValueSchema &schema);
+
+	// Returns the schema declared with `writeValueSchema()`
+	const ValueSchema &getWriteSchema() const { return writeSchema; }
+
+	// Answers ReadValue calls for this characteristic from a snapshot of its value, on GDBus's worker thread
+	//
+	// The snapshot is taken from the replies to ReadValue (from `onReadValue()`) and from change notifications, so this is only
+	// suitable for values whose changes are announced with `ggkNofifyUpdatedCharacteristic()`. See FastRead.cpp.
+	GattCharacteristic &fastRead();
+
+	// Returns the value snapshot kept for `fastRead()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<ValueSnapshot> getValueSnapshot() const { return pValueSnapshot; }
+
+	// Receives firmware images written to this characteristic (see FirmwareReceiver.cpp for the protocol)
+	//
+	// Writes are staged straight into a memory-mapped file in the firmware directory, with progress notified back to the central.
+	// Once an image is complete and its CRC32C verified, its path is handed to the server's data setter (under this
+	// characteristic's data name) as a string, after which `onUpdatedValue` is called.
+	//
+	// Use this in place of `onWriteValue()`. The characteristic should have the "write-without-response" and "notify" flags, and
+	// "encrypt-authenticated-write" so that only an authenticated central can replace the firmware.
+	GattCharacteristic &receiveFirmware();
+
+	// Returns the receiver for `receiveFirmware()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<FirmwareReceiver> getFirmwareReceiver() const { return pFirmwareReceiver; }
+
+	// Keeps the last `capacity` samples of `sampleSize` bytes appended to this characteristic (see SampleRing.cpp)
+	//
+	// Samples are appended with `ggkAppendSample()`. Reads return batches of samples from a cursor that centrals set by writing a
+	// sequence number, and samples are notified in batches of `notifyBatch` as they arrive.
+	//
+	// Use this in place of `onReadValue()`, `onWriteValue()` and `onUpdatedValue()`. The characteristic should have the "read",
+	// "write" and "notify" flags. A batch must hold at least one sample, so `sampleSize` is at most `SampleRing::kMaxSampleSize`.
+	//
+	// Notifications are sized to the smallest ATT_MTU a central has reported (with a read or write), or to the minimum ATT_MTU of
+	// 23 until one has. A notification holds `SampleRing::kHeaderSize` + `SampleRing::kDeltaSize` bytes plus each sample, so
+	// samples over 5 bytes are only notified once a central has reported an MTU of at least `sampleSize` + 18; until then, they
+	// can only be read.
+	GattCharacteristic &sampleRing(size_t capacity, size_t sampleSize, size_t notifyBatch);
+
+	// Returns the ring for `sampleRing()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<SampleRing> getSampleRing() const { return pSampleRing; }
+
+	// Binds the data values `fields` into one packed value, notified once for any number of changes to them (see
+	// CompositeValue.cpp)
+	//
+	// Changes are announced with `ggkNotifyUpdatedData()`, or by notifying a bound value's own characteristic. The library packs
+	// the value for ReadValue and for notifications.
+	//
+	// Use this in place of `onReadValue()` and `onUpdatedValue()`. The characteristic should have the "read" and "notify" flags.
+	GattCharacteristic &composite(const std::vector<CompositeValue::Field> &fields);
+
+	// Returns the layout for `composite()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<CompositeValue> getCompositeValue() const { return pCompositeValue; }
+
+	// Serves this characteristic's value compressed, for large values fetched with long reads (see CompressedBlob.cpp)
+	//
+	// The value is requested from the data getter (under this characteristic's data name) as a null-terminated string. Each
+	// version of it is compressed once, and reads at an offset are served from the cached encoding. This adds a descriptor that
+	// advertises the encoding.
+	//
+	// Use this in place of `onReadValue()`. The characteristic should have the "read" flag.
+	GattCharacteristic &compressedRead();
+
+	// Returns the cache for `compressedRead()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<CompressedBlob> getCompressedBlob() const { return pCompressedBlob; }
+
+	// Sends this characteristic's notifications as deltas against the last value sent (see DeltaNotification.cpp)
+	//
+	// The value is laid out as fields of `fieldSizes` bytes. Each notification carries only the fields that changed since the
+	// previous one, with a keyframe of the whole value at least every `keyframeInterval` notifications. Reads are unaffected.
+	//
+	// Use this alongside `onUpdatedValue()` (or a builder that notifies, such as `composite()`.) The characteristic should have
+	// the "notify" flag, and its notifications must be byte arrays. A keyframe is sent first when a central subscribes.
+	GattCharacteristic &deltaNotify(const std::vector<size_t> &fieldSizes, int keyframeInterval = 16);
+
+	// Returns the encoder for `deltaNotify()`, or nullptr if this characteristic isn't flagged
+	std::shared_ptr<DeltaEncoder> getDeltaEncoder() const { return pDeltaEncoder; }
+
+	// Sends the reply to a method call, publishing the value to our snapshot if it's the reply to ReadValue (see `fastRead()`)
+	virtual void methodReturnVariant(GDBusMethodInvocation *pInvocation, GVariant *pVariant, bool wrapInTuple = false) const;
+
 	// Custom support for handling updates to our characteristic's value
 	//
 	// Defined as: (NOT defined by Bluetooth or BlueZ - this method is internal only)
@@ -168,6 +300,16 @@ struct GattCharacteristic : GattInterface
 	//      })
 	bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
 
+	// Requests the connection profile `profile` for as long as a client is subscribed to this characteristic's notifications
+	//
+	// This adds handlers for BlueZ's StartNotify/StopNotify methods, which are called when the first client subscribes and when
+	// the last client unsubscribes. The handlers only record the request, which the periodic timer applies (to the links that are
+	// already up as well as to new ones.) See ConnectionProfiles.cpp for details on how profiles are applied.
+	GattCharacteristic &connectionProfile(GGKConnectionProfile profile);
+
+	// Returns the connection profile requested by this characteristic while streaming (see `connectionProfile()`)
+	GGKConnectionProfile getConnectionProfile() const { return streamingProfile; }
+
 	// Convenience functions to add a GATT descriptor to the hierarchy
 	//
 	// We simply add a new child at the given path and add an interface configured as a GATT descriptor to it. The
@@ -193,6 +335,10 @@ struct GattCharacteristic : GattInterface
 	// This is a generalized method that accepts a `GVariant *`. A templated version is available that supports common types called
 	// `sendChangeNotificationValue()`.
 	//
+	// The signal is sent from a template that is built with the characteristic (see NotificationTemplate.cpp). If our service
+	// belongs to a dispatch shard, it is sent on the shard's connection instead of `pBusConnection` (see DispatchShards.cpp.) If
+	// this characteristic is flagged with `deltaNotify()`, the value is delta-encoded first.
+	//
 	// The caller may choose to consult HciAdapter::getInstance().getActiveConnectionCount() in order to determine if there are any
 	// active connections before sending a change notification.
 	void sendChangeNotificationVariant(GDBusConnection *pBusConnection, GVariant *pNewValue) const;
@@ -213,8 +359,27 @@ struct GattCharacteristic : GattInterface
 
 protected:
 
+	// Publishes `pValue` to our snapshot if it's a byte array, or invalidates the snapshot if it isn't
+	void publishSnapshot(GVariant *pValue) const;
+
+	// Adds (once) the handlers for BlueZ's StartNotify/StopNotify methods, shared by `connectionProfile()` and `deltaNotify()`
+	void addNotifyMethods();
+
 	GattService &service;
 	UpdatedValueCallback pOnUpdatedValueFunc;
+	AsyncReadCallback pOnReadValueAsyncFunc;
+	AsyncWriteCallback pOnWriteValueAsyncFunc;
+	ValueSchema writeSchema;
+	GGKConnectionProfile streamingProfile;
+	bool streamingProfileRequested;
+	bool notifyMethodsAdded;
+	const std::shared_ptr<NotificationTemplate> pNotificationTemplate;
+	std::shared_ptr<ValueSnapshot> pValueSnapshot;
+	std::shared_ptr<FirmwareReceiver> pFirmwareReceiver;
+	std::shared_ptr<SampleRing> pSampleRing;
+	std::shared_ptr<CompositeValue> pCompositeValue;
+	std::shared_ptr<CompressedBlob> pCompressedBlob;
+	std::shared_ptr<DeltaEncoder> pDeltaEncoder;
 };
 
 }; // namespace ggk
\ No newline at end of file
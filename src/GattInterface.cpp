@@ -45,7 +45,7 @@ GattInterface::~GattInterface()
 //
 
 // Returns the list of GATT properties
-const std::list<GattProperty> &GattInterface::getProperties() const
+const GattInterface::PropertyList &GattInterface::getProperties() const
 {
 	return properties;
 }
@@ -30,6 +30,7 @@
 #include "DBusInterface.h"
 #include "GattProperty.h"
 #include "GattUuid.h"
+#include "MemoryStats.h"
 #include "DosellGatt.h"
 #include "Utils.h"
 
@@ -48,6 +49,9 @@ struct DBusObject;
 
 struct GattInterface : DBusInterface
 {
+	// A convenience typedef for describing our list of properties
+	typedef TaggedList<GattProperty, EMemorySchema> PropertyList;
+
 	// Standard constructor
 	GattInterface(DBusObject &owner, const std::string &name);
 	virtual ~GattInterface();
@@ -60,7 +64,7 @@ struct GattInterface : DBusInterface
 	//
 
 	// Returns the list of GATT properties
-	const std::list<GattProperty> &getProperties() const;
+	const PropertyList &getProperties() const;
 
 	// Add a `GattProperty` to the interface
 	//
@@ -142,7 +146,7 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	T getDataValue(const char *pName, const T defaultValue) const
 	{
-		const void *pData = THESERVER->getDataGetter()(pName);
+		const void *pData = THESERVER->getData(pName);
 		return nullptr == pData ? defaultValue : *static_cast<const T *>(pData);
 	}
 
@@ -150,7 +154,7 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	const T* getDataArrayValue(const char *pName, const T* defaultValue) const
 	{
-		const void *pData = THESERVER->getDataGetter()(pName);
+		const void *pData = THESERVER->getData(pName);
 		return (nullptr == pData) ? defaultValue: static_cast<const T *>(pData);
 	}
 	// Return a data pointer from the server's registered data getter (GGKServerDataGetter)
@@ -163,7 +167,7 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	T getDataPointer(const char *pName, const T defaultValue) const
 	{
-		const void *pData = THESERVER->getDataGetter()(pName);
+		const void *pData = THESERVER->getData(pName);
 		return nullptr == pData ? defaultValue : static_cast<const T>(pData);
 	}
 
@@ -178,7 +182,7 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	bool setDataValue(const char *pName, const T value) const
 	{
-		return THESERVER->getDataSetter()(pName, static_cast<const void *>(&value)) != 0;
+		return THESERVER->setData(pName, static_cast<const void *>(&value));
 	}
 
 	// Sends a data pointer from the server back to the application through the server's registered data setter
@@ -192,7 +196,7 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	bool setDataPointer(const char *pName, const T pointer) const
 	{
-		return THESERVER->getDataSetter()(pName, static_cast<const void *>(pointer)) != 0;
+		return THESERVER->setData(pName, static_cast<const void *>(pointer));
 	}
 
 	// When responding to a ReadValue method, we need to return a GVariant value in the form "(ay)" (a tuple containing an array of
@@ -201,7 +205,7 @@ struct GattInterface : DBusInterface
 	//
 	// This is the generalized form that accepts a GVariant *. There is a templated helper method (`methodReturnValue()`) that accepts
 	// common types.
-	void methodReturnVariant(GDBusMethodInvocation *pInvocation, GVariant *pVariant, bool wrapInTuple = false) const;
+	virtual void methodReturnVariant(GDBusMethodInvocation *pInvocation, GVariant *pVariant, bool wrapInTuple = false) const;
 
 	// When responding to a ReadValue method, we need to return a GVariant value in the form "(ay)" (a tuple containing an array of
 	// bytes). This method will simplify this slightly by wrapping a GVariant of the type "ay" and wrapping it in a tuple before
@@ -226,7 +230,7 @@ struct GattInterface : DBusInterface
 
 protected:
 
-	std::list<GattProperty> properties;
+	PropertyList properties;
 };
 
 }; // namespace ggk
\ No newline at end of file
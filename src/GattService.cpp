@@ -77,7 +77,7 @@ DBusObject &GattService::gattServiceEnd()
 GattCharacteristic &GattService::gattCharacteristicBegin(const std::string &pathElement, const GattUuid &uuid, const std::vector<const char *> &flags)
 {
 	DBusObject &child = owner.addChild(DBusObjectPath(pathElement));
-	GattCharacteristic &characteristic = *child.addInterface(std::make_shared<GattCharacteristic>(child, *this, "org.bluez.GattCharacteristic1"));
+	GattCharacteristic &characteristic = *child.addInterface(std::allocate_shared<GattCharacteristic>(TaggedAllocator<GattCharacteristic, EMemorySchema>(), child, *this, "org.bluez.GattCharacteristic1"));
 	characteristic.addProperty<GattCharacteristic>("UUID", uuid);
 	characteristic.addProperty<GattCharacteristic>("Service", owner.getPath());
 	characteristic.addProperty<GattCharacteristic>("Flags", flags);
@@ -40,11 +40,25 @@
 #include <memory>
 #include <deque>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 
 #include "Init.h"
+#include "Advertising.h"
+#include "Capture.h"
+#include "Clock.h"
+#include "ConnectionProfiles.h"
 #include "HciAdapter.h"
 #include "Logger.h"
+#include "MemoryStats.h"
+#include "Pool.h"
+#include "PowerProfiler.h"
 #include "DosellGatt.h"
+#include "DispatchShards.h"
+#include "FirmwareReceiver.h"
+#include "FastRead.h"
+#include "GattCharacteristic.h"
+#include "ServerStats.h"
 
 namespace ggk
 {
@@ -65,11 +79,43 @@ namespace ggk
 	static GPrintFunc printerrHandlerGLib;
 	static GLogFunc logHandlerGLib;
 
-	// Our update queue
-	typedef std::tuple<std::string, std::string> QueueEntry;
-	std::deque<QueueEntry> updateQueue;
+	// The application's batch data getter (applied to the server when it is created)
+	//
+	// It is registered from the application's thread and read when the server is created, so it is atomic.
+	static std::atomic<GGKServerDataBatchGetter> dataBatchGetter(nullptr);
+
+	// Our update queue (accounted to `EMemoryUpdateQueue`, along with the strings it holds)
+	//
+	// Updates submitted by handle (see `ggkNotifyMany()`) carry only the handle of their characteristic; its path is looked up
+	// when the entry is popped. Others carry their object path and interface name.
+	typedef TaggedString<EMemoryUpdateQueue> QueueString;
+	struct QueueEntry
+	{
+		QueueEntry(int handle) : handle(handle) {}
+		QueueEntry(const char *pObjectPath, const char *pInterfaceName) : handle(-1), path(pObjectPath), interfaceName(pInterfaceName) {}
+
+		int handle;
+		QueueString path;
+		QueueString interfaceName;
+	};
+	std::deque<QueueEntry, TaggedAllocator<QueueEntry, EMemoryUpdateQueue>> updateQueue;
 	std::mutex updateQueueMutex;
 
+	// Returns the queue entry `entry` as a string in the format "com/object/path|com.interface.name"
+	static std::string formatQueueEntry(const QueueEntry &entry)
+	{
+		std::string result;
+		if (entry.handle < 0)
+		{
+			result.append(entry.path.c_str()).append("|").append(entry.interfaceName.c_str());
+		}
+		else if (std::shared_ptr<const GattCharacteristic> pCharacteristic = THESERVER->getCharacteristic(entry.handle))
+		{
+			result.append(pCharacteristic->getPath().c_str()).append("|").append("org.bluez.GattCharacteristic1");
+		}
+		return result;
+	}
+
 	// Internal method to set the run state of the server
 	void setServerRunState(GGKServerRunState newState)
 	{
@@ -134,16 +180,124 @@ int ggkNofifyUpdatedDescriptor(const char *pObjectPath)
 	return ggkPushUpdateQueue(pObjectPath, "org.bluez.GattDescriptor1") != 0;
 }
 
+// Announces a change to a data value, queueing one update for each composite characteristic that binds it
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkNotifyUpdatedData(const char *pName)
+{
+	if (nullptr == THESERVER || nullptr == pName)
+	{
+		return 0;
+	}
+
+	return THESERVER->notifyDataChanged(pName);
+}
+
+// Adds updates to the front of the queue for the characteristics with the handles `pHandles`, all at once
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkNotifyMany(const int *pHandles, size_t count)
+{
+	if (nullptr == THESERVER || nullptr == pHandles)
+	{
+		return 0;
+	}
+
+	int queued = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(updateQueueMutex);
+		for (size_t i = 0; i < count; ++i)
+		{
+			std::shared_ptr<const GattCharacteristic> pCharacteristic = THESERVER->getCharacteristic(pHandles[i]);
+			if (nullptr != pCharacteristic)
+			{
+				// The value has changed, so fast reads wait for it (see FastRead.cpp)
+				if (nullptr != pCharacteristic->getValueSnapshot())
+				{
+					pCharacteristic->getValueSnapshot()->invalidate();
+				}
+
+				updateQueue.emplace_front(pHandles[i]);
+				queued += 1;
+			}
+		}
+
+		ServerStats::recordQueueDepth(updateQueue.size());
+	}
+
+	noteUpdateQueued();
+	return queued;
+}
+
+// Adds updates to the front of the queue for the characteristics at the object paths `ppObjectPaths`, all at once
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkNotifyManyPaths(const char * const *ppObjectPaths, size_t count)
+{
+	if (nullptr == ppObjectPaths)
+	{
+		return 0;
+	}
+
+	// Build the entries before we take the lock, so the consumer only waits for them to be moved in
+	std::vector<QueueEntry> entries;
+	entries.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		// Null paths are skipped, as `ggkPushUpdateQueue()` rejects them
+		if (nullptr == ppObjectPaths[i])
+		{
+			continue;
+		}
+
+		// The value has changed, so fast reads wait for it (see FastRead.cpp)
+		FastRead::invalidate(ppObjectPaths[i]);
+		entries.emplace_back(ppObjectPaths[i], "org.bluez.GattCharacteristic1");
+	}
+
+	if (entries.empty())
+	{
+		return 0;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(updateQueueMutex);
+		for (QueueEntry &entry : entries)
+		{
+			updateQueue.push_front(std::move(entry));
+		}
+
+		ServerStats::recordQueueDepth(updateQueue.size());
+	}
+
+	noteUpdateQueued();
+	return static_cast<int>(entries.size());
+}
+
 // Adds a named update to the front of the queue. Generally, this routine should not be used directly. Instead, use the
 // `ggkNofifyUpdatedCharacteristic()` instead.
 //
 // Returns non-zero value on success or 0 on failure.
 int ggkPushUpdateQueue(const char *pObjectPath, const char *pInterfaceName)
 {
-	QueueEntry t(pObjectPath, pInterfaceName);
+	if (nullptr == pObjectPath || nullptr == pInterfaceName)
+	{
+		return 0;
+	}
 
-	std::lock_guard<std::mutex> guard(updateQueueMutex);
-	updateQueue.push_front(t);
+	QueueEntry entry(pObjectPath, pInterfaceName);
+
+	// The value has changed, so fast reads wait for it (see FastRead.cpp)
+	FastRead::invalidate(pObjectPath);
+
+	{
+		std::lock_guard<std::mutex> guard(updateQueueMutex);
+		updateQueue.push_front(std::move(entry));
+		ServerStats::recordQueueDepth(updateQueue.size());
+	}
+
+	noteUpdateQueued();
 	return 1;
 }
 
@@ -170,11 +324,8 @@ int ggkPopUpdateQueue(char *pElementBuffer, int elementLen, int keep)
 		// Check for an empty queue
 		if (updateQueue.empty()) { return 0; }
 
-		// Get the last element
-		QueueEntry t = updateQueue.back();
-
-		// Get the result string
-		result = std::get<0>(t) + "|" + std::get<1>(t);
+		// Get the last element as a string
+		result = formatQueueEntry(updateQueue.back());
 
 		// Ensure there's enough room for it
 		if (result.length() + 1 > static_cast<size_t>(elementLen)) { return -1; }
@@ -182,6 +333,7 @@ int ggkPopUpdateQueue(char *pElementBuffer, int elementLen, int keep)
 		if (keep == 0)
 		{
 			updateQueue.pop_back();
+			ServerStats::recordQueueDepth(updateQueue.size());
 		}
 	}
 
@@ -191,6 +343,43 @@ int ggkPopUpdateQueue(char *pElementBuffer, int elementLen, int keep)
 	return 1;
 }
 
+// Gets up to `maxElements` updates from the back of the queue, in the order they were added
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkPopUpdateQueueMany(char *pBuffer, int bufferLen, int maxElements)
+{
+	int count = 0;
+	size_t used = 0;
+
+	std::lock_guard<std::mutex> guard(updateQueueMutex);
+	while (count < maxElements && !updateQueue.empty())
+	{
+		std::string element = formatQueueEntry(updateQueue.back());
+
+		// Stop at the first element that doesn't fit (it stays in the queue)
+		if (used + element.length() + 1 > static_cast<size_t>(bufferLen))
+		{
+			if (0 == count)
+			{
+				return -1;
+			}
+			break;
+		}
+
+		memcpy(pBuffer + used, element.c_str(), element.length() + 1);
+		used += element.length() + 1;
+		updateQueue.pop_back();
+		count += 1;
+	}
+
+	if (count > 0)
+	{
+		ServerStats::recordQueueDepth(updateQueue.size());
+	}
+
+	return count;
+}
+
 // Returns 1 if the queue is empty, otherwise 0
 int ggkUpdateQueueIsEmpty()
 {
@@ -210,6 +399,10 @@ void ggkUpdateQueueClear()
 {
 	std::lock_guard<std::mutex> guard(updateQueueMutex);
 	updateQueue.clear();
+	ServerStats::recordQueueDepth(0);
+
+	// The discarded updates won't invalidate the fast path's snapshots, so drop them all
+	FastRead::invalidateAll();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -486,6 +679,7 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 
 		// Allocate our server
 		THESERVER = std::make_shared<DosellGatt>(pServiceName, pAdvertisingName, pAdvertisingShortName, getter, setter);
+		THESERVER->setDataBatchGetter(dataBatchGetter.load());
 
 		// Start our server thread
 		try
@@ -540,6 +734,18 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 	}
 }
 
+// Registers an optional batch data getter (see `GGKServerDataBatchGetter`.) To unregister, simply register with `nullptr`.
+//
+// This may be called before or after `ggkStart()`.
+void ggkRegisterDataBatchGetter(GGKServerDataBatchGetter getter)
+{
+	dataBatchGetter = getter;
+	if (nullptr != THESERVER)
+	{
+		THESERVER->setDataBatchGetter(getter);
+	}
+}
+
 bool ggkIsConnected()
 {	
 	bool connected = HciAdapter::getInstance().getActiveConnectionCount() > 0;
@@ -551,3 +757,396 @@ void ggkRegisterLedStatusReceiver(GGKLedStatusReceiver receiver)
 	Logger::debug(SSTR << "Registred led status receiver.");
 	HciAdapter::getInstance().registerLedStatusReceiver(receiver);
 }
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//     _       _                _   _     _
+//    / \   __| |_   _____ _ __| |_(_)___(_)_ __   __ _
+//   / _ \ / _` \ \ / / _ \ '__| __| / __| | '_ \ / _` |
+//  / ___ \ (_| |\ V /  __/ |  | |_| \__ \ | | | | (_| |
+// /_/   \_\__,_| \_/ \___|_|   \__|_|___/_|_| |_|\__, |
+//                                                 |___/
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Adds an LE advertising set and returns its zero-based index (or -1 on failure)
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkAdvertisingAddSet(const char * const *ppServiceUuids, int uuidCount, uint16_t manufacturerId, const uint8_t *pManufacturerData, int manufacturerDataLen, int includeName)
+{
+	if (uuidCount < 0 || (uuidCount > 0 && nullptr == ppServiceUuids) || manufacturerDataLen < 0)
+	{
+		Logger::error("Invalid parameters passed to ggkAdvertisingAddSet()");
+		return -1;
+	}
+
+	Advertising::Set set;
+	for (int i = 0; i < uuidCount; ++i)
+	{
+		if (nullptr != ppServiceUuids[i])
+		{
+			set.serviceUuids.push_back(ppServiceUuids[i]);
+		}
+	}
+
+	set.hasManufacturerData = nullptr != pManufacturerData;
+	set.manufacturerId = manufacturerId;
+	if (set.hasManufacturerData)
+	{
+		set.manufacturerData.assign(pManufacturerData, pManufacturerData + manufacturerDataLen);
+	}
+
+	set.includeName = includeName != 0;
+
+	return Advertising::getInstance().addSet(set);
+}
+
+// Removes all advertising sets, returning control of advertising to the adapter's advertising setting
+void ggkAdvertisingClearSets()
+{
+	Advertising::getInstance().clearSets();
+}
+
+// Sets the advertising interval ranges (in milliseconds) used for the advertising sets
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkAdvertisingSetIntervals(int fastMinMS, int fastMaxMS, int slowMinMS, int slowMaxMS, int fastPeriodSeconds)
+{
+	Advertising::getInstance().setIntervals(fastMinMS, fastMaxMS, slowMinMS, slowMaxMS, fastPeriodSeconds);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//   ____                            _   _                                __ _ _
+//  / ___|___  _ __  _ __   ___  ___| |_(_) ___  _ __    _ __  _ __ ___  / _(_) | ___
+// | |   / _ \| '_ \| '_ \ / _ \/ __| __| |/ _ \| '_ \  | '_ \| '__/ _ \| |_| | |/ _ \_
+// | |__| (_) | | | | | | |  __/ (__| |_| | (_) | | | | | |_) | | | (_) |  _| | |  __/
+//  \____\___/|_| |_|_| |_|\___|\___|\__|_|\___/|_| |_| | .__/|_|  \___/|_| |_|_|\___|
+//                                                      |_|
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the baseline connection profile, used whenever no subscribed characteristic requests a higher one
+//
+// The default is `EConnectionProfileIdle`. This may be called before or after `ggkStart()`.
+void ggkSetConnectionProfile(enum GGKConnectionProfile profile)
+{
+	ConnectionProfiles::getInstance().setBaseProfile(profile);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//   ____ _            _
+//  / ___| | ___   ___| | __
+// | |   | |/ _ \ / __| |/ /
+// | |___| | (_) | (__|   <
+//  \____|_|\___/ \___|_|\_\_
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Runs the server on a virtual clock (non-zero) or on real time (zero, the default)
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetSimulatedClock(int simulated)
+{
+	if (ggkGetServerRunState() != EUninitialized)
+	{
+		Logger::warn("The clock cannot be changed once the server has been started");
+		return;
+	}
+
+	Clock::getInstance().setSimulated(simulated != 0);
+}
+
+// Returns the server's current (monotonic) clock time in milliseconds
+int64_t ggkGetClockMS()
+{
+	return Clock::getInstance().nowMS();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//   ____            _
+//  / ___|__ _ _ __ | |_ _   _ _ __ ___
+// | |   / _` | '_ \| __| | | | '__/ _ \_
+// | |__| (_| | |_) | |_| |_| | | |  __/
+//  \____\__,_| .__/ \__|\__,_|_|  \___|
+//            |_|
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts capturing the server's D-Bus and HCI traffic to the file `pFilename`, replacing any capture in progress
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkCaptureStart(const char *pFilename)
+{
+	if (nullptr == pFilename)
+	{
+		return 0;
+	}
+
+	return Capture::getInstance().start(pFilename) ? 1 : 0;
+}
+
+// Stops the capture in progress (if any) and closes the capture file
+void ggkCaptureStop()
+{
+	Capture::getInstance().stop();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  __  __
+// |  \/  | ___ _ __ ___   ___  _ __ _   _
+// | |\/| |/ _ \ '_ ` _ \ / _ \| '__| | | |
+// | |  | |  __/ | | | | | (_) | |  | |_| |
+// |_|  |_|\___|_| |_| |_|\___/|_|   \__, |
+//                                   |___/
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Fills `pStats` with the statistics for each subsystem, indexed by `GGKMemorySubsystem`
+//
+// Up to `count` entries are filled. Returns the number of entries filled.
+int ggkGetMemoryStats(struct GGKMemoryStats *pStats, int count)
+{
+	if (nullptr == pStats || count <= 0)
+	{
+		return 0;
+	}
+
+	int filled = std::min(count, static_cast<int>(EMemorySubsystemCount));
+	for (int i = 0; i < filled; ++i)
+	{
+		pStats[i] = MemoryStats::get(static_cast<GGKMemorySubsystem>(i));
+	}
+
+	return filled;
+}
+
+// Returns a human-readable name for a `GGKMemorySubsystem`
+const char *ggkGetMemorySubsystemString(GGKMemorySubsystem subsystem)
+{
+	return MemoryStats::getSubsystemName(subsystem);
+}
+
+// Sets a budget (in bytes) for a subsystem, or removes it if `bytes` is zero
+void ggkSetMemoryBudget(GGKMemorySubsystem subsystem, size_t bytes)
+{
+	if (subsystem < 0 || subsystem >= EMemorySubsystemCount)
+	{
+		return;
+	}
+
+	MemoryStats::setBudget(subsystem, bytes);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// __        __    _                                         __ _ _ _
+// \ \      / /_ _| | _____ _   _ _ __    _ __  _ __ ___  / _(_) (_)_ __   __ _
+//  \ \ /\ / / _` | |/ / _ \ | | | '_ \  | '_ \| '__/ _ \| |_| | | | '_ \ / _` |
+//   \ V  V / (_| |   <  __/ |_| | |_) | | |_) | | | (_) |  _| | | | | | | (_| |
+//    \_/\_/ \__,_|_|\_\___|\__,_| .__/  | .__/|_|  \___/|_| |_|_|_|_| |_|\__, |
+//                              |_|     |_|                               |___/
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts (or restarts) wakeup profiling from zero
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkWakeupProfilerStart(int summaryIntervalSeconds)
+{
+	PowerProfiler::getInstance().start(summaryIntervalSeconds);
+}
+
+// Stops wakeup profiling (the statistics gathered so far remain available)
+void ggkWakeupProfilerStop()
+{
+	PowerProfiler::getInstance().stop();
+}
+
+// Fills `pStats` with the statistics for each source, indexed by `GGKWakeupSource`
+//
+// Up to `count` entries are filled. Returns the number of entries filled.
+int ggkGetWakeupStats(struct GGKWakeupStats *pStats, int count)
+{
+	if (nullptr == pStats || count <= 0)
+	{
+		return 0;
+	}
+
+	int filled = std::min(count, static_cast<int>(EWakeupSourceCount));
+	for (int i = 0; i < filled; ++i)
+	{
+		pStats[i] = PowerProfiler::getInstance().getStats(static_cast<GGKWakeupSource>(i));
+	}
+
+	return filled;
+}
+
+// Returns a human-readable name for a `GGKWakeupSource`
+const char *ggkGetWakeupSourceString(GGKWakeupSource source)
+{
+	return PowerProfiler::getSourceName(source);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  _____                    _            _                     _
+// |_   _| __ __ _ _ __  ___(_) ___ _ __ | |_   _ __   ___   ___ | |
+//   | || '__/ _` | '_ \/ __| |/ _ \ '_ \| __| | '_ \ / _ \ / _ \| |
+//   | || | | (_| | | | \__ \ |  __/ | | | |_  | |_) | (_) | (_) | |
+//   |_||_|  \__,_|_| |_|___/_|\___|_| |_|\__| | .__/ \___/ \___/|_|
+//                                            |_|
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Fills `pStats` with the statistics for each size class of the transient pool, followed by an entry for oversized allocations
+//
+// Up to `count` entries are filled. Returns the number of entries filled.
+int ggkGetPoolStats(struct GGKPoolStats *pStats, int count)
+{
+	if (nullptr == pStats || count <= 0)
+	{
+		return 0;
+	}
+
+	int filled = std::min(count, Pool::kClassCount + 1);
+	for (int i = 0; i < filled; ++i)
+	{
+		pStats[i] = Pool::getStats(i);
+	}
+
+	return filled;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ___    _ _                           _
+// |_ _|__| | | ___    _ __ ___   ___   __| | ___
+//  | |/ _` | |/ _ \  | '_ ` _ \ / _ \ / _` |/ _ \_
+//  | | (_| | |  __/  | | | | | | (_) | (_| |  __/
+// |___\__,_|_|\___|  |_| |_| |_|\___/ \__,_|\___|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Enables or disables idle mode (enabled by default)
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetIdleModeEnabled(int enable)
+{
+	setIdleModeEnabled(enable != 0);
+}
+
+// Returns 1 if the server is in idle mode, otherwise 0
+int ggkIsIdleMode()
+{
+	return isIdleMode() ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  _   _       _                   _             _
+// | | | | ___ | |_   _ __ ___  ___| |_ __ _ _ __| |_
+// | |_| |/ _ \| __| | '__/ _ \/ __| __/ _` | '__| __|
+// |  _  | (_) | |_  | | |  __/\__ \ || (_| | |  | |_
+// |_| |_|\___/ \__| |_|  \___||___/\__\__,_|_|   \__|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets handoff mode, for upgrading a running server without taking it down
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetHandoffMode(int enable)
+{
+	setHandoffMode(enable != 0);
+}
+
+// Allows a new server in handoff mode to take over from this one
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetAllowTakeover(int enable)
+{
+	setAllowTakeover(enable != 0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____  _                 _       _           _                   _
+// |  _ \(_)___ _ __   __ _| |_ ___| |__    ___| |__   __ _ _ __ __| |___
+// | | | | / __| '_ \ / _` | __/ __| '_ \  / __| '_ \ / _` | '__/ _` / __|
+// | |_| | \__ \ |_) | (_| | || (__| | | | \__ \ | | | (_| | | | (_| \__ \_
+// |____/|_|___/ .__/ \__,_|\__\___|_| |_| |___/_| |_|\__,_|_|  \__,_|___/
+//             |_|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the number of threads that dispatch D-Bus calls to our services
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetDispatchShards(int count)
+{
+	DispatchShards::setShardCount(count);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  _____ _
+// |  ___(_)_ __ _ __ _____      ____ _ _ __ ___
+// | |_  | | '__| '_ ` _ \ \ /\ / / _` | '__/ _ \_
+// |  _| | | |  | | | | | \ V  V / (_| | | |  __/
+// |_|   |_|_|  |_| |_| |_|\_/\_/ \__,_|_|  \___|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the directory that firmware images are received into
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetFirmwareDirectory(const char *pDirectory)
+{
+	FirmwareReceiver::setDirectory(pDirectory);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____  _        _         _       _             __
+// / ___|| |_ __ _| |_ ___  (_)_ __ | |_ ___ _ __ / _| __ _  ___ ___
+// \___ \| __/ _` | __/ __| | | '_ \| __/ _ \ '__| |_ / _` |/ __/ _ \_
+//  ___) | || (_| | |_\__ \ | | | | | ||  __/ |  |  _| (_| | (_|  __/
+// |____/ \__\__,_|\__|___/ |_|_| |_|\__\___|_|  |_|  \__,_|\___\___|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Enables or disables the stats interface
+//
+// See the documentation in Gobbledegook.h for details.
+void ggkSetStatsInterfaceEnabled(int enable)
+{
+	ServerStats::setInterfaceEnabled(enable != 0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____                        _             _
+// / ___|  __ _ _ __ ___  _ __ | | ___   _ __(_)_ __   __ _ ___
+// \___ \ / _` | '_ ` _ \| '_ \| |/ _ \ | '__| | '_ \ / _` / __|
+//  ___) | (_| | | | | | | |_) | |  __/ | |  | | | | | (_| \__ \_
+// |____/ \__,_|_| |_| |_| .__/|_|\___| |_|  |_|_| |_|\__, |___/
+//                       |_|                          |___/
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the handle of the characteristic at the given object path
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkGetCharacteristicHandle(const char *pObjectPath)
+{
+	if (nullptr == THESERVER || nullptr == pObjectPath)
+	{
+		return -1;
+	}
+
+	return THESERVER->getCharacteristicHandle(DBusObjectPath(pObjectPath));
+}
+
+// Appends a sample to the ring of a characteristic
+//
+// See the documentation in Gobbledegook.h for details.
+int ggkAppendSample(int handle, int64_t timestampMS, const void *pData, int length)
+{
+	std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == THESERVER ? nullptr : THESERVER->getCharacteristic(handle);
+	std::shared_ptr<SampleRing> pRing = nullptr == pCharacteristic ? nullptr : pCharacteristic->getSampleRing();
+	if (nullptr == pRing || nullptr == pData || length < 0 || size_t(length) != pRing->getSampleSize())
+	{
+		return 0;
+	}
+
+	if (pRing->append(timestampMS, pData))
+	{
+		ggkNotifyMany(&handle, 1);
+	}
+
+	return 1;
+}
@@ -43,6 +43,7 @@
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <string.h>
+#include <algorithm>
 #include <chrono>
 #include <future>
 
@@ -51,6 +52,8 @@
 #include "Utils.h"
 #include "Mgmt.h"
 #include "Logger.h"
+#include "PowerProfiler.h"
+#include "ServerStats.h"
 
 namespace ggk {
 
@@ -130,7 +133,25 @@ const char * const HciAdapter::kCommandCodeNames[kMaxCommandCode + 1] =
 	// code for "Set Appearance Command" is 0x0042. It also says this about the previous command in the list ("Read Extended
 	// Controller Information Command".) This is likely an error, so I'm following the order of the commands as they appear in the
 	// documentation. This makes "Set Appearance Code" have a command code of 0x0043.
-	"Set Appearance Command"                             // 0x0043
+	"Set Appearance Command",                            // 0x0043
+	"Get PHY Configuration Command",                     // 0x0044
+	"Set PHY Configuration Command",                     // 0x0045
+	"Load Blocked Keys Command",                         // 0x0046
+	"Set Wideband Speech Command",                       // 0x0047
+	"Read Controller Capabilities Command",              // 0x0048
+	"Read Experimental Features Information Command",    // 0x0049
+	"Set Experimental Feature Command",                  // 0x004a
+	"Read Default System Configuration Command",         // 0x004b
+	"Set Default System Configuration Command",          // 0x004c
+	"Read Default Runtime Configuration Command",        // 0x004d
+	"Set Default Runtime Configuration Command",         // 0x004e
+	"Get Device Flags Command",                          // 0x004f
+	"Set Device Flags Command",                          // 0x0050
+	"Read Advertisement Monitor Features Command",       // 0x0051
+	"Add Advertisement Patterns Monitor Command",        // 0x0052
+	"Remove Advertisement Monitor Command",              // 0x0053
+	"Add Extended Advertising Parameters Command",       // 0x0054
+	"Add Extended Advertising Data Command"              // 0x0055
 };
 
 const char * const HciAdapter::kEventTypeNames[kMaxEventType + 1] =
@@ -215,15 +236,19 @@ void HciAdapter::runEventThread()
 {
 	Logger::trace("Entering the HciAdapter event thread");
 
+	// Our event buffer, reused for each event
+	HciSocket::Buffer responsePacket;
+
 	while (ggkGetServerRunState() <= ERunning && hciSocket.isConnected())
 	{
 		// Read the next event, waiting until one arrives
-		std::vector<uint8_t> responsePacket = std::vector<uint8_t>();
 		if (!hciSocket.read(responsePacket))
 		{
 			break;
 		}
 
+		WakeupScope wakeup(EWakeupHciPoll, "event");
+
 		// Do we have enough to check the event code?
 		if (responsePacket.size() < 2)
 		{
@@ -241,6 +266,8 @@ void HciAdapter::runEventThread()
 			continue;
 		}
 
+		wakeup.setHandler(HciAdapter::kEventTypeNames[eventCode]);
+
 		switch(eventCode)
 		{
 			// Command complete event
@@ -295,6 +322,19 @@ void HciAdapter::runEventThread()
 						Logger::info(localName.debugText());
 						break;
 					}
+					case Mgmt::EGetPHYConfigurationCommand:
+					{
+						if (dataLen != sizeof(PhyConfiguration))
+						{
+							Logger::error("Invalid data length");
+							return;
+						}
+
+						phyConfiguration = *reinterpret_cast<PhyConfiguration *>(data);
+						phyConfiguration.toHost();
+						Logger::debug(phyConfiguration.debugText());
+						break;
+					}
 					case Mgmt::ESetPoweredCommand:
 					case Mgmt::ESetBREDRCommand:
 					case Mgmt::ESetSecureConnectionsCommand:
@@ -318,7 +358,7 @@ void HciAdapter::runEventThread()
 				}
 
 				// Notify anybody waiting that we received a response to their command code
-				setCommandResponse(event.commandCode);
+				setCommandResponse(event.commandCode, event.status);
 
 				break;
 			}
@@ -328,7 +368,7 @@ void HciAdapter::runEventThread()
 				CommandStatusEvent event(responsePacket);
 
 				// Notify anybody waiting that we received a response to their command code
-				setCommandResponse(event.commandCode);
+				setCommandResponse(event.commandCode, event.status);
 				break;
 			}
 			// Command status event
@@ -336,6 +376,13 @@ void HciAdapter::runEventThread()
 			{
 				DeviceConnectedEvent event(responsePacket);
 				activeConnections += 1;
+				{
+					std::lock_guard<std::mutex> lock(connectedDevicesMutex);
+					ConnectedDevice device;
+					std::copy(event.address, event.address + sizeof(device.address), device.address);
+					device.addressType = event.addressType;
+					connectedDevices.push_back(device);
+				}
 				if (ledStatusReceiver_ && !ledThread_.joinable()) {
 					cancelFlag_ = false; // Reset cancel flag
 
@@ -348,12 +395,24 @@ void HciAdapter::runEventThread()
 					});
 				}
 				Logger::debug(SSTR << "  > Connection count incremented to " << activeConnections);
+				ServerStats::recordConnected(activeConnections);
+				if (ConnectionCountReceiver receiver = connectionCountReceiver)
+				{
+					receiver(activeConnections);
+				}
 				break;
 			}
 			// Command status event
 			case Mgmt::EDeviceDisconnectedEvent:
 			{
 				DeviceDisconnectedEvent event(responsePacket);
+				{
+					std::lock_guard<std::mutex> lock(connectedDevicesMutex);
+					connectedDevices.erase(std::remove_if(connectedDevices.begin(), connectedDevices.end(), [&event](const ConnectedDevice &device)
+					{
+						return device.addressType == event.addressType && std::equal(device.address, device.address + sizeof(device.address), event.address);
+					}), connectedDevices.end());
+				}
 				if (activeConnections > 0)
 				{
 					activeConnections -= 1;
@@ -366,6 +425,11 @@ void HciAdapter::runEventThread()
 						ledStatusReceiver_(0); // Call for disconnection
 					}
 					Logger::debug(SSTR << "  > Connection count decremented to " << activeConnections);
+					ServerStats::recordDisconnected(activeConnections);
+					if (ConnectionCountReceiver receiver = connectionCountReceiver)
+					{
+						receiver(activeConnections);
+					}
 				}
 				else
 				{
@@ -523,6 +587,7 @@ bool HciAdapter::sendCommand(HciHeader &request)
 	uint16_t dataSize = request.dataSize;
 
 	conditionalValue = -1;
+	commandStatus = 0;
 	std::future<bool> fut = std::async(std::launch::async,
 	[&]() mutable
 	{
@@ -570,11 +635,12 @@ bool HciAdapter::waitForCommandResponse(uint16_t commandCode, int timeoutMS)
 	return success;
 }
 
-// Sets the command response and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
-void HciAdapter::setCommandResponse(uint16_t commandCode)
+// Sets the command response (and its status) and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
+void HciAdapter::setCommandResponse(uint16_t commandCode, uint8_t status)
 {
 	std::lock_guard<std::mutex> lk(commandResponseMutex);
 	conditionalValue = commandCode;
+	commandStatus = status;
 	cvCommandResponse.notify_one();
 }
 
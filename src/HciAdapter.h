@@ -58,7 +58,7 @@ public:
 
 	// Command code names
 	static const int kMinCommandCode = 0x0001;
-	static const int kMaxCommandCode = 0x0043;
+	static const int kMaxCommandCode = 0x0055;
 	static const char * const kCommandCodeNames[kMaxCommandCode + 1];
 
 	// Event type names
@@ -132,7 +132,7 @@ public:
 		uint16_t commandCode;
 		uint8_t status;
 
-		CommandCompleteEvent(const std::vector<uint8_t> &data)
+		CommandCompleteEvent(const HciSocket::Buffer &data)
 		{
 			*this = *reinterpret_cast<const CommandCompleteEvent *>(data.data());
 			toHost();
@@ -172,7 +172,7 @@ public:
 		uint16_t commandCode;
 		uint8_t status;
 
-		CommandStatusEvent(const std::vector<uint8_t> &data)
+		CommandStatusEvent(const HciSocket::Buffer &data)
 		{
 			*this = *reinterpret_cast<const CommandStatusEvent *>(data.data());
 			toHost();
@@ -214,7 +214,7 @@ public:
 		uint32_t flags;
 		uint16_t eirDataLength;
 
-		DeviceConnectedEvent(const std::vector<uint8_t> &data)
+		DeviceConnectedEvent(const HciSocket::Buffer &data)
 		{
 			*this = *reinterpret_cast<const DeviceConnectedEvent *>(data.data());
 			toHost();
@@ -264,7 +264,7 @@ public:
 		uint8_t addressType;
 		uint8_t reason;
 
-		DeviceDisconnectedEvent(const std::vector<uint8_t> &data)
+		DeviceDisconnectedEvent(const HciSocket::Buffer &data)
 		{
 			*this = *reinterpret_cast<const DeviceDisconnectedEvent *>(data.data());
 			toHost();
@@ -422,12 +422,50 @@ public:
 		}
 	} __attribute__((packed));
 
+	// The controller's PHY configuration (see `Mgmt::PhyFlags` for the bits)
+	struct PhyConfiguration
+	{
+		uint32_t supportedPhys;
+		uint32_t configurablePhys;
+		uint32_t selectedPhys;
+
+		void toHost()
+		{
+			supportedPhys = Utils::endianToHost(supportedPhys);
+			configurablePhys = Utils::endianToHost(configurablePhys);
+			selectedPhys = Utils::endianToHost(selectedPhys);
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> PHY configuration\n";
+			text += "  + Supported PHYs     : " + Utils::hex(supportedPhys) + "\n";
+			text += "  + Configurable PHYs  : " + Utils::hex(configurablePhys) + "\n";
+			text += "  + Selected PHYs      : " + Utils::hex(selectedPhys);
+			return text;
+		}
+	} __attribute__((packed));
+
+	// A connected remote device
+	struct ConnectedDevice
+	{
+		uint8_t address[6];
+		uint8_t addressType;
+	};
+
 	//
 	// Accessors
 	//
     void registerLedStatusReceiver(GGKLedStatusReceiver receiver) {
         ledStatusReceiver_ = receiver;
     }
+	// A function that is called (on the HCI event thread) whenever the number of active connections changes
+	typedef void (*ConnectionCountReceiver)(int connectionCount);
+
+	// Registers a function to call whenever the number of active connections changes
+	void registerConnectionCountReceiver(ConnectionCountReceiver receiver) { connectionCountReceiver = receiver; }
+
 	// Returns the instance to this singleton class
 	static HciAdapter &getInstance()
 	{
@@ -441,6 +479,20 @@ public:
 	LocalName getLocalName() { return localName; }
 	int getActiveConnectionCount() { return activeConnections; }
 
+	// Returns true if our event thread is receiving events from the controller (and so is tracking connections)
+	bool isRunning() { return hciSocket.isConnected(); }
+	PhyConfiguration getPhyConfiguration() { return phyConfiguration; }
+
+	// Returns the list of currently connected devices
+	std::vector<ConnectedDevice> getConnectedDevices()
+	{
+		std::lock_guard<std::mutex> lock(connectedDevicesMutex);
+		return std::vector<ConnectedDevice>(connectedDevices.begin(), connectedDevices.end());
+	}
+
+	// Returns the status code (see `kStatusCodes`) of the response to the most recent command sent with `sendCommand()`
+	uint8_t getLastCommandStatus() const { return commandStatus; }
+
 	//
 	// Disallow copies of our singleton (c++11)
 	//
@@ -484,7 +536,7 @@ public:
 
 private:
 	// Private constructor for our Singleton
-	HciAdapter() : commandResponseLock(commandResponseMutex), activeConnections(0), cancelFlag_(false) {}
+	HciAdapter() : commandResponseLock(commandResponseMutex), commandStatus(0), activeConnections(0), cancelFlag_(false) {}
 
 	// Uses a std::condition_variable to wait for a response event for the given `commandCode` or `timeoutMS` milliseconds.
 	//
@@ -493,8 +545,8 @@ private:
 	// Command responses are set via `setCommandResponse()`
 	bool waitForCommandResponse(uint16_t commandCode, int timeoutMS);
 
-	// Sets the command response and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
-	void setCommandResponse(uint16_t commandCode);
+	// Sets the command response (and its status) and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
+	void setCommandResponse(uint16_t commandCode, uint8_t status);
 
 	// Our HCI Socket, which allows us to talk directly to the kernel
 	HciSocket hciSocket;
@@ -507,11 +559,17 @@ private:
 	ControllerInformation controllerInformation;
 	VersionInformation versionInformation;
 	LocalName localName;
+	PhyConfiguration phyConfiguration;
+
+	// Our connected devices
+	std::vector<ConnectedDevice, TaggedAllocator<ConnectedDevice, EMemoryHci>> connectedDevices;
+	std::mutex connectedDevicesMutex;
 
 	std::condition_variable cvCommandResponse;
 	std::mutex commandResponseMutex;
 	std::unique_lock<std::mutex> commandResponseLock;
 	int conditionalValue;
+	std::atomic<uint8_t> commandStatus;
 
 	// Our active connection count
 	int activeConnections;
@@ -519,6 +577,9 @@ private:
  	GGKLedStatusReceiver ledStatusReceiver_;  // Static LED status receiver
     std::atomic<bool> cancelFlag_;    // Atomic cancellation flag
     std::thread ledThread_;            // Thread for LED status updates
+
+	// Called whenever our active connection count changes
+	std::atomic<ConnectionCountReceiver> connectionCountReceiver{nullptr};
 };
 
 }; // namespace ggk
\ No newline at end of file
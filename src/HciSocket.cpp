@@ -36,7 +36,9 @@
 #include <fcntl.h>
 
 #include "HciSocket.h"
+#include "Capture.h"
 #include "Logger.h"
+#include "PowerProfiler.h"
 #include "Utils.h"
 
 namespace ggk {
@@ -116,7 +118,7 @@ void HciSocket::disconnect()
 //
 // Returns true if data was read successfully, otherwise false is returned. A false return code does not necessarily depict
 // an error, as this can arise from expected conditions (such as an interrupt.)
-bool HciSocket::read(std::vector<uint8_t> &response) const
+bool HciSocket::read(Buffer &response) const
 {
 	// Fill our response with empty data
 	response.resize(kResponseMaxSize, 0);
@@ -153,6 +155,10 @@ bool HciSocket::read(std::vector<uint8_t> &response) const
 
 	// We have data
 	response.resize(bytesRead);
+	if (Capture::getInstance().isRecording())
+	{
+		Capture::getInstance().recordHci(ECaptureHciRead, response.data(), response.size());
+	}
 
 	std::string dump = "";
 	dump += "  > Read " + std::to_string(response.size()) + " bytes\n";
@@ -188,6 +194,11 @@ bool HciSocket::write(const uint8_t *pBuffer, size_t count) const
 		return false;
 	}
 
+	if (Capture::getInstance().isRecording())
+	{
+		Capture::getInstance().recordHci(ECaptureHciWrite, pBuffer, count);
+	}
+
 	return true;
 }
 
@@ -215,6 +226,7 @@ bool HciSocket::waitForDataOrShutdown() const
 		if (retval < 0) { return false; }
 
 		// No data; keep waiting
+		PowerProfiler::getInstance().record(EWakeupHciPoll, "select timeout", 0);
 		continue;
 	}
 
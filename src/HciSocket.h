@@ -26,11 +26,16 @@
 #include <stdint.h>
 #include <vector>
 
+#include "MemoryStats.h"
+
 namespace ggk {
 
 class HciSocket
 {
 public:
+	// A buffer for data read from the socket (accounted to `EMemoryHci`)
+	typedef std::vector<uint8_t, TaggedAllocator<uint8_t, EMemoryHci>> Buffer;
+
 	// Initializes an unconnected socket
 	HciSocket();
 
@@ -56,7 +61,7 @@ public:
 	// retry for a maximum timeout defined by `kMaxRetryTimeMS`.
 	//
 	// Returns true if any data was read successfully, otherwise false is returned in the case of an error or a timeout.
-	bool read(std::vector<uint8_t> &response) const;
+	bool read(Buffer &response) const;
 
 	// Writes the array of bytes of a given count
 	//
@@ -33,13 +33,18 @@
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <gio/gio.h>
+#include <string.h>
+#include <time.h>
 #include <string>
 #include <vector>
 #include <atomic>
 #include <chrono>
 #include <thread>
+#include <iomanip>
 
 #include "DosellGatt.h"
+#include "Advertising.h"
+#include "ConnectionProfiles.h"
 #include "Globals.h"
 #include "Mgmt.h"
 #include "HciAdapter.h"
@@ -48,6 +53,16 @@
 #include "GattCharacteristic.h"
 #include "GattProperty.h"
 #include "Logger.h"
+#include "Capture.h"
+#include "MemoryStats.h"
+#include "Pool.h"
+#include "PowerProfiler.h"
+#include "Clock.h"
+#include "InitScheduler.h"
+#include "FastRead.h"
+#include "DispatchShards.h"
+#include "ServerStats.h"
+#include "AsyncReply.h"
 #include "Init.h"
 
 namespace ggk {
@@ -59,12 +74,30 @@ namespace ggk {
 static const int kPeriodicTimerFrequencySeconds = 1;
 static const int kRetryDelaySeconds = 2;
 static const int kIdleFrequencyMS = 10;
+static const int kMaxUpdatesPerIdle = 16;
+static const int kIdleModeDelaySeconds = 10;
+static const int kIdleModeHeartbeatSeconds = 30;
+
+// The adapter we look for directly (this matches the management API's default controller index, see `Mgmt`)
+static const char *kBluezAdapterPath = "/org/bluez/hci0";
 
 //
-// Retries
+// Initialization
 //
 
-static time_t retryTimeStart = 0;
+// Our initialization steps, in the order they are added to the scheduler (see `buildInitGraph()`)
+enum InitStep
+{
+	EInitBus,
+	EInitObjects,
+	EInitAdapterLookup,
+	EInitAdapterConfig,
+	EInitOwnedName,
+	EInitApplication,
+	EInitShards
+};
+
+static InitScheduler initScheduler(kRetryDelaySeconds * 1000);
 
 //
 // Adapter configuration
@@ -73,7 +106,9 @@ static time_t retryTimeStart = 0;
 GDBusConnection *pBusConnection = nullptr;
 static guint ownedNameId = 0;
 static guint periodicTimeoutId = 0;
-static std::vector<guint> registeredObjectIds;
+static guint idlePollSourceId = 0;
+static RegisteredObjectIds registeredObjectIds;
+static size_t registeredIntrospectionBytes = 0;
 static std::atomic<GMainLoop *> pMainLoop(nullptr);
 static GDBusObjectManager *pBluezObjectManager = nullptr;
 static GDBusObject *pBluezAdapterObject = nullptr;
@@ -83,10 +118,30 @@ static GDBusProxy *pBluezAdapterInterfaceProxy = nullptr;
 static GDBusProxy *pBluezDeviceInterfaceProxy = nullptr;
 static GDBusProxy *pBluezAdapterPropertiesInterfaceProxy = nullptr;
 static bool bOwnedNameAcquired = false;
-static bool bAdapterConfigured = false;
 static bool bApplicationRegistered = false;
+static bool bAdapterLookupByPathFailed = false;
 static std::string bluezGattManagerInterfaceName = "";
 
+//
+// Hot restart
+//
+
+static std::atomic<bool> bHandoffMode(false);
+static std::atomic<bool> bAllowTakeover(false);
+static bool bHandingOff = false;
+static int64_t handoffStartMS = 0;
+
+//
+// Idle mode
+//
+
+static std::atomic<bool> bIdleModeEnabled(true);
+static std::atomic<bool> bIdleMode(false);
+static guint idleHeartbeatId = 0;
+static std::atomic<int64_t> lastActivityMS(0);
+static int64_t modeStartMS = 0;
+static int64_t modeStartCpuUS = 0;
+
 //
 // Externs
 //
@@ -99,6 +154,11 @@ extern void setServerHealth(enum GGKServerHealth newHealth);
 //
 
 static void initializationStateProcessor();
+static void findAdapter();
+static bool canEnterIdleMode();
+static void enterIdleMode();
+static void leaveIdleMode(const char *pReason);
+static void noteActivity();
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 //  ___    _ _           __      _       _                                             _
@@ -112,14 +172,58 @@ static void initializationStateProcessor();
 // `TheServer` object, then call `ggkPushUpdateQueue` to trigger that data to be updated (in whatever way the service responsible
 // for that data() sees fit.
 //
-// This is done using the `ggkPushUpdateQueue` / `ggkPopUpdateQueue` methods to manage the queue of pending update messages. Each
-// entry represents an interface that needs to be updated. The idleFunc calls the interface's `onUpdatedValue` method for each
-// update.
+// This is done using the `ggkPushUpdateQueue` / `ggkPopUpdateQueueMany` methods to manage the queue of pending update messages.
+// Each entry represents an interface that needs to be updated. The idleFunc calls the interface's `onUpdatedValue` method for
+// each update.
 //
-// The idle processor will perform one update per idle tick, however, it will notify that there is more data so the idle ticks
-// do not lag behind.
+// The idle processor will perform up to `kMaxUpdatesPerIdle` updates per idle tick and will notify that there is more data so the
+// idle ticks do not lag behind. When more than one update is processed in a single tick, the values are prefetched with a single
+// call to the application's batch data getter (if one was registered with `ggkRegisterDataBatchGetter`.)
 // ---------------------------------------------------------------------------------------------------------------------------------
 
+// Returns the name used to request a characteristic's data from the application's data getter
+//
+// By convention, the server description uses each characteristic's path element (e.g., "status" or "authentication/id") as the
+// name of the data it serves.
+static std::string getDataName(const GattCharacteristic &characteristic)
+{
+	return characteristic.getPathNode().toString();
+}
+
+// Hands the updates in `characteristics` that are owned by other dispatch shards to the shards' threads, leaving only our own (and
+// their data names) behind
+static void postShardUpdates(PooledVector<std::shared_ptr<const GattCharacteristic>> &characteristics, std::vector<std::string> &dataNames, void *pUserData)
+{
+	std::vector<std::shared_ptr<const GattCharacteristic>> shardUpdates[DispatchShards::kMaxShards];
+
+	size_t kept = 0;
+	for (size_t i = 0; i < characteristics.size(); ++i)
+	{
+		int shard = DispatchShards::getShard(*characteristics[i]);
+		if (0 == shard)
+		{
+			characteristics[kept] = characteristics[i];
+			dataNames[kept] = dataNames[i];
+			++kept;
+		}
+		else
+		{
+			shardUpdates[shard].push_back(characteristics[i]);
+		}
+	}
+
+	characteristics.resize(kept);
+	dataNames.resize(kept);
+
+	for (int shard = 1; shard < DispatchShards::kMaxShards; ++shard)
+	{
+		if (!shardUpdates[shard].empty())
+		{
+			DispatchShards::post(shard, shardUpdates[shard], pUserData);
+		}
+	}
+}
+
 // Our idle function
 //
 // This method is used to process data on the same thread as our main loop. This allows us to communicate with our service from
@@ -137,43 +241,130 @@ bool idleFunc(void *pUserData)
 		return false;
 	}
 
-	// Try to get an update
+	// Gather up to kMaxUpdatesPerIdle updates, taking as many from the queue at once as we can
+	PooledVector<std::shared_ptr<const GattCharacteristic>> characteristics;
+	std::vector<std::string> dataNames;
 	const int kQueueEntryLen = 1024;
-	char queueEntry[kQueueEntryLen];
-	if (ggkPopUpdateQueue(queueEntry, kQueueEntryLen, 0) != 1)
+	static char queueEntries[kQueueEntryLen * kMaxUpdatesPerIdle];
+	int popped = 0;
+	char *pQueueEntry = queueEntries;
+	while (characteristics.size() < static_cast<size_t>(kMaxUpdatesPerIdle))
 	{
-		return false;
+		if (0 == popped)
+		{
+			popped = ggkPopUpdateQueueMany(queueEntries, sizeof(queueEntries), kMaxUpdatesPerIdle - static_cast<int>(characteristics.size()));
+			pQueueEntry = queueEntries;
+			if (popped <= 0)
+			{
+				break;
+			}
+		}
+
+		char *pEntry = pQueueEntry;
+		pQueueEntry += strlen(pQueueEntry) + 1;
+		popped -= 1;
+
+		// Split the entry in place
+		char *pToken = strchr(pEntry, '|');
+		if (nullptr == pToken)
+		{
+			Logger::error("Queue entry was not formatted properly - could not find separating token");
+			continue;
+		}
+
+		*pToken = 0;
+		DBusObjectPath objectPath = DBusObjectPath(pEntry);
+		std::string interfaceName = pToken + 1;
+
+		// We have an update - find the interface it belongs to
+		std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(objectPath, interfaceName);
+		if (nullptr == pInterface)
+		{
+			Logger::warn(SSTR << "Unable to find interface for update: path[" << objectPath << "], name[" << interfaceName << "]");
+		}
+
+		// Is it a characteristic?
+		else if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
+		{
+			Logger::debug(SSTR << "Processing updated value for interface '" << interfaceName << "' at path '" << objectPath << "'");
+			characteristics.push_back(pCharacteristic);
+			dataNames.push_back(getDataName(*pCharacteristic));
+
+			// Composites that bind this value notify it too, coalesced into one update each (see CompositeValue.cpp)
+			THESERVER->notifyDataChanged(dataNames.back());
+		}
 	}
 
-	std::string entryString = queueEntry;
-	auto token = entryString.find('|');
-	if (token == std::string::npos)
+	if (characteristics.empty())
 	{
-		Logger::error("Queue entry was not formatted properly - could not find separating token");
 		return false;
 	}
 
-	DBusObjectPath objectPath = DBusObjectPath(entryString.substr(0, token));
-	std::string interfaceName = entryString.substr(token+1);
+	// Hand the updates for other shards' characteristics to their threads
+	if (DispatchShards::isRunning())
+	{
+		postShardUpdates(characteristics, dataNames, pUserData);
+	}
 
-	// We have an update - call the onUpdatedValue method on the interface
-	std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(objectPath, interfaceName);
-	if (nullptr == pInterface)
+	// Composites read all of their bound values, so prefetch those along with the rest
+	for (const std::shared_ptr<const GattCharacteristic> &pCharacteristic : characteristics)
 	{
-		Logger::warn(SSTR << "Unable to find interface for update: path[" << objectPath << "], name[" << interfaceName << "]");
+		if (nullptr != pCharacteristic->getCompositeValue())
+		{
+			for (const CompositeValue::Field &field : pCharacteristic->getCompositeValue()->getFields())
+			{
+				dataNames.push_back(field.name);
+			}
+		}
 	}
-	else
+
+	// Call the onUpdatedValue method on each interface, serving their data from a single batch when there is more than one
+	THESERVER->beginDataBatch(dataNames);
+	for (const std::shared_ptr<const GattCharacteristic> &pCharacteristic : characteristics)
 	{
-		// Is it a characteristic?
-		if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
+		// The value has changed, so fast reads wait for the notification (or the next read) to take a new snapshot
+		if (nullptr != pCharacteristic->getValueSnapshot())
 		{
-			Logger::debug(SSTR << "Processing updated value for interface '" << interfaceName << "' at path '" << objectPath << "'");
-			pCharacteristic->callOnUpdatedValue(pBusConnection, pUserData);
-			return true;
+			pCharacteristic->getValueSnapshot()->invalidate();
 		}
+
+		pCharacteristic->callOnUpdatedValue(pBusConnection, pUserData);
 	}
+	THESERVER->endDataBatch();
 
-	return false;
+	return true;
+}
+
+// Runs our idle function from the main loop
+//
+// Running the idle function from here allows us to manage the inter-idle sleep so we don't soak up 100% of our CPU. On virtual
+// time, we skip the sleep and jump straight to the next timer instead.
+//
+// This is removed from the main loop while we're in idle mode (see `enterIdleMode()`.)
+static gboolean onIdlePoll(gpointer pUserData)
+{
+	// Try to process some data and if no data is processed, sleep for the requested frequency
+	bool processed;
+	{
+		WakeupScope wakeup(EWakeupIdle, "idleFunc");
+		processed = idleFunc(pUserData);
+		wakeup.setHandler(processed ? "idleFunc (updates)" : "idleFunc (no work)");
+	}
+
+	if (!processed)
+	{
+		if (Clock::getInstance().isSimulated())
+		{
+			Clock::getInstance().runUntilNextTimer(kPeriodicTimerFrequencySeconds * 1000);
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(kIdleFrequencyMS));
+		}
+	}
+
+	// Always return TRUE so our idle remains in tact
+	return TRUE;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -243,12 +434,30 @@ void uninit()
 		registeredObjectIds.clear();
 	}
 
+	MemoryStats::adjust(EMemoryGLib, -static_cast<ptrdiff_t>(registeredIntrospectionBytes));
+	registeredIntrospectionBytes = 0;
+
 	if (0 != periodicTimeoutId)
 	{
-		g_source_remove(periodicTimeoutId);
+		Clock::getInstance().removeTimer(periodicTimeoutId);
 		periodicTimeoutId = 0;
 	}
 
+	if (0 != idleHeartbeatId)
+	{
+		Clock::getInstance().removeTimer(idleHeartbeatId);
+		idleHeartbeatId = 0;
+	}
+
+	HciAdapter::getInstance().registerConnectionCountReceiver(nullptr);
+	idlePollSourceId = 0;
+
+	DispatchShards::stop();
+	bIdleMode = false;
+
+	// Join the asynchronous handlers' workers while the bus connection is still around to fail what they leave behind
+	AsyncReply::stopWorkers();
+
   	if (ownedNameId > 0)
   	{
 		g_bus_unown_name(ownedNameId);
@@ -256,6 +465,7 @@ void uninit()
 
 	if (nullptr != pBusConnection)
 	{
+		FastRead::uninstall(pBusConnection);
 		g_object_unref(pBusConnection);
 		pBusConnection = nullptr;
 	}
@@ -265,6 +475,9 @@ void uninit()
 		g_main_loop_unref(pMainLoop);
 		pMainLoop = nullptr;
 	}
+
+	// Close out any capture in progress so the file is complete
+	Capture::getInstance().stop();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -288,6 +501,10 @@ void shutdown()
 		return;
 	}
 
+	// Remove our advertising instance while the HciAdapter can still carry the command (its event thread stops once we're no
+	// longer running), so the controller doesn't keep advertising an instance that nobody owns
+	Advertising::getInstance().stop();
+
 	// Our new state: shutting down
 	setServerRunState(EStopping);
 
@@ -310,39 +527,53 @@ void shutdown()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Periodic timer handler
-//
-// A periodic timer is a timer fires every so often (see kPeriodicTimerFrequencySeconds.) This is used for our initialization
-// failure retries, but custom code can also be added to a server description (see `onEvent()`)
-gboolean onPeriodicTimer(gpointer pUserData)
+// Collects the data names of every characteristic within `object` (and its children) that has an event firing on the next tick
+static void collectDueDataNames(const DBusObject &object, std::vector<std::string> &dataNames)
 {
-	// If we're shutting down, don't do anything and stop the periodic timer
-	if (ggkGetServerRunState() > ERunning)
+	for (std::shared_ptr<const DBusInterface> pInterface : object.getInterfaces())
 	{
-		return FALSE;
+		if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
+		{
+			if (pCharacteristic->hasDueEvents())
+			{
+				dataNames.push_back(getDataName(*pCharacteristic));
+			}
+		}
 	}
 
-	// Deal with retry timers
-	if (0 != retryTimeStart)
+	for (const DBusObject &child : object.getChildren())
 	{
-		Logger::debug(SSTR << "Ticking retry timer");
+		collectDueDataNames(child, dataNames);
+	}
+}
 
-		// Has the retry time expired?
-		int secondsRemaining = time(nullptr) - retryTimeStart - kRetryDelaySeconds;
-		if (secondsRemaining >= 0)
-		{
-			retryTimeStart = 0;
-			initializationStateProcessor();
-		}
+// The work of a single periodic tick: retries, events, advertising, connection profiles and our housekeeping
+static void tickServer(gpointer pUserData)
+{
+	// Retry any failed initialization steps that are due
+	if (initScheduler.tick())
+	{
+		initializationStateProcessor();
 	}
 
 	// If we're registered, then go ahead and emit signals
 	if (bApplicationRegistered)
 	{
+		// Prefetch the data for every characteristic with an event firing on this tick in a single batch
+		std::vector<std::string> dataNames;
+		for (const DBusObject &object : THESERVER->getObjects())
+		{
+			if (object.isPublished())
+			{
+				collectDueDataNames(object, dataNames);
+			}
+		}
+
 		// Tick the object hierarchy
 		//
 		// The real goal here is to have the objects tick their interfaces (see `onEvent()` method when adding interfaces inside
 		// 'Server::Server()'
+		THESERVER->beginDataBatch(dataNames);
 		for (const DBusObject &object : THESERVER->getObjects())
 		{
 			if (object.isPublished())
@@ -350,11 +581,261 @@ gboolean onPeriodicTimer(gpointer pUserData)
 				object.tickEvents(pBusConnection, pUserData);
 			}
 		}
+		THESERVER->endDataBatch();
+
+		// Keep our advertising instance up to date (once we're handing off, advertising belongs to the new instance)
+		if (!bHandingOff)
+		{
+			Advertising::getInstance().tick();
+		}
+
+		// Apply connection profile changes (including for new connections)
+		ConnectionProfiles::getInstance().tick();
+	}
+
+	// Report any subsystem that has grown past its memory budget
+	MemoryStats::checkBudgets();
+
+	// Log the wakeup summary if one is due
+	PowerProfiler::getInstance().tick();
+}
+
+// Periodic timer handler
+//
+// A periodic timer is a timer fires every so often (see kPeriodicTimerFrequencySeconds.) This is used for our initialization
+// failure retries, but custom code can also be added to a server description (see `onEvent()`)
+gboolean onPeriodicTimer(gpointer pUserData)
+{
+	// If we're shutting down, don't do anything and stop the periodic timer
+	if (ggkGetServerRunState() > ERunning)
+	{
+		return FALSE;
+	}
+
+	WakeupScope wakeup(EWakeupPeriodicTimer, "onPeriodicTimer");
+	tickServer(pUserData);
+
+	// With nobody connected, stop ticking until somebody is (returning FALSE removes this timer)
+	if (canEnterIdleMode())
+	{
+		// Cleared first, as entering idle mode may leave it again right away (starting a new periodic timer)
+		periodicTimeoutId = 0;
+		enterIdleMode();
+		return FALSE;
 	}
 
 	return TRUE;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ___    _ _                           _
+// |_ _|__| | | ___    _ __ ___   ___   __| | ___
+//  | |/ _` | |/ _ \  | '_ ` _ \ / _ \ / _` |/ _ \_
+//  | | (_| | |  __/  | | | | | | (_) | (_| |  __/
+// |___\__,_|_|\___|  |_| |_| |_|\___/ \__,_|\___|
+//
+// While no central is connected, there is nobody to notify and nobody to read our values. Ticking events (which build values
+// such as the current time) and polling the update queue every `kIdleFrequencyMS` is wasted work and, on a battery-powered
+// device, wasted power.
+//
+// Once we've been registered with BlueZ, nobody has been connected for `kIdleModeDelaySeconds`, and our advertising has settled
+// on its slow interval, the periodic timer stops itself and the idle poll is removed from the main loop. All that remains is a
+// heartbeat every `kIdleModeHeartbeatSeconds`, which runs our housekeeping (memory budgets and the wakeup summary.)
+//
+// We leave idle mode as soon as the HCI adapter reports a new connection, at the first D-Bus method call or property access
+// (in case we missed one), or when the application queues an update. Updates are never dropped: even with nobody subscribed,
+// processing one is what brings its characteristic's cached and derived state (fast reads, composite and delta values) up to
+// date. We don't enter idle mode while updates are waiting, and once they've been processed the periodic timer returns us to
+// idle mode on its next tick. Leaving restarts the timer and the idle poll and runs a tick right away, so advertising and connection
+// profiles catch up before the central has finished discovering our services.
+//
+// Idle mode is not used on virtual time (which is advanced by the idle poll), nor when the HCI adapter isn't running, as we would
+// have no way of knowing when a central connects.
+//
+// Each change of mode logs the server thread's CPU usage over the period that just ended, as a measure of what idle mode saves.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the CPU time used by the calling thread, in microseconds
+static int64_t threadCpuUS()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Logs the server thread's CPU usage over the mode that is ending (`pModeName`) and starts measuring the next one
+static void logModeChange(const char *pChange, const char *pModeName, const char *pReason)
+{
+	int64_t nowMS = Clock::getInstance().nowMS();
+	int64_t nowCpuUS = threadCpuUS();
+	double elapsedSeconds = (nowMS - modeStartMS) / 1000.0;
+	double cpuPercent = elapsedSeconds > 0.0 ? (nowCpuUS - modeStartCpuUS) / (elapsedSeconds * 10000.0) : 0.0;
+
+	Logger::info(SSTR << std::fixed << std::setprecision(1) << pChange << " (" << pReason << ") after " << elapsedSeconds << "s "
+		<< pModeName << ", using " << std::setprecision(3) << cpuPercent << "% of the CPU");
+
+	modeStartMS = nowMS;
+	modeStartCpuUS = nowCpuUS;
+}
+
+// Returns true if nothing needs our periodic timer (see the discussion above)
+static bool canEnterIdleMode()
+{
+	return bIdleModeEnabled
+		&& !Clock::getInstance().isSimulated()
+		&& bApplicationRegistered
+		&& !initScheduler.isRetryPending()
+		&& HciAdapter::getInstance().isRunning()
+		&& 0 == HciAdapter::getInstance().getActiveConnectionCount()
+		&& Clock::getInstance().nowMS() - lastActivityMS >= kIdleModeDelaySeconds * 1000
+		&& 0 != ggkUpdateQueueIsEmpty()
+		&& Advertising::getInstance().isSettled();
+}
+
+// Idle mode heartbeat
+//
+// Returning FALSE removes this timer.
+static gboolean onIdleHeartbeat(gpointer)
+{
+	if (ggkGetServerRunState() > ERunning)
+	{
+		return FALSE;
+	}
+
+	WakeupScope wakeup(EWakeupPeriodicTimer, "onIdleHeartbeat");
+
+	// If something has changed that needs our timer (such as the advertising configuration or queued updates), go back to work
+	if (!canEnterIdleMode())
+	{
+		leaveIdleMode("idle conditions no longer met");
+		return FALSE;
+	}
+
+	MemoryStats::checkBudgets();
+	PowerProfiler::getInstance().tick();
+
+	return TRUE;
+}
+
+// Enters idle mode (the caller is the periodic timer, which stops itself)
+//
+// `noteUpdateQueued()` only wakes us once `bIdleMode` is set, so an update queued after `canEnterIdleMode()` looked at the queue
+// would sit there until the heartbeat. We set `bIdleMode` first and then look at the queue again: either we see the update
+// here, or its `noteUpdateQueued()` sees that we're idle.
+static void enterIdleMode()
+{
+	if (bIdleMode)
+	{
+		return;
+	}
+
+	logModeChange("Entering idle mode", "active", "no connections");
+
+	if (0 != idlePollSourceId)
+	{
+		g_source_remove(idlePollSourceId);
+		idlePollSourceId = 0;
+	}
+
+	idleHeartbeatId = Clock::getInstance().addTimer(kIdleModeHeartbeatSeconds * 1000, onIdleHeartbeat, nullptr);
+	bIdleMode = true;
+
+	if (0 == ggkUpdateQueueIsEmpty())
+	{
+		leaveIdleMode("updates queued");
+	}
+}
+
+// Leaves idle mode, restarting our periodic timer and idle poll and catching up with a tick right away
+static void leaveIdleMode(const char *pReason)
+{
+	if (!bIdleMode)
+	{
+		return;
+	}
+
+	bIdleMode = false;
+	logModeChange("Leaving idle mode", "idle", pReason);
+
+	if (0 != idleHeartbeatId)
+	{
+		Clock::getInstance().removeTimer(idleHeartbeatId);
+		idleHeartbeatId = 0;
+	}
+
+	periodicTimeoutId = Clock::getInstance().addTimer(kPeriodicTimerFrequencySeconds * 1000, onPeriodicTimer, pBusConnection);
+	idlePollSourceId = g_idle_add(onIdlePoll, nullptr);
+
+	tickServer(pBusConnection);
+}
+
+// Notes D-Bus activity, which holds off idle mode (and ends it, in case we missed a connection)
+//
+// With dispatch shards, this is also called from the shards' threads, so leaving idle mode is passed to the server's thread (when
+// called from the server's thread, it happens right away.)
+static void noteActivity()
+{
+	lastActivityMS = Clock::getInstance().nowMS();
+	if (bIdleMode)
+	{
+		g_main_context_invoke(nullptr, [](gpointer) -> gboolean
+		{
+			leaveIdleMode("D-Bus activity");
+			return FALSE;
+		}, nullptr);
+	}
+}
+
+// Notes that updates were added to the update queue, which ends idle mode so the idle poll processes them
+//
+// This is called from the application's threads, so leaving idle mode is passed to the server's thread. It is always deferred
+// (never run right away on the server's thread), as leaving idle mode runs a tick, which may take from the update queue.
+void noteUpdateQueued()
+{
+	if (bIdleMode)
+	{
+		g_idle_add_full(G_PRIORITY_HIGH, [](gpointer) -> gboolean
+		{
+			leaveIdleMode("updates queued");
+			return FALSE;
+		}, nullptr, nullptr);
+	}
+}
+
+// Receives changes in the active connection count from the HCI adapter's event thread and passes them to the server's thread
+static void onConnectionCountChanged(int connectionCount)
+{
+	g_idle_add_full(G_PRIORITY_HIGH, [](gpointer pConnectionCount) -> gboolean
+	{
+		lastActivityMS = Clock::getInstance().nowMS();
+		if (GPOINTER_TO_INT(pConnectionCount) > 0)
+		{
+			leaveIdleMode("device connected");
+		}
+		return FALSE;
+	}, GINT_TO_POINTER(connectionCount), nullptr);
+}
+
+// Enables or disables idle mode (enabled by default)
+void setIdleModeEnabled(bool enable)
+{
+	bIdleModeEnabled = enable;
+	if (!enable)
+	{
+		g_idle_add_full(G_PRIORITY_HIGH, [](gpointer) -> gboolean
+		{
+			leaveIdleMode("disabled");
+			return FALSE;
+		}, nullptr, nullptr);
+	}
+}
+
+// Returns true if the server is in idle mode
+bool isIdleMode()
+{
+	return bIdleMode;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 //  _____                 _
 // | ____|_   _____ _ __ | |_ ___
@@ -379,10 +860,21 @@ void onMethodCall
 	gpointer pUserData
 )
 {
+	WakeupScope wakeup(EWakeupDBus, pMethodName, pObjectPath);
+	noteActivity();
+	int64_t startUS = Capture::nowUS();
+
 	// Convert our input path into our custom type for path management
 	DBusObjectPath objectPath(pObjectPath);
 
-	if (!THESERVER->callMethod(objectPath, pInterfaceName, pMethodName, pConnection, pParameters, pInvocation, pUserData))
+	bool found = THESERVER->callMethod(objectPath, pInterfaceName, pMethodName, pConnection, pParameters, pInvocation, pUserData);
+	ServerStats::recordDispatch(Capture::nowUS() - startUS);
+	if (Capture::getInstance().isRecording())
+	{
+		Capture::getInstance().recordDBus(ECaptureMethodCall, startUS, pSender, pObjectPath, pInterfaceName, pMethodName, pParameters);
+	}
+
+	if (!found)
 	{
 		Logger::error(SSTR << " + Method not found: [" << pSender << "]:[" << objectPath << "]:[" << pInterfaceName << "]:[" << pMethodName << "]");
 		g_dbus_method_invocation_return_dbus_error(pInvocation, kErrorNotImplemented.c_str(), "This method is not implemented");
@@ -392,6 +884,15 @@ void onMethodCall
 	return;
 }
 
+// Builds the "[sender]:[path]:[interface]:[property]" string that identifies a property access in our diagnostics
+static PooledString describeProperty(const gchar *pSender, const DBusObjectPath &objectPath, const gchar *pInterfaceName, const gchar *pPropertyName)
+{
+	PooledString description;
+	description.append("[").append(pSender).append("]:[").append(objectPath.c_str()).append("]:[").append(pInterfaceName);
+	description.append("]:[").append(pPropertyName).append("]");
+	return description;
+}
+
 // Handle D-Bus requests to get a property
 GVariant *onGetProperty
 (
@@ -404,12 +905,15 @@ GVariant *onGetProperty
 	gpointer         pUserData
 )
 {
+	WakeupScope wakeup(EWakeupDBus, "Get", pPropertyName);
+	noteActivity();
+
 	// Convert our input path into our custom type for path management
 	DBusObjectPath objectPath(pObjectPath);
 
 	const GattProperty *pProperty = THESERVER->findProperty(objectPath, pInterfaceName, pPropertyName);
 
-	std::string propertyPath = std::string("[") + pSender + "]:[" + objectPath.toString() + "]:[" + pInterfaceName + "]:[" + pPropertyName + "]";
+	PooledString propertyPath = describeProperty(pSender, objectPath, pInterfaceName, pPropertyName);
 	if (!pProperty)
 	{
 		Logger::error(SSTR << "Property(get) not found: " << propertyPath);
@@ -425,7 +929,13 @@ GVariant *onGetProperty
 	}
 
 	Logger::info(SSTR << "Calling property getter: " << propertyPath);
+	bool recording = Capture::getInstance().isRecording();
+	int64_t startUS = recording ? Capture::nowUS() : 0;
 	GVariant *pResult = pProperty->getGetterFunc()(pConnection, pSender, objectPath.c_str(), pInterfaceName, pPropertyName, ppError, pUserData);
+	if (recording)
+	{
+		Capture::getInstance().recordDBus(ECaptureGetProperty, startUS, pSender, pObjectPath, pInterfaceName, pPropertyName, nullptr);
+	}
 
 	if (nullptr == pResult)
 	{
@@ -449,12 +959,15 @@ gboolean onSetProperty
 	gpointer         pUserData
 )
 {
+	WakeupScope wakeup(EWakeupDBus, "Set", pPropertyName);
+	noteActivity();
+
 	// Convert our input path into our custom type for path management
 	DBusObjectPath objectPath(pObjectPath);
 
 	const GattProperty *pProperty = THESERVER->findProperty(objectPath, pInterfaceName, pPropertyName);
 
-	std::string propertyPath = std::string("[") + pSender + "]:[" + objectPath.toString() + "]:[" + pInterfaceName + "]:[" + pPropertyName + "]";
+	PooledString propertyPath = describeProperty(pSender, objectPath, pInterfaceName, pPropertyName);
 	if (!pProperty)
 	{
 		Logger::error(SSTR << "Property(set) not found: " << propertyPath);
@@ -470,7 +983,15 @@ gboolean onSetProperty
 	}
 
 	Logger::info(SSTR << "Calling property getter: " << propertyPath);
-	if (!pProperty->getSetterFunc()(pConnection, pSender, objectPath.c_str(), pInterfaceName, pPropertyName, pValue, ppError, pUserData))
+	bool recording = Capture::getInstance().isRecording();
+	int64_t startUS = recording ? Capture::nowUS() : 0;
+	gboolean result = pProperty->getSetterFunc()(pConnection, pSender, objectPath.c_str(), pInterfaceName, pPropertyName, pValue, ppError, pUserData);
+	if (recording)
+	{
+		Capture::getInstance().recordDBus(ECaptureSetProperty, startUS, pSender, pObjectPath, pInterfaceName, pPropertyName, pValue);
+	}
+
+	if (!result)
 	{
 	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(set) failed: " + propertyPath).c_str(), pSender);
 	    return false;
@@ -479,30 +1000,6 @@ gboolean onSetProperty
 	return true;
 }
 
-// ---------------------------------------------------------------------------------------------------------------------------------
-//  _____     _ _                                                                              _
-// |  ___|_ _(_) |_   _ _ __ ___   _ __ ___   __ _ _ __   __ _  __ _  ___ _ __ ___   ___ _ __ | |_
-// | |_ / _` | | | | | | '__/ _ \ | '_ ` _ \ / _` | '_ \ / _` |/ _` |/ _ \ '_ ` _ \ / _ \ '_ \| __|
-// |  _| (_| | | | |_| | | |  __/ | | | | | | (_| | | | | (_| | (_| |  __/ | | | | |  __/ | | | |_
-// |_|  \__,_|_|_|\__,_|_|  \___| |_| |_| |_|\__,_|_| |_|\__,_|\__, |\___|_| |_| |_|\___|_| |_|\__|
-//                                                             |___/
-//
-// ---------------------------------------------------------------------------------------------------------------------------------
-
-// Convenience method for setting a retry timer so that operations can be continuously retried until we eventually succeed
-void setRetry()
-{
-	retryTimeStart = time(nullptr);
-}
-
-// Convenience method for setting a retry timer so that failures (related to initialization) can be continuously retried until we
-// eventually succeed.
-void setRetryFailure()
-{
-	setRetry();
-	Logger::warn(SSTR << "  + Will retry the failed operation in about " << kRetryDelaySeconds << " seconds");
-}
-
 // ---------------------------------------------------------------------------------------------------------------------------------
 //   ____    _  _____ _____                  _     _             _   _
 //  / ___|  / \|_   _|_   _|  _ __ ___  __ _(_)___| |_ _ __ __ _| |_(_) ___  _ ___
@@ -537,13 +1034,14 @@ void doRegisterApplication()
 			if (nullptr == pVariant)
 			{
 				Logger::error(SSTR << "Failed to register application: " << (nullptr == pError ? "Unknown" : pError->message));
-				setRetryFailure();
+				initScheduler.fail(EInitApplication);
 			}
 			else
 			{
 				g_variant_unref(pVariant);
 				Logger::debug(SSTR << "GATT application registered with BlueZ");
 				bApplicationRegistered = true;
+				initScheduler.succeed(EInitApplication);
 			}
 
 			// Keep going...
@@ -554,6 +1052,26 @@ void doRegisterApplication()
 	);
 }
 
+// Starts our dispatch shards, each of which registers its own GATT application with BlueZ (see DispatchShards.cpp)
+void doStartShards()
+{
+	DispatchShards::start("", bluezGattManagerInterfaceName, [](bool success)
+	{
+		if (success)
+		{
+			Logger::debug(SSTR << "Dispatch shards running");
+			initScheduler.succeed(EInitShards);
+		}
+		else
+		{
+			initScheduler.fail(EInitShards);
+		}
+
+		// Keep going...
+		initializationStateProcessor();
+	});
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 //   ___  _     _           _                    _     _             _   _
 //  / _ \| |__ (_) ___  ___| |_   _ __ ___  __ _(_)___| |_ _ __ __ _| |_(_) ___  _ ___
@@ -566,7 +1084,9 @@ void doRegisterApplication()
 // use an XML description of our D-Bus objects.
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath = DBusObjectPath(), int depth = 1)
+// Registers each interface of `pNode` and its children at `basePath` on `pConnection` with our D-Bus entry points, adding their
+// IDs to `objectIds` and returning false on failure
+bool registerNodeHierarchy(GDBusConnection *pConnection, GDBusNodeInfo *pNode, const DBusObjectPath &basePath, RegisteredObjectIds &objectIds, int depth)
 {
 	std::string prefix;
 	prefix.insert(0, depth * 2, ' ');
@@ -586,7 +1106,7 @@ void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath
 		// Logger::debug(SSTR << prefix << "    (iface: " << (*ppInterface)->name << ")");
 		guint registeredObjectId = g_dbus_connection_register_object
 		(
-			pBusConnection,             // GDBusConnection *connection
+			pConnection,                // GDBusConnection *connection
 			basePath.c_str(),           // const gchar *object_path
 			*ppInterface,               // GDBusInterfaceInfo *interface_info
 			&interfaceVtable,           // const GDBusInterfaceVTable *vtable
@@ -600,16 +1120,12 @@ void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath
 			Logger::error(SSTR << "Failed to register object: " << (nullptr == pError ? "Unknown" : pError->message));
 
 			// Cleanup and pretend like we were never here
-			g_dbus_node_info_unref(pNode);
-			registeredObjectIds.clear();
-
-			// Try again later
-			setRetryFailure();
-			return;
+			objectIds.clear();
+			return false;
 		}
 
 		// Save the registered object Id so we can clean it up later
-		registeredObjectIds.push_back(registeredObjectId);
+		objectIds.push_back(registeredObjectId);
 
 		++ppInterface;
 	}
@@ -617,14 +1133,22 @@ void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath
 	GDBusNodeInfo **ppChild = pNode->nodes;
 	while(nullptr != *ppChild)
 	{
-		registerNodeHierarchy(*ppChild, basePath + (*ppChild)->path, depth + 1);
+		if (!registerNodeHierarchy(pConnection, *ppChild, basePath + (*ppChild)->path, objectIds, depth + 1))
+		{
+			return false;
+		}
 
 		++ppChild;
 	}
+
+	return true;
 }
 
 void registerObjects()
 {
+	// Deal our services to the dispatch shards first, as this decides which services we report to BlueZ (see DispatchShards.cpp)
+	DispatchShards::assign();
+
 	// Parse each object into an XML interface tree
 	for (const DBusObject &object : THESERVER->getObjects())
 	{
@@ -634,20 +1158,34 @@ void registerObjects()
 		if (nullptr == pNode)
 		{
 			Logger::error(SSTR << "Failed to introspect XML: " << (nullptr == pError ? "Unknown" : pError->message));
-			setRetryFailure();
+			initScheduler.fail(EInitObjects);
 			return;
 		}
 
 		Logger::debug(SSTR << "Registering object hierarchy with D-Bus hierarchy");
 
-		// Register the node hierarchy
-		registerNodeHierarchy(pNode, DBusObjectPath(pNode->path));
+		// Register the node hierarchy (and try again later if that fails)
+		if (!registerNodeHierarchy(pBusConnection, pNode, DBusObjectPath(pNode->path), registeredObjectIds))
+		{
+			g_dbus_node_info_unref(pNode);
+			initScheduler.fail(EInitObjects);
+			return;
+		}
+
+		// GLib keeps the interface info for our registered objects, which we can't measure directly, so we account the size of
+		// the introspection data it was built from
+		MemoryStats::adjust(EMemoryGLib, xmlString.size());
+		registeredIntrospectionBytes += xmlString.size();
 
 		// Cleanup the node
 		g_dbus_node_info_unref(pNode);
 	}
 
+	// Answer reads of our fast-read characteristics on GDBus's worker thread
+	FastRead::install(pBusConnection);
+
 	// Keep going
+	initScheduler.succeed(EInitObjects);
 	initializationStateProcessor();
 }
 
@@ -679,6 +1217,10 @@ void configureAdapter()
 	HciAdapter::ControllerInformation info = HciAdapter::getInstance().getControllerInformation();
 
 	// Are all of our settings the way we want them?
+	//
+	// Note that if the application configured advertising sets, advertising is managed by `Advertising` and the adapter's
+	// advertising setting must be disabled
+	bool enableAdvertising = THESERVER->getEnableAdvertising() && !Advertising::getInstance().isManaged();
 	bool pwFlag = info.currentSettings.isSet(HciAdapter::EHciPowered) == true;
 	bool leFlag = info.currentSettings.isSet(HciAdapter::EHciLowEnergy) == true;
 	bool brFlag = info.currentSettings.isSet(HciAdapter::EHciBasicRate_EnhancedDataRate) == THESERVER->getEnableBREDR();
@@ -686,7 +1228,7 @@ void configureAdapter()
 	bool bnFlag = info.currentSettings.isSet(HciAdapter::EHciBondable) == THESERVER->getEnableBondable();
 	bool cnFlag = info.currentSettings.isSet(HciAdapter::EHciConnectable) == THESERVER->getEnableConnectable();
 	bool diFlag = info.currentSettings.isSet(HciAdapter::EHciDiscoverable) == THESERVER->getEnableDiscoverable();
-	bool adFlag = info.currentSettings.isSet(HciAdapter::EHciAdvertising) == THESERVER->getEnableAdvertising();
+	bool adFlag = info.currentSettings.isSet(HciAdapter::EHciAdvertising) == enableAdvertising;
 	bool anFlag = (advertisingName.length() == 0 || advertisingName == info.name) && (advertisingShortName.length() == 0 || advertisingShortName == info.shortName);
 
 	// If everything is setup already, we're done
@@ -696,14 +1238,14 @@ void configureAdapter()
 		if (pwFlag)
 		{
 			Logger::debug("Powering off");
-			if (!mgmt.setPowered(false)) { setRetry(); return; }
+			if (!mgmt.setPowered(false)) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Enable the LE state (we always set this state if it's not set)
 		if (!leFlag)
 		{
 			Logger::debug("Enabling LE");
-			if (!mgmt.setLE(true)) { setRetry(); return; }
+			if (!mgmt.setLE(true)) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Br/Edr state?
@@ -712,60 +1254,60 @@ void configureAdapter()
 		if (!brFlag)
 		{
 			Logger::debug(SSTR << (THESERVER->getEnableBREDR() ? "Enabling":"Disabling") << " BR/EDR");
-			if (!mgmt.setBredr(THESERVER->getEnableBREDR())) { setRetry(); return; }
+			if (!mgmt.setBredr(THESERVER->getEnableBREDR())) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Secure Connectinos state?
 		if (!scFlag)
 		{
 			Logger::debug(SSTR << (THESERVER->getEnableSecureConnection() ? "Enabling":"Disabling") << " Secure Connections");
-			if (!mgmt.setSecureConnections(THESERVER->getEnableSecureConnection() ? 1 : 0)) { setRetry(); return; }
+			if (!mgmt.setSecureConnections(THESERVER->getEnableSecureConnection() ? 1 : 0)) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Bondable state?
 		if (!bnFlag)
 		{
 			Logger::debug(SSTR << (THESERVER->getEnableBondable() ? "Enabling":"Disabling") << " Bondable");
-			if (!mgmt.setBondable(THESERVER->getEnableBondable())) { setRetry(); return; }
+			if (!mgmt.setBondable(THESERVER->getEnableBondable())) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Connectable state?
 		if (!cnFlag)
 		{
 			Logger::debug(SSTR << (THESERVER->getEnableConnectable() ? "Enabling":"Disabling") << " Connectable");
-			if (!mgmt.setConnectable(THESERVER->getEnableConnectable())) { setRetry(); return; }
+			if (!mgmt.setConnectable(THESERVER->getEnableConnectable())) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Discoverable state?
 		if (!diFlag)
 		{
 			Logger::debug(SSTR << (THESERVER->getEnableDiscoverable() ? "Enabling":"Disabling") << " Discoverable");
-			if (!mgmt.setDiscoverable(THESERVER->getEnableDiscoverable() ? 1 : 0, 0)) { setRetry(); return; }
+			if (!mgmt.setDiscoverable(THESERVER->getEnableDiscoverable() ? 1 : 0, 0)) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Change the Advertising state?
 		if (!adFlag)
 		{
-			Logger::debug(SSTR << (THESERVER->getEnableAdvertising() ? "Enabling":"Disabling") << " Advertising");
-			if (!mgmt.setAdvertising(THESERVER->getEnableAdvertising() ? 1 : 0)) { setRetry(); return; }
+			Logger::debug(SSTR << (enableAdvertising ? "Enabling":"Disabling") << " Advertising");
+			if (!mgmt.setAdvertising(enableAdvertising ? 1 : 0)) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Set the name?
 		if (!anFlag)
 		{
 			Logger::info(SSTR << "Setting advertising name to '" << advertisingName << "' (with short name: '" << advertisingShortName << "')");
-			if (!mgmt.setName(advertisingName.c_str(), advertisingShortName.c_str())) { setRetry(); return; }
+			if (!mgmt.setName(advertisingName.c_str(), advertisingShortName.c_str())) { initScheduler.fail(EInitAdapterConfig); return; }
 		}
 
 		// Turn it back on
 		Logger::debug("Powering on");
-		if (!mgmt.setPowered(true)) { setRetry(); return; }
+		if (!mgmt.setPowered(true)) { initScheduler.fail(EInitAdapterConfig); return; }
 	}
 
 	Logger::info("The Bluetooth adapter is fully configured");
 
 	// We're all set, nothing to do!
-	bAdapterConfigured = true;
+	initScheduler.succeed(EInitAdapterConfig);
 	initializationStateProcessor();
 }
 
@@ -779,8 +1321,102 @@ void configureAdapter()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
+// Creates a proxy for `interfaceName` on the BlueZ object at `path`
+//
+// The proxy neither loads properties nor subscribes to signals, so creating it is cheap. Returns nullptr on failure.
+static GDBusProxy *newBluezProxy(const char *pPath, const char *pInterfaceName)
+{
+	GError *pError = nullptr;
+	GDBusProxy *pProxy = g_dbus_proxy_new_sync
+	(
+		pBusConnection,                                  // GDBusConnection *connection
+		GDBusProxyFlags(G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES
+			| G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS
+			| G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START),    // GDBusProxyFlags flags
+		nullptr,                                         // GDBusInterfaceInfo *info
+		"org.bluez",                                     // const gchar *name
+		pPath,                                           // const gchar *object_path
+		pInterfaceName,                                  // const gchar *interface_name
+		nullptr,                                         // GCancellable *cancellable
+		&pError                                          // GError **error
+	);
+
+	if (nullptr == pProxy)
+	{
+		Logger::warn(SSTR << "Failed to create a proxy for '" << pInterfaceName << "' on '" << pPath << "': " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+	}
+
+	return pProxy;
+}
+
+// Find the BlueZ's GATT Manager interface for our adapter by looking it up directly by its path (see `kBluezAdapterPath`)
+//
+// This only touches the adapter object itself, so its cost does not depend on how many other objects (devices, remote GATT
+// services, etc.) BlueZ has. If the adapter can't be found, we fall back to `findAdapterInterface()`.
+void findAdapterByPath()
+{
+	// Make sure the adapter exists and provides a GATT manager. GattManager1 has no properties, so this is as cheap as a call gets
+	// and fails if either the object or the interface is missing.
+	g_dbus_connection_call
+	(
+		pBusConnection,                                  // GDBusConnection *connection
+		"org.bluez",                                     // const gchar *bus_name
+		kBluezAdapterPath,                               // const gchar *object_path
+		"org.freedesktop.DBus.Properties",               // const gchar *interface_name
+		"GetAll",                                        // const gchar *method_name
+		g_variant_new("(s)", "org.bluez.GattManager1"),  // GVariant *parameters
+		nullptr,                                         // const GVariantType *reply_type
+		G_DBUS_CALL_FLAGS_NONE,                          // GDBusCallFlags flags
+		-1,                                              // gint timeout_msec
+		nullptr,                                         // GCancellable *cancellable
+
+		// GAsyncReadyCallback callback
+		[] (GObject * /*pSourceObject*/, GAsyncResult *pAsyncResult, gpointer /*pUserData*/)
+		{
+			GError *pError = nullptr;
+			GVariant *pResult = g_dbus_connection_call_finish(pBusConnection, pAsyncResult, &pError);
+			if (nullptr == pResult)
+			{
+				Logger::info(SSTR << "Adapter '" << kBluezAdapterPath << "' not found (" << (nullptr == pError ? "Unknown" : pError->message)
+					<< "); falling back to a search of BlueZ's objects");
+				g_clear_error(&pError);
+				bAdapterLookupByPathFailed = true;
+				findAdapter();
+				return;
+			}
+
+			g_variant_unref(pResult);
+
+			pBluezGattManagerProxy = newBluezProxy(kBluezAdapterPath, "org.bluez.GattManager1");
+			pBluezAdapterInterfaceProxy = newBluezProxy(kBluezAdapterPath, "org.bluez.Adapter1");
+			pBluezAdapterPropertiesInterfaceProxy = newBluezProxy(kBluezAdapterPath, "org.freedesktop.DBus.Properties");
+
+			if (nullptr == pBluezGattManagerProxy || nullptr == pBluezAdapterInterfaceProxy || nullptr == pBluezAdapterPropertiesInterfaceProxy)
+			{
+				Logger::error(SSTR << "Unable to create proxies for adapter '" << kBluezAdapterPath << "'");
+				if (nullptr != pBluezGattManagerProxy) { g_object_unref(pBluezGattManagerProxy); pBluezGattManagerProxy = nullptr; }
+				if (nullptr != pBluezAdapterInterfaceProxy) { g_object_unref(pBluezAdapterInterfaceProxy); pBluezAdapterInterfaceProxy = nullptr; }
+				if (nullptr != pBluezAdapterPropertiesInterfaceProxy) { g_object_unref(pBluezAdapterPropertiesInterfaceProxy); pBluezAdapterPropertiesInterfaceProxy = nullptr; }
+				initScheduler.fail(EInitAdapterLookup);
+				return;
+			}
+
+			bluezGattManagerInterfaceName = kBluezAdapterPath;
+
+			// Keep going
+			initScheduler.succeed(EInitAdapterLookup);
+			initializationStateProcessor();
+		},
+
+		nullptr                                          // gpointer user_data
+	);
+}
+
 // Find the BlueZ's GATT Manager interface for the *first* Bluetooth adapter provided by BlueZ. We'll need this to register our
 // GATT server with BlueZ.
+//
+// This is our fallback for when our adapter can't be found by its path (see `findAdapterByPath()`.)
 void findAdapterInterface()
 {
 	// Get a list of the BlueZ's D-Bus objects
@@ -788,57 +1424,64 @@ void findAdapterInterface()
 	if (nullptr == pObjects)
 	{
 		Logger::error(SSTR << "Unable to get ObjectManager objects");
-		setRetryFailure();
+		initScheduler.fail(EInitAdapterLookup);
 		return;
 	}
 
 	// Scan the list of objects we find one with a GATT manager interface
 	//
 	// Note that if there are multiple interfaces, we will only find the first
-	for (guint i = 0; i < g_list_length(pObjects) && bluezGattManagerInterfaceName.empty(); ++i)
+	GDBusObject *pFoundObject = nullptr;
+	for (GList *pItem = pObjects; nullptr != pItem; pItem = pItem->next)
 	{
 		// Current object in question
-		pBluezAdapterObject = static_cast<GDBusObject *>(g_list_nth_data(pObjects, i));
-		if (nullptr == pBluezAdapterObject) { continue; }
+		GDBusObject *pObject = static_cast<GDBusObject *>(pItem->data);
+		if (nullptr == pObject) { continue; }
 
 		// See if it has a GATT manager interface
-		pBluezGattManagerProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.bluez.GattManager1"));
+		pBluezGattManagerProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.bluez.GattManager1"));
 		if (nullptr == pBluezGattManagerProxy) { continue; }
 
 		// Get the interface proxy for this adapter - this will come in handy later
-		pBluezAdapterInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.bluez.Adapter1"));
+		pBluezAdapterInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.bluez.Adapter1"));
 		if (nullptr == pBluezAdapterInterfaceProxy)
 		{
 			Logger::warn(SSTR << "Failed to get adapter proxy for interface 'org.bluez.Adapter1'");
+			g_object_unref(pBluezGattManagerProxy);
+			pBluezGattManagerProxy = nullptr;
 			continue;
 		}
 
 		// Get the interface proxy for this adapter's properties - this will come in handy later
-		pBluezAdapterPropertiesInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.freedesktop.DBus.Properties"));
+		pBluezAdapterPropertiesInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.freedesktop.DBus.Properties"));
 		if (nullptr == pBluezAdapterPropertiesInterfaceProxy)
 		{
 			Logger::warn(SSTR << "Failed to get adapter properties proxy for interface 'org.freedesktop.DBus.Properties'");
+			g_object_unref(pBluezGattManagerProxy);
+			pBluezGattManagerProxy = nullptr;
+			g_object_unref(pBluezAdapterInterfaceProxy);
+			pBluezAdapterInterfaceProxy = nullptr;
 			continue;
 		}
 
 		// Finally, save off the interface name, we're done!
 		bluezGattManagerInterfaceName = g_dbus_proxy_get_object_path(pBluezGattManagerProxy);
+		pFoundObject = pObject;
 		break;
 	}
 
-	// Get a fresh copy of our objects so we can release the entire list
-	pBluezAdapterObject = g_dbus_object_manager_get_object(pBluezObjectManager, g_dbus_object_get_object_path(pBluezAdapterObject));
-
-	// We'll need access to the device object so we can set properties on it
-	pBluezDeviceObject = g_dbus_object_manager_get_object(pBluezObjectManager, g_dbus_object_get_object_path(pBluezAdapterObject));
-
-	// Cleanup the list
-	for (guint i = 0; i < g_list_length(pObjects) && bluezGattManagerInterfaceName.empty(); ++i)
+	if (nullptr != pFoundObject)
 	{
-		g_object_unref(g_list_nth_data(pObjects, i));
+		// Get a fresh copy of our objects so we can release the entire list
+		const gchar *pAdapterPath = g_dbus_object_get_object_path(pFoundObject);
+		pBluezAdapterObject = g_dbus_object_manager_get_object(pBluezObjectManager, pAdapterPath);
+
+		// We'll need access to the device object so we can set properties on it
+		pBluezDeviceObject = g_dbus_object_manager_get_object(pBluezObjectManager, pAdapterPath);
 	}
 
-	g_list_free(pObjects);
+	// Cleanup the list
+	g_list_free_full(pObjects, g_object_unref);
 
 	// If we didn't find the adapter object, reset things and we'll try again later
 	if (nullptr == pBluezAdapterObject || nullptr == pBluezDeviceObject)
@@ -851,11 +1494,12 @@ void findAdapterInterface()
 	if (bluezGattManagerInterfaceName.empty())
 	{
 		Logger::error(SSTR << "Unable to find the adapter");
-		setRetryFailure();
+		initScheduler.fail(EInitAdapterLookup);
 		return;
 	}
 
 	// Keep going
+	initScheduler.succeed(EInitAdapterLookup);
 	initializationStateProcessor();
 }
 
@@ -896,18 +1540,145 @@ void getBluezObjectManager()
 			if (nullptr == pBluezObjectManager)
 			{
 				Logger::error(SSTR << "Failed to get an ObjectManager client: " << (nullptr == pError ? "Unknown" : pError->message));
-				setRetryFailure();
+				initScheduler.fail(EInitAdapterLookup);
 				return;
 			}
 
-			// Keep going
-			initializationStateProcessor();
+			// Keep going with the search
+			findAdapterInterface();
 		},
 
 		nullptr                                     // gpointer user_data
 	);
 }
 
+// Finds our adapter's GATT manager, first by its path and failing that, by searching BlueZ's objects
+//
+// Each part picks up where the previous one left off, so a retry resumes the search rather than starting over.
+static void findAdapter()
+{
+	if (!bAdapterLookupByPathFailed)
+	{
+		Logger::debug(SSTR << "Looking up BlueZ adapter '" << kBluezAdapterPath << "'");
+		findAdapterByPath();
+	}
+	else if (nullptr == pBluezObjectManager)
+	{
+		Logger::debug(SSTR << "Getting BlueZ ObjectManager");
+		getBluezObjectManager();
+	}
+	else
+	{
+		Logger::debug(SSTR << "Finding BlueZ GattManager1 interface");
+		findAdapterInterface();
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  _   _       _                   _             _
+// | | | | ___ | |_   _ __ ___  ___| |_ __ _ _ __| |_
+// | |_| |/ _ \| __| | '__/ _ \/ __| __/ _` | '__| __|
+// |  _  | (_) | |_  | | |  __/\__ \ || (_| | |  | |_
+// |_| |_|\___/ \__| |_|  \___||___/\__\__,_|_|   \__|
+//
+// To upgrade the application without taking the GATT server down, a new process starts in handoff mode (see
+// `ggkSetHandoffMode()`) while the old one is still running. The new process does all of its slow work first: it connects to the
+// bus, registers its objects, finds and configures the adapter (which is a no-op when the configuration is unchanged.) Only then
+// does it take the owned name, replacing the running instance, and register its application with BlueZ.
+//
+// The running instance must allow replacement: either it was started with `ggkSetAllowTakeover()`, or it was itself started in
+// handoff mode (so each upgrade can be replaced by the next.) A server that allows neither keeps its name, and a new instance in
+// handoff mode waits in the bus's queue until it exits. When its name is taken, the running instance removes its advertising
+// instance (the new instance adds its own, under the same instance number, and must not have it removed from under it), sends
+// any notifications still in its update queue, unregisters its application from BlueZ and shuts down (its application sees
+// `ggkWait()` return.) From BlueZ's side, both applications are briefly registered at once, so there is no point at which our
+// services are missing.
+//
+// A change to the adapter's configuration (such as its name) still requires the adapter to be power-cycled, which drops any
+// connections.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts our periodic timer, if it isn't already running
+//
+// We start it as soon as we have a bus connection, as it drives the retries of failed initialization steps.
+static void startPeriodicTimer()
+{
+	if (0 != periodicTimeoutId)
+	{
+		return;
+	}
+
+	periodicTimeoutId = Clock::getInstance().addTimer(kPeriodicTimerFrequencySeconds * 1000, onPeriodicTimer, pBusConnection);
+	if (periodicTimeoutId <= 0)
+	{
+		Logger::fatal(SSTR << "Failed to add a periodic timer");
+		setServerHealth(EFailedInit);
+		shutdown();
+	}
+}
+
+// Hands off to the instance that has taken our owned name
+//
+// We stop advertising, send any notifications still queued, unregister our application from BlueZ and then shut down.
+static void handOff()
+{
+	Logger::info(SSTR << "Owned name ('" << THESERVER->getOwnedName() << "') taken over by a new instance; handing off");
+	handoffStartMS = Clock::getInstance().nowMS();
+
+	// Remove our advertising instance now, before the new instance adds its own; our periodic timer no longer touches it
+	bHandingOff = true;
+	Advertising::getInstance().stop();
+
+	// Our subscribers are still ours until we unregister, so deliver what's pending
+	while (idleFunc(nullptr))
+	{
+	}
+
+	g_dbus_proxy_call
+	(
+		pBluezGattManagerProxy,         // GDBusProxy *proxy
+		"UnregisterApplication",        // const gchar *method_name
+		g_variant_new("(o)", "/"),      // GVariant *parameters
+		G_DBUS_CALL_FLAGS_NONE,         // GDBusCallFlags flags
+		-1,                             // gint timeout_msec
+		nullptr,                        // GCancellable *cancellable
+
+		// GAsyncReadyCallback callback
+		[] (GObject * /*pSourceObject*/, GAsyncResult *pAsyncResult, gpointer /*pUserData*/)
+		{
+			GError *pError = nullptr;
+			GVariant *pVariant = g_dbus_proxy_call_finish(pBluezGattManagerProxy, pAsyncResult, &pError);
+			if (nullptr == pVariant)
+			{
+				Logger::warn(SSTR << "Failed to unregister application: " << (nullptr == pError ? "Unknown" : pError->message));
+				g_clear_error(&pError);
+			}
+			else
+			{
+				g_variant_unref(pVariant);
+			}
+
+			bApplicationRegistered = false;
+			Logger::info(SSTR << "Handed off in " << Clock::getInstance().nowMS() - handoffStartMS << "ms; shutting down");
+			shutdown();
+		},
+
+		nullptr                         // gpointer user_data
+	);
+}
+
+// Sets handoff mode, in which we take over from a running instance (see the discussion above)
+void setHandoffMode(bool enable)
+{
+	bHandoffMode = enable;
+}
+
+// Allows a new instance in handoff mode to take over from us (see the discussion above)
+void setAllowTakeover(bool enable)
+{
+	bAllowTakeover = enable;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 //   ___                          _
 //  / _ \__      ___ __   ___  __| |  _ __   __ _ _ __ ___   ___
@@ -922,6 +1693,9 @@ void getBluezObjectManager()
 // reside under this owned name.
 //
 // Note about error management: We don't yet hwave a timeout callback running for retries; errors are considered fatal
+//
+// We allow a new instance to replace us (see `handOff()`) only if takeover is allowed or we are in handoff mode ourselves. In
+// handoff mode, we are that new instance: we replace the running instance, or queue for the name until it lets it go.
 void doOwnedNameAcquire()
 {
 	// Our name is not presently lost
@@ -931,33 +1705,51 @@ void doOwnedNameAcquire()
 	(
 		pBusConnection,                    // GDBusConnection *connection
 		THESERVER->getOwnedName().c_str(), // const gchar *name
-		G_BUS_NAME_OWNER_FLAGS_NONE,       // GBusNameOwnerFlags flags
+		GBusNameOwnerFlags((bAllowTakeover || bHandoffMode ? G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT : 0)
+			| (bHandoffMode ? G_BUS_NAME_OWNER_FLAGS_REPLACE : 0)), // GBusNameOwnerFlags flags
 
 		// GBusNameAcquiredCallback name_acquired_handler
 		[](GDBusConnection *, const gchar *, gpointer)
 		{
 			// Handy way to get periodic activity
-			periodicTimeoutId = g_timeout_add_seconds(kPeriodicTimerFrequencySeconds, onPeriodicTimer, pBusConnection);
-			if (periodicTimeoutId <= 0)
-			{
-				Logger::fatal(SSTR << "Failed to add a periodic timer");
-				setServerHealth(EFailedInit);
-				shutdown();
-			}
+			startPeriodicTimer();
 
 			// Bus name acquired
 			bOwnedNameAcquired = true;
+			initScheduler.succeed(EInitOwnedName);
+			if (bHandoffMode)
+			{
+				Logger::info(SSTR << "Took over owned name ('" << THESERVER->getOwnedName() << "') from the running instance");
+			}
 
 			// Keep going...
 			initializationStateProcessor();
 		},
 
 		// GBusNameLostCallback name_lost_handler
-		[](GDBusConnection *, const gchar *, gpointer)
+		[](GDBusConnection *pConnection, const gchar *, gpointer)
 		{
 			// Bus name lost
+			bool wasAcquired = bOwnedNameAcquired;
 			bOwnedNameAcquired = false;
 
+			// If we were running, then a new instance has replaced us
+			if (wasAcquired && bApplicationRegistered && nullptr != pConnection && !g_dbus_connection_is_closed(pConnection))
+			{
+				handOff();
+				return;
+			}
+
+			// When taking over, the running instance may not allow replacement; we stay queued for the name until it exits
+			if (!wasAcquired && bHandoffMode)
+			{
+				Logger::warn(SSTR << "Owned name ('" << THESERVER->getOwnedName() << "') was not handed off; waiting for the running instance to release it");
+				return;
+			}
+
+			// We need our periodic timer for the retry
+			leaveIdleMode("owned name lost");
+
 			// If we don't have a periodicTimeout (which we use for error recovery) then we're sunk
 			if (0 == periodicTimeoutId)
 			{
@@ -968,7 +1760,7 @@ void doOwnedNameAcquire()
 			else
 			{
 				Logger::warn(SSTR << "Owned name ('" << THESERVER->getOwnedName() << "') lost");
-				setRetryFailure();
+				initScheduler.fail(EInitOwnedName);
 				return;
 			}
 
@@ -1012,8 +1804,13 @@ void doBusAcquire()
 				Logger::fatal(SSTR << "Failed to get bus connection: " << (nullptr == pError ? "Unknown" : pError->message));
 				setServerHealth(EFailedInit);
 				shutdown();
+				return;
 			}
 
+			// We need our periodic timer for retries
+			initScheduler.succeed(EInitBus);
+			startPeriodicTimer();
+
 			// Continue
 			initializationStateProcessor();
 		},
@@ -1032,83 +1829,98 @@ void doBusAcquire()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Poor-man's state machine, which effectively ensures everything is initialized in order by verifying actual initialization state
-// rather than stepping through a set of numeric states. This way, if something fails in an out-of-order sort of way, we can still
-// handle it and recover nicely.
-void initializationStateProcessor()
+// Builds the graph of our initialization steps
+//
+// Each step waits only for what it needs:
+//
+//     bus              nothing
+//     objects          the bus (registering our objects with D-Bus)
+//     adapter lookup   the bus (finding our adapter's GATT manager in BlueZ, see `findAdapter()`)
+//     adapter config   nothing (the adapter is configured through the management socket, see `configureAdapter()`)
+//     owned name       the bus, or when taking over from a running instance, everything but the application (see the
+//                      discussion of hot restarts)
+//     application      everything else (BlueZ calls into our objects while registering our application)
+//     shards           the same as the application, as each shard registers an application of its own (see DispatchShards.cpp);
+//                      in particular, during a hot restart, not before we've taken over the owned name
+//
+// See InitScheduler.cpp for how the steps are run.
+static void buildInitGraph()
 {
-	// If we're in our end-of-life or waiting for a retry, don't process states
-	if (ggkGetServerRunState() > ERunning || 0 != retryTimeStart)
-	{
-		return;
-	}
+	initScheduler.clear();
 
-	//
-	// Get a bus connection
-	//
-	if (nullptr == pBusConnection)
+	initScheduler.addStep("bus", [](InitScheduler &, int)
 	{
 		Logger::debug(SSTR << "Acquiring bus connection");
 		doBusAcquire();
-		return;
-	}
+	}, {});
 
-	//
-	// Acquire an owned name on the bus
-	//
-	if (!bOwnedNameAcquired)
+	initScheduler.addStep("objects", [](InitScheduler &, int)
 	{
-		Logger::debug(SSTR << "Acquiring owned name: '" << THESERVER->getOwnedName() << "'");
-		doOwnedNameAcquire();
-		return;
-	}
+		Logger::debug(SSTR << "Registering with D-Bus");
+		registerObjects();
+	}, { EInitBus });
 
-	//
-	// Get BlueZ's ObjectManager
-	//
-	if (nullptr == pBluezObjectManager)
+	initScheduler.addStep("adapter lookup", [](InitScheduler &, int)
 	{
-		Logger::debug(SSTR << "Getting BlueZ ObjectManager");
-		getBluezObjectManager();
-		return;
-	}
+		findAdapter();
+	}, { EInitBus });
 
-	//
-	// Find the adapter interface
-	//
-	if (bluezGattManagerInterfaceName.empty())
+	initScheduler.addStep("adapter config", [](InitScheduler &, int)
 	{
-		Logger::debug(SSTR << "Finding BlueZ GattManager1 interface");
-		findAdapterInterface();
-		return;
+		Logger::debug(SSTR << "Configuring the Bluetooth adapter");
+		configureAdapter();
+	}, {}, true);
+
+	if (bHandoffMode)
+	{
+		initScheduler.addStep("owned name", [](InitScheduler &, int)
+		{
+			Logger::debug(SSTR << "Taking over owned name: '" << THESERVER->getOwnedName() << "'");
+			doOwnedNameAcquire();
+		}, { EInitBus, EInitObjects, EInitAdapterLookup, EInitAdapterConfig });
+	}
+	else
+	{
+		initScheduler.addStep("owned name", [](InitScheduler &, int)
+		{
+			Logger::debug(SSTR << "Acquiring owned name: '" << THESERVER->getOwnedName() << "'");
+			doOwnedNameAcquire();
+		}, { EInitBus });
 	}
 
-	//
-	// Find the adapter interface
-	//
-	if (!bAdapterConfigured)
+	initScheduler.addStep("application", [](InitScheduler &, int)
 	{
-		Logger::debug(SSTR << "Configuring BlueZ adapter '" << bluezGattManagerInterfaceName << "'");
-		configureAdapter();
-		return;
+		Logger::debug(SSTR << "Registering application with BlueZ GATT manager");
+		doRegisterApplication();
+	}, { EInitObjects, EInitAdapterLookup, EInitAdapterConfig, EInitOwnedName });
+
+	if (DispatchShards::getShardCount() > 1)
+	{
+		initScheduler.addStep("shards", [](InitScheduler &, int)
+		{
+			Logger::debug(SSTR << "Starting " << DispatchShards::getShardCount() - 1 << " dispatch shard(s)");
+			doStartShards();
+		}, { EInitObjects, EInitAdapterLookup, EInitAdapterConfig, EInitOwnedName });
 	}
 
-	//
-	// Register our object with D-bus
-	//
-	if (registeredObjectIds.empty())
+	initScheduler.start();
+}
+
+// Launches whatever initialization steps are ready and switches to the running state once they have all succeeded
+//
+// Every step calls this when it finishes, as does our periodic timer when a failed step is due for a retry.
+void initializationStateProcessor()
+{
+	// If we're in our end-of-life, don't process states
+	if (ggkGetServerRunState() > ERunning)
 	{
-		Logger::debug(SSTR << "Registering with D-Bus");
-		registerObjects();
 		return;
 	}
 
-	// Register our appliation with the BlueZ GATT manager
-	if (!bApplicationRegistered)
-	{
-		Logger::debug(SSTR << "Registering application with BlueZ GATT manager");
+	initScheduler.run();
 
-		doRegisterApplication();
+	if (ggkGetServerRunState() != EInitializing || !initScheduler.isComplete())
+	{
 		return;
 	}
 
@@ -1121,6 +1933,9 @@ void initializationStateProcessor()
 		return;
 	}
 
+	Logger::info(SSTR << "Initialized in " << initScheduler.getElapsedMS() << "ms (critical path: " << initScheduler.describeCriticalPath() << ")");
+	ServerStats::recordStartup(initScheduler.getElapsedMS(), initScheduler.describeCriticalPath());
+
 	// Successful initialization - switch to running state
 	setServerRunState(ERunning);
 }
@@ -1143,8 +1958,8 @@ void runServerThread()
 	// Set the initialization state
 	setServerRunState(EInitializing);
 
-	// Start our state processor, which is really just a simplified state machine that steps us through an asynchronous
-	// initialization process.
+	// Start our state processor, which runs the steps of our asynchronous initialization as their dependencies are met (see
+	// `buildInitGraph()`.)
 	//
 	// In case you're wondering if these really need to be async, the answer is yes. For one, it's the right way to do it. But
 	// the more practical response is that the main loop must be running (see below) in order for us to receive and respond to
@@ -1153,36 +1968,25 @@ void runServerThread()
 	// 'RegisterApplication', then we've effectively created a deadlock.
 	//
 	// There are alternatives, but using async methods is the recommended way.
+	buildInitGraph();
 	initializationStateProcessor();
 
 	Logger::debug(SSTR << "Creating GLib main loop");
 	pMainLoop = g_main_loop_new(NULL, FALSE);
 
-	// Add the idle function
-	//
-	// Note that we actually run the idle function from a lambda. This allows us to manage the inter-idle sleep so we don't
-	// soak up 100% of our CPU.
-	guint res = g_idle_add
-	(
-		[](gpointer pUserData) -> gboolean
-		{
-			// Try to process some data and if no data is processed, sleep for the requested frequency
-			if (!idleFunc(pUserData))
-			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(kIdleFrequencyMS));
-			}
-
-			// Always return TRUE so our idle remains in tact
-			return TRUE;
-		},
-		nullptr
-	);
-
-	if (res == 0)
+	// Add the idle function (see `onIdlePoll()`)
+	idlePollSourceId = g_idle_add(onIdlePoll, nullptr);
+	if (idlePollSourceId == 0)
 	{
 		Logger::error(SSTR << "Unable to add idle to main loop");
 	}
 
+	// Follow our connections, so that we can go idle while nobody is connected
+	lastActivityMS = Clock::getInstance().nowMS();
+	modeStartMS = lastActivityMS;
+	modeStartCpuUS = threadCpuUS();
+	HciAdapter::getInstance().registerConnectionCountReceiver(onConnectionCountChanged);
+
 	Logger::trace(SSTR << "Starting GLib main loop");
 	g_main_loop_run(pMainLoop);
 
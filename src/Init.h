@@ -22,8 +22,53 @@
 
 #pragma once
 
+#include <gio/gio.h>
+#include <vector>
+
+#include "DBusObjectPath.h"
+#include "MemoryStats.h"
+
 namespace ggk {
 
+// The IDs of the object interfaces registered on a connection (see `registerNodeHierarchy()`)
+typedef std::vector<guint, TaggedAllocator<guint, EMemoryGLib>> RegisteredObjectIds;
+
+// D-Bus entry points for method calls and property access on our registered objects
+//
+// These are registered with GLib for each of our objects. They are exposed here so that the bench tool can drive the same dispatch
+// path on a private bus.
+void onMethodCall(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName, const gchar *pMethodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData);
+GVariant *onGetProperty(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName, const gchar *pPropertyName, GError **ppError, gpointer pUserData);
+gboolean onSetProperty(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName, const gchar *pPropertyName, GVariant *pValue, GError **ppError, gpointer pUserData);
+
+// Registers each interface of `pNode` and its children at `basePath` on `pConnection` with our D-Bus entry points, adding their
+// IDs to `objectIds` and returning false on failure
+bool registerNodeHierarchy(GDBusConnection *pConnection, GDBusNodeInfo *pNode, const DBusObjectPath &basePath, RegisteredObjectIds &objectIds, int depth = 1);
+
+// Enables or disables idle mode, in which the periodic timer and the idle poll are suspended while nobody is connected
+//
+// See the discussion of idle mode in Init.cpp. This may be called from any thread.
+void setIdleModeEnabled(bool enable);
+
+// Returns true if the server is in idle mode
+bool isIdleMode();
+
+// Notes that updates were added to the update queue, which ends idle mode so they are processed
+//
+// This may be called from any thread, but not while holding the update queue's lock.
+void noteUpdateQueued();
+
+// Sets handoff mode, in which the server takes over from a running instance of itself (see the discussion of hot restarts in
+// Init.cpp)
+//
+// This must be called before the server is started.
+void setHandoffMode(bool enable);
+
+// Allows a new instance in handoff mode to take over our owned name (see the discussion of hot restarts in Init.cpp)
+//
+// This must be called before the server is started.
+void setAllowTakeover(bool enable);
+
 // Trigger a graceful, asynchronous shutdown of the server
 //
 // This method is non-blocking and as such, will only trigger the shutdown process but not wait for it
@@ -0,0 +1,277 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A dependency-graph scheduler for the server's initialization steps
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Initializing the server is a handful of steps, most of them waiting on somebody else: the bus, the bus daemon (for our owned
+// name), BlueZ (for the adapter and for registering our application) and the kernel (for configuring the adapter.) Run one after
+// another, the time to get running is the sum of all of those waits. Many of the steps don't actually depend on one another, so
+// the scheduler runs each step as soon as the steps it depends on have succeeded, with the rest running alongside it.
+//
+// Each step is launched through a function that starts the work and later reports the outcome with `succeed()` or `fail()`
+// (usually from an asynchronous callback.) All of this happens on a single thread (the server's main loop), so steps run
+// concurrently only in the sense that their asynchronous calls are outstanding at the same time. A step that blocks (such as
+// configuring the adapter through the management socket) is launched after the other steps that become ready with it, so that
+// their calls are in flight while it blocks.
+//
+// A failed step is retried on its own after a delay, without disturbing steps that are running or have succeeded. The owner
+// calls `tick()` periodically to bring due retries back and `run()` to launch them.
+//
+// When every step has succeeded, the critical path (the chain of steps that determined when the last one finished) shows where
+// the time to get running went. Each step on the path is charged the time from the end of the step before it until its own end,
+// which includes any retries.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+
+#include "InitScheduler.h"
+#include "Clock.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// Creates an empty scheduler that retries failed steps after `delayMS` milliseconds
+InitScheduler::InitScheduler(int delayMS)
+: retryDelayMS(delayMS), startMS(0), running(false), runAgain(false)
+{
+}
+
+// Removes all steps
+void InitScheduler::clear()
+{
+	steps.clear();
+}
+
+// Adds a step that is launched once all of its `dependencies` have succeeded, returning its index
+//
+// Dependencies are the indices returned for the other steps. A `blocking` step does its work before returning from `launch`;
+// these are launched after the other steps that are ready at the same time, so that those are already in flight.
+int InitScheduler::addStep(const char *pName, Launch launch, std::initializer_list<int> dependencies, bool blocking)
+{
+	Step step;
+	step.name = pName;
+	step.launch = launch;
+	step.dependencies = dependencies;
+	step.blocking = blocking;
+	step.state = EPending;
+	step.attempts = 0;
+	step.startMS = 0;
+	step.endMS = 0;
+	step.retryAtMS = 0;
+
+	steps.push_back(step);
+	return static_cast<int>(steps.size()) - 1;
+}
+
+// Resets every step and starts timing
+void InitScheduler::start()
+{
+	for (Step &step : steps)
+	{
+		step.state = EPending;
+		step.attempts = 0;
+		step.startMS = 0;
+		step.endMS = 0;
+		step.retryAtMS = 0;
+	}
+
+	startMS = Clock::getInstance().nowMS();
+}
+
+// Returns true if `step` is waiting to be launched and everything it depends on has succeeded
+bool InitScheduler::isReady(const Step &step) const
+{
+	if (step.state != EPending)
+	{
+		return false;
+	}
+
+	for (int dependency : step.dependencies)
+	{
+		if (steps[dependency].state != ESucceeded)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Launches every step that is ready
+//
+// This may be called from within a step (directly or from a completion); the nested call is folded into the outer one.
+void InitScheduler::run()
+{
+	if (running)
+	{
+		runAgain = true;
+		return;
+	}
+
+	running = true;
+	do
+	{
+		runAgain = false;
+
+		// Launch the asynchronous steps first, then the blocking ones
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (size_t i = 0; i < steps.size(); ++i)
+			{
+				Step &step = steps[i];
+				if (step.blocking != (pass == 1) || !isReady(step))
+				{
+					continue;
+				}
+
+				step.state = ERunning;
+				step.attempts += 1;
+				if (0 == step.startMS)
+				{
+					step.startMS = Clock::getInstance().nowMS();
+				}
+
+				step.launch(*this, static_cast<int>(i));
+			}
+		}
+	} while (runAgain);
+	running = false;
+}
+
+// Records the success of a running step
+void InitScheduler::succeed(int step)
+{
+	Step &entry = steps[step];
+	entry.state = ESucceeded;
+	entry.endMS = Clock::getInstance().nowMS();
+
+	Logger::debug(SSTR << "Initialization step '" << entry.name << "' done after " << entry.endMS - entry.startMS << "ms"
+		<< (entry.attempts > 1 ? " (" + std::to_string(entry.attempts) + " attempts)" : ""));
+}
+
+// Records the failure of a step, which is retried on its own after the retry delay
+void InitScheduler::fail(int step)
+{
+	Step &entry = steps[step];
+	entry.state = EFailed;
+	entry.retryAtMS = Clock::getInstance().nowMS() + retryDelayMS;
+
+	Logger::warn(SSTR << "  + Will retry '" << entry.name << "' in about " << retryDelayMS / 1000.0 << " seconds");
+}
+
+// Returns any failed steps that are due for a retry to the ready state, returning true if there are any (call `run()` next)
+bool InitScheduler::tick()
+{
+	int64_t nowMS = Clock::getInstance().nowMS();
+	bool due = false;
+
+	for (Step &step : steps)
+	{
+		if (step.state == EFailed && nowMS >= step.retryAtMS)
+		{
+			Logger::debug(SSTR << "Retrying initialization step '" << step.name << "'");
+			step.state = EPending;
+			due = true;
+		}
+	}
+
+	return due;
+}
+
+// Returns true if a failed step is waiting for its retry
+bool InitScheduler::isRetryPending() const
+{
+	return std::any_of(steps.begin(), steps.end(), [](const Step &step) { return step.state == EFailed; });
+}
+
+// Returns true if every step has succeeded
+bool InitScheduler::isComplete() const
+{
+	return std::all_of(steps.begin(), steps.end(), [](const Step &step) { return step.state == ESucceeded; });
+}
+
+// Returns the time from `start()` until the last step succeeded (or until now, if some are still outstanding)
+int64_t InitScheduler::getElapsedMS() const
+{
+	if (!isComplete())
+	{
+		return Clock::getInstance().nowMS() - startMS;
+	}
+
+	int64_t endMS = startMS;
+	for (const Step &step : steps)
+	{
+		endMS = std::max(endMS, step.endMS);
+	}
+
+	return endMS - startMS;
+}
+
+// Returns the critical path: the chain of steps, each waiting on the one before, that determined when the last step finished
+std::vector<int> InitScheduler::getCriticalPath() const
+{
+	std::vector<int> path;
+	if (steps.empty() || !isComplete())
+	{
+		return path;
+	}
+
+	// Start from the step that finished last and follow whichever of its dependencies finished last
+	int current = 0;
+	for (size_t i = 1; i < steps.size(); ++i)
+	{
+		current = steps[i].endMS >= steps[current].endMS ? static_cast<int>(i) : current;
+	}
+
+	while (current >= 0)
+	{
+		path.push_back(current);
+
+		int latest = -1;
+		for (int dependency : steps[current].dependencies)
+		{
+			latest = latest < 0 || steps[dependency].endMS > steps[latest].endMS ? dependency : latest;
+		}
+		current = latest;
+	}
+
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+// Returns a description of the critical path, with each step's share of the elapsed time
+std::string InitScheduler::describeCriticalPath() const
+{
+	std::string description;
+	int64_t previousEndMS = startMS;
+
+	for (int index : getCriticalPath())
+	{
+		const Step &step = steps[index];
+		description += (description.empty() ? "" : " -> ") + step.name + " " + std::to_string(step.endMS - previousEndMS) + "ms";
+		if (step.attempts > 1)
+		{
+			description += " (" + std::to_string(step.attempts) + " attempts)";
+		}
+
+		previousEndMS = step.endMS;
+	}
+
+	return description;
+}
+
+}; // namespace ggk
@@ -0,0 +1,119 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A dependency-graph scheduler for the server's initialization steps
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of InitScheduler.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+namespace ggk {
+
+class InitScheduler
+{
+public:
+
+	// Launches a step (`step` is the index returned from `addStep()`)
+	//
+	// The step reports its outcome with `succeed()` or `fail()`, either before returning or later, from an asynchronous callback.
+	typedef void (*Launch)(InitScheduler &scheduler, int step);
+
+	// Creates an empty scheduler that retries failed steps after `delayMS` milliseconds
+	InitScheduler(int delayMS);
+
+	// Removes all steps
+	void clear();
+
+	// Adds a step that is launched once all of its `dependencies` have succeeded, returning its index
+	//
+	// Dependencies are the indices returned for the other steps. A `blocking` step does its work before returning from
+	// `launch`; these are launched after the other steps that are ready at the same time, so that those are already in flight.
+	int addStep(const char *pName, Launch launch, std::initializer_list<int> dependencies, bool blocking = false);
+
+	// Resets every step and starts timing
+	void start();
+
+	// Launches every step that is ready
+	//
+	// This may be called from within a step (directly or from a completion); the nested call is folded into the outer one.
+	void run();
+
+	// Records the outcome of a running step
+	//
+	// A step that already succeeded may also fail (for example, if a resource it acquired is lost), in which case it is retried
+	// on its own. Steps that depend on it are left as they are.
+	void succeed(int step);
+	void fail(int step);
+
+	// Returns any failed steps that are due for a retry to the ready state, returning true if there are any (call `run()` next)
+	bool tick();
+
+	// Returns true if a failed step is waiting for its retry
+	bool isRetryPending() const;
+
+	// Returns true if every step has succeeded
+	bool isComplete() const;
+
+	// Returns the time from `start()` until the last step succeeded (or until now, if some are still outstanding)
+	int64_t getElapsedMS() const;
+
+	// Returns the critical path: the chain of steps, each waiting on the one before, that determined when the last step finished
+	std::vector<int> getCriticalPath() const;
+
+	// Returns a description of the critical path, with each step's share of the elapsed time
+	std::string describeCriticalPath() const;
+
+private:
+
+	enum State
+	{
+		EPending,
+		ERunning,
+		EFailed,
+		ESucceeded
+	};
+
+	struct Step
+	{
+		std::string name;
+		Launch launch;
+		std::vector<int> dependencies;
+		bool blocking;
+		State state;
+		int attempts;
+		int64_t startMS;
+		int64_t endMS;
+		int64_t retryAtMS;
+	};
+
+	bool isReady(const Step &step) const;
+
+	std::vector<Step> steps;
+	int retryDelayMS;
+	int64_t startMS;
+	bool running;
+	bool runAgain;
+};
+
+}; // namespace ggk
@@ -0,0 +1,166 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Memory accounting by subsystem, and the tagged allocator our containers use to feed it
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// On small devices, it's important to know where the library's memory goes and whether any of it grows over the life of a
+// long-running server. To that end, the library's own long-lived containers use a `TaggedAllocator`, which accounts each
+// allocation (bytes and counts, live and peak) to a subsystem:
+//
+//     Schema        the object tree (`DBusObject` children and interfaces, `DBusInterface` methods and events, `GattProperty` lists)
+//     Update queue  the queue of pending notifications, including the queued object paths and interface names
+//     Cache         values cached on behalf of the application (the batched data getter's results)
+//     Logging       the traffic capture's string table (log messages themselves are transient)
+//     HCI           the HCI event buffer and the list of connected devices
+//     GLib          our registered D-Bus objects; GLib's own allocations can't be measured, so the size of the introspection data
+//                   it was given stands in for the interface info it keeps
+//
+// The accounting covers the containers' storage, not the heap storage of strings held within them (most of our names fit
+// within std::string's inline buffer.) It's meant for setting budgets and spotting growth rather than as an exact audit.
+//
+// A budget can be set for each subsystem (see `ggkSetMemoryBudget()`.) Exceeding a budget raises a warning on the next periodic
+// timer.
+//
+// The counters are plain atomics with constant initialization, so containers constructed during static initialization (such
+// as the update queue) are accounted correctly.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <atomic>
+
+#include "MemoryStats.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Counters
+//
+
+static std::atomic<size_t> currentBytes[EMemorySubsystemCount];
+static std::atomic<size_t> peakBytes[EMemorySubsystemCount];
+static std::atomic<size_t> currentAllocations[EMemorySubsystemCount];
+static std::atomic<size_t> totalAllocations[EMemorySubsystemCount];
+static std::atomic<size_t> budgets[EMemorySubsystemCount];
+static std::atomic<bool> overBudget[EMemorySubsystemCount];
+
+// Raises the peak for `subsystem` to `bytes` (if higher) and flags the subsystem if it has exceeded its budget
+static void updatePeak(GGKMemorySubsystem subsystem, size_t bytes)
+{
+	size_t peak = peakBytes[subsystem].load(std::memory_order_relaxed);
+	while (bytes > peak && !peakBytes[subsystem].compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+	{
+	}
+
+	size_t budget = budgets[subsystem].load(std::memory_order_relaxed);
+	if (0 != budget && bytes > budget)
+	{
+		overBudget[subsystem].store(true, std::memory_order_relaxed);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Accounting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Records an allocation of `bytes` bytes by `subsystem`
+void MemoryStats::allocated(GGKMemorySubsystem subsystem, size_t bytes)
+{
+	size_t total = currentBytes[subsystem].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	currentAllocations[subsystem].fetch_add(1, std::memory_order_relaxed);
+	totalAllocations[subsystem].fetch_add(1, std::memory_order_relaxed);
+	updatePeak(subsystem, total);
+}
+
+// Records the release of an allocation of `bytes` bytes by `subsystem`
+void MemoryStats::released(GGKMemorySubsystem subsystem, size_t bytes)
+{
+	currentBytes[subsystem].fetch_sub(bytes, std::memory_order_relaxed);
+	currentAllocations[subsystem].fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Adjusts the bytes held by `subsystem` without counting an allocation (for memory that we can only estimate)
+void MemoryStats::adjust(GGKMemorySubsystem subsystem, ptrdiff_t bytes)
+{
+	size_t total = currentBytes[subsystem].fetch_add(static_cast<size_t>(bytes), std::memory_order_relaxed) + static_cast<size_t>(bytes);
+	if (bytes > 0)
+	{
+		updatePeak(subsystem, total);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the current statistics for `subsystem`
+GGKMemoryStats MemoryStats::get(GGKMemorySubsystem subsystem)
+{
+	GGKMemoryStats stats;
+	stats.bytes = currentBytes[subsystem].load(std::memory_order_relaxed);
+	stats.peakBytes = peakBytes[subsystem].load(std::memory_order_relaxed);
+	stats.allocations = currentAllocations[subsystem].load(std::memory_order_relaxed);
+	stats.totalAllocations = totalAllocations[subsystem].load(std::memory_order_relaxed);
+	stats.budget = budgets[subsystem].load(std::memory_order_relaxed);
+	return stats;
+}
+
+// Returns a human-readable name for `subsystem`
+const char *MemoryStats::getSubsystemName(GGKMemorySubsystem subsystem)
+{
+	switch(subsystem)
+	{
+		case EMemorySchema: return "Schema";
+		case EMemoryUpdateQueue: return "Update queue";
+		case EMemoryCache: return "Cache";
+		case EMemoryLogging: return "Logging";
+		case EMemoryHci: return "HCI";
+		case EMemoryGLib: return "GLib";
+		default: return "Unknown";
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Budgets
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sets the budget (in bytes) for `subsystem`, or removes it if `bytes` is zero
+void MemoryStats::setBudget(GGKMemorySubsystem subsystem, size_t bytes)
+{
+	budgets[subsystem].store(bytes, std::memory_order_relaxed);
+	overBudget[subsystem].store(false, std::memory_order_relaxed);
+	updatePeak(subsystem, currentBytes[subsystem].load(std::memory_order_relaxed));
+}
+
+// Logs a warning for each subsystem that has exceeded its budget since the last check
+//
+// The allocator only flags a subsystem as over budget (it can't safely log from inside an allocation), so this is called from
+// the server's periodic timer.
+void MemoryStats::checkBudgets()
+{
+	for (int i = 0; i < EMemorySubsystemCount; ++i)
+	{
+		GGKMemorySubsystem subsystem = static_cast<GGKMemorySubsystem>(i);
+		if (overBudget[i].exchange(false, std::memory_order_relaxed))
+		{
+			GGKMemoryStats stats = get(subsystem);
+			Logger::warn(SSTR << "Memory budget exceeded for " << getSubsystemName(subsystem) << ": " << stats.bytes
+				<< " bytes in use (peak " << stats.peakBytes << ") against a budget of " << stats.budget << " bytes");
+		}
+	}
+}
+
+}; // namespace ggk
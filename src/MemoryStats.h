@@ -0,0 +1,123 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Memory accounting by subsystem, and the tagged allocator our containers use to feed it
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of MemoryStats.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <list>
+#include <string>
+
+#include "../include/Gobbledegook.h"
+#include "Pool.h"
+
+namespace ggk {
+
+class MemoryStats
+{
+public:
+
+	//
+	// Accounting (may be called from any thread)
+	//
+
+	// Records an allocation of `bytes` bytes by `subsystem`
+	static void allocated(GGKMemorySubsystem subsystem, size_t bytes);
+
+	// Records the release of an allocation of `bytes` bytes by `subsystem`
+	static void released(GGKMemorySubsystem subsystem, size_t bytes);
+
+	// Adjusts the bytes held by `subsystem` without counting an allocation (for memory that we can only estimate)
+	static void adjust(GGKMemorySubsystem subsystem, ptrdiff_t bytes);
+
+	//
+	// Reporting
+	//
+
+	// Returns the current statistics for `subsystem`
+	static GGKMemoryStats get(GGKMemorySubsystem subsystem);
+
+	// Returns a human-readable name for `subsystem`
+	static const char *getSubsystemName(GGKMemorySubsystem subsystem);
+
+	//
+	// Budgets
+	//
+
+	// Sets the budget (in bytes) for `subsystem`, or removes it if `bytes` is zero
+	static void setBudget(GGKMemorySubsystem subsystem, size_t bytes);
+
+	// Logs a warning for each subsystem that has exceeded its budget since the last check
+	//
+	// The allocator only flags a subsystem as over budget (it can't safely log from inside an allocation), so this is called from
+	// the server's periodic timer.
+	static void checkBudgets();
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// A standard allocator that accounts its allocations to a subsystem (drawing its memory from the transient pool)
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+template<typename T, GGKMemorySubsystem S>
+struct TaggedAllocator
+{
+	typedef T value_type;
+
+	// The subsystem is a non-type parameter, so std::allocator_traits needs to be told how to rebind us
+	template<typename U>
+	struct rebind { typedef TaggedAllocator<U, S> other; };
+
+	TaggedAllocator() noexcept {}
+
+	template<typename U>
+	TaggedAllocator(const TaggedAllocator<U, S> &) noexcept {}
+
+	T *allocate(size_t count)
+	{
+		size_t bytes = count * sizeof(T);
+		T *p = static_cast<T *>(Pool::allocate(bytes));
+		MemoryStats::allocated(S, bytes);
+		return p;
+	}
+
+	void deallocate(T *p, size_t count) noexcept
+	{
+		Pool::deallocate(p, count * sizeof(T));
+		MemoryStats::released(S, count * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==(const TaggedAllocator<U, S> &) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const TaggedAllocator<U, S> &) const noexcept { return false; }
+};
+
+// Convenience types for tagged containers
+template<typename T, GGKMemorySubsystem S>
+using TaggedList = std::list<T, TaggedAllocator<T, S>>;
+
+template<GGKMemorySubsystem S>
+using TaggedString = std::basic_string<char, std::char_traits<char>, TaggedAllocator<char, S>>;
+
+}; // namespace ggk
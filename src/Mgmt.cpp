@@ -24,6 +24,7 @@
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <string.h>
+#include <algorithm>
 
 #include "Mgmt.h"
 #include "Logger.h"
@@ -193,6 +194,308 @@ bool Mgmt::setAdvertising(uint8_t newState)
 	return setState(Mgmt::ESetAdvertisingCommand, controllerIndex, newState);
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Advertising instances
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Adds (or replaces) the advertising instance `instance` (1-based) with the given `flags` (see `AdvertisingFlags`.)
+//
+// `duration` is the number of seconds this instance is advertised before the controller moves on to the next instance, and
+// `timeout` is the number of seconds after which the instance is removed (0 for both means "use the defaults".)
+//
+// Instances are only advertised while the advertising setting (see `setAdvertising()`) is disabled.
+//
+// Returns true on success, otherwise false
+bool Mgmt::addAdvertising(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData)
+{
+	if (advertisingData.size() > kMaxAdvertisingDataLength || scanResponseData.size() > kMaxAdvertisingDataLength)
+	{
+		Logger::warn(SSTR << "  + Advertising data too long for instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint8_t instance;
+		uint32_t flags;
+		uint16_t duration;
+		uint16_t timeout;
+		uint8_t advertisingDataLength;
+		uint8_t scanResponseLength;
+		uint8_t data[kMaxAdvertisingDataLength * 2];
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::EAddAdvertisingCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader) - sizeof(request.data) + advertisingData.size() + scanResponseData.size();
+	request.instance = instance;
+	request.flags = Utils::endianToHci(flags);
+	request.duration = Utils::endianToHci(duration);
+	request.timeout = Utils::endianToHci(timeout);
+	request.advertisingDataLength = advertisingData.size();
+	request.scanResponseLength = scanResponseData.size();
+	std::copy(advertisingData.begin(), advertisingData.end(), request.data);
+	std::copy(scanResponseData.begin(), scanResponseData.end(), request.data + advertisingData.size());
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to add advertising instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	return true;
+}
+
+// Adds (or replaces) the parameters for advertising instance `instance` (1-based), including its advertising intervals
+//
+// `minInterval` and `maxInterval` are in units of 0.625ms. Only the parameters flagged in `flags` (see `EAdvertisingParam*` in
+// `AdvertisingFlags`) are used; the rest are left to the controller's defaults.
+//
+// The instance is not advertised until its data is provided with `addExtendedAdvertisingData()`.
+//
+// This command requires a newer kernel; older kernels respond with "Unknown Command" and this method returns false.
+//
+// Returns true on success, otherwise false
+bool Mgmt::addExtendedAdvertisingParameters(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, uint32_t minInterval, uint32_t maxInterval, int8_t txPower)
+{
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint8_t instance;
+		uint32_t flags;
+		uint16_t duration;
+		uint16_t timeout;
+		uint32_t minInterval;
+		uint32_t maxInterval;
+		int8_t txPower;
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::EAddExtendedAdvertisingParametersCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	request.instance = instance;
+	request.flags = Utils::endianToHci(flags);
+	request.duration = Utils::endianToHci(duration);
+	request.timeout = Utils::endianToHci(timeout);
+	request.minInterval = Utils::endianToHci(minInterval);
+	request.maxInterval = Utils::endianToHci(maxInterval);
+	request.txPower = txPower;
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to add extended advertising parameters for instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	return true;
+}
+
+// Provides the advertising and scan response data for an instance previously added with `addExtendedAdvertisingParameters()`
+//
+// Returns true on success, otherwise false
+bool Mgmt::addExtendedAdvertisingData(uint8_t instance, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData)
+{
+	if (advertisingData.size() > kMaxAdvertisingDataLength || scanResponseData.size() > kMaxAdvertisingDataLength)
+	{
+		Logger::warn(SSTR << "  + Advertising data too long for instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint8_t instance;
+		uint8_t advertisingDataLength;
+		uint8_t scanResponseLength;
+		uint8_t data[kMaxAdvertisingDataLength * 2];
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::EAddExtendedAdvertisingDataCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader) - sizeof(request.data) + advertisingData.size() + scanResponseData.size();
+	request.instance = instance;
+	request.advertisingDataLength = advertisingData.size();
+	request.scanResponseLength = scanResponseData.size();
+	std::copy(advertisingData.begin(), advertisingData.end(), request.data);
+	std::copy(scanResponseData.begin(), scanResponseData.end(), request.data + advertisingData.size());
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to add extended advertising data for instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	return true;
+}
+
+// Removes advertising instance `instance` (or all instances if `instance` is 0)
+//
+// Returns true on success, otherwise false
+bool Mgmt::removeAdvertising(uint8_t instance)
+{
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint8_t instance;
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::ERemoveAdvertisingCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	request.instance = instance;
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to remove advertising instance " << static_cast<int>(instance));
+		return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Connection parameters and PHY
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Loads the preferred connection parameters for the remote devices in `parameters`
+//
+// The kernel uses these parameters for connections to those devices, including when it responds to connection parameter
+// update requests. At most `kMaxConnectionParameters` entries are sent.
+//
+// Returns true on success, otherwise false
+bool Mgmt::loadConnectionParameters(const std::vector<ConnectionParameters> &parameters)
+{
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint16_t parameterCount;
+		ConnectionParameters parameters[kMaxConnectionParameters];
+	} __attribute__((packed));
+
+	size_t count = std::min(parameters.size(), static_cast<size_t>(kMaxConnectionParameters));
+
+	SRequest request;
+	request.code = Mgmt::ELoadConnectionParametersCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(request.parameterCount) + count * sizeof(ConnectionParameters);
+	request.parameterCount = Utils::endianToHci(static_cast<uint16_t>(count));
+	for (size_t i = 0; i < count; ++i)
+	{
+		ConnectionParameters &entry = request.parameters[i];
+		entry = parameters[i];
+		entry.minInterval = Utils::endianToHci(entry.minInterval);
+		entry.maxInterval = Utils::endianToHci(entry.maxInterval);
+		entry.latency = Utils::endianToHci(entry.latency);
+		entry.supervisionTimeout = Utils::endianToHci(entry.supervisionTimeout);
+	}
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to load connection parameters for " << count << " device(s)");
+		return false;
+	}
+
+	return true;
+}
+
+// Sets the default LE connection parameters (intervals in units of 1.25ms, supervision timeout in units of 10ms)
+//
+// These are used for devices without parameters of their own (see `loadConnectionParameters()`.) This uses the "Set Default
+// System Configuration" command, which requires a newer kernel.
+//
+// Returns true on success, otherwise false
+bool Mgmt::setDefaultConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t supervisionTimeout)
+{
+	// Each parameter is sent as a type/length/value entry
+	struct SParameter
+	{
+		uint16_t type;
+		uint8_t length;
+		uint16_t value;
+	} __attribute__((packed));
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		SParameter parameters[4];
+	} __attribute__((packed));
+
+	// Parameter types for the "Set Default System Configuration" command
+	static const uint16_t kLEMinConnectionInterval = 0x0017;
+	static const uint16_t kLEMaxConnectionInterval = 0x0018;
+	static const uint16_t kLEConnectionLatency = 0x0019;
+	static const uint16_t kLEConnectionSupervisionTimeout = 0x001a;
+
+	const uint16_t types[4] = { kLEMinConnectionInterval, kLEMaxConnectionInterval, kLEConnectionLatency, kLEConnectionSupervisionTimeout };
+	const uint16_t values[4] = { minInterval, maxInterval, latency, supervisionTimeout };
+
+	SRequest request;
+	request.code = Mgmt::ESetDefaultSystemConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	for (int i = 0; i < 4; ++i)
+	{
+		request.parameters[i].type = Utils::endianToHci(types[i]);
+		request.parameters[i].length = sizeof(uint16_t);
+		request.parameters[i].value = Utils::endianToHci(values[i]);
+	}
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to set default connection parameters");
+		return false;
+	}
+
+	return true;
+}
+
+// Requests the controller's PHY configuration
+//
+// The result is available from `HciAdapter::getPhyConfiguration()` once this returns.
+//
+// Returns true on success, otherwise false
+bool Mgmt::getPhyConfiguration()
+{
+	HciAdapter::HciHeader request;
+	request.code = Mgmt::EGetPHYConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = 0;
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to get PHY configuration");
+		return false;
+	}
+
+	return true;
+}
+
+// Sets the selected PHYs (see `PhyFlags`)
+//
+// `selectedPhys` must include all of the PHYs that are supported but not configurable (see `HciAdapter::PhyConfiguration`.)
+//
+// Returns true on success, otherwise false
+bool Mgmt::setPhyConfiguration(uint32_t selectedPhys)
+{
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint32_t selectedPhys;
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::ESetPHYConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	request.selectedPhys = Utils::endianToHci(selectedPhys);
+
+	if (!HciAdapter::getInstance().sendCommand(request) || HciAdapter::getInstance().getLastCommandStatus() != 0)
+	{
+		Logger::warn(SSTR << "  + Failed to set PHY configuration to " << Utils::hex(selectedPhys));
+		return false;
+	}
+
+	return true;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Utilitarian
 // ---------------------------------------------------------------------------------------------------------------------------------
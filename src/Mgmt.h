@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "HciAdapter.h"
 #include "Utils.h"
@@ -162,15 +163,86 @@ struct Mgmt
 		EGetAdvertisingSizeInformationCommand                 = 0x0040,
 		EStartLimitedDiscoveryCommand                         = 0x0041,
 		EReadExtendedControllerInformationCommand             = 0x0042,
-		ESetAppearanceCommand                                 = 0x0043
+		ESetAppearanceCommand                                 = 0x0043,
+		EGetPHYConfigurationCommand                           = 0x0044,
+		ESetPHYConfigurationCommand                           = 0x0045,
+		ELoadBlockedKeysCommand                               = 0x0046,
+		ESetWidebandSpeechCommand                             = 0x0047,
+		EReadControllerCapabilitiesCommand                    = 0x0048,
+		EReadExperimentalFeaturesInformationCommand           = 0x0049,
+		ESetExperimentalFeatureCommand                        = 0x004a,
+		EReadDefaultSystemConfigurationCommand                = 0x004b,
+		ESetDefaultSystemConfigurationCommand                 = 0x004c,
+		EReadDefaultRuntimeConfigurationCommand               = 0x004d,
+		ESetDefaultRuntimeConfigurationCommand                = 0x004e,
+		EGetDeviceFlagsCommand                                = 0x004f,
+		ESetDeviceFlagsCommand                                = 0x0050,
+		EReadAdvertisementMonitorFeaturesCommand              = 0x0051,
+		EAddAdvertisementPatternsMonitorCommand               = 0x0052,
+		ERemoveAdvertisementMonitorCommand                    = 0x0053,
+		EAddExtendedAdvertisingParametersCommand              = 0x0054,
+		EAddExtendedAdvertisingDataCommand                    = 0x0055
 	};
 
+	// Flags used by `addAdvertising()` and `addExtendedAdvertisingParameters()`
+	//
+	// See the "Add Advertising Command" in https://git.kernel.org/pub/scm/bluetooth/bluez.git/tree/doc/mgmt-api.txt
+	enum AdvertisingFlags
+	{
+		EAdvertisingConnectable                               = (1<<0),
+		EAdvertisingDiscoverable                              = (1<<1),
+		EAdvertisingLimitedDiscoverable                       = (1<<2),
+		EAdvertisingManagedFlags                              = (1<<3),
+		EAdvertisingTxPower                                   = (1<<4),
+		EAdvertisingAppearance                                = (1<<5),
+		EAdvertisingLocalName                                 = (1<<6),
+
+		// The following are only used by `addExtendedAdvertisingParameters()` to flag which optional parameters are present
+		EAdvertisingParamDuration                             = (1<<12),
+		EAdvertisingParamTimeout                              = (1<<13),
+		EAdvertisingParamIntervals                            = (1<<14),
+		EAdvertisingParamTxPower                              = (1<<15)
+	};
+
+	// The maximum length of legacy advertising data (and scan response data)
+	static const int kMaxAdvertisingDataLength = 31;
+
+	// PHY bits used by `setPhyConfiguration()` (see `HciAdapter::PhyConfiguration`)
+	enum PhyFlags
+	{
+		EPhyLE1MTx                                            = (1<<9),
+		EPhyLE1MRx                                            = (1<<10),
+		EPhyLE2MTx                                            = (1<<11),
+		EPhyLE2MRx                                            = (1<<12),
+		EPhyLECodedTx                                         = (1<<13),
+		EPhyLECodedRx                                         = (1<<14)
+	};
+
+	// The maximum number of entries accepted by `loadConnectionParameters()`
+	static const int kMaxConnectionParameters = 16;
+
+	// Connection parameters for a single remote device, as used by `loadConnectionParameters()`
+	//
+	// Intervals are in units of 1.25ms and the supervision timeout is in units of 10ms.
+	struct ConnectionParameters
+	{
+		uint8_t address[6];
+		uint8_t addressType;
+		uint16_t minInterval;
+		uint16_t maxInterval;
+		uint16_t latency;
+		uint16_t supervisionTimeout;
+	} __attribute__((packed));
+
 	// Construct the Mgmt device
 	//
 	// Set `controllerIndex` to the zero-based index of the device as recognized by the OS. If this parameter is omitted, the index
 	// of the first device (0) will be used.
 	Mgmt(uint16_t controllerIndex = kDefaultControllerIndex);
 
+	// Returns the zero-based index of the device we manage
+	uint16_t getControllerIndex() const { return controllerIndex; }
+
 	// Set the adapter name and short name
 	//
 	// The inputs `name` and `shortName` may be truncated prior to setting them on the adapter. To ensure that `name` and
@@ -230,6 +302,68 @@ struct Mgmt
 	// Returns true on success, otherwise false
 	bool setAdvertising(uint8_t newState);
 
+	// Adds (or replaces) the advertising instance `instance` (1-based) with the given `flags` (see `AdvertisingFlags`.)
+	//
+	// `duration` is the number of seconds this instance is advertised before the controller moves on to the next instance, and
+	// `timeout` is the number of seconds after which the instance is removed (0 for both means "use the defaults".)
+	//
+	// Instances are only advertised while the advertising setting (see `setAdvertising()`) is disabled.
+	//
+	// Returns true on success, otherwise false
+	bool addAdvertising(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData);
+
+	// Adds (or replaces) the parameters for advertising instance `instance` (1-based), including its advertising intervals
+	//
+	// `minInterval` and `maxInterval` are in units of 0.625ms. Only the parameters flagged in `flags` (see `EAdvertisingParam*` in
+	// `AdvertisingFlags`) are used; the rest are left to the controller's defaults.
+	//
+	// The instance is not advertised until its data is provided with `addExtendedAdvertisingData()`.
+	//
+	// This command requires a newer kernel; older kernels respond with "Unknown Command" and this method returns false.
+	//
+	// Returns true on success, otherwise false
+	bool addExtendedAdvertisingParameters(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, uint32_t minInterval, uint32_t maxInterval, int8_t txPower);
+
+	// Provides the advertising and scan response data for an instance previously added with `addExtendedAdvertisingParameters()`
+	//
+	// Returns true on success, otherwise false
+	bool addExtendedAdvertisingData(uint8_t instance, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData);
+
+	// Removes advertising instance `instance` (or all instances if `instance` is 0)
+	//
+	// Returns true on success, otherwise false
+	bool removeAdvertising(uint8_t instance);
+
+	// Loads the preferred connection parameters for the remote devices in `parameters`
+	//
+	// The kernel uses these parameters for connections to those devices, including when it responds to connection parameter
+	// update requests. At most `kMaxConnectionParameters` entries are sent.
+	//
+	// Returns true on success, otherwise false
+	bool loadConnectionParameters(const std::vector<ConnectionParameters> &parameters);
+
+	// Sets the default LE connection parameters (intervals in units of 1.25ms, supervision timeout in units of 10ms)
+	//
+	// These are used for devices without parameters of their own (see `loadConnectionParameters()`.) This uses the "Set Default
+	// System Configuration" command, which requires a newer kernel.
+	//
+	// Returns true on success, otherwise false
+	bool setDefaultConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t supervisionTimeout);
+
+	// Requests the controller's PHY configuration
+	//
+	// The result is available from `HciAdapter::getPhyConfiguration()` once this returns.
+	//
+	// Returns true on success, otherwise false
+	bool getPhyConfiguration();
+
+	// Sets the selected PHYs (see `PhyFlags`)
+	//
+	// `selectedPhys` must include all of the PHYs that are supported but not configurable (see `HciAdapter::PhyConfiguration`.)
+	//
+	// Returns true on success, otherwise false
+	bool setPhyConfiguration(uint32_t selectedPhys);
+
 	//
 	// Utilitarian
 	//
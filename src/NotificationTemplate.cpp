@@ -0,0 +1,103 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A prebuilt PropertiesChanged signal for sending a characteristic's change notifications
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Every change notification is the same signal with a different value:
+//
+//     path       the characteristic's object path
+//     interface  org.freedesktop.DBus.Properties
+//     member     PropertiesChanged
+//     body       (sa{sv}) = ("org.bluez.GattCharacteristic1", {"Value": <value>})
+//
+// The generic path (`DBusObject::emitSignal()`) rebuilds all of this for each notification: the object path is reassembled from
+// the tree, the header fields are validated and copied from strings, and the body is built by parsing format strings through a
+// `GVariantBuilder`. For a characteristic streaming at a high rate, this is most of the cost of a notification.
+//
+// A NotificationTemplate builds the constant parts once. The header lives in a signal message that is never sent; each
+// notification copies it, which shares the header values by reference rather than rebuilding them. The body's prefix (the
+// interface name and the "Value" key) is kept as ready-made values, so that the body is assembled directly from its parts with
+// only the new value added.
+//
+// GDBus serializes each message as it is sent and has no way to send a preserialized message, so the header and body are
+// serialized once per notification; we save everything up to that point. The message is handed to
+// `g_dbus_connection_send_message()`, which queues it on the connection's worker thread just as `g_dbus_connection_emit_signal()`
+// would.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "NotificationTemplate.h"
+#include "Capture.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+static const char *kPropertiesInterface = "org.freedesktop.DBus.Properties";
+static const char *kPropertiesChangedSignal = "PropertiesChanged";
+
+// Builds the template for notifications from the object at `objectPath` carrying the properties of `interfaceName`
+NotificationTemplate::NotificationTemplate(const std::string &objectPath, const std::string &interfaceName)
+: path(objectPath)
+{
+	pMessage = g_dbus_message_new_signal(path.c_str(), kPropertiesInterface, kPropertiesChangedSignal);
+	pInterfaceName = g_variant_ref_sink(g_variant_new_string(interfaceName.c_str()));
+	pValueKey = g_variant_ref_sink(g_variant_new_string("Value"));
+}
+
+NotificationTemplate::~NotificationTemplate()
+{
+	g_object_unref(pMessage);
+	g_variant_unref(pInterfaceName);
+	g_variant_unref(pValueKey);
+}
+
+// Sends a PropertiesChanged signal carrying `pValue` as the "Value" property
+//
+// A floating `pValue` is consumed. Returns true if the signal was queued for sending.
+bool NotificationTemplate::send(GDBusConnection *pBusConnection, GVariant *pValue) const
+{
+	// Assemble the body from its parts: (sa{sv}) = (interface, {"Value": <value>})
+	GVariant *pEntry = g_variant_new_dict_entry(pValueKey, g_variant_new_variant(pValue));
+	GVariant *pBodyParts[2] = { pInterfaceName, g_variant_new_array(G_VARIANT_TYPE("{sv}"), &pEntry, 1) };
+
+	GDBusMessage *pSignal = g_dbus_message_copy(pMessage, nullptr);
+	g_dbus_message_set_body(pSignal, g_variant_new_tuple(pBodyParts, 2));
+
+	if (Capture::getInstance().isRecording())
+	{
+		Capture::getInstance().recordDBus(ECaptureSignal, Capture::nowUS(), nullptr, path.c_str(), kPropertiesInterface,
+			kPropertiesChangedSignal, g_dbus_message_get_body(pSignal));
+	}
+
+	GError *pError = nullptr;
+	gboolean result = g_dbus_connection_send_message(pBusConnection, pSignal, G_DBUS_SEND_MESSAGE_FLAGS_NONE, nullptr, &pError);
+	g_object_unref(pSignal);
+
+	if (0 == result)
+	{
+		Logger::error(SSTR << "Failed to send change notification for '" << path << "': " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+		return false;
+	}
+
+	return true;
+}
+
+}; // namespace ggk
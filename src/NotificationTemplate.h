@@ -0,0 +1,57 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A prebuilt PropertiesChanged signal for sending a characteristic's change notifications
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of NotificationTemplate.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string>
+
+namespace ggk {
+
+class NotificationTemplate
+{
+public:
+
+	// Builds the template for notifications from the object at `objectPath` carrying the properties of `interfaceName`
+	NotificationTemplate(const std::string &objectPath, const std::string &interfaceName);
+	~NotificationTemplate();
+
+	// Not copyable (we own GLib references)
+	NotificationTemplate(const NotificationTemplate &) = delete;
+	NotificationTemplate &operator =(const NotificationTemplate &) = delete;
+
+	// Sends a PropertiesChanged signal carrying `pValue` as the "Value" property
+	//
+	// A floating `pValue` is consumed. Returns true if the signal was queued for sending.
+	bool send(GDBusConnection *pBusConnection, GVariant *pValue) const;
+
+private:
+
+	std::string path;
+	GDBusMessage *pMessage;
+	GVariant *pInterfaceName;
+	GVariant *pValueKey;
+};
+
+}; // namespace ggk
@@ -0,0 +1,206 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A per-thread, size-class pool for the library's small transient allocations
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Each D-Bus request and each notification allocates a handful of short-lived objects: the queued path and interface strings,
+// the reply context for an asynchronous method, the copy of a written string value, diagnostic strings and small scratch
+// vectors. They're freed again within a few milliseconds, usually on the same thread, and on a small device the general-purpose
+// heap spends more time on them than the work they support.
+//
+// The pool rounds each request up to one of `kClassCount` power-of-two size classes (16 bytes through 1KB) and keeps a free list
+// of released blocks for each class, per thread. Allocation pops a block from the calling thread's list when one is available and
+// otherwise falls back to the heap; release pushes the block onto the calling thread's list. A block may be freed on a different
+// thread from the one that allocated it (the update queue is pushed by the application and popped by the server thread); it
+// simply joins the freeing thread's list. There's no locking on either path.
+//
+// Each thread's list for a class holds at most `kMaxCachedBytes` worth of blocks. A release beyond that (an "overflow") returns
+// the block to the heap, so a burst can't pin memory indefinitely. Requests larger than the largest class go straight to the heap.
+//
+// The statistics (see `ggkGetPoolStats()`) report, per class, the allocations made, how many of them were recycled from a free
+// list, the overflows, and the blocks currently held in free lists across all threads. A low recycle rate means a class isn't
+// earning its keep; frequent overflows mean the per-thread limit is too small for the traffic.
+//
+// Containers use the pool through `PoolAllocator` (or `TaggedAllocator`, which adds memory accounting on top of it.)
+//
+// A thread's free lists are released to the heap when the thread exits. Blocks released on a thread after its lists have gone
+// (during static destruction, for example) go straight to the heap.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <atomic>
+#include <new>
+
+#include "Pool.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// The most memory that a thread's free list for a single class may hold
+static const size_t kMaxCachedBytes = 16 * 1024;
+
+//
+// Counters
+//
+// Indexed by class, with an extra entry for oversized allocations
+//
+
+static std::atomic<uint64_t> allocations[Pool::kClassCount + 1];
+static std::atomic<uint64_t> recycled[Pool::kClassCount + 1];
+static std::atomic<uint64_t> overflows[Pool::kClassCount + 1];
+static std::atomic<size_t> cachedBlocks[Pool::kClassCount + 1];
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Per-thread free lists
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+struct FreeBlock
+{
+	FreeBlock *pNext;
+};
+
+struct ThreadCache
+{
+	FreeBlock *pHeads[Pool::kClassCount] = {};
+	size_t counts[Pool::kClassCount] = {};
+
+	~ThreadCache();
+};
+
+static thread_local ThreadCache threadCache;
+
+// Set once this thread's cache has been destroyed (a plain flag, so that it remains readable afterwards)
+static thread_local bool threadCacheGone = false;
+
+// Releases the thread's free lists to the heap
+ThreadCache::~ThreadCache()
+{
+	for (int index = 0; index < Pool::kClassCount; ++index)
+	{
+		while (nullptr != pHeads[index])
+		{
+			FreeBlock *pBlock = pHeads[index];
+			pHeads[index] = pBlock->pNext;
+			::operator delete(pBlock);
+		}
+
+		cachedBlocks[index].fetch_sub(counts[index], std::memory_order_relaxed);
+		counts[index] = 0;
+	}
+
+	threadCacheGone = true;
+}
+
+// Returns the class for an allocation of `bytes` bytes, or `kClassCount` if it's too large for any class
+static int classIndex(size_t bytes)
+{
+	if (bytes <= Pool::kMinBlockSize)
+	{
+		return 0;
+	}
+
+	if (bytes > Pool::kMaxBlockSize)
+	{
+		return Pool::kClassCount;
+	}
+
+	// Round up to the next power of two, relative to the smallest class
+	int index = 0;
+	for (size_t blockSize = Pool::kMinBlockSize; blockSize < bytes; blockSize <<= 1)
+	{
+		++index;
+	}
+
+	return index;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Allocation
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns a block of at least `bytes` bytes, recycled from this thread's free list when possible
+void *Pool::allocate(size_t bytes)
+{
+	int index = classIndex(bytes);
+	allocations[index].fetch_add(1, std::memory_order_relaxed);
+
+	if (index == kClassCount)
+	{
+		return ::operator new(bytes);
+	}
+
+	if (!threadCacheGone && nullptr != threadCache.pHeads[index])
+	{
+		FreeBlock *pBlock = threadCache.pHeads[index];
+		threadCache.pHeads[index] = pBlock->pNext;
+		threadCache.counts[index] -= 1;
+		cachedBlocks[index].fetch_sub(1, std::memory_order_relaxed);
+		recycled[index].fetch_add(1, std::memory_order_relaxed);
+		return pBlock;
+	}
+
+	return ::operator new(kMinBlockSize << index);
+}
+
+// Returns a block of `bytes` bytes (as passed to `allocate()`) to this thread's free list, or to the heap if the list is full
+void Pool::deallocate(void *p, size_t bytes) noexcept
+{
+	if (nullptr == p)
+	{
+		return;
+	}
+
+	int index = classIndex(bytes);
+	if (index == kClassCount || threadCacheGone)
+	{
+		::operator delete(p);
+		return;
+	}
+
+	if (threadCache.counts[index] >= kMaxCachedBytes / (kMinBlockSize << index))
+	{
+		overflows[index].fetch_add(1, std::memory_order_relaxed);
+		::operator delete(p);
+		return;
+	}
+
+	FreeBlock *pBlock = static_cast<FreeBlock *>(p);
+	pBlock->pNext = threadCache.pHeads[index];
+	threadCache.pHeads[index] = pBlock;
+	threadCache.counts[index] += 1;
+	cachedBlocks[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the statistics for the size class at `index` (the entry at `kClassCount` covers oversized allocations)
+GGKPoolStats Pool::getStats(int index)
+{
+	GGKPoolStats stats;
+	stats.blockSize = index < kClassCount ? kMinBlockSize << index : 0;
+	stats.allocations = allocations[index].load(std::memory_order_relaxed);
+	stats.recycled = recycled[index].load(std::memory_order_relaxed);
+	stats.overflows = overflows[index].load(std::memory_order_relaxed);
+	stats.cachedBlocks = cachedBlocks[index].load(std::memory_order_relaxed);
+	return stats;
+}
+
+}; // namespace ggk
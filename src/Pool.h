@@ -0,0 +1,102 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A per-thread, size-class pool for the library's small transient allocations
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Pool.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "../include/Gobbledegook.h"
+
+namespace ggk {
+
+class Pool
+{
+public:
+
+	// The number of size classes (allocations larger than the largest class go straight to the heap)
+	static const int kClassCount = 7;
+
+	// The block size of the smallest class; each class doubles the size of the previous one
+	static const size_t kMinBlockSize = 16;
+
+	// The block size of the largest class
+	static const size_t kMaxBlockSize = kMinBlockSize << (kClassCount - 1);
+
+	//
+	// Allocation (may be called from any thread)
+	//
+
+	// Returns a block of at least `bytes` bytes, recycled from this thread's free list when possible
+	static void *allocate(size_t bytes);
+
+	// Returns a block of `bytes` bytes (as passed to `allocate()`) to this thread's free list, or to the heap if the list is full
+	static void deallocate(void *p, size_t bytes) noexcept;
+
+	//
+	// Reporting
+	//
+
+	// Returns the statistics for the size class at `index` (the entry at `kClassCount` covers oversized allocations)
+	static GGKPoolStats getStats(int index);
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// A standard allocator that draws from the pool
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+template<typename T>
+struct PoolAllocator
+{
+	typedef T value_type;
+
+	PoolAllocator() noexcept {}
+
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+	T *allocate(size_t count)
+	{
+		return static_cast<T *>(Pool::allocate(count * sizeof(T)));
+	}
+
+	void deallocate(T *p, size_t count) noexcept
+	{
+		Pool::deallocate(p, count * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U> &) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const PoolAllocator<U> &) const noexcept { return false; }
+};
+
+// Convenience types for pooled scratch storage
+typedef std::basic_string<char, std::char_traits<char>, PoolAllocator<char>> PooledString;
+
+template<typename T>
+using PooledVector = std::vector<T, PoolAllocator<T>>;
+
+}; // namespace ggk
@@ -0,0 +1,261 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Accounting of the server's wakeups and the time it spends awake, per event source
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// On battery-powered devices, every wakeup costs power. The server wakes for a handful of reasons:
+//
+//     Idle loop       the main loop's idle function, which sleeps `kIdleFrequencyMS` between polls of the update queue
+//     Periodic timer  the once-per-second timer that ticks events, retries, advertising and connection profiles
+//     HCI poll        the HCI event thread, which wakes from `select()` on each timeout as well as for each event
+//     D-Bus           method calls and property accesses from BlueZ and other clients
+//
+// Each wakeup is wrapped in a `WakeupScope`, which records the source, the handler that ran (for example, the D-Bus method and
+// object path, or the HCI event type) and the time spent awake. From these we keep per-source and per-handler counts, both since
+// profiling started (see `ggkGetWakeupStats()`) and since the last summary.
+//
+// If a summary interval is set, the periodic timer logs a summary of each interval: the wakeups per second from each source,
+// the time spent awake, and the busiest handlers. This makes it easy to verify the idle behavior of a device and to catch changes
+// that add wakeups.
+//
+// Profiling is off until started, at which point recording a wakeup costs a couple of clock reads and a short lock.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <glib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+
+#include "PowerProfiler.h"
+#include "Logger.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// The number of handlers listed for each source in a summary
+static const size_t kSummaryHandlerCount = 3;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Control
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts (or restarts) profiling from zero, logging a summary every `intervalSeconds` seconds (zero for no summary)
+void PowerProfiler::start(int intervalSeconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (Source &source : sources)
+	{
+		source = Source();
+	}
+
+	startUS = g_get_monotonic_time();
+	lastSummaryUS = startUS;
+	summaryIntervalSeconds = std::max(0, intervalSeconds);
+	enabled = true;
+
+	Logger::info(SSTR << "Wakeup profiling started" << (intervalSeconds > 0 ? " (summary every " + std::to_string(intervalSeconds) + "s)" : ""));
+}
+
+// Stops profiling (the statistics gathered so far remain available)
+void PowerProfiler::stop()
+{
+	enabled = false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Accounting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Records a wakeup from `source` that ran `handler` and stayed awake for `awakeUS` microseconds
+void PowerProfiler::record(GGKWakeupSource source, const std::string &handler, int64_t awakeUS)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Source &entry = sources[source];
+	entry.total.wakeups += 1;
+	entry.total.awakeUS += awakeUS;
+	entry.interval.wakeups += 1;
+	entry.interval.awakeUS += awakeUS;
+
+	HandlerCounters &counters = entry.handlers[handler];
+	counters.total.wakeups += 1;
+	counters.total.awakeUS += awakeUS;
+	counters.interval.wakeups += 1;
+	counters.interval.awakeUS += awakeUS;
+
+	entry.lastHandler = handler;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the statistics for `source` since profiling started
+GGKWakeupStats PowerProfiler::getStats(GGKWakeupSource source)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const Source &entry = sources[source];
+	double elapsedSeconds = startUS == 0 ? 0.0 : (g_get_monotonic_time() - startUS) / 1000000.0;
+
+	GGKWakeupStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.wakeups = entry.total.wakeups;
+	stats.awakeUS = entry.total.awakeUS;
+	stats.wakeupsPerSecond = elapsedSeconds > 0.0 ? entry.total.wakeups / elapsedSeconds : 0.0;
+	stats.awakePercent = elapsedSeconds > 0.0 ? entry.total.awakeUS / (elapsedSeconds * 10000.0) : 0.0;
+	g_strlcpy(stats.lastHandler, entry.lastHandler.c_str(), sizeof(stats.lastHandler));
+
+	uint64_t topWakeups = 0;
+	for (const auto &handler : entry.handlers)
+	{
+		if (handler.second.total.wakeups > topWakeups)
+		{
+			topWakeups = handler.second.total.wakeups;
+			g_strlcpy(stats.topHandler, handler.first.c_str(), sizeof(stats.topHandler));
+		}
+	}
+
+	return stats;
+}
+
+// Logs a summary if one is due (called from the server's periodic timer)
+void PowerProfiler::tick()
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	int64_t nowUS = g_get_monotonic_time();
+	if (summaryIntervalSeconds > 0 && nowUS - lastSummaryUS >= static_cast<int64_t>(summaryIntervalSeconds) * 1000000)
+	{
+		logSummary(nowUS);
+	}
+}
+
+// Logs the summary for the interval that ends at `nowUS` and starts a new interval (requires `mutex`)
+void PowerProfiler::logSummary(int64_t nowUS)
+{
+	double elapsedSeconds = (nowUS - lastSummaryUS) / 1000000.0;
+
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(1) << "Wakeups over the last " << elapsedSeconds << "s:";
+
+	for (int i = 0; i < EWakeupSourceCount; ++i)
+	{
+		Source &source = sources[i];
+		summary << "\n  + " << std::left << std::setw(15) << getSourceName(static_cast<GGKWakeupSource>(i)) << std::right
+			<< ": " << std::setw(6) << source.interval.wakeups << " wakeups (" << source.interval.wakeups / elapsedSeconds << "/s), awake "
+			<< source.interval.awakeUS / 1000.0 << "ms (" << std::setprecision(3) << source.interval.awakeUS / (elapsedSeconds * 10000.0)
+			<< "%)" << std::setprecision(1);
+
+		// List the busiest handlers
+		std::vector<std::pair<std::string, Counters>> handlers;
+		for (auto &handler : source.handlers)
+		{
+			if (handler.second.interval.wakeups > 0)
+			{
+				handlers.push_back(std::make_pair(handler.first, handler.second.interval));
+			}
+			handler.second.interval = Counters();
+		}
+
+		std::sort(handlers.begin(), handlers.end(), [](const std::pair<std::string, Counters> &a, const std::pair<std::string, Counters> &b)
+		{
+			return a.second.wakeups > b.second.wakeups;
+		});
+
+		for (size_t h = 0; h < handlers.size() && h < kSummaryHandlerCount; ++h)
+		{
+			summary << "\n      - " << handlers[h].first << ": " << handlers[h].second.wakeups << " wakeups, awake "
+				<< handlers[h].second.awakeUS / 1000.0 << "ms";
+		}
+
+		source.interval = Counters();
+	}
+
+	Logger::info(summary.str());
+	lastSummaryUS = nowUS;
+}
+
+// Returns a human-readable name for `source`
+const char *PowerProfiler::getSourceName(GGKWakeupSource source)
+{
+	switch(source)
+	{
+		case EWakeupIdle: return "Idle loop";
+		case EWakeupPeriodicTimer: return "Periodic timer";
+		case EWakeupHciPoll: return "HCI poll";
+		case EWakeupDBus: return "D-Bus";
+		default: return "Unknown";
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// WakeupScope
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts timing a wakeup from `source` that runs `pHandler` (with an optional `pDetail`, such as an object path)
+WakeupScope::WakeupScope(GGKWakeupSource wakeupSource, const char *pHandler, const char *pDetail)
+: source(wakeupSource), enabled(PowerProfiler::getInstance().isEnabled()), startUS(0)
+{
+	if (enabled)
+	{
+		startUS = g_get_monotonic_time();
+		setHandler(pHandler, pDetail);
+	}
+}
+
+// Records the wakeup
+WakeupScope::~WakeupScope()
+{
+	if (enabled)
+	{
+		PowerProfiler::getInstance().record(source, handler, g_get_monotonic_time() - startUS);
+	}
+}
+
+// Replaces the handler name (for sources where the handler is only known after waking)
+void WakeupScope::setHandler(const char *pHandler, const char *pDetail)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	handler = nullptr == pHandler ? "" : pHandler;
+	if (nullptr != pDetail)
+	{
+		handler += " ";
+		handler += pDetail;
+	}
+}
+
+}; // namespace ggk
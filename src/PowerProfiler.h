@@ -0,0 +1,154 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Accounting of the server's wakeups and the time it spends awake, per event source
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of PowerProfiler.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+
+#include "../include/Gobbledegook.h"
+
+namespace ggk {
+
+class PowerProfiler
+{
+public:
+
+	//
+	// Accessors
+	//
+
+	// Returns the instance to this singleton class
+	static PowerProfiler &getInstance()
+	{
+		static PowerProfiler instance;
+		return instance;
+	}
+
+	//
+	// Disallow copies of our singleton (c++11)
+	//
+	PowerProfiler(PowerProfiler const&) = delete;
+	void operator=(PowerProfiler const&) = delete;
+
+	//
+	// Control
+	//
+
+	// Starts (or restarts) profiling from zero, logging a summary every `intervalSeconds` seconds (zero for no summary)
+	void start(int intervalSeconds);
+
+	// Stops profiling (the statistics gathered so far remain available)
+	void stop();
+
+	// Returns true while profiling
+	bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	//
+	// Accounting (may be called from any thread)
+	//
+
+	// Records a wakeup from `source` that ran `handler` and stayed awake for `awakeUS` microseconds
+	void record(GGKWakeupSource source, const std::string &handler, int64_t awakeUS);
+
+	//
+	// Reporting
+	//
+
+	// Returns the statistics for `source` since profiling started
+	GGKWakeupStats getStats(GGKWakeupSource source);
+
+	// Logs a summary if one is due (called from the server's periodic timer)
+	void tick();
+
+	// Returns a human-readable name for `source`
+	static const char *getSourceName(GGKWakeupSource source);
+
+private:
+	// Private constructor for our Singleton
+	PowerProfiler() : enabled(false), startUS(0), lastSummaryUS(0), summaryIntervalSeconds(0) {}
+
+	// Wakeup counts and awake time
+	struct Counters
+	{
+		uint64_t wakeups = 0;
+		int64_t awakeUS = 0;
+	};
+
+	// The counters for a handler, since profiling started and since the last summary
+	struct HandlerCounters
+	{
+		Counters total;
+		Counters interval;
+	};
+
+	// The counters for an event source
+	struct Source
+	{
+		Counters total;
+		Counters interval;
+		std::map<std::string, HandlerCounters> handlers;
+		std::string lastHandler;
+	};
+
+	// Logs the summary for the interval that ends at `nowUS` and starts a new interval (requires `mutex`)
+	void logSummary(int64_t nowUS);
+
+	std::atomic<bool> enabled;
+	std::mutex mutex;
+	Source sources[EWakeupSourceCount];
+	int64_t startUS;
+	int64_t lastSummaryUS;
+	int summaryIntervalSeconds;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Records a single wakeup, from construction to destruction
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+class WakeupScope
+{
+public:
+	// Starts timing a wakeup from `source` that runs `pHandler` (with an optional `pDetail`, such as an object path)
+	WakeupScope(GGKWakeupSource wakeupSource, const char *pHandler, const char *pDetail = nullptr);
+
+	// Records the wakeup
+	~WakeupScope();
+
+	WakeupScope(WakeupScope const&) = delete;
+	void operator=(WakeupScope const&) = delete;
+
+	// Replaces the handler name (for sources where the handler is only known after waking)
+	void setHandler(const char *pHandler, const char *pDetail = nullptr);
+
+private:
+	GGKWakeupSource source;
+	bool enabled;
+	int64_t startUS;
+	std::string handler;
+};
+
+}; // namespace ggk
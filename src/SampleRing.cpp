@@ -0,0 +1,253 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A fixed-size ring of timestamped samples behind a characteristic flagged with `sampleRing()`
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Notifying each sample of a high-rate sensor costs an ATT operation per sample, and a central that reconnects has missed
+// everything sent while it was away. A characteristic flagged with `sampleRing()` instead keeps the most recent samples in a ring
+// (appended by the application with `ggkAppendSample()`) and hands them to centrals in batches.
+//
+// Each sample is numbered with a sequence number that counts up from zero as samples are appended. A batch is packed densely:
+//
+//     [u32 sequence of the first sample][u8 sample count][i64 timestamp of the first sample, in milliseconds]
+//     then for each sample: [u16 milliseconds since the previous sample (zero for the first)][sample]
+//
+// All integers are little-endian. A batch ends early if a sample's timestamp is more than 65535ms after (or at all before) the
+// sample before it; the next batch starts at that sample with a full timestamp.
+//
+// Centrals retrieve samples in two ways:
+//
+//     Reads          A write of [u32 sequence] sets the central's read cursor. Each read returns a batch from that cursor (as much
+//                    as fits in the MTU, when BlueZ tells us what it is) and moves the cursor past it, so a central catches up
+//                    after a reconnect by writing the sequence after the last sample it has and then reading until a batch comes
+//                    back empty. Reads at an offset (long reads) return the rest of the same batch. Each central has its own
+//                    cursor, keyed by the device object path that BlueZ passes with the request.
+//     Notifications  Once `notifyBatch` samples have been appended since the last notification, an update is queued and the
+//                    samples are notified in batches of up to `notifyBatch`. Notifications go to every subscribed central, so
+//                    batches are sized to the smallest ATT_MTU any central has told us (through its reads and writes.) Until
+//                    one has, they're sized to the minimum ATT_MTU of 23, which leaves room for one sample of up to 5 bytes;
+//                    larger samples aren't notified (only read) until a central has told us a large enough MTU.
+//
+// If a cursor falls behind the oldest sample in the ring, its batch starts at the oldest sample instead; the sequence number in the
+// header shows the central how many it missed.
+//
+// The ring is guarded by a mutex: appends come from the application's threads and reads from the server's thread, and each holds
+// it only to copy samples in or out.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+#include <algorithm>
+
+#include "SampleRing.h"
+
+namespace ggk {
+
+//
+// Encoding helpers
+//
+
+// Appends `value` to `batch` as `size` little-endian bytes
+static void appendLittleEndian(SampleRing::Batch &batch, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		batch.push_back(uint8_t(value >> (8 * i)));
+	}
+}
+
+// Constructs a ring of `capacity` samples of `sampleSize` bytes each, notifying in batches of `notifyBatch` samples
+SampleRing::SampleRing(size_t capacity, size_t sampleSize, size_t notifyBatch)
+: capacity(std::max(capacity, size_t(1))), sampleSize(sampleSize),
+  notifyBatch(std::min(std::max(notifyBatch, size_t(1)), kMaxBatchSamples)), samples(this->capacity * sampleSize),
+  timestamps(this->capacity), nextSequence(0), cursorUses(0), notifyCursor(0)
+{
+}
+
+// Appends a sample of `getSampleSize()` bytes at `pData`, taken at `timestampMS`, replacing the oldest if the ring is full
+//
+// Returns true if a batch of samples is waiting to be notified. May be called from any thread.
+bool SampleRing::append(int64_t timestampMS, const void *pData)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t slot = nextSequence % capacity;
+	memcpy(samples.data() + slot * sampleSize, pData, sampleSize);
+	timestamps[slot] = timestampMS;
+	nextSequence += 1;
+
+	return nextSequence - clamp(notifyCursor) >= notifyBatch;
+}
+
+// Sets the sequence number of the next sample returned by `read()` for the central `device` (its object path), whose ATT_MTU is
+// `mtu` (zero if BlueZ didn't tell us)
+void SampleRing::setCursor(const std::string &device, uint16_t mtu, uint32_t sequence)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Cursor &cursor = getCursor(device, mtu);
+	cursor.sequence = sequence;
+	cursor.batchStart = sequence;
+}
+
+// Encodes into `batch` the samples returned by a read at `offset` from the central `device`, whose ATT_MTU is `mtu` (zero if
+// BlueZ didn't tell us)
+//
+// A read at offset zero returns the samples from the central's cursor and moves the cursor past them. Reads at later offsets
+// return the rest of the same batch (for long reads.) Returns false if `offset` is beyond the end of the batch.
+bool SampleRing::read(const std::string &device, uint16_t mtu, uint16_t offset, Batch &batch)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// A read returns at most MTU - 1 bytes
+	size_t maxLength = mtu > 1 ? std::min(size_t(mtu - 1), kMaxReadLength) : kMaxReadLength;
+	Cursor &cursor = getCursor(device, mtu);
+	if (0 == offset)
+	{
+		cursor.batchStart = cursor.sequence;
+		cursor.sequence = encode(cursor.batchStart, kMaxBatchSamples, maxLength, batch);
+		return true;
+	}
+
+	// A long read rebuilds the batch that the read at offset zero returned
+	Batch whole;
+	encode(cursor.batchStart, kMaxBatchSamples, maxLength, whole);
+	if (offset > whole.size())
+	{
+		return false;
+	}
+
+	batch.assign(whole.begin() + offset, whole.end());
+	return true;
+}
+
+// Encodes into `batch` the next batch of samples to notify, moving past them
+//
+// Returns false if there are no samples waiting to be notified.
+bool SampleRing::takeNotification(Batch &batch)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	notifyCursor = clamp(notifyCursor);
+	if (notifyCursor == nextSequence)
+	{
+		return false;
+	}
+
+	// Notifications carry at most ATT_MTU - 3 bytes, for the smallest MTU we know of
+	size_t maxLength = 0;
+	for (const Cursor &cursor : cursors)
+	{
+		if (cursor.mtu > 3)
+		{
+			maxLength = 0 == maxLength ? size_t(cursor.mtu - 3) : std::min(maxLength, size_t(cursor.mtu - 3));
+		}
+	}
+	maxLength = 0 == maxLength ? kDefaultNotifyLength : std::min(maxLength, kMaxReadLength);
+
+	// Samples too large for a notification (every sample is the same size, so none of them fit) are skipped and left for reads.
+	// Moving the cursor past them stops `append()` from asking for notifications we can't send.
+	uint32_t next = encode(notifyCursor, notifyBatch, maxLength, batch);
+	if (next == notifyCursor)
+	{
+		notifyCursor = nextSequence;
+		return false;
+	}
+
+	notifyCursor = next;
+	return true;
+}
+
+// Encodes the samples from `sequence` into `batch`, up to `maxSamples` samples in `maxLength` bytes
+//
+// If `sequence` has been overwritten, this starts from the oldest sample instead. Returns the sequence after the last sample
+// encoded. The caller must hold `mutex`.
+uint32_t SampleRing::encode(uint32_t sequence, size_t maxSamples, size_t maxLength, Batch &batch) const
+{
+	sequence = clamp(sequence);
+
+	batch.clear();
+	appendLittleEndian(batch, sequence, sizeof(uint32_t));
+	batch.push_back(0);
+	appendLittleEndian(batch, uint64_t(nextSequence == sequence ? 0 : timestamps[sequence % capacity]), sizeof(int64_t));
+
+	size_t count = 0;
+	int64_t previousMS = 0;
+	while (sequence != nextSequence && count < maxSamples && batch.size() + kDeltaSize + sampleSize <= maxLength)
+	{
+		size_t slot = sequence % capacity;
+		int64_t deltaMS = 0 == count ? 0 : timestamps[slot] - previousMS;
+		if (deltaMS < 0 || deltaMS > 0xffff)
+		{
+			break;
+		}
+
+		appendLittleEndian(batch, uint64_t(deltaMS), kDeltaSize);
+		batch.insert(batch.end(), samples.begin() + slot * sampleSize, samples.begin() + (slot + 1) * sampleSize);
+
+		previousMS = timestamps[slot];
+		sequence += 1;
+		count += 1;
+	}
+
+	batch[sizeof(uint32_t)] = uint8_t(count);
+	return sequence;
+}
+
+// Returns the cursor for the central `device`, creating it (at the oldest sample) if needed (the caller must hold `mutex`)
+//
+// A known `mtu` replaces the one we had for the central. When we already have `kMaxCursors` cursors, the least recently used is
+// replaced.
+SampleRing::Cursor &SampleRing::getCursor(const std::string &device, uint16_t mtu)
+{
+	cursorUses += 1;
+
+	auto found = std::find_if(cursors.begin(), cursors.end(), [&device](const Cursor &cursor) { return cursor.device == device; });
+	if (found == cursors.end())
+	{
+		uint32_t oldest = clamp(nextSequence - uint32_t(capacity));
+		if (cursors.size() < kMaxCursors)
+		{
+			cursors.push_back(Cursor());
+			found = cursors.end() - 1;
+		}
+		else
+		{
+			found = std::min_element(cursors.begin(), cursors.end(),
+				[](const Cursor &a, const Cursor &b) { return a.lastUsed < b.lastUsed; });
+		}
+
+		*found = Cursor{device, 0, oldest, oldest, 0};
+	}
+
+	if (0 != mtu)
+	{
+		found->mtu = mtu;
+	}
+
+	found->lastUsed = cursorUses;
+	return *found;
+}
+
+// Returns `sequence`, or the oldest sample we hold if `sequence` has been overwritten (the caller must hold `mutex`)
+uint32_t SampleRing::clamp(uint32_t sequence) const
+{
+	uint32_t held = nextSequence < capacity ? nextSequence : uint32_t(capacity);
+
+	// Sequence numbers wrap, so compare distances from the next sequence rather than the sequences themselves
+	return nextSequence - sequence > held ? nextSequence - held : sequence;
+}
+
+}; // namespace ggk
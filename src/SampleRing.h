@@ -0,0 +1,129 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A fixed-size ring of timestamped samples behind a characteristic flagged with `sampleRing()`
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of SampleRing.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include "MemoryStats.h"
+
+namespace ggk {
+
+class SampleRing
+{
+public:
+
+	// The size of the header of each batch: [u32 sequence][u8 count][i64 timestamp]
+	static constexpr size_t kHeaderSize = 13;
+
+	// The size of each sample's timestamp delta: [u16 milliseconds since the previous sample]
+	static constexpr size_t kDeltaSize = 2;
+
+	// The most samples in a batch
+	static constexpr size_t kMaxBatchSamples = 255;
+
+	// The longest value we return from a read (the longest attribute value ATT allows)
+	static constexpr size_t kMaxReadLength = 512;
+
+	// The largest sample a batch can carry
+	static constexpr size_t kMaxSampleSize = kMaxReadLength - kHeaderSize - kDeltaSize;
+
+	// The longest notification we send before any central has told us its MTU (the minimum ATT_MTU of 23, less 3 bytes of header)
+	static constexpr size_t kDefaultNotifyLength = 20;
+
+	// The most centrals we keep a read cursor for (the least recently used is forgotten first)
+	static constexpr size_t kMaxCursors = 8;
+
+	// A batch of encoded samples
+	typedef std::vector<uint8_t, TaggedAllocator<uint8_t, EMemoryCache>> Batch;
+
+	// Constructs a ring of `capacity` samples of `sampleSize` bytes each, notifying in batches of `notifyBatch` samples
+	SampleRing(size_t capacity, size_t sampleSize, size_t notifyBatch);
+
+	// Returns the size of each sample
+	size_t getSampleSize() const { return sampleSize; }
+
+	// Appends a sample of `getSampleSize()` bytes at `pData`, taken at `timestampMS`, replacing the oldest if the ring is full
+	//
+	// Returns true if a batch of samples is waiting to be notified. May be called from any thread.
+	bool append(int64_t timestampMS, const void *pData);
+
+	// Sets the sequence number of the next sample returned by `read()` for the central `device` (its object path), whose ATT_MTU is
+	// `mtu` (zero if BlueZ didn't tell us)
+	void setCursor(const std::string &device, uint16_t mtu, uint32_t sequence);
+
+	// Encodes into `batch` the samples returned by a read at `offset` from the central `device`, whose ATT_MTU is `mtu` (zero if
+	// BlueZ didn't tell us)
+	//
+	// A read at offset zero returns the samples from the central's cursor and moves the cursor past them. Reads at later offsets
+	// return the rest of the same batch (for long reads.) Returns false if `offset` is beyond the end of the batch.
+	bool read(const std::string &device, uint16_t mtu, uint16_t offset, Batch &batch);
+
+	// Encodes into `batch` the next batch of samples to notify, moving past them
+	//
+	// Batches fit in the smallest ATT_MTU a central has told us (less 3 bytes of header), or `kDefaultNotifyLength`. Returns false
+	// if there are no samples waiting to be notified, or if the next sample doesn't fit (the waiting samples are then skipped, and
+	// are left for reads.)
+	bool takeNotification(Batch &batch);
+
+private:
+
+	// Encodes the samples from `sequence` into `batch`, up to `maxSamples` samples in `maxLength` bytes
+	//
+	// If `sequence` has been overwritten, this starts from the oldest sample instead. Returns the sequence after the last sample
+	// encoded. The caller must hold `mutex`.
+	uint32_t encode(uint32_t sequence, size_t maxSamples, size_t maxLength, Batch &batch) const;
+
+	// Returns `sequence`, or the oldest sample we hold if `sequence` has been overwritten (the caller must hold `mutex`)
+	uint32_t clamp(uint32_t sequence) const;
+
+	// A central's read cursor
+	struct Cursor
+	{
+		std::string device;
+		uint16_t mtu;
+		uint32_t sequence;
+		uint32_t batchStart;
+		uint64_t lastUsed;
+	};
+
+	// Returns the cursor for the central `device`, creating it (at the oldest sample) if needed (the caller must hold `mutex`)
+	Cursor &getCursor(const std::string &device, uint16_t mtu);
+
+	size_t capacity;
+	size_t sampleSize;
+	size_t notifyBatch;
+	std::vector<uint8_t, TaggedAllocator<uint8_t, EMemoryCache>> samples;
+	std::vector<int64_t, TaggedAllocator<int64_t, EMemoryCache>> timestamps;
+	uint32_t nextSequence;
+	std::vector<Cursor> cursors;
+	uint64_t cursorUses;
+	uint32_t notifyCursor;
+	mutable std::mutex mutex;
+};
+
+}; // namespace ggk
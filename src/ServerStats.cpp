@@ -0,0 +1,170 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Server metrics (queue depth, dispatch latency, notifications, connections and startup), gathered without locks
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Tooling on the device can't link against the application to call our C API, but it can talk D-Bus. These metrics are gathered
+// as the server runs and served over D-Bus by the stats interface (see StatsInterface.cpp):
+//
+//     Queue depth      the update queue's current and peak depth
+//     Dispatch         the number of D-Bus method calls dispatched, their total time, and a histogram of their latency in
+//                      power-of-two buckets of microseconds
+//     Notifications    the number of change notifications sent
+//     Connections      the current number of connections and the number made since the server started
+//     Startup          the time the server took to get running and its critical path (see InitScheduler.cpp)
+//
+// The recording side sits on our hot paths (dispatch, the update queue and notifications), so each metric is a plain atomic that
+// is updated with a relaxed operation, and reading them takes no locks either. A scrape only loads the counters, so it never
+// makes the server wait; in exchange, a snapshot is not a single instant across metrics (a call may be counted in the histogram
+// but not yet in the total.) The startup description is published once, as an immutable string swapped in atomically.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <atomic>
+#include <memory>
+
+#include "ServerStats.h"
+
+namespace ggk {
+
+//
+// Counters
+//
+
+static std::atomic<uint32_t> queueDepth(0);
+static std::atomic<uint32_t> queuePeak(0);
+static std::atomic<uint64_t> dispatchCount(0);
+static std::atomic<uint64_t> dispatchTotalUS(0);
+static std::atomic<uint64_t> dispatchLatency[ServerStats::kLatencyBuckets];
+static std::atomic<uint64_t> notificationCount(0);
+static std::atomic<uint32_t> connectionCount(0);
+static std::atomic<uint64_t> connectionTotal(0);
+static std::atomic<int64_t> startupMS(0);
+static std::shared_ptr<const std::string> pStartupCriticalPath;
+
+//
+// Stats interface
+//
+
+static std::atomic<bool> interfaceEnabled(false);
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Records the depth of the update queue after a change
+void ServerStats::recordQueueDepth(size_t depth)
+{
+	uint32_t value = static_cast<uint32_t>(depth);
+	queueDepth.store(value, std::memory_order_relaxed);
+
+	uint32_t peak = queuePeak.load(std::memory_order_relaxed);
+	while (value > peak && !queuePeak.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+// Records a D-Bus method call that took `durationUS` to dispatch
+void ServerStats::recordDispatch(int64_t durationUS)
+{
+	uint64_t duration = durationUS > 0 ? static_cast<uint64_t>(durationUS) : 0;
+
+	// The bucket is the number of significant bits in the duration
+	int bucket = 0 == duration ? 0 : 64 - __builtin_clzll(duration);
+	bucket = bucket < kLatencyBuckets ? bucket : kLatencyBuckets - 1;
+
+	dispatchLatency[bucket].fetch_add(1, std::memory_order_relaxed);
+	dispatchTotalUS.fetch_add(duration, std::memory_order_relaxed);
+	dispatchCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Records a change notification sent to subscribers
+void ServerStats::recordNotification()
+{
+	notificationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Records a new connection, leaving `activeCount` connections
+void ServerStats::recordConnected(int activeCount)
+{
+	connectionCount.store(static_cast<uint32_t>(activeCount), std::memory_order_relaxed);
+	connectionTotal.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Records a disconnection, leaving `activeCount` connections
+void ServerStats::recordDisconnected(int activeCount)
+{
+	connectionCount.store(static_cast<uint32_t>(activeCount), std::memory_order_relaxed);
+}
+
+// Records the time the server took to get running, with a description of its critical path (see InitScheduler.cpp)
+void ServerStats::recordStartup(int64_t elapsedMS, const std::string &criticalPath)
+{
+	std::atomic_store(&pStartupCriticalPath, std::shared_ptr<const std::string>(std::make_shared<std::string>(criticalPath)));
+	startupMS.store(elapsedMS, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns a copy of the current metrics
+ServerStats::Snapshot ServerStats::get()
+{
+	Snapshot snapshot;
+	snapshot.queueDepth = queueDepth.load(std::memory_order_relaxed);
+	snapshot.queuePeak = queuePeak.load(std::memory_order_relaxed);
+	snapshot.dispatchCount = dispatchCount.load(std::memory_order_relaxed);
+	snapshot.dispatchTotalUS = dispatchTotalUS.load(std::memory_order_relaxed);
+	for (int i = 0; i < kLatencyBuckets; ++i)
+	{
+		snapshot.dispatchLatency[i] = dispatchLatency[i].load(std::memory_order_relaxed);
+	}
+	snapshot.notificationCount = notificationCount.load(std::memory_order_relaxed);
+	snapshot.connectionCount = connectionCount.load(std::memory_order_relaxed);
+	snapshot.connectionTotal = connectionTotal.load(std::memory_order_relaxed);
+	snapshot.startupMS = startupMS.load(std::memory_order_relaxed);
+
+	std::shared_ptr<const std::string> pCriticalPath = std::atomic_load(&pStartupCriticalPath);
+	snapshot.startupCriticalPath = nullptr == pCriticalPath ? std::string() : *pCriticalPath;
+	return snapshot;
+}
+
+// Returns the upper bound (in microseconds) of the dispatch latency bucket `bucket` (zero for the last, which has none)
+uint64_t ServerStats::getLatencyBoundUS(int bucket)
+{
+	return bucket < kLatencyBuckets - 1 ? uint64_t(1) << bucket : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Stats interface
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Enables or disables the stats interface on our object tree (see StatsInterface.cpp)
+//
+// This must be called before the server is started.
+void ServerStats::setInterfaceEnabled(bool enabled)
+{
+	interfaceEnabled = enabled;
+}
+
+// Returns true if the stats interface is enabled
+bool ServerStats::isInterfaceEnabled()
+{
+	return interfaceEnabled;
+}
+
+}; // namespace ggk
@@ -0,0 +1,100 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Server metrics (queue depth, dispatch latency, notifications, connections and startup), gathered without locks
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of ServerStats.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace ggk {
+
+class ServerStats
+{
+public:
+
+	// The number of dispatch latency buckets: bucket `i` counts calls that took less than 2^i microseconds (and at least
+	// 2^(i-1)), except the last, which counts everything slower
+	static const int kLatencyBuckets = 20;
+
+	// A copy of the metrics at one moment
+	struct Snapshot
+	{
+		uint32_t queueDepth;
+		uint32_t queuePeak;
+		uint64_t dispatchCount;
+		uint64_t dispatchTotalUS;
+		uint64_t dispatchLatency[kLatencyBuckets];
+		uint64_t notificationCount;
+		uint32_t connectionCount;
+		uint64_t connectionTotal;
+		int64_t startupMS;
+		std::string startupCriticalPath;
+	};
+
+	//
+	// Recording (may be called from any thread)
+	//
+
+	// Records the depth of the update queue after a change
+	static void recordQueueDepth(size_t depth);
+
+	// Records a D-Bus method call that took `durationUS` to dispatch
+	static void recordDispatch(int64_t durationUS);
+
+	// Records a change notification sent to subscribers
+	static void recordNotification();
+
+	// Records a new connection, leaving `activeCount` connections
+	static void recordConnected(int activeCount);
+
+	// Records a disconnection, leaving `activeCount` connections
+	static void recordDisconnected(int activeCount);
+
+	// Records the time the server took to get running, with a description of its critical path (see InitScheduler.cpp)
+	static void recordStartup(int64_t elapsedMS, const std::string &criticalPath);
+
+	//
+	// Reporting
+	//
+
+	// Returns a copy of the current metrics
+	static Snapshot get();
+
+	// Returns the upper bound (in microseconds) of the dispatch latency bucket `bucket` (zero for the last, which has none)
+	static uint64_t getLatencyBoundUS(int bucket);
+
+	//
+	// Stats interface
+	//
+
+	// Enables or disables the stats interface on our object tree (see StatsInterface.cpp)
+	//
+	// This must be called before the server is started.
+	static void setInterfaceEnabled(bool enabled);
+
+	// Returns true if the stats interface is enabled
+	static bool isInterfaceEnabled();
+};
+
+}; // namespace ggk
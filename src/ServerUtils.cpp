@@ -37,7 +37,9 @@
 #include "GattDescriptor.h"
 #include "Server.h"
 #include "Logger.h"
+#include "Clock.h"
 #include "Utils.h"
+#include "DispatchShards.h"
 
 namespace ggk {
 
@@ -56,13 +58,21 @@ namespace ggk {
 //     the empty dict is returned.
 //
 //     (a{oa{sa{sv}}})
-static void addManagedObjectsNode(const DBusObject &object, const DBusObjectPath &basePath, GVariantBuilder *pObjectArray)
+//
+// Only the services dealt to dispatch shard `shard` are included (see DispatchShards.cpp.)
+static void addManagedObjectsNode(const DBusObject &object, const DBusObjectPath &basePath, int shard, GVariantBuilder *pObjectArray)
 {
 	if (!object.isPublished())
 	{
 		return;
 	}
 
+	int serviceShard = DispatchShards::getShard(basePath + object.getPathNode());
+	if (serviceShard >= 0 && serviceShard != shard)
+	{
+		return;
+	}
+
 	if (!object.getInterfaces().empty())
 	{
 		DBusObjectPath path = basePath + object.getPathNode();
@@ -175,19 +185,23 @@ static void addManagedObjectsNode(const DBusObject &object, const DBusObjectPath
 
 	for (const DBusObject &child : object.getChildren())
 	{
-		addManagedObjectsNode(child, basePath + object.getPathNode(), pObjectArray);
+		addManagedObjectsNode(child, basePath + object.getPathNode(), shard, pObjectArray);
 	}
 }
 
 // Builds the response to the method call `GetManagedObjects` from the D-Bus interface `org.freedesktop.DBus.ObjectManager`
+//
+// With dispatch shards, each connection reports only the services of its own shard.
 void ServerUtils::getManagedObjects(GDBusMethodInvocation *pInvocation)
 {
 	// Logger::debug(SSTR << "Reporting managed objects");
 
+	int shard = DispatchShards::getShard(g_dbus_method_invocation_get_connection(pInvocation));
+
 	GVariantBuilder *pObjectArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
 	for (const DBusObject &object : THESERVER->getObjects())
 	{
-		addManagedObjectsNode(object, DBusObjectPath(""), pObjectArray);
+		addManagedObjectsNode(object, DBusObjectPath(""), shard, pObjectArray);
 	}
 
 	GVariant *pParams = g_variant_new("(a{oa{sa{sv}}})", pObjectArray);
@@ -255,12 +269,39 @@ std::string ServerUtils::getCpuInfo(int16_t &cpuCount)
 	return cachedModel;
 }
 
+// Returns the value of `field` (such as "VERSION_ID") from the os-release file at `filename`, without its quotes
+//
+// Returns an empty string if the file can't be read or has no such field. This reads a file, so it shouldn't be called from
+// the server's thread (see AsyncReply.cpp.)
+std::string ServerUtils::getOsReleaseField(const std::string &filename, const std::string &field)
+{
+	std::ifstream osRelease(filename);
+	std::string line;
+	while (getline(osRelease, line))
+	{
+		if (line.compare(0, field.size(), field) != 0 || line.size() <= field.size() || line[field.size()] != '=')
+		{
+			continue;
+		}
+
+		std::string value = Utils::trim(line.substr(field.size() + 1));
+		if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front())
+		{
+			value = value.substr(1, value.size() - 2);
+		}
+
+		return value;
+	}
+
+	return "";
+}
+
 // Build a variant that meets the standard for the Current Time (0x2A2B) Bluetooth Characteristic standard
 //
 // See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.current_time.xml
 GVariant *ServerUtils::gvariantCurrentTime()
 {
-	time_t timeValue = time(nullptr);
+	time_t timeValue = Clock::getInstance().wallTime();
 	struct tm *pTimeStruct = localtime(&timeValue);
 	guint16 year = pTimeStruct->tm_year + 1900;
 	guint8 wday = guint8(pTimeStruct->tm_wday == 0 ? 7 : pTimeStruct->tm_wday);
@@ -289,7 +330,7 @@ GVariant *ServerUtils::gvariantCurrentTime()
 GVariant *ServerUtils::gvariantLocalTime()
 {
 	tzset();
-	time_t timeValue = time(nullptr);
+	time_t timeValue = Clock::getInstance().wallTime();
 	struct tm *pTimeStruct = localtime(&timeValue);
 
 	gint8 utcOffset = -gint8(timezone / 60 / 15); // UTC time (uses 15-minute increments, 0 = UTC time)
@@ -42,6 +42,12 @@ struct ServerUtils
 	// If this routine fails, it will respond with something reasonable, if not _entirely_ accurate.
 	static std::string getCpuInfo(int16_t &cpuCount);
 
+	// Returns the value of `field` (such as "VERSION_ID") from the os-release file at `filename`, without its quotes
+	//
+	// Returns an empty string if the file can't be read or has no such field. This reads a file, so it shouldn't be called from
+	// the server's thread (see AsyncReply.cpp.)
+	static std::string getOsReleaseField(const std::string &filename, const std::string &field);
+
 	// Build a variant that meets the standard for the Current Time (0x2A2B) Bluetooth Characteristic standard
 	//
 	// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.current_time.xml
@@ -0,0 +1,141 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A D-Bus interface that serves the server's metrics (see ServerStats.cpp) to tooling on the device
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// With `ggkSetStatsInterfaceEnabled()`, the server adds an object at "/com/<service name>/stats" with the interface
+// "com.<service name>.Stats1". It isn't part of any GATT service, so it is not reported to BlueZ; tools reach it on the server's
+// own connection (through our owned name, or our unique name) with the standard Properties interface or its one method:
+//
+//     QueueDepth                u    The update queue's current depth
+//     QueuePeak                 u    The update queue's deepest point
+//     DispatchCount             t    D-Bus method calls dispatched
+//     DispatchTotalUS           t    The total time spent dispatching them
+//     DispatchLatency           at   A histogram of their latency (see DispatchLatencyBoundsUS)
+//     DispatchLatencyBoundsUS   at   The upper bound of each histogram bucket in microseconds (zero for the last, unbounded one)
+//     NotificationCount         t    Change notifications sent
+//     ConnectionCount           u    Current connections
+//     ConnectionTotal           t    Connections made since the server started
+//     StartupMS                 x    The time the server took to get running (zero until it is running)
+//     StartupCriticalPath       s    The steps that determined that time (see InitScheduler.cpp)
+//
+//     Snapshot() -> a{sv}            All of the above, read together
+//
+// Each read is served from a fresh copy of the lock-free counters in ServerStats, so scraping never blocks the paths that record
+// them. The properties don't emit PropertiesChanged; tools are expected to poll.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+
+#include "StatsInterface.h"
+#include "ServerStats.h"
+
+namespace ggk {
+
+//
+// Constants
+//
+
+// Our properties, in the order they are reported by `Snapshot()`
+static const char *kPropertyNames[] =
+{
+	"QueueDepth",
+	"QueuePeak",
+	"DispatchCount",
+	"DispatchTotalUS",
+	"DispatchLatency",
+	"DispatchLatencyBoundsUS",
+	"NotificationCount",
+	"ConnectionCount",
+	"ConnectionTotal",
+	"StartupMS",
+	"StartupCriticalPath",
+};
+
+// Returns the value of the property `pName` from `snapshot`, or nullptr if there is no such property
+static GVariant *encodeProperty(const ServerStats::Snapshot &snapshot, const char *pName)
+{
+	if (0 == strcmp(pName, "QueueDepth")) { return g_variant_new_uint32(snapshot.queueDepth); }
+	if (0 == strcmp(pName, "QueuePeak")) { return g_variant_new_uint32(snapshot.queuePeak); }
+	if (0 == strcmp(pName, "DispatchCount")) { return g_variant_new_uint64(snapshot.dispatchCount); }
+	if (0 == strcmp(pName, "DispatchTotalUS")) { return g_variant_new_uint64(snapshot.dispatchTotalUS); }
+	if (0 == strcmp(pName, "NotificationCount")) { return g_variant_new_uint64(snapshot.notificationCount); }
+	if (0 == strcmp(pName, "ConnectionCount")) { return g_variant_new_uint32(snapshot.connectionCount); }
+	if (0 == strcmp(pName, "ConnectionTotal")) { return g_variant_new_uint64(snapshot.connectionTotal); }
+	if (0 == strcmp(pName, "StartupMS")) { return g_variant_new_int64(snapshot.startupMS); }
+	if (0 == strcmp(pName, "StartupCriticalPath")) { return g_variant_new_string(snapshot.startupCriticalPath.c_str()); }
+
+	if (0 == strcmp(pName, "DispatchLatency"))
+	{
+		return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, snapshot.dispatchLatency, ServerStats::kLatencyBuckets,
+			sizeof(uint64_t));
+	}
+
+	if (0 == strcmp(pName, "DispatchLatencyBoundsUS"))
+	{
+		uint64_t bounds[ServerStats::kLatencyBuckets];
+		for (int i = 0; i < ServerStats::kLatencyBuckets; ++i)
+		{
+			bounds[i] = ServerStats::getLatencyBoundUS(i);
+		}
+		return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, bounds, ServerStats::kLatencyBuckets, sizeof(uint64_t));
+	}
+
+	return nullptr;
+}
+
+// Answers a read of one of our properties
+static GVariant *getProperty(GDBusConnection *, const gchar *, const gchar *, const gchar *, const gchar *pPropertyName, GError **,
+	gpointer)
+{
+	return encodeProperty(ServerStats::get(), pPropertyName);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+// Constructs the interface with its properties and its `Snapshot()` method
+//
+// Generally speaking, this object should not be constructed directly. The server description adds it when the stats interface is
+// enabled (see `ggkSetStatsInterfaceEnabled()`.)
+StatsInterface::StatsInterface(DBusObject &owner, const std::string &name)
+: GattInterface(owner, name)
+{
+	// The initial values only describe each property's type; reads are answered by `getProperty()`
+	ServerStats::Snapshot empty = ServerStats::Snapshot();
+	for (const char *pName : kPropertyNames)
+	{
+		addProperty<StatsInterface>(pName, encodeProperty(empty, pName), getProperty);
+	}
+
+	const char *pInArgs[] = { nullptr };
+	addMethod("Snapshot", pInArgs, "a{sv}", INTERFACE_METHOD_CALLBACK_LAMBDA
+	{
+		ServerStats::Snapshot snapshot = ServerStats::get();
+
+		GVariantBuilder builder;
+		g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+		for (const char *pName : kPropertyNames)
+		{
+			g_variant_builder_add(&builder, "{sv}", pName, encodeProperty(snapshot, pName));
+		}
+
+		g_dbus_method_invocation_return_value(pInvocation, g_variant_new("(a{sv})", &builder));
+	});
+}
+#pragma GCC diagnostic pop
+
+}; // namespace ggk
@@ -0,0 +1,57 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A D-Bus interface that serves the server's metrics (see ServerStats.cpp) to tooling on the device
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of StatsInterface.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <string>
+
+#include "GattInterface.h"
+
+namespace ggk {
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Forward declarations
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+struct DBusObject;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Representation of our stats interface
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+struct StatsInterface : GattInterface
+{
+	// Our interface type
+	static constexpr const char *kInterfaceType = "StatsInterface";
+
+	// Constructs the interface with its properties and its `Snapshot()` method
+	StatsInterface(DBusObject &owner, const std::string &name);
+
+	virtual ~StatsInterface() {}
+
+	// Returns a string identifying the type of interface
+	virtual const std::string getInterfaceType() const { return StatsInterface::kInterfaceType; }
+};
+
+}; // namespace ggk
@@ -104,6 +104,9 @@ struct TickEvent
 	// Tick management
 	//
 
+	// Returns true if the next call to `tick()` will fire this event
+	bool isDue() const { return elapsedTicks + 1 >= tickFrequency; }
+
 	// Perform a single tick of a TickEvent
 	//
 	// A TickEvent is ticked each time the periodic timer fires. The TickEvent only fires after `tickFrequency` ticks. As a result,
@@ -25,12 +25,20 @@
 //       + Producing hex values of various types (8-bit, 16-bit, 32-bit)
 //       + Standardied Hex/ASCII dumps to the log file of chunks of binary data
 //       + Properly formatted Bluetooth addresses)
+//     - CRC32C (Castagnoli) checksums, using the CPU's CRC instructions where available (SSE 4.2 on x86-64 and the CRC extension
+//       on ARMv8)
 //     - GVariant helper funcions of various forms to convert values to/from GVariants
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <algorithm>
 #include <string.h>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 #include "Utils.h"
 
 namespace ggk {
@@ -203,6 +211,143 @@ std::string Utils::bluetoothAddressString(uint8_t *pAddress)
 	return hex;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------
+// CRC32C
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// The reflected CRC32C (Castagnoli) polynomial
+static const uint32_t kCrc32cPolynomial = 0x82f63b78;
+
+// Slicing-by-8 tables for the software CRC32C
+struct Crc32cTables
+{
+	uint32_t table[8][256];
+
+	Crc32cTables()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc >> 1) ^ (kCrc32cPolynomial & (0 - (crc & 1)));
+			}
+			table[0][i] = crc;
+		}
+
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			for (int slice = 1; slice < 8; ++slice)
+			{
+				table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xff];
+			}
+		}
+	}
+};
+
+// Updates the (inverted) CRC `crc` with `length` bytes at `pData` in software
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *pData, size_t length)
+{
+	static const Crc32cTables tables;
+	const uint32_t (*t)[256] = tables.table;
+
+	while (length >= 8)
+	{
+		uint32_t low;
+		uint32_t high;
+		memcpy(&low, pData, sizeof(low));
+		memcpy(&high, pData + 4, sizeof(high));
+		low ^= crc;
+
+		crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+			^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+
+		pData += 8;
+		length -= 8;
+	}
+
+	while (length-- > 0)
+	{
+		crc = (crc >> 8) ^ t[0][(crc ^ *pData++) & 0xff];
+	}
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+
+// Updates the (inverted) CRC `crc` with `length` bytes at `pData` using SSE 4.2
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *pData, size_t length)
+{
+	uint64_t crc64 = crc;
+	while (length >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, pData, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		pData += 8;
+		length -= 8;
+	}
+
+	crc = uint32_t(crc64);
+	while (length-- > 0)
+	{
+		crc = _mm_crc32_u8(crc, *pData++);
+	}
+
+	return crc;
+}
+
+static bool detectHardwareCrc32c() { return __builtin_cpu_supports("sse4.2"); }
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+// Updates the (inverted) CRC `crc` with `length` bytes at `pData` using the ARMv8 CRC extension
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *pData, size_t length)
+{
+	while (length >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, pData, sizeof(word));
+		crc = __crc32cd(crc, word);
+		pData += 8;
+		length -= 8;
+	}
+
+	while (length-- > 0)
+	{
+		crc = __crc32cb(crc, *pData++);
+	}
+
+	return crc;
+}
+
+static bool detectHardwareCrc32c() { return true; }
+
+#else
+
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *pData, size_t length) { return crc32cSoftware(crc, pData, length); }
+static bool detectHardwareCrc32c() { return false; }
+
+#endif
+
+// Returns true if `crc32c()` uses the CPU's CRC32C instructions
+bool Utils::hasHardwareCrc32c()
+{
+	static const bool hardware = detectHardwareCrc32c();
+	return hardware;
+}
+
+// Returns the CRC32C of `length` bytes at `pData`, continuing from `crc` (the CRC32C of the data before it, or 0)
+uint32_t Utils::crc32c(uint32_t crc, const void *pData, size_t length)
+{
+	const uint8_t *pBytes = static_cast<const uint8_t *>(pData);
+	crc = ~crc;
+	crc = hasHardwareCrc32c() ? crc32cHardware(crc, pBytes, length) : crc32cSoftware(crc, pBytes, length);
+	return ~crc;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // GVariant helper functions
 // ---------------------------------------------------------------------------------------------------------------------------------
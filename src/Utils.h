@@ -25,6 +25,8 @@
 //       + Producing hex values of various types (8-bit, 16-bit, 32-bit)
 //       + Standardied Hex/ASCII dumps to the log file of chunks of binary data
 //       + Properly formatted Bluetooth addresses)
+//     - CRC32C (Castagnoli) checksums, using the CPU's CRC instructions where available (SSE 4.2 on x86-64 and the CRC extension
+//       on ARMv8)
 //     - GVariant helper funcions of various forms to convert values to/from GVariants
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
@@ -89,6 +91,16 @@ struct Utils
 	// This method returns a set of six zero-padded 8-bit hex values 8-bit in the format: 12:34:56:78:9A:BC
 	static std::string bluetoothAddressString(uint8_t *pAddress);
 
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// CRC32C
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Returns the CRC32C of `length` bytes at `pData`, continuing from `crc` (the CRC32C of the data before it, or 0)
+	static uint32_t crc32c(uint32_t crc, const void *pData, size_t length);
+
+	// Returns true if `crc32c()` uses the CPU's CRC32C instructions
+	static bool hasHardwareCrc32c();
+
 	// -----------------------------------------------------------------------------------------------------------------------------
 	// A small collection of helper functions for generating various types of GVariants, which are needed when responding to BlueZ
 	// method/property messages. Real services will likley need more of these to support various types of data passed to/from BlueZ,
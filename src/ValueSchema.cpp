@@ -0,0 +1,121 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Declared layouts for characteristic values, used to validate and decode writes
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// A characteristic can declare the layout of the values written to it (see `GattCharacteristic::writeValueSchema()`.) The library
+// then handles WriteValue itself: a write with the wrong length or an out-of-range value is rejected with the matching ATT error
+// before the application hears about it, and a valid write reaches the data setter already decoded:
+//
+//     EUnsigned   the setter receives a pointer to a uint8_t, uint16_t or uint32_t (matching the declared width)
+//     EString     the setter receives a pointer to a null-terminated C string
+//     EFixed      the setter receives a pointer to exactly `size` bytes, laid out as written
+//
+// Integers are little-endian on the wire, as is the Bluetooth convention.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "ValueSchema.h"
+
+namespace ggk {
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Construction
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// An unsigned 8-bit integer within [minValue, maxValue]
+ValueSchema ValueSchema::uint8(uint8_t minValue, uint8_t maxValue)
+{
+	return { EUnsigned, sizeof(uint8_t), minValue, maxValue };
+}
+
+// An unsigned 16-bit integer within [minValue, maxValue]
+ValueSchema ValueSchema::uint16(uint16_t minValue, uint16_t maxValue)
+{
+	return { EUnsigned, sizeof(uint16_t), minValue, maxValue };
+}
+
+// An unsigned 32-bit integer within [minValue, maxValue]
+ValueSchema ValueSchema::uint32(uint32_t minValue, uint32_t maxValue)
+{
+	return { EUnsigned, sizeof(uint32_t), minValue, maxValue };
+}
+
+// A string of at most `maxLength` bytes
+ValueSchema ValueSchema::string(size_t maxLength)
+{
+	return { EString, maxLength, 0, 0 };
+}
+
+// A fixed layout of exactly `size` bytes
+ValueSchema ValueSchema::fixed(size_t size)
+{
+	return { EFixed, size, 0, 0 };
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Validation and decoding
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Validates `length` bytes at `pData` against this schema
+ValueSchema::Result ValueSchema::validate(const uint8_t *pData, size_t length) const
+{
+	switch(kind)
+	{
+		case EUnsigned:
+		{
+			if (length != size) { return EInvalidLength; }
+			uint32_t value = decodeUnsigned(pData);
+			return value < minValue || value > maxValue ? EOutOfRange : EValid;
+		}
+		case EString:
+			return length > size ? EInvalidLength : EValid;
+		case EFixed:
+			return length != size ? EInvalidLength : EValid;
+	}
+
+	return EInvalidLength;
+}
+
+// Decodes an `EUnsigned` value (which must have been validated)
+uint32_t ValueSchema::decodeUnsigned(const uint8_t *pData) const
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		value |= uint32_t(pData[i]) << (8 * i);
+	}
+
+	return value;
+}
+
+// Returns a description of this schema for logging (such as "uint16 [0, 100]")
+std::string ValueSchema::toString() const
+{
+	switch(kind)
+	{
+		case EUnsigned:
+			return "uint" + std::to_string(size * 8) + " [" + std::to_string(minValue) + ", " + std::to_string(maxValue) + "]";
+		case EString:
+			return "string (max " + std::to_string(size) + " bytes)";
+		case EFixed:
+			return "fixed (" + std::to_string(size) + " bytes)";
+	}
+
+	return "unknown";
+}
+
+}; // namespace ggk
@@ -0,0 +1,97 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Declared layouts for characteristic values, used to validate and decode writes
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of ValueSchema.cpp
+//
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace ggk {
+
+struct ValueSchema
+{
+	//
+	// Types
+	//
+
+	// The kinds of values we understand
+	enum Kind
+	{
+		// A little-endian unsigned integer of `size` bytes (1, 2 or 4) within [minValue, maxValue]
+		EUnsigned,
+
+		// A string of at most `size` bytes
+		EString,
+
+		// A fixed layout (such as a packed struct) of exactly `size` bytes
+		EFixed
+	};
+
+	// The result of validating a value
+	enum Result
+	{
+		EValid,
+		EInvalidLength,
+		EOutOfRange
+	};
+
+	//
+	// Construction
+	//
+
+	// An unsigned 8-bit integer within [minValue, maxValue]
+	static ValueSchema uint8(uint8_t minValue = 0, uint8_t maxValue = UINT8_MAX);
+
+	// An unsigned 16-bit integer within [minValue, maxValue]
+	static ValueSchema uint16(uint16_t minValue = 0, uint16_t maxValue = UINT16_MAX);
+
+	// An unsigned 32-bit integer within [minValue, maxValue]
+	static ValueSchema uint32(uint32_t minValue = 0, uint32_t maxValue = UINT32_MAX);
+
+	// A string of at most `maxLength` bytes
+	static ValueSchema string(size_t maxLength);
+
+	// A fixed layout of exactly `size` bytes
+	static ValueSchema fixed(size_t size);
+
+	//
+	// Validation and decoding
+	//
+
+	// Validates `length` bytes at `pData` against this schema
+	Result validate(const uint8_t *pData, size_t length) const;
+
+	// Decodes an `EUnsigned` value (which must have been validated)
+	uint32_t decodeUnsigned(const uint8_t *pData) const;
+
+	// Returns a description of this schema for logging (such as "uint16 [0, 100]")
+	std::string toString() const;
+
+	Kind kind;
+	size_t size;
+	uint32_t minValue;
+	uint32_t maxValue;
+};
+
+}; // namespace ggk
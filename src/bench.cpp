@@ -0,0 +1,1545 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A load generator that drives the server's dispatch and notification paths on a private bus
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Usage: bench [-n <iterations>] [-r <report file>] [-w <workload>[,<workload>...]]
+//
+// The bench needs neither BlueZ nor a Bluetooth adapter. It starts a private D-Bus daemon (via GTestDBus), registers the server's
+// object tree on it with the server's own D-Bus entry points (see Init.h) and then measures:
+//
+//     dispatch   ReadValue and WriteValue calls from a client connection, round-trip, across a mix of characteristics
+//     firmware   a firmware image streamed to a characteristic flagged with `receiveFirmware()` in packets of
+//                `kFirmwarePayloadSize` bytes, without waiting for each one, then verified (see FirmwareReceiver.cpp)
+//     samples    samples appended with `ggkAppendSample()` and read back in batches from a cursor by a client (see
+//                SampleRing.cpp), counted per sample delivered
+//     shards-N   ReadValue calls from one client thread per service, with the services dealt to N dispatch shards (see
+//                DispatchShards.cpp), which shows how dispatch throughput scales across cores
+//     queue      sets of `kQueueBatchSize` updates submitted one at a time (`ggkNofifyUpdatedCharacteristic()`) and drained one
+//                at a time (`ggkPopUpdateQueue()`), counted per update
+//     queue-many the same sets submitted by handle (`ggkNotifyMany()`) and drained (`ggkPopUpdateQueueMany()`) all at once
+//     notify     updates pushed through the update queue and sent as PropertiesChanged signals, as the server's idle loop does
+//     composite  state changes that each touch every value bound by a composite characteristic, announced with
+//                `ggkNotifyUpdatedData()` and coalesced into one notification per change (see CompositeValue.cpp)
+//     emit       change notifications built and emitted through the generic signal path (`DBusObject::emitSignal()`)
+//     template   the same notifications sent from the characteristics' prebuilt templates (see NotificationTemplate.cpp)
+//
+// The results are printed, and with `-r`, written to a report file as "<name> <operations per second>" lines. The `make pgo`
+// flow (see the top-level Makefile.am) uses this both as the training workload and to measure the speedup of the optimized build.
+//
+// It also measures how long a client calling through our owned name goes without an answer while a new server takes over from
+// a running one:
+//
+//     handoff    the new server registers its objects, then replaces the running server as the owner of the name (a hot restart,
+//                see `ggkSetHandoffMode()`)
+//     cold       the running server releases the name and goes away, then the new server connects, registers its objects and
+//                takes the name
+//
+// Both servers live in this process, so the measurement covers the bus side of a restart (connecting, registering objects and
+// moving the name), not BlueZ's side (RegisterApplication.) These are printed only, as they aren't rates.
+//
+// It measures the latency of ReadValue calls while the server's main loop is kept busy (`kMainLoopLoadUS` out of every
+// millisecond), as it would be while ticking events and sending notifications:
+//
+//     read       ReadValue calls dispatched to the main loop
+//     fast-read  the same calls answered on GDBus's worker thread (see FastRead.cpp)
+//
+// These are printed (as the median and 99th percentile) only.
+//
+// It measures long reads of a large text value from a characteristic flagged with `compressedRead()` (see CompressedBlob.cpp), as a
+// central with an ATT MTU of `kAttMtu` would make them:
+//
+//     compressed  the bytes and ATT reads needed to fetch the value compressed, against those needed to fetch it as it is
+//
+// This is also printed only.
+//
+// It measures the bytes on air (ATT notification payloads plus their `kAttNotificationHeader` byte header) of notifications from
+// characteristics flagged with `deltaNotify()` (see DeltaNotification.cpp), each decoded and checked with the reference decoder:
+//
+//     delta-time    a Current Time value (the 10-byte struct built by `ServerUtils::gvariantCurrentTime()`) notified every second
+//     delta-config  a configuration struct of `kDeltaConfigFields` 32-bit fields, of which one or two change per notification
+//
+// These are printed only, against the bytes of the same notifications sent whole.
+//
+// Finally, it measures the time to get running with the server's initialization graph (see InitScheduler.cpp) against the same
+// steps run one after another, as they were before the graph:
+//
+//     init-graph   the steps of `buildInitGraph()` in Init.cpp, each launched as soon as its dependencies have succeeded
+//     init-serial  the same steps, each waiting for the one before it
+//
+// The real steps need BlueZ and an adapter, so these steps only wait out a fixed latency (`kInitStepLatencyMS`) and the adapter
+// lookup fails its first attempt (as it does while BlueZ is still starting.) This measures the scheduling, not the steps
+// themselves; the server logs its own time to running and critical path as it starts. These are also printed only.
+//
+// Every workload produces the same kind of result: a rate if it measures one, whatever else it measures as printed text, and a
+// count of errors. Errors are failed calls, values that didn't decode, transfers that didn't arrive intact and restarts after
+// which the new server doesn't answer. Any error in any workload makes the bench exit with a failure, so a fast but broken build
+// can't pass for a good one.
+//
+// With `-w`, only the named workloads run: dispatch, firmware, samples, shards (all of the shards-N), queue (queue and
+// queue-many), notify, composite, signal (emit and template), read (read and fast-read), compressed, delta (delta-time and
+// delta-config), restart (handoff and cold) and init (init-graph and init-serial.) `make pgo` uses this to train on the paths a
+// running server spends its time on (dispatch and notifications), leaving out the one-off work of restarts, initialization and
+// firmware updates, which would otherwise skew the profile towards code that runs once in a device's day.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+
+#include "../include/Gobbledegook.h"
+#include "DosellGatt.h"
+#include "DBusObjectPath.h"
+#include "GattCharacteristic.h"
+#include "Init.h"
+#include "InitScheduler.h"
+#include "Clock.h"
+#include "FastRead.h"
+#include "DispatchShards.h"
+#include "FirmwareReceiver.h"
+#include "DeltaNotification.h"
+#include "Utils.h"
+
+using namespace ggk;
+
+//
+// Constants
+//
+
+// The service name used for the bench server (our objects live under "/com/<service name>")
+static const char *kServiceName = "bench";
+
+// The default number of iterations of each workload
+static const int kDefaultIterations = 20000;
+
+// How long we wait for each call to complete
+static const int kCallTimeoutMS = 5000;
+
+// How long the client calls through our owned name before and after a restart
+static const int kRestartSettleMS = 100;
+
+// The simulated latency of each initialization step, in the order they are added in Init.cpp's `buildInitGraph()` (bus, objects,
+// adapter lookup, adapter config, owned name, application)
+static const int kInitStepLatencyMS[] = { 5, 15, 10, 60, 10, 30 };
+
+// The initialization steps that need special treatment: the adapter lookup fails its first attempt and the adapter configuration
+// blocks
+static const int kInitLookupStep = 2;
+static const int kInitBlockingStep = 3;
+
+// How long a failed initialization step waits for its retry
+static const int kInitRetryDelayMS = 20;
+
+// Flags for the bus's RequestName method
+static const guint32 kNameFlagAllowReplacement = 0x1;
+static const guint32 kNameFlagReplaceExisting = 0x2;
+
+// The characteristics that we read (relative to our root object)
+static const char *kReadPaths[] =
+{
+	"/device/information/manufacture/name",
+	"/service/1/status",
+	"/service/1/control",
+	"/service/2/name/first",
+	"/service/2/birthday",
+	"/service/2/dispense/daysbeforelastdispensealert",
+};
+
+// The characteristic read by the read latency workloads (it is flagged with `fastRead()`)
+static const char *kFastReadPath = "/device/information/manufacture/name";
+
+// How long the server's main loop stays busy in each millisecond while we measure read latency
+static const int kMainLoopLoadUS = 500;
+
+// The characteristics that we write (these declare a value schema, so writes are validated and decoded)
+static const char *kWritePaths[] =
+{
+	"/service/1/control",
+	"/service/2/birthday",
+};
+
+// The characteristic that receives firmware images (it is flagged with `receiveFirmware()`) and the payload carried by each packet
+// (an ATT MTU of 512, less the ATT header and our own)
+static const char *kFirmwarePath = "/service/1/firmware";
+static const int kFirmwarePayloadSize = 504;
+
+// The characteristic that keeps a ring of samples (it is flagged with `sampleRing()`), and how many samples we append between
+// each catch-up by the client (well within the ring, so none are lost)
+static const char *kSamplesPath = "/service/1/samples";
+static const int kSamplesPerCatchUp = 200;
+
+// The characteristic that serves its value compressed (it is flagged with `compressedRead()`), the number of lines in the log-like
+// text it serves, and the ATT MTU of the central that reads it (each ATT read returns at most MTU - 1 bytes)
+static const char *kCompressedPath = "/service/1/configuration";
+static const int kCompressedLines = 400;
+static const int kAttMtu = 247;
+
+// The services called by the sharded dispatch workloads, each from its own client thread (the first read paths in each service are
+// taken from `kReadPaths`)
+static const char *kShardedServicePaths[] =
+{
+	"/device/information",
+	"/service/1",
+	"/service/2",
+};
+
+// The shard counts measured by the sharded dispatch workloads, and the names of their results
+static const int kShardCounts[] = { 1, 2, 3 };
+static const char *kShardResultNames[] = { "shards-1", "shards-2", "shards-3" };
+
+// The characteristics that we update
+static const char *kNotifyPaths[] =
+{
+	"/service/1/status",
+	"/service/1/control",
+	"/service/1/current/time",
+};
+
+// The number of updates a producer submits at once in the queue workloads (taken round-robin from `kNotifyPaths`)
+static const int kQueueBatchSize = 32;
+
+// The data values bound by the composite characteristic, each of which changes with every state change in the composite workload
+static const char *kCompositeDataNames[] =
+{
+	"status",
+	"control",
+	"dispense/nexttime",
+};
+
+// The size of an ATT notification's header (opcode and handle), the keyframe interval and the number of 32-bit fields in the
+// configuration struct of the delta workloads
+static const int kAttNotificationHeader = 3;
+static const int kDeltaKeyframeInterval = 16;
+static const int kDeltaConfigFields = 16;
+
+// The workloads `-w` selects from, in the order they run
+static const char *kWorkloadNames[] =
+{
+	"dispatch",
+	"firmware",
+	"samples",
+	"shards",
+	"queue",
+	"notify",
+	"composite",
+	"signal",
+	"read",
+	"compressed",
+	"delta",
+	"restart",
+	"init",
+};
+
+//
+// Logging
+//
+
+void LogError(const char *pText) { std::cout << "!!ERROR: " << pText << std::endl; }
+
+//
+// Server data
+//
+
+// Every value is served from a zeroed buffer, which reads as zero for integers and as an empty string for text
+static uint8_t serverData[256];
+
+// The text served by the compressed characteristic (see `benchCompressedRead()`)
+static std::string compressedText;
+
+const void *dataGetter(const char *pName)
+{
+	if (0 == strcmp(pName, "configuration"))
+	{
+		return compressedText.c_str();
+	}
+
+	return serverData;
+}
+
+int dataSetter(const char *pName, const void *pData)
+{
+	(void)pName;
+	(void)pData;
+	return 1;
+}
+
+//
+// Server side
+//
+
+// A server's connection to the private bus and the thread and loop that dispatch its calls
+struct BenchServer
+{
+	GDBusConnection *pConnection = nullptr;
+	GMainLoop *pLoop = nullptr;
+	bool started = false;
+	std::thread thread;
+};
+
+static std::mutex serverMutex;
+static std::condition_variable serverReady;
+
+// Registers each interface of `pNode` (and its children) at `basePath` on `pConnection`, as the server does at startup
+static bool registerNode(GDBusConnection *pConnection, GDBusNodeInfo *pNode, const DBusObjectPath &basePath)
+{
+	static GDBusInterfaceVTable interfaceVtable;
+	interfaceVtable.method_call = onMethodCall;
+	interfaceVtable.get_property = onGetProperty;
+	interfaceVtable.set_property = onSetProperty;
+
+	for (GDBusInterfaceInfo **ppInterface = pNode->interfaces; nullptr != *ppInterface; ++ppInterface)
+	{
+		GError *pError = nullptr;
+		if (0 == g_dbus_connection_register_object(pConnection, basePath.c_str(), *ppInterface, &interfaceVtable, nullptr, nullptr, &pError))
+		{
+			LogError((std::string("Failed to register object: ") + (nullptr == pError ? "Unknown" : pError->message)).c_str());
+			g_clear_error(&pError);
+			return false;
+		}
+	}
+
+	for (GDBusNodeInfo **ppChild = pNode->nodes; nullptr != *ppChild; ++ppChild)
+	{
+		if (!registerNode(pConnection, *ppChild, basePath + (*ppChild)->path))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Runs a server's side of the bench: connects, registers our objects and dispatches calls until the loop is quit
+static void runServer(BenchServer *pServer, std::string address)
+{
+	GMainContext *pContext = g_main_context_new();
+	g_main_context_push_thread_default(pContext);
+
+	GError *pError = nullptr;
+	GDBusConnection *pConnection = g_dbus_connection_new_for_address_sync(address.c_str(),
+		GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+		nullptr, nullptr, &pError);
+
+	bool registered = nullptr != pConnection;
+	for (const DBusObject &object : THESERVER->getObjects())
+	{
+		if (!registered || !object.isPublished())
+		{
+			continue;
+		}
+
+		GDBusNodeInfo *pNode = g_dbus_node_info_new_for_xml(object.generateIntrospectionXML().c_str(), &pError);
+		registered = nullptr != pNode && registerNode(pConnection, pNode, DBusObjectPath(pNode->path));
+		if (nullptr != pNode)
+		{
+			g_dbus_node_info_unref(pNode);
+		}
+	}
+
+	if (!registered)
+	{
+		LogError((std::string("Unable to start the bench server: ") + (nullptr == pError ? "Unknown" : pError->message)).c_str());
+		g_clear_error(&pError);
+	}
+
+	GMainLoop *pLoop = g_main_loop_new(pContext, FALSE);
+	{
+		std::lock_guard<std::mutex> lock(serverMutex);
+		pServer->pConnection = pConnection;
+		pServer->started = registered;
+		pServer->pLoop = pLoop;
+		serverReady.notify_all();
+	}
+
+	if (registered)
+	{
+		g_main_loop_run(pLoop);
+	}
+
+	g_main_context_pop_thread_default(pContext);
+	g_main_context_unref(pContext);
+}
+
+// Starts `server` on its own thread, returning once it has registered our objects (true) or failed to (false)
+static bool startServer(BenchServer &server, const std::string &address)
+{
+	server.thread = std::thread(runServer, &server, address);
+
+	std::unique_lock<std::mutex> lock(serverMutex);
+	serverReady.wait(lock, [&server]() { return nullptr != server.pLoop; });
+	return server.started;
+}
+
+// Stops `server` and closes its connection (which releases any name it owns)
+static void stopServer(BenchServer &server)
+{
+	// Quit the server's loop from within the loop, in case it hasn't started running yet
+	GSource *pQuit = g_idle_source_new();
+	g_source_set_callback(pQuit, [](gpointer pLoop) -> gboolean
+	{
+		g_main_loop_quit(static_cast<GMainLoop *>(pLoop));
+		return FALSE;
+	}, server.pLoop, nullptr);
+	g_source_attach(pQuit, g_main_loop_get_context(server.pLoop));
+	g_source_unref(pQuit);
+
+	server.thread.join();
+	g_main_loop_unref(server.pLoop);
+	server.pLoop = nullptr;
+
+	if (nullptr != server.pConnection)
+	{
+		g_dbus_connection_close_sync(server.pConnection, nullptr, nullptr);
+		g_object_unref(server.pConnection);
+		server.pConnection = nullptr;
+	}
+}
+
+//
+// Workloads
+//
+
+// The result of a workload
+//
+// A workload that measures a rate counts its `operations` in `seconds`; anything else it measures goes into `detail`, which is
+// printed only. Any `errors` fail the bench.
+struct Result
+{
+	const char *pName;
+	int operations;
+	int errors;
+	double seconds;
+	std::string detail;
+};
+
+// Calls `pMethod` on the characteristic at `path` and waits for the reply, returning true on success
+static bool call(GDBusConnection *pConnection, const char *pDestination, const std::string &path, const char *pMethod, GVariant *pParameters)
+{
+	GError *pError = nullptr;
+	GVariant *pResult = g_dbus_connection_call_sync(pConnection, pDestination, path.c_str(), "org.bluez.GattCharacteristic1",
+		pMethod, pParameters, nullptr, G_DBUS_CALL_FLAGS_NONE, kCallTimeoutMS, nullptr, &pError);
+
+	if (nullptr == pResult)
+	{
+		g_clear_error(&pError);
+		return false;
+	}
+
+	g_variant_unref(pResult);
+	return true;
+}
+
+// Measures round-trip ReadValue and WriteValue calls
+static Result benchDispatch(GDBusConnection *pClient, GDBusConnection *pServerConnection, const std::string &root, int iterations)
+{
+	const char *pDestination = g_dbus_connection_get_unique_name(pServerConnection);
+	const size_t readCount = sizeof(kReadPaths) / sizeof(kReadPaths[0]);
+	const size_t writeCount = sizeof(kWritePaths) / sizeof(kWritePaths[0]);
+	const uint8_t value[4] = { 0x01, 0x00, 0x00, 0x00 };
+
+	Result result = { "dispatch", 0, 0, 0.0, "" };
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		bool success;
+
+		// One write for every four reads
+		if (i % 5 == 4)
+		{
+			std::string path = root + kWritePaths[i % writeCount];
+			size_t size = path.find("control") != std::string::npos ? 2 : 4;
+			GVariant *pValue = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, value, size, sizeof(uint8_t));
+			success = call(pClient, pDestination, path, "WriteValue", g_variant_new("(@aya{sv})", pValue, nullptr));
+		}
+		else
+		{
+			success = call(pClient, pDestination, root + kReadPaths[i % readCount], "ReadValue", g_variant_new("(a{sv})", nullptr));
+		}
+
+		result.operations += 1;
+		result.errors += success ? 0 : 1;
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Writes `pData` (`length` bytes) to the characteristic at `path`, waiting for the reply only if `wait` is set
+static bool writeFirmware(GDBusConnection *pConnection, const char *pDestination, const std::string &path, const uint8_t *pData,
+	size_t length, bool wait)
+{
+	GVariant *pValue = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, pData, length, sizeof(uint8_t));
+	GVariant *pParameters = g_variant_new("(@aya{sv})", pValue, nullptr);
+	if (wait)
+	{
+		return call(pConnection, pDestination, path, "WriteValue", pParameters);
+	}
+
+	// Like a write without response, the central doesn't wait for each packet
+	g_dbus_connection_call(pConnection, pDestination, path.c_str(), "org.bluez.GattCharacteristic1", "WriteValue", pParameters,
+		nullptr, G_DBUS_CALL_FLAGS_NONE, kCallTimeoutMS, nullptr, nullptr, nullptr);
+	return true;
+}
+
+// Measures the sustained receive rate of a firmware image of `iterations` packets, sent without waiting for each packet
+//
+// The image is received into a temporary directory. Calls from our client are dispatched in order, so once the Finish write
+// returns, every packet has been received and the image verified.
+static Result benchFirmware(GDBusConnection *pClient, GDBusConnection *pServerConnection, const std::string &root, int iterations)
+{
+	const char *pDestination = g_dbus_connection_get_unique_name(pServerConnection);
+	std::string path = root + kFirmwarePath;
+
+	Result result = { "firmware", 0, 0, 0.0, "" };
+
+	gchar *pDirectory = g_dir_make_tmp("ggk-bench-XXXXXX", nullptr);
+	if (nullptr == pDirectory)
+	{
+		result.errors = 1;
+		return result;
+	}
+	FirmwareReceiver::setDirectory(pDirectory);
+
+	// A deterministic image
+	std::vector<uint8_t> image(size_t(iterations) * kFirmwarePayloadSize);
+	for (size_t i = 0; i < image.size(); ++i)
+	{
+		image[i] = uint8_t(i * 31 + (i >> 11));
+	}
+	uint32_t crc = Utils::crc32c(0, image.data(), image.size());
+
+	std::vector<uint8_t> packet(5 + kFirmwarePayloadSize);
+	packet[0] = FirmwareReceiver::EOpStart;
+	for (int i = 0; i < 4; ++i)
+	{
+		packet[1 + i] = uint8_t(image.size() >> (8 * i));
+		packet[5 + i] = uint8_t(crc >> (8 * i));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	bool success = writeFirmware(pClient, pDestination, path, packet.data(), 9, true);
+	for (int i = 0; success && i < iterations; ++i)
+	{
+		uint32_t offset = uint32_t(i) * kFirmwarePayloadSize;
+		packet[0] = FirmwareReceiver::EOpData;
+		for (int byte = 0; byte < 4; ++byte)
+		{
+			packet[1 + byte] = uint8_t(offset >> (8 * byte));
+		}
+		std::copy(image.begin() + offset, image.begin() + offset + kFirmwarePayloadSize, packet.begin() + 5);
+
+		writeFirmware(pClient, pDestination, path, packet.data(), packet.size(), false);
+		result.operations += 1;
+	}
+
+	packet[0] = FirmwareReceiver::EOpFinish;
+	success = success && writeFirmware(pClient, pDestination, path, packet.data(), 1, true);
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// The image only exists if it arrived intact
+	std::string imagePath = std::string(pDirectory) + "/firmware.bin";
+	struct stat info;
+	if (!success || 0 != stat(imagePath.c_str(), &info) || size_t(info.st_size) != image.size())
+	{
+		result.errors = 1;
+	}
+
+	unlink(imagePath.c_str());
+	rmdir(pDirectory);
+	g_free(pDirectory);
+	return result;
+}
+
+// Measures samples appended to a sample ring and read back by a client, which catches up in batches from its cursor
+static Result benchSamples(GDBusConnection *pClient, GDBusConnection *pServerConnection, const std::string &root, int iterations)
+{
+	const char *pDestination = g_dbus_connection_get_unique_name(pServerConnection);
+	std::string path = root + kSamplesPath;
+	int handle = ggkGetCharacteristicHandle(path.c_str());
+	const int kQueueEntryLen = 1024;
+	char queueEntry[kQueueEntryLen];
+
+	Result result = { "samples", 0, 0, 0.0, "" };
+
+	// Start the client's cursor at the first sample we append
+	uint32_t sequence = 0;
+	GVariant *pCursor = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, &sequence, sizeof(sequence), sizeof(uint8_t));
+	if (handle < 0 || !call(pClient, pDestination, path, "WriteValue", g_variant_new("(@aya{sv})", pCursor, nullptr)))
+	{
+		result.errors = 1;
+		return result;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	int appended = 0;
+	while (appended < iterations && 0 == result.errors)
+	{
+		for (int i = 0; i < kSamplesPerCatchUp && appended < iterations; ++i, ++appended)
+		{
+			uint32_t sample = uint32_t(appended);
+			result.errors += ggkAppendSample(handle, int64_t(appended) * 10, &sample, sizeof(sample)) ? 0 : 1;
+		}
+
+		// Nobody is subscribed, so the updates queued for batches of notifications can go
+		while (ggkPopUpdateQueue(queueEntry, kQueueEntryLen, 0) == 1)
+		{
+		}
+
+		// Read until a batch comes back empty
+		for (;;)
+		{
+			GError *pError = nullptr;
+			GVariant *pResult = g_dbus_connection_call_sync(pClient, pDestination, path.c_str(), "org.bluez.GattCharacteristic1",
+				"ReadValue", g_variant_new("(a{sv})", nullptr), G_VARIANT_TYPE("(ay)"), G_DBUS_CALL_FLAGS_NONE, kCallTimeoutMS,
+				nullptr, &pError);
+			if (nullptr == pResult)
+			{
+				g_clear_error(&pError);
+				result.errors += 1;
+				break;
+			}
+
+			GVariant *pBytes = g_variant_get_child_value(pResult, 0);
+			gsize length = 0;
+			const uint8_t *pBatch = static_cast<const uint8_t *>(g_variant_get_fixed_array(pBytes, &length, sizeof(uint8_t)));
+			int count = length >= SampleRing::kHeaderSize ? pBatch[sizeof(uint32_t)] : 0;
+			g_variant_unref(pBytes);
+			g_variant_unref(pResult);
+
+			if (0 == count)
+			{
+				break;
+			}
+			result.operations += count;
+		}
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Every sample should have been delivered exactly once
+	result.errors += result.operations == iterations ? 0 : 1;
+	return result;
+}
+
+// Measures ReadValue calls from one client thread per service in `kShardedServicePaths`, with our services dealt to the dispatch
+// shards as `kShardCounts[shardIndex]` (see DispatchShards.cpp)
+static Result benchShards(const std::string &address, GDBusConnection *pServerConnection, const std::string &root, int iterations, int shardIndex)
+{
+	const size_t serviceCount = sizeof(kShardedServicePaths) / sizeof(kShardedServicePaths[0]);
+	const size_t readCount = sizeof(kReadPaths) / sizeof(kReadPaths[0]);
+
+	Result result = { kShardResultNames[shardIndex], 0, 0, 0.0, "" };
+
+	// Our bench server's connection stands in for the server's own (shard 0)
+	DispatchShards::setShardCount(kShardCounts[shardIndex]);
+	DispatchShards::assign();
+	DispatchShards::start(address, "", nullptr);
+
+	// Each client calls the connection that dispatches its service, with its own connection to the bus
+	std::vector<GDBusConnection *> clients(serviceCount, nullptr);
+	std::vector<std::string> destinations(serviceCount);
+	std::vector<std::vector<std::string>> paths(serviceCount);
+	for (size_t s = 0; s < serviceCount; ++s)
+	{
+		GError *pError = nullptr;
+		clients[s] = g_dbus_connection_new_for_address_sync(address.c_str(),
+			GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+			nullptr, nullptr, &pError);
+		g_clear_error(&pError);
+
+		int shard = DispatchShards::getShard(DBusObjectPath(root + kShardedServicePaths[s]));
+		destinations[s] = shard > 0 ? DispatchShards::getUniqueName(shard) : g_dbus_connection_get_unique_name(pServerConnection);
+
+		for (size_t i = 0; i < readCount; ++i)
+		{
+			if (std::string(kReadPaths[i]).find(std::string(kShardedServicePaths[s]) + "/") == 0)
+			{
+				paths[s].push_back(root + kReadPaths[i]);
+			}
+		}
+	}
+
+	std::vector<int> errors(serviceCount, 0);
+	std::vector<std::thread> threads;
+	int callsPerClient = std::max(1, iterations / static_cast<int>(serviceCount));
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t s = 0; s < serviceCount; ++s)
+	{
+		threads.push_back(std::thread([&, s]()
+		{
+			for (int i = 0; i < callsPerClient; ++i)
+			{
+				bool success = nullptr != clients[s] && !destinations[s].empty() && call(clients[s], destinations[s].c_str(),
+					paths[s][i % paths[s].size()], "ReadValue", g_variant_new("(a{sv})", nullptr));
+				errors[s] += success ? 0 : 1;
+			}
+		}));
+	}
+
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (size_t s = 0; s < serviceCount; ++s)
+	{
+		result.operations += callsPerClient;
+		result.errors += errors[s];
+		if (nullptr != clients[s])
+		{
+			g_object_unref(clients[s]);
+		}
+	}
+
+	// Back to a single dispatch thread for the workloads that follow
+	DispatchShards::stop();
+	DispatchShards::setShardCount(1);
+	DispatchShards::assign();
+
+	return result;
+}
+
+// Measures sets of updates submitted to the update queue and drained from it, either one at a time or all at once
+static Result benchQueue(const std::string &root, int iterations, bool many)
+{
+	const size_t notifyCount = sizeof(kNotifyPaths) / sizeof(kNotifyPaths[0]);
+	const int kQueueEntryLen = 1024;
+	std::vector<char> queueEntries(kQueueEntryLen * kQueueBatchSize);
+
+	std::vector<std::string> paths;
+	std::vector<int> handles;
+	for (int i = 0; i < kQueueBatchSize; ++i)
+	{
+		paths.push_back(root + kNotifyPaths[i % notifyCount]);
+		handles.push_back(ggkGetCharacteristicHandle(paths.back().c_str()));
+	}
+
+	Result result = { many ? "queue-many" : "queue", 0, 0, 0.0, "" };
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations / kQueueBatchSize + 1; ++i)
+	{
+		int drained = 0;
+		if (many)
+		{
+			ggkNotifyMany(handles.data(), handles.size());
+
+			int popped;
+			while ((popped = ggkPopUpdateQueueMany(queueEntries.data(), int(queueEntries.size()), kQueueBatchSize)) > 0)
+			{
+				drained += popped;
+			}
+		}
+		else
+		{
+			for (const std::string &path : paths)
+			{
+				ggkNofifyUpdatedCharacteristic(path.c_str());
+			}
+
+			while (ggkPopUpdateQueue(queueEntries.data(), kQueueEntryLen, 0) == 1)
+			{
+				drained += 1;
+			}
+		}
+
+		result.operations += drained;
+		result.errors += kQueueBatchSize == drained ? 0 : 1;
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Measures updates through the update queue, sent as PropertiesChanged signals
+static Result benchNotify(GDBusConnection *pServerConnection, const std::string &root, int iterations)
+{
+	const size_t notifyCount = sizeof(kNotifyPaths) / sizeof(kNotifyPaths[0]);
+	const int kQueueEntryLen = 1024;
+	char queueEntry[kQueueEntryLen];
+
+	Result result = { "notify", 0, 0, 0.0, "" };
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		ggkNofifyUpdatedCharacteristic((root + kNotifyPaths[i % notifyCount]).c_str());
+
+		// Drain the queue as the server's idle loop would
+		while (ggkPopUpdateQueue(queueEntry, kQueueEntryLen, 0) == 1)
+		{
+			std::string entryString = queueEntry;
+			size_t token = entryString.find('|');
+			std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(DBusObjectPath(entryString.substr(0, token)), entryString.substr(token + 1));
+			std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+			bool success = nullptr != pCharacteristic && pCharacteristic->callOnUpdatedValue(pServerConnection, nullptr);
+
+			result.operations += 1;
+			result.errors += success ? 0 : 1;
+		}
+	}
+
+	// The signals are sent asynchronously, so they only count once they're out the door
+	g_dbus_connection_flush_sync(pServerConnection, nullptr, nullptr);
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Measures state changes that touch every value bound by a composite characteristic, each announced separately and coalesced
+// into a single notification
+static Result benchComposite(GDBusConnection *pServerConnection, int iterations)
+{
+	const size_t nameCount = sizeof(kCompositeDataNames) / sizeof(kCompositeDataNames[0]);
+	const int kQueueEntryLen = 1024;
+	char queueEntry[kQueueEntryLen];
+
+	Result result = { "composite", 0, 0, 0.0, "" };
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (size_t name = 0; name < nameCount; ++name)
+		{
+			ggkNotifyUpdatedData(kCompositeDataNames[name]);
+		}
+
+		// Drain the queue as the server's idle loop would, which should find a single update
+		int updates = 0;
+		while (ggkPopUpdateQueue(queueEntry, kQueueEntryLen, 0) == 1)
+		{
+			std::string entryString = queueEntry;
+			size_t token = entryString.find('|');
+			std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(DBusObjectPath(entryString.substr(0, token)), entryString.substr(token + 1));
+			std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+			if (nullptr != pCharacteristic && pCharacteristic->callOnUpdatedValue(pServerConnection, nullptr))
+			{
+				updates += 1;
+			}
+		}
+
+		result.operations += 1;
+		result.errors += 1 == updates ? 0 : 1;
+	}
+
+	// The signals are sent asynchronously, so they only count once they're out the door
+	g_dbus_connection_flush_sync(pServerConnection, nullptr, nullptr);
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Sends change notifications with a 20-byte value directly, from the characteristics' templates if `useTemplate` is set, or else
+// built and emitted as the generic signal path does
+static Result benchSignal(GDBusConnection *pServerConnection, const std::string &root, int iterations, bool useTemplate)
+{
+	const size_t notifyCount = sizeof(kNotifyPaths) / sizeof(kNotifyPaths[0]);
+	const size_t kValueLen = 20;
+	uint8_t value[kValueLen] = { 0 };
+
+	std::vector<std::shared_ptr<const GattCharacteristic>> characteristics;
+	for (size_t i = 0; i < notifyCount; ++i)
+	{
+		std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(DBusObjectPath(root + kNotifyPaths[i]), "org.bluez.GattCharacteristic1");
+		characteristics.push_back(nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic));
+	}
+
+	Result result = { useTemplate ? "template" : "emit", 0, 0, 0.0, "" };
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		const std::shared_ptr<const GattCharacteristic> &pCharacteristic = characteristics[i % notifyCount];
+		result.operations += 1;
+		if (nullptr == pCharacteristic)
+		{
+			result.errors += 1;
+			continue;
+		}
+
+		value[0] = static_cast<uint8_t>(i);
+		GVariant *pValue = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, value, kValueLen, 1);
+
+		if (useTemplate)
+		{
+			pCharacteristic->sendChangeNotificationVariant(pServerConnection, pValue);
+			continue;
+		}
+
+		g_auto(GVariantBuilder) builder;
+		g_variant_builder_init(&builder, G_VARIANT_TYPE_ARRAY);
+		g_variant_builder_add(&builder, "{sv}", "Value", pValue);
+		GVariant *pSasv = g_variant_new("(sa{sv})", "org.bluez.GattCharacteristic1", &builder);
+		if (!g_dbus_connection_emit_signal(pServerConnection, nullptr, pCharacteristic->getPath().toString().c_str(),
+			"org.freedesktop.DBus.Properties", "PropertiesChanged", pSasv, nullptr))
+		{
+			result.errors += 1;
+		}
+	}
+
+	// The signals are sent asynchronously, so they only count once they're out the door
+	g_dbus_connection_flush_sync(pServerConnection, nullptr, nullptr);
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Keeps the server's main loop busy for `kMainLoopLoadUS` of every millisecond
+static gboolean onMainLoopLoad(gpointer)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(kMainLoopLoadUS);
+	while (std::chrono::steady_clock::now() < end)
+	{
+	}
+
+	return TRUE;
+}
+
+// Measures the latency of ReadValue calls to `kFastReadPath` while the server's main loop is busy, with or without the fast path
+static Result benchReadLatency(GDBusConnection *pClient, BenchServer &server, const std::string &root, int iterations, bool fast)
+{
+	const char *pDestination = g_dbus_connection_get_unique_name(server.pConnection);
+	std::string path = root + kFastReadPath;
+	int calls = std::max(100, iterations / 20);
+
+	if (fast)
+	{
+		FastRead::install(server.pConnection);
+	}
+
+	// The first read goes through the main loop, which takes the snapshot for the fast path
+	call(pClient, pDestination, path, "ReadValue", g_variant_new("(a{sv})", nullptr));
+
+	GSource *pLoad = g_timeout_source_new(1);
+	g_source_set_callback(pLoad, onMainLoopLoad, nullptr, nullptr);
+	g_source_attach(pLoad, g_main_loop_get_context(server.pLoop));
+
+	Result result = { fast ? "fast-read" : "read", 0, 0, 0.0, "" };
+	std::vector<int64_t> latenciesUS;
+	for (int i = 0; i < calls; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		bool success = call(pClient, pDestination, path, "ReadValue", g_variant_new("(a{sv})", nullptr));
+		latenciesUS.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+		result.errors += success ? 0 : 1;
+	}
+
+	g_source_destroy(pLoad);
+	g_source_unref(pLoad);
+
+	if (fast)
+	{
+		FastRead::uninstall(server.pConnection);
+	}
+
+	std::sort(latenciesUS.begin(), latenciesUS.end());
+	std::ostringstream detail;
+	detail << "latency under load: median " << latenciesUS[latenciesUS.size() / 2] << "us, p99 "
+		<< latenciesUS[latenciesUS.size() * 99 / 100] << "us over " << calls << " calls";
+	result.detail = detail.str();
+	return result;
+}
+
+// Fetches the characteristic at `path` with long reads of at most `kAttMtu` - 1 bytes each, as a central would, into `value`
+//
+// Returns the number of ATT reads it took, or -1 if a read failed.
+static int longRead(GDBusConnection *pClient, const char *pDestination, const std::string &path, std::vector<uint8_t> &value)
+{
+	const size_t kReadSize = kAttMtu - 1;
+
+	value.clear();
+	for (int reads = 1;; ++reads)
+	{
+		GVariantBuilder options;
+		g_variant_builder_init(&options, G_VARIANT_TYPE("a{sv}"));
+		g_variant_builder_add(&options, "{sv}", "offset", g_variant_new_uint16(guint16(value.size())));
+
+		GError *pError = nullptr;
+		GVariant *pResult = g_dbus_connection_call_sync(pClient, pDestination, path.c_str(), "org.bluez.GattCharacteristic1",
+			"ReadValue", g_variant_new("(a{sv})", &options), G_VARIANT_TYPE("(ay)"), G_DBUS_CALL_FLAGS_NONE, kCallTimeoutMS,
+			nullptr, &pError);
+		if (nullptr == pResult)
+		{
+			g_clear_error(&pError);
+			return -1;
+		}
+
+		// BlueZ returns at most an MTU's worth of what we answer; the central reads on while the reads come back full
+		GVariant *pBytes = g_variant_get_child_value(pResult, 0);
+		gsize length = 0;
+		const uint8_t *pData = static_cast<const uint8_t *>(g_variant_get_fixed_array(pBytes, &length, sizeof(uint8_t)));
+		size_t taken = std::min(size_t(length), kReadSize);
+		value.insert(value.end(), pData, pData + taken);
+		g_variant_unref(pBytes);
+		g_variant_unref(pResult);
+
+		if (taken < kReadSize)
+		{
+			return reads;
+		}
+	}
+}
+
+// Measures long reads of a large text value from a characteristic flagged with `compressedRead()`, decoding each as a central
+// would, against the reads the same value would take uncompressed
+static Result benchCompressedRead(GDBusConnection *pClient, GDBusConnection *pServerConnection, const std::string &root, int iterations)
+{
+	const char *pDestination = g_dbus_connection_get_unique_name(pServerConnection);
+	std::string path = root + kCompressedPath;
+
+	// Log-like text, which repeats itself the way logs and configuration dumps do
+	compressedText.clear();
+	for (int line = 0; line < kCompressedLines; ++line)
+	{
+		compressedText += "2026-10-18T08:" + std::to_string(10 + line / 60) + ":" + std::to_string(10 + line % 50) + "Z dispense slot="
+			+ std::to_string(line % 7) + " status=" + (line % 13 ? "ok" : "uncollected") + " battery=" + std::to_string(90 - line / 10)
+			+ "\n";
+	}
+
+	Result result = { "compressed", 0, 0, 0.0, "" };
+	int plainReads = int(compressedText.size() / (kAttMtu - 1)) + 1;
+
+	std::shared_ptr<const DBusInterface> pInterface = THESERVER->findInterface(DBusObjectPath(path), "org.bluez.GattCharacteristic1");
+	std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+	if (nullptr == pCharacteristic || nullptr == pCharacteristic->getCompressedBlob())
+	{
+		result.errors = 1;
+		return result;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint8_t> value;
+	int transfers = 0;
+	int reads = 0;
+	for (int i = 0; i < std::max(iterations / 100, 1); ++i)
+	{
+		reads = longRead(pClient, pDestination, path, value);
+		transfers += 1;
+
+		// Decode the value: [u8 method][u32 original size][encoded value]
+		bool decoded = false;
+		if (reads > 0 && value.size() >= CompressedBlob::kHeaderSize)
+		{
+			size_t originalSize = size_t(value[1]) | size_t(value[2]) << 8 | size_t(value[3]) << 16 | size_t(value[4]) << 24;
+			CompressedBlob::Buffer original(originalSize);
+			if (CompressedBlob::EMethodLz4 == value[0])
+			{
+				decoded = CompressedBlob::decompress(value.data() + CompressedBlob::kHeaderSize,
+					value.size() - CompressedBlob::kHeaderSize, original);
+			}
+			else
+			{
+				decoded = value.size() - CompressedBlob::kHeaderSize == originalSize;
+				std::copy(value.begin() + CompressedBlob::kHeaderSize, value.end(), original.begin());
+			}
+			decoded = decoded && 0 == memcmp(original.data(), compressedText.data(), originalSize)
+				&& originalSize == compressedText.size();
+		}
+
+		result.errors += decoded ? 0 : 1;
+	}
+
+	int64_t transferUS = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+		/ transfers;
+
+	std::ostringstream detail;
+	detail << value.size() << " bytes in " << reads << " ATT reads (uncompressed: " << compressedText.size() << " bytes in "
+		<< plainReads << "), " << transferUS << "us per transfer, " << pCharacteristic->getCompressedBlob()->getEncodeCount()
+		<< " encoding(s) for " << transfers << " transfers";
+	result.detail = detail.str();
+	return result;
+}
+
+// Delta-encodes the notifications of `values` (laid out as `fieldSizes`), decoding each with the reference decoder as a central
+// would and checking it against the value sent
+static Result benchDelta(const char *pName, const std::vector<size_t> &fieldSizes, const std::vector<std::vector<uint8_t>> &values)
+{
+	Result result = { pName, 0, 0, 0.0, "" };
+	int notifications = 0;
+	size_t plainBytes = 0;
+	size_t bytes = 0;
+	int keyframes = 0;
+
+	DeltaEncoder encoder(fieldSizes, kDeltaKeyframeInterval);
+	DeltaDecoder decoder(fieldSizes);
+	DeltaBuffer encoded;
+	for (const std::vector<uint8_t> &value : values)
+	{
+		encoder.encode(value.data(), value.size(), encoded);
+
+		DeltaDecoder::Result applied = decoder.apply(encoded.data(), encoded.size());
+		bool decoded = (DeltaDecoder::EKeyframe == applied || DeltaDecoder::EDelta == applied)
+			&& decoder.getValue().size() == value.size() && 0 == memcmp(decoder.getValue().data(), value.data(), value.size());
+
+		notifications += 1;
+		plainBytes += kAttNotificationHeader + value.size();
+		bytes += kAttNotificationHeader + encoded.size();
+		keyframes += DeltaDecoder::EKeyframe == applied ? 1 : 0;
+		result.errors += decoded ? 0 : 1;
+	}
+
+	std::ostringstream detail;
+	detail << std::fixed << std::setprecision(1) << bytes << " bytes on air for " << notifications << " notifications (sent whole: "
+		<< plainBytes << " bytes, " << 100.0 * bytes / plainBytes << "%), " << keyframes << " keyframes";
+	result.detail = detail.str();
+	return result;
+}
+
+// Measures Current Time notifications sent every second, as deltas
+static Result benchDeltaTime(int iterations)
+{
+	// [u16 year][u8 month][u8 day][u8 hours][u8 minutes][u8 seconds][u8 weekday][u8 fractions][u8 adjust reason]
+	std::vector<size_t> fieldSizes = { 2, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+	std::vector<std::vector<uint8_t>> values;
+	time_t timeValue = 1792310400;
+	for (int i = 0; i < iterations; ++i, ++timeValue)
+	{
+		struct tm timeStruct;
+		gmtime_r(&timeValue, &timeStruct);
+		int year = timeStruct.tm_year + 1900;
+		values.push_back({ uint8_t(year), uint8_t(year >> 8), uint8_t(timeStruct.tm_mon + 1), uint8_t(timeStruct.tm_mday),
+			uint8_t(timeStruct.tm_hour), uint8_t(timeStruct.tm_min), uint8_t(timeStruct.tm_sec),
+			uint8_t(0 == timeStruct.tm_wday ? 7 : timeStruct.tm_wday), 0, 0 });
+	}
+
+	return benchDelta("delta-time", fieldSizes, values);
+}
+
+// Measures notifications of a configuration struct in which one field, and sometimes two, change each time, as deltas
+static Result benchDeltaConfig(int iterations)
+{
+	std::vector<size_t> fieldSizes(kDeltaConfigFields, sizeof(uint32_t));
+
+	std::vector<std::vector<uint8_t>> values;
+	std::vector<uint8_t> value(kDeltaConfigFields * sizeof(uint32_t), 0);
+	uint32_t random = 1;
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (int change = 0; change < (i % 4 ? 1 : 2); ++change)
+		{
+			random = random * 1103515245 + 12345;
+			uint32_t field = (random >> 16) % kDeltaConfigFields;
+			uint32_t fieldValue = random ^ uint32_t(i);
+			memcpy(value.data() + field * sizeof(uint32_t), &fieldValue, sizeof(fieldValue));
+		}
+		values.push_back(value);
+	}
+
+	return benchDelta("delta-config", fieldSizes, values);
+}
+
+// A simulated initialization step that is in flight
+struct PendingStep
+{
+	int step;
+	int64_t dueMS;
+};
+
+static std::vector<PendingStep> pendingSteps;
+static bool initLookupFailed = false;
+
+// Launches a simulated initialization step, which completes after its latency (see `kInitStepLatencyMS`)
+static void launchSimulatedStep(InitScheduler &scheduler, int step)
+{
+	if (step == kInitBlockingStep)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(kInitStepLatencyMS[step]));
+		scheduler.succeed(step);
+		return;
+	}
+
+	pendingSteps.push_back({ step, Clock::getInstance().nowMS() + kInitStepLatencyMS[step] });
+}
+
+// Runs the simulated initialization steps to completion, either with the server's graph or one after another
+static Result benchInit(bool graph)
+{
+	InitScheduler scheduler(kInitRetryDelayMS);
+	if (graph)
+	{
+		int bus = scheduler.addStep("bus", launchSimulatedStep, {});
+		int objects = scheduler.addStep("objects", launchSimulatedStep, { bus });
+		int lookup = scheduler.addStep("adapter lookup", launchSimulatedStep, { bus });
+		int config = scheduler.addStep("adapter config", launchSimulatedStep, {}, true);
+		int name = scheduler.addStep("owned name", launchSimulatedStep, { bus });
+		scheduler.addStep("application", launchSimulatedStep, { objects, lookup, config, name });
+	}
+	else
+	{
+		// The old order: bus, owned name, adapter lookup, adapter config, objects, application
+		scheduler.addStep("bus", launchSimulatedStep, {});
+		scheduler.addStep("objects", launchSimulatedStep, { 3 });                     // after the adapter config
+		scheduler.addStep("adapter lookup", launchSimulatedStep, { 4 });              // after the owned name
+		scheduler.addStep("adapter config", launchSimulatedStep, { 2 }, true);        // after the adapter lookup
+		scheduler.addStep("owned name", launchSimulatedStep, { 0 });                  // after the bus
+		scheduler.addStep("application", launchSimulatedStep, { 1 });                 // after the objects
+	}
+
+	pendingSteps.clear();
+	initLookupFailed = false;
+
+	scheduler.start();
+	scheduler.run();
+	while (!scheduler.isComplete())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		// Complete the steps that are due
+		int64_t nowMS = Clock::getInstance().nowMS();
+		for (size_t i = 0; i < pendingSteps.size();)
+		{
+			if (pendingSteps[i].dueMS > nowMS)
+			{
+				++i;
+				continue;
+			}
+
+			int step = pendingSteps[i].step;
+			pendingSteps.erase(pendingSteps.begin() + i);
+			if (step == kInitLookupStep && !initLookupFailed)
+			{
+				initLookupFailed = true;
+				scheduler.fail(step);
+			}
+			else
+			{
+				scheduler.succeed(step);
+			}
+		}
+
+		scheduler.tick();
+		scheduler.run();
+	}
+
+	Result result = { graph ? "init-graph" : "init-serial", 0, 0, 0.0, "" };
+	result.detail = "time to running: " + std::to_string(scheduler.getElapsedMS()) + "ms (" + scheduler.describeCriticalPath() + ")";
+	return result;
+}
+
+// Requests (or releases, if `release` is set) `name` for `pConnection`, returning true on success
+static bool requestName(GDBusConnection *pConnection, const std::string &name, guint32 flags, bool release = false)
+{
+	GError *pError = nullptr;
+	GVariant *pResult = g_dbus_connection_call_sync(pConnection, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+		release ? "ReleaseName" : "RequestName", release ? g_variant_new("(s)", name.c_str()) : g_variant_new("(su)", name.c_str(), flags),
+		nullptr, G_DBUS_CALL_FLAGS_NONE, kCallTimeoutMS, nullptr, &pError);
+
+	if (nullptr == pResult)
+	{
+		LogError((std::string("Unable to request name: ") + (nullptr == pError ? "Unknown" : pError->message)).c_str());
+		g_clear_error(&pError);
+		return false;
+	}
+
+	g_variant_unref(pResult);
+	return true;
+}
+
+// Measures the longest time a client calling through our owned name goes without an answer while a new server takes over from
+// a running one, by handoff (`handoff`) or by a cold restart
+//
+// Calls that go unanswered while the name moves are what this measures, so they are counted but aren't errors. The restart
+// fails if a server can't start or take the name, or if the new server doesn't answer once it has.
+static Result benchRestart(GDBusConnection *pClient, const std::string &address, const std::string &root, bool handoff)
+{
+	Result result = { handoff ? "handoff" : "cold", 0, 0, 0.0, "" };
+	int64_t longestGapUS = 0;
+	int calls = 0;
+	int unanswered = 0;
+	std::string ownedName = THESERVER->getOwnedName();
+	std::string path = root + kReadPaths[0];
+
+	BenchServer oldServer;
+	if (!startServer(oldServer, address) || !requestName(oldServer.pConnection, ownedName, kNameFlagAllowReplacement))
+	{
+		stopServer(oldServer);
+		result.errors = 1;
+		return result;
+	}
+
+	// Call through the owned name until told to stop, tracking the longest time between answers
+	std::atomic<bool> stop(false);
+	std::thread client([&]()
+	{
+		auto lastAnswer = std::chrono::steady_clock::now();
+		while (!stop)
+		{
+			bool success = call(pClient, ownedName.c_str(), path, "ReadValue", g_variant_new("(a{sv})", nullptr));
+			auto now = std::chrono::steady_clock::now();
+
+			calls += 1;
+			if (success)
+			{
+				longestGapUS = std::max(longestGapUS, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - lastAnswer).count()));
+				lastAnswer = now;
+			}
+			else
+			{
+				unanswered += 1;
+			}
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(kRestartSettleMS));
+
+	BenchServer newServer;
+	bool restarted = false;
+	if (handoff)
+	{
+		// The new server gets ready, then takes the name; the old one goes away afterwards
+		restarted = startServer(newServer, address)
+			&& requestName(newServer.pConnection, ownedName, kNameFlagAllowReplacement | kNameFlagReplaceExisting);
+		stopServer(oldServer);
+	}
+	else
+	{
+		// The old server goes away, then the new one starts from scratch
+		requestName(oldServer.pConnection, ownedName, 0, true);
+		stopServer(oldServer);
+		restarted = startServer(newServer, address) && requestName(newServer.pConnection, ownedName, kNameFlagAllowReplacement);
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(kRestartSettleMS));
+	stop = true;
+	client.join();
+
+	// The new server must be the one answering now
+	restarted = restarted && call(pClient, ownedName.c_str(), path, "ReadValue", g_variant_new("(a{sv})", nullptr));
+	result.errors += restarted ? 0 : 1;
+
+	std::ostringstream detail;
+	detail << std::fixed << std::setprecision(2) << "longest time without an answer: " << longestGapUS / 1000.0 << "ms ("
+		<< unanswered << " of " << calls << " calls unanswered)";
+	result.detail = detail.str();
+
+	stopServer(newServer);
+	return result;
+}
+
+//
+// Entry point
+//
+
+int main(int argc, char **ppArgv)
+{
+	int iterations = kDefaultIterations;
+	std::string reportFilename;
+	const size_t workloadCount = sizeof(kWorkloadNames) / sizeof(kWorkloadNames[0]);
+	std::vector<bool> selected(workloadCount, true);
+
+	// A basic command-line parser
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = ppArgv[i];
+		if (arg == "-n" && i + 1 < argc)
+		{
+			iterations = std::max(1, atoi(ppArgv[++i]));
+		}
+		else if (arg == "-r" && i + 1 < argc)
+		{
+			reportFilename = ppArgv[++i];
+		}
+		else if (arg == "-w" && i + 1 < argc)
+		{
+			std::fill(selected.begin(), selected.end(), false);
+
+			std::istringstream names(ppArgv[++i]);
+			std::string name;
+			while (std::getline(names, name, ','))
+			{
+				const char **ppFound = std::find_if(kWorkloadNames, kWorkloadNames + workloadCount, [&](const char *pName) { return name == pName; });
+				if (ppFound == kWorkloadNames + workloadCount)
+				{
+					LogError((std::string("Unknown workload: '") + name + "'").c_str());
+					return -1;
+				}
+				selected[ppFound - kWorkloadNames] = true;
+			}
+		}
+		else
+		{
+			LogError((std::string("Unknown parameter: '") + arg + "'").c_str());
+			LogError("Usage: bench [-n <iterations>] [-r <report file>] [-w <workload>[,<workload>...]]");
+			return -1;
+		}
+	}
+
+	// Returns true if the workload named `pName` was selected
+	auto runs = [&](const char *pName)
+	{
+		const char **ppFound = std::find_if(kWorkloadNames, kWorkloadNames + workloadCount, [&](const char *pWorkload) { return 0 == strcmp(pName, pWorkload); });
+		return ppFound != kWorkloadNames + workloadCount && selected[ppFound - kWorkloadNames];
+	};
+
+	ggkLogRegisterError(LogError);
+
+	// Our server, without starting it (the bench takes the place of BlueZ and the server's own bus connection)
+	THESERVER = std::make_shared<DosellGatt>(kServiceName, kServiceName, kServiceName, dataGetter, dataSetter);
+	std::string root = std::string("/com/") + kServiceName;
+
+	// Start a private bus
+	GTestDBus *pBus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(pBus);
+	std::string address = g_test_dbus_get_bus_address(pBus);
+
+	BenchServer server;
+	int exitCode = -1;
+	if (startServer(server, address))
+	{
+		GError *pError = nullptr;
+		GDBusConnection *pClient = g_dbus_connection_new_for_address_sync(address.c_str(),
+			GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+			nullptr, nullptr, &pError);
+
+		if (nullptr == pClient)
+		{
+			LogError((std::string("Unable to connect to the private bus: ") + (nullptr == pError ? "Unknown" : pError->message)).c_str());
+			g_clear_error(&pError);
+		}
+		else
+		{
+			std::vector<Result> results;
+			if (runs("dispatch"))
+			{
+				results.push_back(benchDispatch(pClient, server.pConnection, root, iterations));
+			}
+			if (runs("firmware"))
+			{
+				results.push_back(benchFirmware(pClient, server.pConnection, root, iterations));
+			}
+			if (runs("samples"))
+			{
+				results.push_back(benchSamples(pClient, server.pConnection, root, iterations));
+			}
+			if (runs("shards"))
+			{
+				for (size_t i = 0; i < sizeof(kShardCounts) / sizeof(kShardCounts[0]); ++i)
+				{
+					results.push_back(benchShards(address, server.pConnection, root, iterations, static_cast<int>(i)));
+				}
+			}
+			if (runs("queue"))
+			{
+				results.push_back(benchQueue(root, iterations, false));
+				results.push_back(benchQueue(root, iterations, true));
+			}
+			if (runs("notify"))
+			{
+				results.push_back(benchNotify(server.pConnection, root, iterations));
+			}
+			if (runs("composite"))
+			{
+				results.push_back(benchComposite(server.pConnection, iterations));
+			}
+			if (runs("signal"))
+			{
+				results.push_back(benchSignal(server.pConnection, root, iterations, false));
+				results.push_back(benchSignal(server.pConnection, root, iterations, true));
+			}
+			if (runs("read"))
+			{
+				results.push_back(benchReadLatency(pClient, server, root, iterations, false));
+				results.push_back(benchReadLatency(pClient, server, root, iterations, true));
+			}
+			if (runs("compressed"))
+			{
+				results.push_back(benchCompressedRead(pClient, server.pConnection, root, iterations));
+			}
+			if (runs("delta"))
+			{
+				results.push_back(benchDeltaTime(iterations));
+				results.push_back(benchDeltaConfig(iterations));
+			}
+			if (runs("restart"))
+			{
+				results.push_back(benchRestart(pClient, address, root, true));
+				results.push_back(benchRestart(pClient, address, root, false));
+			}
+			g_object_unref(pClient);
+
+			if (runs("init"))
+			{
+				results.push_back(benchInit(true));
+				results.push_back(benchInit(false));
+			}
+
+			std::ofstream report;
+			if (!reportFilename.empty())
+			{
+				report.open(reportFilename, std::ios::trunc);
+			}
+
+			exitCode = 0;
+			for (const Result &result : results)
+			{
+				std::string errors = result.errors > 0 ? " (" + std::to_string(result.errors) + " errors)" : "";
+
+				// Results without a rate are printed only
+				if (result.operations <= 0 || result.seconds <= 0.0)
+				{
+					std::cout << std::left << std::setw(10) << result.pName << std::right << " " << result.detail << errors << std::endl;
+				}
+				else
+				{
+					double rate = result.operations / result.seconds;
+					std::cout << std::left << std::setw(10) << result.pName << std::right << std::fixed << std::setprecision(1)
+						<< std::setw(8) << result.operations << " ops in " << std::setw(8) << result.seconds * 1000.0 << "ms: "
+						<< std::setw(10) << rate << " ops/s, " << std::setprecision(2) << std::setw(7) << result.seconds * 1000000.0 / result.operations
+						<< " us/op" << errors << std::endl;
+
+					if (report.is_open())
+					{
+						report << result.pName << " " << std::fixed << std::setprecision(1) << rate << std::endl;
+					}
+				}
+
+				exitCode = result.errors > 0 ? -1 : exitCode;
+			}
+		}
+	}
+
+	stopServer(server);
+
+	g_test_dbus_down(pBus);
+	g_object_unref(pBus);
+
+	return exitCode;
+}
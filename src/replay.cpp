@@ -0,0 +1,333 @@
+// Copyright 2017-2019 Paul Nettle
+//
+// This file is part of Gobbledegook.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file in the root of the source tree.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A tool that replays a capture (see Capture.cpp) against a running server and reports the latencies it observed
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Usage: replay [-m] [-v] <capture file>
+//
+// The method calls and property accesses in the capture are sent to the server (on the system bus) in their original order. By
+// default, they are also sent with their original timing, which reproduces the load the server saw in the field. With `-m`, they
+// are sent back-to-back as fast as the server responds.
+//
+// The server is addressed by its owned name, which is derived from the object paths in the capture (our objects live under
+// "/com/<service name>", and the owned name is "com.<service name>".)
+//
+// Emitted signals and HCI packets are the server's own output (or the kernel's), so they are counted but not replayed. Replaying
+// HCI traffic would reconfigure the adapter underneath the running server.
+//
+// Once done, we report the distribution of round-trip latencies for each kind of record, alongside the handler times recorded in
+// the capture for comparison.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <gio/gio.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include "../include/Gobbledegook.h"
+#include "Capture.h"
+
+using namespace ggk;
+
+//
+// Constants
+//
+
+// How long we wait for each replayed call to complete
+static const int kCallTimeoutMS = 5000;
+
+//
+// Logging
+//
+
+bool verbose = false;
+
+void LogInfo(const char *pText) { if (verbose) { std::cout << "   INFO: " << pText << std::endl; } }
+void LogWarn(const char *pText) { std::cout << "WARNING: " << pText << std::endl; }
+void LogError(const char *pText) { std::cout << "!!ERROR: " << pText << std::endl; }
+
+//
+// Statistics
+//
+
+// The statistics gathered for one kind of record
+struct Stats
+{
+	int count = 0;
+	int errors = 0;
+	size_t bytes = 0;
+	std::vector<int64_t> replayUS;
+	std::vector<int64_t> recordedUS;
+};
+
+// Returns the given percentile of the (sorted) `values`
+static int64_t percentile(const std::vector<int64_t> &values, int percent)
+{
+	if (values.empty()) { return 0; }
+	size_t index = std::min(values.size() - 1, values.size() * percent / 100);
+	return values[index];
+}
+
+// Writes a line of latency statistics for `values` (in microseconds)
+static void reportLatencies(const char *pLabel, std::vector<int64_t> values)
+{
+	if (values.empty())
+	{
+		return;
+	}
+
+	std::sort(values.begin(), values.end());
+	std::cout << "    " << std::left << std::setw(10) << pLabel << std::right
+		<< " min " << std::setw(8) << values.front()
+		<< "  p50 " << std::setw(8) << percentile(values, 50)
+		<< "  p90 " << std::setw(8) << percentile(values, 90)
+		<< "  p99 " << std::setw(8) << percentile(values, 99)
+		<< "  max " << std::setw(8) << values.back() << "  (us)" << std::endl;
+}
+
+// Returns a readable name for a record type
+static const char *typeName(CaptureRecordType type)
+{
+	switch(type)
+	{
+		case ECaptureMethodCall: return "Method calls";
+		case ECaptureGetProperty: return "Property gets";
+		case ECaptureSetProperty: return "Property sets";
+		case ECaptureSignal: return "Signals (not replayed)";
+		case ECaptureHciRead: return "HCI reads (not replayed)";
+		case ECaptureHciWrite: return "HCI writes (not replayed)";
+		default: return "Unknown";
+	}
+}
+
+//
+// Replay
+//
+
+// Returns the owned name of the server that owns the object at `path` ("/com/foo/..." -> "com.foo")
+static std::string ownedNameForPath(const std::string &path)
+{
+	size_t first = path.find('/', 1);
+	if (first == std::string::npos) { return ""; }
+	size_t second = path.find('/', first + 1);
+	std::string name = path.substr(1, second == std::string::npos ? std::string::npos : second - 1);
+	std::replace(name.begin(), name.end(), '/', '.');
+	return name;
+}
+
+// Rebuilds the GVariant stored in a record (returns nullptr if the record had no parameters or they are invalid)
+static GVariant *recordVariant(const CaptureRecord &record)
+{
+	if (record.typeString.empty() || !g_variant_type_string_is_valid(record.typeString.c_str()))
+	{
+		return nullptr;
+	}
+
+	GBytes *pBytes = g_bytes_new(record.data.data(), record.data.size());
+	// Not trusted: a damaged capture could hold data that isn't in normal form
+	GVariant *pVariant = g_variant_new_from_bytes(G_VARIANT_TYPE(record.typeString.c_str()), pBytes, FALSE);
+	g_bytes_unref(pBytes);
+	return pVariant;
+}
+
+// Sends a single method call or property access from the capture, returning true on success
+static bool replayRecord(GDBusConnection *pConnection, const CaptureRecord &record)
+{
+	std::string destination = ownedNameForPath(record.path);
+	const char *pInterface = record.interface.c_str();
+	const char *pMethod = record.member.c_str();
+	GVariant *pParameters = nullptr;
+
+	if (ECaptureMethodCall == record.type)
+	{
+		pParameters = recordVariant(record);
+	}
+	else if (ECaptureGetProperty == record.type)
+	{
+		pInterface = "org.freedesktop.DBus.Properties";
+		pMethod = "Get";
+		pParameters = g_variant_new("(ss)", record.interface.c_str(), record.member.c_str());
+	}
+	else
+	{
+		GVariant *pValue = recordVariant(record);
+		if (nullptr == pValue)
+		{
+			return false;
+		}
+
+		pInterface = "org.freedesktop.DBus.Properties";
+		pMethod = "Set";
+		pParameters = g_variant_new("(ssv)", record.interface.c_str(), record.member.c_str(), pValue);
+	}
+
+	GError *pError = nullptr;
+	GVariant *pResult = g_dbus_connection_call_sync
+	(
+		pConnection,                // GDBusConnection *connection
+		destination.c_str(),        // const gchar *bus_name
+		record.path.c_str(),        // const gchar *object_path
+		pInterface,                 // const gchar *interface_name
+		pMethod,                    // const gchar *method_name
+		pParameters,                // GVariant *parameters
+		nullptr,                    // const GVariantType *reply_type
+		G_DBUS_CALL_FLAGS_NONE,     // GDBusCallFlags flags
+		kCallTimeoutMS,             // gint timeout_msec
+		nullptr,                    // GCancellable *cancellable
+		&pError                     // GError **error
+	);
+
+	if (nullptr == pResult)
+	{
+		LogInfo((std::string("Replay of ") + record.path + " " + record.interface + "." + record.member + " failed: "
+			+ (nullptr == pError ? "Unknown" : pError->message)).c_str());
+		g_clear_error(&pError);
+		return false;
+	}
+
+	g_variant_unref(pResult);
+	return true;
+}
+
+//
+// Entry point
+//
+
+int main(int argc, char **ppArgv)
+{
+	bool maximumSpeed = false;
+	std::string filename;
+
+	// A basic command-line parser
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = ppArgv[i];
+		if (arg == "-m")
+		{
+			maximumSpeed = true;
+		}
+		else if (arg == "-v")
+		{
+			verbose = true;
+		}
+		else if (filename.empty() && !arg.empty() && arg[0] != '-')
+		{
+			filename = arg;
+		}
+		else
+		{
+			LogError((std::string("Unknown parameter: '") + arg + "'").c_str());
+			filename.clear();
+			break;
+		}
+	}
+
+	if (filename.empty())
+	{
+		LogError("Usage: replay [-m] [-v] <capture file>");
+		return -1;
+	}
+
+	ggkLogRegisterInfo(LogInfo);
+	ggkLogRegisterWarn(LogWarn);
+	ggkLogRegisterError(LogError);
+
+	CaptureReader reader;
+	if (!reader.open(filename))
+	{
+		return -1;
+	}
+
+	GError *pError = nullptr;
+	GDBusConnection *pConnection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &pError);
+	if (nullptr == pConnection)
+	{
+		LogError((std::string("Unable to connect to the system bus: ") + (nullptr == pError ? "Unknown" : pError->message)).c_str());
+		g_clear_error(&pError);
+		return -1;
+	}
+
+	std::map<CaptureRecordType, Stats> stats;
+	auto replayStart = std::chrono::steady_clock::now();
+	int64_t firstTimestampUS = -1;
+
+	CaptureRecord record;
+	while (reader.next(record))
+	{
+		Stats &entry = stats[record.type];
+		entry.count += 1;
+		entry.bytes += record.data.size();
+
+		if (ECaptureMethodCall != record.type && ECaptureGetProperty != record.type && ECaptureSetProperty != record.type)
+		{
+			continue;
+		}
+
+		// Keep to the original timing (relative to the first record we replay)
+		if (firstTimestampUS < 0)
+		{
+			firstTimestampUS = record.timestampUS;
+		}
+
+		if (!maximumSpeed)
+		{
+			std::this_thread::sleep_until(replayStart + std::chrono::microseconds(record.timestampUS - firstTimestampUS));
+		}
+
+		auto callStart = std::chrono::steady_clock::now();
+		bool success = replayRecord(pConnection, record);
+		int64_t elapsedUS = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - callStart).count();
+
+		if (!success)
+		{
+			entry.errors += 1;
+			continue;
+		}
+
+		entry.replayUS.push_back(elapsedUS);
+		entry.recordedUS.push_back(record.durationUS);
+	}
+
+	g_object_unref(pConnection);
+
+	int64_t totalMS = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - replayStart).count();
+
+	// Report
+	std::cout << "Replayed '" << filename << "' in " << totalMS << "ms (" << (maximumSpeed ? "maximum speed" : "original timing") << ")"
+		<< (reader.isDamaged() ? " - the capture is damaged or truncated" : "") << std::endl;
+
+	for (const auto &item : stats)
+	{
+		const Stats &entry = item.second;
+		std::cout << std::endl << "  " << typeName(item.first) << ": " << entry.count << " record(s), " << entry.bytes << " byte(s)";
+		if (entry.errors > 0)
+		{
+			std::cout << ", " << entry.errors << " error(s)";
+		}
+		std::cout << std::endl;
+
+		reportLatencies("replay", entry.replayUS);
+		reportLatencies("recorded", entry.recordedUS);
+	}
+
+	return reader.isDamaged() ? -1 : 0;
+}
@@ -189,6 +189,9 @@ static uint8_t dispense_daysbeforelastdispensealert= 0;
 static uint8_t dispense_daysbeforelastdispensenotification = 0;
 static uint16_t uncollected_minutesbefore = 60;
 
+// The configuration dump ("configuration") served compressed by the server (see Server.cpp), built once at startup
+static std::string configuration;
+
 //
 // Server data management
 //
@@ -294,10 +297,30 @@ const void *dataGetter(const char *pName)
 		LogAlways16(uncollected_minutesbefore);
 		return &uncollected_minutesbefore;
 	}
+	else if (strName == "configuration")
+	{
+		return configuration.c_str();
+	}
 	LogWarn((std::string("Unknown name for server data getter request: '") + pName + "'").c_str());
 	return nullptr;
 }
 
+// Called by the server when it wants to retrieve several named values at once
+//
+// This method conforms to `GGKServerDataBatchGetter` and is registered with the server via `ggkRegisterDataBatchGetter()`.
+//
+// Our values are simple stored values, so we just resolve each one through `dataGetter`. An application that guards its data
+// with a lock would take that lock once here for the whole batch.
+int dataBatchGetter(const char * const *ppNames, size_t count, const void **ppValues)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		ppValues[i] = dataGetter(ppNames[i]);
+	}
+
+	return 1;
+}
+
 // Called by the server when it wants to update a named value
 //
 // This method conforms to `GGKServerDataSetter` and is passed to the server via our call to `ggkStart()`.
@@ -337,6 +360,31 @@ int dataSetter(const char *pName, const void *pData)
 		LogDebug((std::string("careTokenSetter data: text string set to '") + careTokenSetter + "'").c_str());
 		return 1;
 	}
+	// These characteristics declare a value schema, so their writes arrive validated and decoded
+	else if (strName == "birthday")
+	{
+		birthday = *static_cast<const uint32_t *>(pData);
+		LogDebug((std::string("Server data: birthday set to ") + std::to_string(birthday)).c_str());
+		return 1;
+	}
+	else if (strName == "control")
+	{
+		control = *static_cast<const uint16_t *>(pData);
+		LogDebug((std::string("Server data: control set to ") + std::to_string(control)).c_str());
+		return 1;
+	}
+	else if (strName == "dispense/daysbeforelastdispensealert")
+	{
+		dispense_daysbeforelastdispensealert = *static_cast<const uint8_t *>(pData);
+		LogDebug((std::string("Server data: days before last dispense alert set to ") + std::to_string(dispense_daysbeforelastdispensealert)).c_str());
+		return 1;
+	}
+	// A firmware image has been received and verified (see FirmwareReceiver.cpp)
+	else if (strName == "firmware")
+	{
+		LogInfo((std::string("Server data: firmware image received at '") + static_cast<const char *>(pData) + "'").c_str());
+		return 1;
+	}
 
 	LogWarn((std::string("Unknown name for server data setter request: '") + pName + "'").c_str());
 
@@ -365,11 +413,36 @@ int main(int argc, char **ppArgv)
 		{
 			logLevel = Debug;
 		}
+		else if (arg == "-s")
+		{
+			// Run on the virtual clock (must be set before the server starts)
+			ggkSetSimulatedClock(1);
+		}
+		else if (arg == "-p")
+		{
+			// Profile wakeups, with a summary every minute
+			ggkWakeupProfilerStart(60);
+		}
+		else if (arg == "-r")
+		{
+			// Take over from a running instance (a hot restart)
+			ggkSetHandoffMode(1);
+		}
+		else if (arg == "-t")
+		{
+			// Allow a later instance to take over from us (with -r)
+			ggkSetAllowTakeover(1);
+		}
+		else if (arg == "-m")
+		{
+			// Serve our metrics over D-Bus (see ggkSetStatsInterfaceEnabled())
+			ggkSetStatsInterfaceEnabled(1);
+		}
 		else
 		{
 			LogFatal((std::string("Unknown parameter: '") + arg + "'").c_str());
 			LogFatal("");
-			LogFatal("Usage: standalone [-q | -v | -d]");
+			LogFatal("Usage: standalone [-q | -v | -d] [-s] [-p] [-r] [-t] [-m]");
 			return -1;
 		}
 	}
@@ -388,6 +461,18 @@ int main(int argc, char **ppArgv)
 	ggkLogRegisterAlways(LogAlways);
 	ggkLogRegisterTrace(LogTrace);
 
+	// Register our batch data getter
+	ggkRegisterDataBatchGetter(dataBatchGetter);
+
+	// Build the configuration dump
+	for (int day = 0; day < 7; ++day)
+	{
+		configuration += "schedule/day" + std::to_string(day) + "/dispense=" + strFirstDispense + "\n";
+		configuration += "schedule/day" + std::to_string(day) + "/alert/minutesbefore=" + std::to_string(uncollected_minutesbefore) + "\n";
+	}
+	configuration += "name/first=" + firstname + "\n";
+	configuration += "name/last=" + lastName + "\n";
+
 	// Start the server's ascync processing
 	//
 	// This starts the server on a thread and begins the initialization process
@@ -403,6 +488,9 @@ int main(int argc, char **ppArgv)
 		return -1;
 	}
 
+	// The samples characteristic keeps a history of the battery level (see `ggkAppendSample()`)
+	int samplesHandle = ggkGetCharacteristicHandle("/com/dosell/service/1/samples");
+
 	// Wait for the server to start the shutdown process
 	//
 	// While we wait, every 15 ticks, drop the battery level by one percent until we reach 0
@@ -411,6 +499,9 @@ int main(int argc, char **ppArgv)
 		std::this_thread::sleep_for(std::chrono::seconds(15));
 
 		serverDataBatteryLevel = std::max(serverDataBatteryLevel - 1, 0);
+
+		uint32_t sample = serverDataBatteryLevel;
+		ggkAppendSample(samplesHandle, ggkGetClockMS(), &sample, sizeof(sample));
 		//ggkNofifyUpdatedCharacteristic("/com/dosell/service/1/status");
 	}
 